@@ -21,6 +21,8 @@ QGL_HEADERS = \
 	  quaternion.h \
 	  vec.h \
 	  domUtils.h \
+	  frameSink.h \
+	  geometrySink.h \
 	  config.h
 
 SOURCES = \
@@ -30,13 +32,20 @@ SOURCES = \
 	  manipulatedCameraFrame.cpp \
 	  frame.cpp \
 	  saveSnapshot.cpp \
+	  frameSink.cpp \
+	  geometrySink.cpp \
 	  constraint.cpp \
 	  keyFrameInterpolator.cpp \
 	  mouseGrabber.cpp \
 	  quaternion.cpp \
+	  batchTransform.cpp \
+	  coreProfileRenderer.cpp \
+	  reprojectionCache.cpp \
 	  vec.cpp
 
 HEADERS *= $${QGL_HEADERS}
+# Internal headers, not installed
+HEADERS *= batchTransform.h coreProfileRenderer.h reprojectionCache.h
 DISTFILES *= qglviewer-icon.xpm
 DESTDIR = $${PWD}
 
@@ -13,6 +13,10 @@ typedef enum { BSP_CROSS_PLANE, BSP_UPPER, BSP_LOWER } BSPPosition;
 
 class BSPNode;
 
+//  The tree owns the inserted primitives, and the ones created when they are
+// split: they are deleted with the tree, unless they were given back by
+// releasePrimitives().
+
 class BSPTree
 {
 	public:
@@ -23,7 +27,7 @@ class BSPTree
 		void insert(Segment *);
 		void insert(Point *);
 
-		void recursFillPrimitiveArray(vector<PtrPrimitive>&) const;
+		void releasePrimitives(vector<PtrPrimitive>&);
 	private:
 		BSPNode *_root;
 		vector<Segment *> _segments;	// these are for storing segments and points when _root is null
@@ -32,47 +36,74 @@ class BSPTree
 
 void BSPSortMethod::sortPrimitives(std::vector<PtrPrimitive>& primitive_tab,VRenderParams& vparams)
 {
+	//  The primitives are split, and deleted, during the insertion. They are
+	// moved out of primitive_tab, which is only refilled when the sort is
+	// complete: when vparams.progress() throws (the render is canceled),
+	// primitive_tab is empty and the primitives are deleted here or by the tree.
+
+	vector<PtrPrimitive> to_insert;
+	to_insert.swap(primitive_tab);
+
 	// 1 - build BSP using polygons only
 
 	BSPTree tree;
 	Polygone *P;
 
-        unsigned int N = primitive_tab.size()/200 +1;
+        unsigned int N = to_insert.size()/200 +1;
 	int nbinserted = 0;
 
 	vector<PtrPrimitive> segments_and_points;	// Store segments and points for pass 2, because polygons are deleted
 																// by the insertion and can not be dynamic_casted anymore.
-	for(unsigned int i=0;i<primitive_tab.size();++i,++nbinserted)
+	try
 	{
-		if((P = dynamic_cast<Polygone *>(primitive_tab[i])) != NULL)
-			tree.insert(P);
-		else
-			segments_and_points.push_back(primitive_tab[i]);
+		for(unsigned int i=0;i<to_insert.size();++i,++nbinserted)
+		{
+			PtrPrimitive primitive = to_insert[i];
+			to_insert[i] = NULL;
 
-		if(nbinserted%N==0)
-			vparams.progress(nbinserted/(float)primitive_tab.size(), QGLViewer::tr("BSP Construction"));
-	}
+			if((P = dynamic_cast<Polygone *>(primitive)) != NULL)
+				tree.insert(P);
+			else
+				segments_and_points.push_back(primitive);
+
+			if(nbinserted%N==0)
+				vparams.progress(nbinserted/(float)to_insert.size(), QGLViewer::tr("BSP Construction"));
+		}
 
-	// 2 - insert points and segments into the BSP
+		// 2 - insert points and segments into the BSP
 
-	Segment *S;
-	Point *p;
+		Segment *S;
+		Point *p;
 
-	for(unsigned int j=0;j<segments_and_points.size();++j,++nbinserted)
+		for(unsigned int j=0;j<segments_and_points.size();++j,++nbinserted)
+		{
+			PtrPrimitive primitive = segments_and_points[j];
+			segments_and_points[j] = NULL;
+
+			if((S = dynamic_cast<Segment *>(primitive)) != NULL)
+				tree.insert(S);
+			else if((p = dynamic_cast<Point *>(primitive)) != NULL)
+				tree.insert(p);
+
+			if(nbinserted%N==0)
+				vparams.progress(nbinserted/(float)to_insert.size(), QGLViewer::tr("BSP Construction"));
+		}
+	}
+	catch(...)
 	{
-		if((S = dynamic_cast<Segment *>(segments_and_points[j])) != NULL)
-			tree.insert(S);
-		else if((p = dynamic_cast<Point *>(segments_and_points[j])) != NULL)
-			tree.insert(p);
+		// Not inserted yet. The inserted ones are deleted with the tree.
 
-		if(nbinserted%N==0)
-			vparams.progress(nbinserted/(float)primitive_tab.size(), QGLViewer::tr("BSP Construction"));
+		for(unsigned int i=0;i<to_insert.size();++i)
+			delete to_insert[i];
+		for(unsigned int j=0;j<segments_and_points.size();++j)
+			delete segments_and_points[j];
+
+		throw;
 	}
 
 	// 3 - refill the array with the content of the BSP
 
-	primitive_tab.resize(0);
-	tree.recursFillPrimitiveArray(primitive_tab);
+	tree.releasePrimitives(primitive_tab);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////
@@ -84,6 +115,7 @@ class BSPNode
 		~BSPNode();
 
 		void recursFillPrimitiveArray(vector<PtrPrimitive>&) const;
+		void recursDeletePrimitives();
 
 		void insert(Polygone *);
 		void insert(Segment *);
@@ -117,19 +149,29 @@ BSPTree::BSPTree()
 
 BSPTree::~BSPTree()
 {
+	if(_root != NULL) _root->recursDeletePrimitives();
 	delete _root;
+
+	for(unsigned int i=0;i<_points.size();++i) delete _points[i];
+	for(unsigned int j=0;j<_segments.size();++j) delete _segments[j];
 }
 
 void BSPTree::insert(Point *P) 	{ if(_root == NULL) _points.push_back(P) 	; else _root->insert(P); }
 void BSPTree::insert(Segment *S) { if(_root == NULL) _segments.push_back(S); else _root->insert(S); }
 void BSPTree::insert(Polygone *P){ if(_root == NULL) _root = new BSPNode(P); else _root->insert(P); }
 
-void BSPTree::recursFillPrimitiveArray(vector<PtrPrimitive>& tab) const
+// Fills tab with the sorted primitives, which are then owned by the caller.
+void BSPTree::releasePrimitives(vector<PtrPrimitive>& tab)
 {
 	if(_root != NULL) _root->recursFillPrimitiveArray(tab);
 
 	for(unsigned int i=0;i<_points.size();++i) tab.push_back(_points[i]);
 	for(unsigned int j=0;j<_segments.size();++j) tab.push_back(_segments[j]);
+
+	delete _root;
+	_root = NULL;
+	_points.clear();
+	_segments.clear();
 }
 
 //----------------------------------------------------------------------------//
@@ -257,9 +299,6 @@ void BSPNode::Classify(Segment *S, Segment * & moins_, Segment * & plus_)
 
 void BSPNode::Classify(Polygone *P, Polygone * & moins_, Polygone * & plus_)
 {
-	static int Signs[100];
-	static double Zvals[100];
-
 	moins_ = NULL;
 	plus_ = NULL;
 
@@ -271,6 +310,26 @@ void BSPNode::Classify(Polygone *P, Polygone * & moins_, Polygone * & plus_)
 
 	int n = P->nbVertices();
 
+	//  Per call arrays, so that several sorts can run in parallel. On the stack
+	// for the usual small polygons, without any limit on the number of vertices.
+
+	const int nbStackVertices = 32 ;
+	int SignsOnStack[nbStackVertices];
+	double ZvalsOnStack[nbStackVertices];
+	vector<int> SignsOnHeap;
+	vector<double> ZvalsOnHeap;
+
+	int *Signs = SignsOnStack;
+	double *Zvals = ZvalsOnStack;
+
+	if(n > nbStackVertices)
+	{
+		SignsOnHeap.resize(n);
+		ZvalsOnHeap.resize(n);
+		Signs = &SignsOnHeap[0];
+		Zvals = &ZvalsOnHeap[0];
+	}
+
 	int Smin = 1;
 	int Smax = -1;
 
@@ -489,6 +548,31 @@ void BSPNode::recursFillPrimitiveArray(vector<PtrPrimitive>& primitive_tab) cons
     primitive_tab.push_back(pts_moins[j2]);
 }
 
+void BSPNode::recursDeletePrimitives()
+{
+  if(fils_plus != NULL)
+    fils_plus->recursDeletePrimitives();
+  if(fils_moins != NULL)
+    fils_moins->recursDeletePrimitives();
+
+  for(unsigned int i=0;i<seg_plus.size();++i)
+    delete seg_plus[i];
+  for(unsigned int j=0;j<pts_plus.size();++j)
+    delete pts_plus[j];
+  for(unsigned int i2=0;i2<seg_moins.size();++i2)
+    delete seg_moins[i2];
+  for(unsigned int j2=0;j2<pts_moins.size();++j2)
+    delete pts_moins[j2];
+
+  delete polygone;
+
+  seg_plus.clear();
+  pts_plus.clear();
+  seg_moins.clear();
+  pts_moins.clear();
+  polygone = NULL;
+}
+
 void BSPNode::insert(Point *P)
 {
 	int res = Classify(P);
@@ -9,10 +9,6 @@ using namespace std ;
 const double EPSExporter::EPS_GOURAUD_THRESHOLD = 0.05 ;
 const char *EPSExporter::CREATOR = "VRender library - (c) Cyril Soler 2005" ;
 
-float EPSExporter::last_r = -1.0 ;
-float EPSExporter::last_g = -1.0 ;
-float EPSExporter::last_b = -1.0 ;
-
 EPSExporter::EPSExporter()
 {
 	last_r = -1 ;
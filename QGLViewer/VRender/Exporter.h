@@ -65,9 +65,9 @@ namespace vrender
 			static const char *GOURAUD_TRIANGLE_EPS[] ;
 			static const char *CREATOR ;
 
-			static float last_r ;
-			static float last_g ;
-			static float last_b ;
+			float last_r ;
+			float last_g ;
+			float last_b ;
 	};
 
 	//  Exports to postscript. The only difference is the filename extension and
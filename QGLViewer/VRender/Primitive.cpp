@@ -60,11 +60,46 @@ Polygone::Polygone(const vector<Feedback3DColor>& fc)
 	: _vertices(fc)
 {
 	initNormal() ;
+	initXY() ;
 
 	for(size_t i=0;i<fc.size();i++)
 		_bbox.include(fc[i].pos()) ;
 }
 
+void Polygone::initXY()
+{
+	size_t n = nbVertices() ;
+
+	_vertices_XY.resize(n) ;
+	_edges_XY.resize(n) ;
+	_edgeCrosses_XY.resize(n) ;
+
+	for(size_t i=0;i<n;++i)
+		_vertices_XY[i] = Vector2(vertex(i)) ;
+
+	double area = 0.0 ;
+
+	for(size_t i=0;i<n;++i)
+	{
+		const Vector2& q1 = _vertices_XY[i] ;
+		const Vector2& q2 = _vertices_XY[(i+1)%n] ;
+
+		_edges_XY[i] = q2 - q1 ;
+		_edgeCrosses_XY[i] = q1 ^ q2 ;
+		area += _edgeCrosses_XY[i] ;
+	}
+
+	_orientation_XY = (area > 0.0) ? 1 : ((area < 0.0) ? -1 : 0) ;
+
+	// Convex when all the turns have the orientation of the polygon
+
+	_convex_XY = (_orientation_XY != 0) ;
+
+	for(size_t i=0;i<n && _convex_XY;++i)
+		if((_edges_XY[i] ^ _edges_XY[(i+1)%n]) * _orientation_XY < 0.0)
+			_convex_XY = false ;
+}
+
 AxisAlignedBox_xyz Polygone::bbox() const
 {
 	return _bbox ;
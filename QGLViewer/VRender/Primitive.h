@@ -3,6 +3,7 @@
 
 #include <vector>
 #include "AxisAlignedBox.h"
+#include "Vector2.h"
 #include "Vector3.h"
 #include "NVector3.h"
 #include "Types.h"
@@ -157,8 +158,20 @@ namespace vrender
 
 		FLOAT FlatFactor() const { return anglefactor ; }
 
+		//  Projection in the XY plane, precomputed for PrimitivePositioning:
+		// edge i goes from vertex(i) to vertex(i+1), and edgeCross_XY(i) is
+		// vertex(i) ^ vertex(i+1). orientation_XY() is 1 for counter clockwise
+		// polygons, -1 for clockwise ones and 0 for degenerated ones.
+
+		const Vector2& vertex_XY(size_t i) const { return _vertices_XY[i] ; }
+		const Vector2& edge_XY(size_t i) const { return _edges_XY[i] ; }
+		double edgeCross_XY(size_t i) const { return _edgeCrosses_XY[i] ; }
+		int orientation_XY() const { return _orientation_XY ; }
+		bool isConvex_XY() const { return _convex_XY ; }
+
 		protected:
 		virtual void initNormal() ;
+		void initXY() ;
 		void CheckInfoForPositionOperators() ;
 
 		AxisAlignedBox_xyz _bbox ;
@@ -169,6 +182,12 @@ namespace vrender
 		// Comparer a FLAT_POLYGON_EPS
 		double _c ;
 		NVector3 _normal ;
+
+		std::vector<Vector2> _vertices_XY ;
+		std::vector<Vector2> _edges_XY ;
+		std::vector<double> _edgeCrosses_XY ;
+		int _orientation_XY ;
+		bool _convex_XY ;
 	} ;
 }
 #endif
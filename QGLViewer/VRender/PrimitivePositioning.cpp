@@ -13,6 +13,7 @@ using namespace std ;
 #define DEBUG_TS
 
 double PrimitivePositioning::_EPS = 0.00001 ;
+double PrimitivePositioning::_CONTACT_EPS = 0.001 ;
 
 // Computes relative position of the second primitive toward the first.
 // As a general rule, the smaller the Z of a primitive, the Upper the primitive.
@@ -27,25 +28,26 @@ int PrimitivePositioning::computeRelativePosition(const Primitive *p1,const Prim
 	if( bb1.maxi().x() < bb2.mini().x() || bb1.mini().x() > bb2.maxi().x()) return Independent ;
 	if( bb1.maxi().y() < bb2.mini().y() || bb1.mini().y() > bb2.maxi().y()) return Independent ;
 
-	// 2 - call specific tests for each case.
+	// 2 - call specific tests for each case. The number of vertices gives the
+	// type of the primitives.
 
 	if(p1->nbVertices() >= 3)
 		if(p2->nbVertices() >= 3)
-			return computeRelativePosition( dynamic_cast<const Polygone *>(p1),dynamic_cast<const Polygone *>(p2)) ;
+			return computeRelativePosition( static_cast<const Polygone *>(p1),static_cast<const Polygone *>(p2)) ;
 		else if(p2->nbVertices() == 2) // Case of a segment versus a polygon
-			return computeRelativePosition( dynamic_cast<const Polygone *>(p1),dynamic_cast<const Segment *>(p2)) ;
+			return computeRelativePosition( static_cast<const Polygone *>(p1),static_cast<const Segment *>(p2)) ;
 		else
-			return computeRelativePosition( dynamic_cast<const Polygone *>(p1),dynamic_cast<const Point *>(p2)) ;
+			return computeRelativePosition( static_cast<const Polygone *>(p1),static_cast<const Point *>(p2)) ;
 	else if(p1->nbVertices() == 2)
 		if(p2->nbVertices() >= 3)
-			return inverseRP(computeRelativePosition( dynamic_cast<const Polygone *>(p2),dynamic_cast<const Segment *>(p1))) ;
+			return inverseRP(computeRelativePosition( static_cast<const Polygone *>(p2),static_cast<const Segment *>(p1))) ;
 		else if(p2->nbVertices() == 2)
-			return computeRelativePosition( dynamic_cast<const Segment *>(p1),dynamic_cast<const Segment *>(p2)) ;
+			return computeRelativePosition( static_cast<const Segment *>(p1),static_cast<const Segment *>(p2)) ;
 		else
 			return Independent ;	// segment vs point => independent
 	else
 		if(p2->nbVertices() >= 3)
-			return inverseRP(computeRelativePosition( dynamic_cast<const Polygone *>(p2),dynamic_cast<const Point *>(p1))) ;
+			return inverseRP(computeRelativePosition( static_cast<const Polygone *>(p2),static_cast<const Point *>(p1))) ;
 		else if(p2->nbVertices() == 2)
 			return Independent ;	// point vs segment => independent
 		else
@@ -83,9 +85,12 @@ int PrimitivePositioning::computeRelativePosition(const Polygone *P,const Segmen
 	if(!pointOutOfPolygon_XY(S->vertex(1),P,_EPS)) intersections.push_back(1.0);
 
 	double t1,t2 ;
+	size_t n = P->nbVertices() ;
+	Vector2 s0(S->vertex(0)) ;
+	Vector2 s1(S->vertex(1)) ;
 
-		for(size_t i=0;i<P->nbVertices();++i)
-		if(intersectSegments_XY(Vector2(S->vertex(0)),Vector2(S->vertex(1)),Vector2(P->vertex(i)),Vector2(P->vertex(i+1)),_EPS,t1,t2))
+	for(size_t i=0;i<n;++i)
+		if(intersectSegments_XY(s0,s1,P->vertex_XY(i),P->vertex_XY((i+1)%n),_EPS,t1,t2))
 			intersections.push_back(t1) ;
 
 	// 2 - Checks wether the intersection segment is reduced to a point. In this case,
@@ -126,7 +131,30 @@ int PrimitivePositioning::computeRelativePosition(const Polygone *P,const Segmen
 
 int PrimitivePositioning::computeRelativePosition(const Polygone *P1,const Polygone *P2)
 {
-	// 1 - use gpc to conservatively check for intersection. This works fine because
+	// 1 - compute the 2D intersection of the polygons. Convex polygons (all the
+	//    polygons produced by the parser and by the splits) do not need gpc,
+	//    unless their intersection is thinner than _CONTACT_EPS: they share an
+	//    edge or a vertex, or one of them is a sliver left by the splits. The
+	//    result then depends on rounding errors, and gpc is still used so that
+	//    it does not change.
+
+	if(P1->isConvex_XY() && P2->isConvex_XY())
+	{
+		double depth = penetration_XY(P1,P2) ;
+
+		if(depth >= -_CONTACT_EPS)
+			depth = std::min(depth,penetration_XY(P2,P1)) ;
+
+		if(depth < -_CONTACT_EPS)
+			return Independent ;
+
+		vector<Vector2> intersection ;
+
+		if(intersectConvexPolygons_XY(P1,P2,intersection))
+			return relativePositionOnIntersection(P1,P2,&intersection[0],intersection.size()) ;
+	}
+
+	// 1' - use gpc to conservatively check for intersection. This works fine because
 	//    gpc produces a null intersection for polygons sharing an edge, which
 	//    is exactly what we need.
 
@@ -156,33 +184,173 @@ int PrimitivePositioning::computeRelativePosition(const Polygone *P1,const Polyg
 		// throw runtime_error("Intersection with more than 1 contour ! Non convex polygons ?") ;
 	  }
 
-	// 2 - polygons are not independent. Compute their relative position.
-	//    For this, we project the vertices of the 2D intersection onto the
-	//   support plane of each polygon. The epsilon-signs of each point toward
-	//   both planes give the relative position of the polygons.
+	vector<Vector2> intersection ;
+
+	for(long i=0;i<gpc_int.contour[0].num_vertices;++i)
+		intersection.push_back(Vector2(gpc_int.contour[0].vertex[i].x,gpc_int.contour[0].vertex[i].y)) ;
+
+	gpc_free_polygon(&gpc_int) ;
+
+	if(intersection.empty())
+		return res ;
+
+	return relativePositionOnIntersection(P1,P2,&intersection[0],intersection.size()) ;
+}
+
+// 2 - polygons are not independent. Compute their relative position.
+//    For this, we project the vertices of the 2D intersection onto the
+//   support plane of each polygon. The epsilon-signs of each point toward
+//   both planes give the relative position of the polygons.
+
+int PrimitivePositioning::relativePositionOnIntersection(const Polygone *P1,const Polygone *P2,const Vector2 *intersection,size_t n)
+{
+	int res = Independent ;
 
-	for(long i=0;i<gpc_int.contour[0].num_vertices && (res < (Upper | Lower));++i)
+	for(size_t i=0;i<n && (res < (Upper | Lower));++i)
 	{
 		if(P1->normal().z() == 0.0) throw runtime_error("could not project point. Unexpected case !") ;
 		if(P2->normal().z() == 0.0) throw runtime_error("could not project point. Unexpected case !") ;
 
 		// project point onto support planes
 
-		double f1 = P1->normal().x() * gpc_int.contour[0].vertex[i].x + P1->normal().y() * gpc_int.contour[0].vertex[i].y - P1->c() ;
-		double f2 = P2->normal().x() * gpc_int.contour[0].vertex[i].x + P2->normal().y() * gpc_int.contour[0].vertex[i].y - P2->c() ;
+		double f1 = P1->normal().x() * intersection[i].x() + P1->normal().y() * intersection[i].y() - P1->c() ;
+		double f2 = P2->normal().x() * intersection[i].x() + P2->normal().y() * intersection[i].y() - P2->c() ;
 
-		Vector3 v1(gpc_int.contour[0].vertex[i].x,gpc_int.contour[0].vertex[i].y, -f1/P1->normal().z()) ;
-		Vector3 v2(gpc_int.contour[0].vertex[i].x,gpc_int.contour[0].vertex[i].y, -f2/P2->normal().z()) ;
+		Vector3 v1(intersection[i].x(),intersection[i].y(), -f1/P1->normal().z()) ;
+		Vector3 v2(intersection[i].x(),intersection[i].y(), -f2/P2->normal().z()) ;
 
 		if(P1->equation(v2) < -_EPS) res |= Lower ;
 		if(P1->equation(v2) >  _EPS) res |= Upper ;
 		if(P2->equation(v1) < -_EPS) res |= Upper ;
 		if(P2->equation(v1) >  _EPS) res |= Lower ;
 	}
-	gpc_free_polygon(&gpc_int) ;
+
 	return res ;
 }
 
+//  Separating axis test of two convex polygons in the XY plane, on the
+// normals of the edges of P. Returns the smallest overlap of the projections of
+// both polygons on these axes, in pixels: it is negative when an axis
+// separates the polygons.
+
+double PrimitivePositioning::penetration_XY(const Polygone *P,const Polygone *Q)
+{
+	size_t np = P->nbVertices() ;
+	size_t nq = Q->nbVertices() ;
+	double depth = FLT_MAX ;
+
+	for(size_t i=0;i<np;++i)
+	{
+		// Projections on the edge normal, relative to the edge
+
+		const Vector2& e = P->edge_XY(i) ;
+		double k = P->edgeCross_XY(i) ;
+		double l = e.norm() ;
+
+		if(l == 0.0)
+			continue ;
+
+		double pmin =  FLT_MAX ;
+		double pmax = -FLT_MAX ;
+		double qmin =  FLT_MAX ;
+		double qmax = -FLT_MAX ;
+
+		for(size_t j=0;j<np;++j)
+		{
+			double z = k + (e ^ P->vertex_XY(j)) ;
+			pmin = std::min(pmin,z) ;
+			pmax = std::max(pmax,z) ;
+		}
+
+		for(size_t j=0;j<nq;++j)
+		{
+			double z = k + (e ^ Q->vertex_XY(j)) ;
+			qmin = std::min(qmin,z) ;
+			qmax = std::max(qmax,z) ;
+		}
+
+		depth = std::min(depth,std::min(pmax-qmin,qmax-pmin)/l) ;
+	}
+
+	return depth ;
+}
+
+//  Computes the intersection of two convex polygons in the XY plane by
+// clipping P1 with each edge of P2 (Sutherland-Hodgman). Returns false when
+// the intersection is thinner than _CONTACT_EPS.
+
+bool PrimitivePositioning::intersectConvexPolygons_XY(const Polygone *P1,const Polygone *P2,vector<Vector2>& intersection)
+{
+	size_t n1 = P1->nbVertices() ;
+	size_t n2 = P2->nbVertices() ;
+	int orientation = P2->orientation_XY() ;
+
+	intersection.resize(n1) ;
+	for(size_t i=0;i<n1;++i)
+		intersection[i] = P1->vertex_XY(i) ;
+
+	vector<Vector2> clipped ;
+	vector<double> sides ;
+
+	for(size_t j=0;j<n2 && intersection.size() >= 3;++j)
+	{
+		//  Positive on the inner side of edge j of P2: (q1-p)^(q2-p) has the
+		// sign of the orientation of P2 for inner points.
+
+		const Vector2& e = P2->edge_XY(j) ;
+		double k = P2->edgeCross_XY(j) ;
+		size_t n = intersection.size() ;
+
+		sides.resize(n) ;
+		for(size_t i=0;i<n;++i)
+			sides[i] = (k + (e ^ intersection[i])) * orientation ;
+
+		clipped.clear() ;
+
+		for(size_t i=0;i<n;++i)
+		{
+			const Vector2& a = intersection[i] ;
+			const Vector2& b = intersection[(i+1)%n] ;
+			double sa = sides[i] ;
+			double sb = sides[(i+1)%n] ;
+
+			if(sa >= 0.0)
+				clipped.push_back(a) ;
+
+			if((sa >= 0.0) != (sb >= 0.0))
+			{
+				double t = sa / (sa - sb) ;
+				clipped.push_back(Vector2(a.x() + t*(b.x()-a.x()),a.y() + t*(b.y()-a.y()))) ;
+			}
+		}
+
+		intersection.swap(clipped) ;
+	}
+
+	// Width of the intersection: the smallest of its extents across its edges
+
+	size_t n = intersection.size() ;
+	double width = (n >= 3) ? FLT_MAX : 0.0 ;
+
+	for(size_t i=0;i<n && width > _CONTACT_EPS;++i)
+	{
+		Vector2 e = intersection[(i+1)%n] - intersection[i] ;
+		double l = e.norm() ;
+
+		if(l == 0.0)
+			continue ;
+
+		double extent = 0.0 ;
+
+		for(size_t j=0;j<n;++j)
+			extent = std::max(extent,fabs(e ^ (intersection[j] - intersection[i]))) ;
+
+		width = std::min(width,extent/l) ;
+	}
+
+	return width > _CONTACT_EPS ;
+}
+
 // Computes the relative position of a segment toward another segment.
 
 int PrimitivePositioning::computeRelativePosition(const Segment *S1,const Segment *S2)
@@ -222,10 +390,9 @@ bool PrimitivePositioning::pointOutOfPolygon_XY(const Vector3& P,const Polygone
 
 	for(size_t j=0;j<nq;j++)  				//  Regarde si P.(x,y) est a l'interieur
 	{                               	// ou a l'exterieur du polygone.
-		Vector2 q1 = Vector2(Q->vertex(j)) ;
-		Vector2 q2 = Vector2(Q->vertex(j+1)) ;
 
-		double Z = (q1-p)^(q2-p) ;
+		// (q1-p)^(q2-p) = q1^q2 + (q2-q1)^p, with precomputed edge values
+		double Z = Q->edgeCross_XY(j) + (Q->edge_XY(j) ^ p) ;
 
 		MinZ = std::min(Z,MinZ) ;
 		MaxZ = std::max(Z,MaxZ) ;
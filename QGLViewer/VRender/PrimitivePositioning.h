@@ -44,6 +44,13 @@ namespace vrender
 														double I_EPS,double & t1,double & t2) ;
 			static gpc_polygon createGPCPolygon_XY(const Polygone *P) ;
 
+			//  Convex polygons intersection, without gpc. Uses the XY data
+			// precomputed by the polygons.
+
+			static double penetration_XY(const Polygone *P,const Polygone *Q) ;
+			static bool intersectConvexPolygons_XY(const Polygone *P1,const Polygone *P2,std::vector<Vector2>& intersection) ;
+			static int relativePositionOnIntersection(const Polygone *P1,const Polygone *P2,const Vector2 *intersection,size_t n) ;
+
 
 			static int inverseRP(int) ;
 
@@ -52,6 +59,11 @@ namespace vrender
 			// the positionning.
 
 			static double _EPS ;
+
+			//  Convex polygons whose intersection is thinner than this value
+			// (in pixels) are intersected with gpc.
+
+			static double _CONTACT_EPS ;
 	};
 }
 
@@ -13,6 +13,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <QFile>
+
 #include "VRender.h"
 #include "ParserGL.h"
 #include "Exporter.h"
@@ -24,10 +26,48 @@ using namespace std ;
 
 void vrender::VectorialRender(RenderCB render_callback, void *callback_params, VRenderParams& vparams)
 {
-	GLfloat *feedbackBuffer = NULL ;
-	SortMethod *sort_method = NULL ;
-	Exporter *exporter = NULL ;
+	FeedbackCapture capture ;
+
+	CaptureFeedback(render_callback,callback_params,vparams,capture) ;
+	ProcessFeedback(capture,vparams) ;
+}
+
+void vrender::VectorialRender(const qglviewer::GeometrySink& geometry, VRenderParams& vparams)
+{
+	FeedbackCapture capture ;
+
+	vparams.error() = 0 ;
+
+	CaptureGeometry(geometry,capture) ;
+	ProcessFeedback(capture,vparams) ;
+}
+
+void vrender::CaptureGeometry(const qglviewer::GeometrySink& geometry, FeedbackCapture& capture)
+{
+	const QVector<float>& buffer = geometry.feedbackBuffer() ;
+
+	delete[] capture._buffer ;
+	capture._buffer = new GLfloat[buffer.size()+1] ;
+	capture._size = buffer.size() ;
+
+	for(int i=0;i<buffer.size();++i)
+		capture._buffer[i] = buffer[i] ;
+
+	const QColor background = geometry.backgroundColor() ;
+
+	capture._viewport[0] = capture._viewport[1] = 0.0f ;
+	capture._viewport[2] = GLfloat(geometry.width()) ;
+	capture._viewport[3] = GLfloat(geometry.height()) ;
+	capture._clearColor[0] = GLfloat(background.redF()) ;
+	capture._clearColor[1] = GLfloat(background.greenF()) ;
+	capture._clearColor[2] = GLfloat(background.blueF()) ;
+	capture._clearColor[3] = GLfloat(background.alphaF()) ;
+	capture._lineWidth = GLfloat(geometry.lineWidth()) ;
+	capture._pointSize = GLfloat(geometry.pointSize()) ;
+}
 
+void vrender::CaptureFeedback(RenderCB render_callback, void *callback_params, VRenderParams& vparams, FeedbackCapture& capture)
+{
 	try
 	{
 		GLint returned = -1 ;
@@ -40,15 +80,15 @@ void vrender::VectorialRender(RenderCB render_callback, void *callback_params, V
 
 		while(returned < 0)
 		{
-			if(feedbackBuffer != NULL)
-				delete[] feedbackBuffer ;
+			if(capture._buffer != NULL)
+				delete[] capture._buffer ;
 
-			feedbackBuffer = new GLfloat[vparams.size()] ;
+			capture._buffer = new GLfloat[vparams.size()] ;
 
-			if(feedbackBuffer == NULL)
+			if(capture._buffer == NULL)
 				throw std::runtime_error("Out of memory during feedback buffer allocation.") ;
 
-			glFeedbackBuffer(vparams.size(), GL_3D_COLOR, feedbackBuffer);
+			glFeedbackBuffer(vparams.size(), GL_3D_COLOR, capture._buffer);
 			glRenderMode(GL_FEEDBACK);
 			render_callback(callback_params);
 			returned = glRenderMode(GL_RENDER);
@@ -74,20 +114,45 @@ void vrender::VectorialRender(RenderCB render_callback, void *callback_params, V
 #ifdef _VRENDER_DEBUG
 		cout << "Size = " << vparams.size() << ", returned=" << returned << endl ;
 #endif
+		capture._size = returned ;
+
+		// The exporters' settings, read now since ProcessFeedback() may be
+		// called in an other thread.
+
+		glGetFloatv(GL_COLOR_CLEAR_VALUE, capture._clearColor);
+		glGetFloatv(GL_LINE_WIDTH, &capture._lineWidth);
+		glGetFloatv(GL_POINT_SIZE, &capture._pointSize);
+		glGetFloatv(GL_VIEWPORT, capture._viewport);
+	}
+	catch(exception& e)
+	{
+		cout << "Render aborted: " << e.what() << endl ;
+
+		delete[] capture._buffer ;
+		capture._buffer = NULL ;
+		capture._size = 0 ;
+
+		throw ;
+	}
+}
 
+void vrender::ProcessFeedback(FeedbackCapture& capture, VRenderParams& vparams)
+{
+	SortMethod *sort_method = NULL ;
+	Exporter *exporter = NULL ;
+	vector<PtrPrimitive> primitive_tab ;
+
+	try
+	{
 		//  On a un beau feedback buffer tout plein de saloperies. Faut aller
 		// defricher tout ca. Ouaiiiis !
 
-		vector<PtrPrimitive> primitive_tab ;
-
 		ParserGL parserGL ;
-		parserGL.parseFeedbackBuffer(feedbackBuffer,returned,primitive_tab,vparams) ;
+		parserGL.parseFeedbackBuffer(capture._buffer,capture._size,primitive_tab,vparams) ;
 
-		if(feedbackBuffer != NULL)
-		{
-			delete[] feedbackBuffer ;
-			feedbackBuffer = NULL ;
-		}
+		delete[] capture._buffer ;
+		capture._buffer = NULL ;
+		capture._size = 0 ;
 
 		if(vparams.isEnabled(VRenderParams::OptimizeBackFaceCulling))
 		{
@@ -153,12 +218,9 @@ void vrender::VectorialRender(RenderCB render_callback, void *callback_params, V
 
 		// sets background and black & white options
 
-		GLfloat viewport[4],clearColor[4],lineWidth,pointSize ;
-
-		glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
-		glGetFloatv(GL_LINE_WIDTH, &lineWidth);
-		glGetFloatv(GL_POINT_SIZE, &pointSize);
-		glGetFloatv(GL_VIEWPORT, viewport);
+		const GLfloat *viewport = capture._viewport ;
+		const GLfloat *clearColor = capture._clearColor ;
+		GLfloat lineWidth = capture._lineWidth ;
 
 		lineWidth /= (float)max(viewport[2] - viewport[0],viewport[3]-viewport[1]) ;
 
@@ -187,12 +249,139 @@ void vrender::VectorialRender(RenderCB render_callback, void *callback_params, V
 	{
 		cout << "Render aborted: " << e.what() << endl ;
 
+		//  The stages keep primitive_tab consistent when they throw: its
+		// primitives are the only ones left.
+
+		for(unsigned int i=0;i<primitive_tab.size();++i)
+			delete primitive_tab[i] ;
+		primitive_tab.clear() ;
+
 		if(exporter != NULL) delete exporter ;
 		if(sort_method != NULL) delete sort_method ;
-		if(feedbackBuffer != NULL) delete[] feedbackBuffer ;
 
-		throw e ;
+		delete[] capture._buffer ;
+		capture._buffer = NULL ;
+		capture._size = 0 ;
+
+		throw ;
+	}
+}
+
+FeedbackCapture::FeedbackCapture()
+{
+	_buffer = NULL ;
+	_size = 0 ;
+	_lineWidth = _pointSize = 1.0f ;
+
+	for(int i=0;i<4;++i)
+		_viewport[i] = _clearColor[i] = 0.0f ;
+}
+
+FeedbackCapture::~FeedbackCapture()
+{
+	delete[] _buffer ;
+}
+
+VectorialRenderJob::VectorialRenderJob(const VRenderParams& render_params, QObject *parent)
+	: QObject(parent), _params(render_params), _thread(this)
+{
+	_params._job = this ;
+	_params._progress_function = NULL ;
+	_params._canceled.storeRelease(0) ;
+	_success = false ;
+	_percent = -1 ;
+
+	connect(&_thread, SIGNAL(finished()), SLOT(threadFinished())) ;
+}
+
+VectorialRenderJob::~VectorialRenderJob()
+{
+	cancel() ;
+	_thread.wait() ;
+}
+
+bool VectorialRenderJob::start(RenderCB render_callback, void *callback_params)
+{
+	if(_thread.isRunning())
+		return false ;
+
+	try
+	{
+		CaptureFeedback(render_callback,callback_params,_params,_capture) ;
 	}
+	catch(exception& e)
+	{
+		_message = QString::fromLatin1(e.what()) ;
+		return false ;
+	}
+
+	startThread() ;
+	return true ;
+}
+
+bool VectorialRenderJob::start(const qglviewer::GeometrySink& geometry)
+{
+	if(_thread.isRunning())
+		return false ;
+
+	_params.error() = 0 ;
+	CaptureGeometry(geometry,_capture) ;
+
+	startThread() ;
+	return true ;
+}
+
+void VectorialRenderJob::startThread()
+{
+	_success = false ;
+	_message.clear() ;
+	_percent = -1 ;
+	_step.clear() ;
+	_thread.start() ;
+}
+
+void VectorialRenderJob::WorkerThread::run()
+{
+	try
+	{
+		ProcessFeedback(_job->_capture,_job->_params) ;
+		_job->_success = true ;
+	}
+	catch(VRenderCanceled& e)
+	{
+		_job->_message = QString::fromLatin1(e.what()) ;
+
+		// Does not leave a truncated file
+		QFile::remove(_job->_params.filename()) ;
+	}
+	catch(exception& e)
+	{
+		_job->_message = QString::fromLatin1(e.what()) ;
+	}
+}
+
+// Called in the worker thread. Signals are only emitted when the displayed
+// values change, since the sort methods report their progress very often.
+void VectorialRenderJob::reportProgress(float f, const QString& progress_string)
+{
+	const int percent = int(f * 100) ;
+
+	if(progress_string != _step)
+	{
+		_step = progress_string ;
+		Q_EMIT stepChanged(_step) ;
+	}
+
+	if(percent != _percent)
+	{
+		_percent = percent ;
+		Q_EMIT progressChanged(_percent) ;
+	}
+}
+
+void VectorialRenderJob::threadFinished()
+{
+	Q_EMIT finished(_success) ;
 }
 
 VRenderParams::VRenderParams()
@@ -201,6 +390,7 @@ VRenderParams::VRenderParams()
 	_format = EPS ;
 	_filename = "" ;
 	_progress_function = NULL ;
+	_job = NULL ;
 	_sortMethod = BSPSort ;
 }
 
@@ -210,7 +400,14 @@ VRenderParams::~VRenderParams()
 
 void VRenderParams::progress(float f, const QString& progress_string)
 {
-	_progress_function(f,progress_string) ;
+	if(isCanceled())
+		throw VRenderCanceled() ;
+
+	if(_progress_function != NULL)
+		_progress_function(f,progress_string) ;
+
+	if(_job != NULL)
+		_job->reportProgress(f,progress_string) ;
 }
 
 void VRenderParams::setFilename(const QString& filename)
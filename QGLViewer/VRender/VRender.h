@@ -4,17 +4,47 @@
 #include "../config.h"
 #include <QTextStream>
 #include <QString>
+#include <QObject>
+#include <QAtomicInt>
+#include <QThread>
+#include <stdexcept>
 
 #include "../qglviewer.h"
+#include "../geometrySink.h"
 
 namespace vrender
 {
 	class VRenderParams ;
+	class FeedbackCapture ;
+	class VectorialRenderJob ;
 	typedef void (*RenderCB)(void *) ;
 	typedef void (*ProgressFunction)(float,const QString&) ;
 
+	// Synchronous rendering: CaptureFeedback() followed by ProcessFeedback().
 	void VectorialRender(RenderCB DrawFunc, void *callback_params, VRenderParams& render_params) ;
 
+	// Same as above, with primitives given by the application instead of the
+	// OpenGL feedback mode. Does not use OpenGL.
+	void VectorialRender(const qglviewer::GeometrySink& geometry, VRenderParams& render_params) ;
+
+	// Renders the scene in OpenGL feedback mode. Must be called in the OpenGL thread.
+	void CaptureFeedback(RenderCB DrawFunc, void *callback_params, VRenderParams& render_params, FeedbackCapture& capture) ;
+
+	// Copies the primitives of the geometry sink, which are already in the
+	// feedback buffer format.
+	void CaptureGeometry(const qglviewer::GeometrySink& geometry, FeedbackCapture& capture) ;
+
+	// Parses, sorts, optimizes and exports the captured primitives. Only uses
+	// the CPU and can hence be called in any thread. Throws VRenderCanceled
+	// when render_params.cancel() is called meanwhile.
+	void ProcessFeedback(FeedbackCapture& capture, VRenderParams& render_params) ;
+
+	class VRenderCanceled: public std::runtime_error
+	{
+		public:
+			VRenderCanceled() : std::runtime_error("Render canceled.") {}
+	};
+
 	class VRenderParams
 	{
 		public:
@@ -44,12 +74,18 @@ namespace vrender
 
 			void setProgressFunction(ProgressFunction pf) { _progress_function = pf ; }
 
+			// Thread safe. The processing stops at the next progress report.
+			void cancel() { _canceled.storeRelease(1) ; }
+			bool isCanceled() const { return _canceled.loadAcquire() != 0 ; }
+
 		private:
 			int _error;
 			VRenderSortMethod _sortMethod;
 			VRenderFormat     _format ;
 
 			ProgressFunction _progress_function ;
+			VectorialRenderJob *_job ; // notified of the progress, may be NULL
+			QAtomicInt _canceled ;
 
 			unsigned int _options; // _DrawMode; _ClearBG; _TightenBB;
 			QString _filename;
@@ -57,6 +93,12 @@ namespace vrender
 			friend void VectorialRender(	RenderCB render_callback,
 							void *callback_params,
 							VRenderParams& vparams);
+			friend void CaptureFeedback(	RenderCB render_callback,
+							void *callback_params,
+							VRenderParams& vparams,
+							FeedbackCapture& capture);
+			friend void ProcessFeedback(FeedbackCapture& capture, VRenderParams& vparams);
+			friend class VectorialRenderJob ;
 			friend class ParserGL ;
 			friend class Exporter ;
 			friend class BSPSortMethod ;
@@ -69,6 +111,87 @@ namespace vrender
 
 			void progress(float,const QString&) ;
 	};
+
+	// The OpenGL feedback buffer and the OpenGL state used by the exporters.
+	class FeedbackCapture
+	{
+		public:
+			FeedbackCapture() ;
+			~FeedbackCapture() ;
+
+		private:
+			GLfloat *_buffer ;
+			GLint _size ;
+			GLfloat _viewport[4], _clearColor[4], _lineWidth, _pointSize ;
+
+			friend void CaptureFeedback(RenderCB,void *,VRenderParams&,FeedbackCapture&) ;
+			friend void CaptureGeometry(const qglviewer::GeometrySink&,FeedbackCapture&) ;
+			friend void ProcessFeedback(FeedbackCapture&,VRenderParams&) ;
+
+			FeedbackCapture(const FeedbackCapture&) ;
+			FeedbackCapture& operator=(const FeedbackCapture&) ;
+	};
+
+	// Asynchronous rendering. start() captures the feedback buffer in the
+	// calling (OpenGL) thread, and then runs ProcessFeedback() in a worker
+	// thread. The progress and the result are reported with signals, which
+	// are queued to the slots of the objects of the job's thread. A partially
+	// written file is removed when the job is canceled.
+	class VectorialRenderJob: public QObject
+	{
+		Q_OBJECT
+
+		public:
+			VectorialRenderJob(const VRenderParams& render_params, QObject *parent = NULL) ;
+			virtual ~VectorialRenderJob() ; // cancels and waits for the worker thread
+
+			// Returns false if the capture failed. finished() is then not emitted.
+			bool start(RenderCB DrawFunc, void *callback_params) ;
+			// Uses the geometry primitives instead of an OpenGL capture.
+			bool start(const qglviewer::GeometrySink& geometry) ;
+
+			bool isRunning() const { return _thread.isRunning() ; }
+			bool wait(unsigned long time = ULONG_MAX) { return _thread.wait(time) ; }
+			bool isCanceled() const { return _params.isCanceled() ; }
+			const QString& errorMessage() const { return _message ; }
+
+		public Q_SLOTS:
+			void cancel() { _params.cancel() ; }
+
+		Q_SIGNALS:
+			void progressChanged(int percent) ;
+			void stepChanged(const QString& step) ;
+			// success is false when the job failed or was canceled
+			void finished(bool success) ;
+
+		private Q_SLOTS:
+			void threadFinished() ;
+
+		private:
+			class WorkerThread: public QThread
+			{
+				public:
+					WorkerThread(VectorialRenderJob *job) : _job(job) {}
+					virtual void run() ;
+				private:
+					VectorialRenderJob *_job ;
+			};
+
+			friend class WorkerThread ;
+			friend class VRenderParams ;
+
+			void reportProgress(float,const QString&) ;
+			void startThread() ;
+
+			VRenderParams _params ;
+			FeedbackCapture _capture ;
+			WorkerThread _thread ;
+
+			bool _success ;
+			QString _message ;
+			int _percent ;	// last reported values, only used by the worker thread
+			QString _step ;
+	};
 }
 #endif
 
@@ -0,0 +1,160 @@
+#include "batchTransform.h"
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define QGLVIEWER_BATCH_SSE
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define QGLVIEWER_BATCH_NEON
+#include <arm_neon.h>
+#endif
+
+using namespace qglviewer;
+
+BatchTransform::BatchTransform(const Quaternion &rotation,
+                               const Vec &translation) {
+  // Matrix columns are the rotated axes
+  for (int j = 0; j < 3; ++j) {
+    Vec axis;
+    axis[j] = 1.0;
+    const Vec column = rotation.rotate(axis);
+    for (int i = 0; i < 3; ++i) {
+      m_[i][j] = column[i];
+      mf_[i][j] = float(column[i]);
+    }
+  }
+  for (int i = 0; i < 3; ++i) {
+    t_[i] = translation[i];
+    tf_[i] = float(translation[i]);
+  }
+}
+
+// Scalar path, on coordinates separated by stride values.
+template <typename Real, typename Matrix, typename Translation>
+static void applyScalar(const Matrix &m, const Translation &t, int nb,
+                        const Real *x, const Real *y, const Real *z, Real *rx,
+                        Real *ry, Real *rz, int stride) {
+  for (int i = 0; i < nb; ++i, x += stride, y += stride, z += stride,
+           rx += stride, ry += stride, rz += stride) {
+    const Real px = *x, py = *y, pz = *z;
+    *rx = Real(m[0][0] * px + m[0][1] * py + m[0][2] * pz + t[0]);
+    *ry = Real(m[1][0] * px + m[1][1] * py + m[1][2] * pz + t[1]);
+    *rz = Real(m[2][0] * px + m[2][1] * py + m[2][2] * pz + t[2]);
+  }
+}
+
+void BatchTransform::apply(int nb, const float *src, float *dst) const {
+  int i = 0;
+#if defined(QGLVIEWER_BATCH_SSE)
+  const __m128 m00 = _mm_set1_ps(mf_[0][0]), m01 = _mm_set1_ps(mf_[0][1]),
+               m02 = _mm_set1_ps(mf_[0][2]), m10 = _mm_set1_ps(mf_[1][0]),
+               m11 = _mm_set1_ps(mf_[1][1]), m12 = _mm_set1_ps(mf_[1][2]),
+               m20 = _mm_set1_ps(mf_[2][0]), m21 = _mm_set1_ps(mf_[2][1]),
+               m22 = _mm_set1_ps(mf_[2][2]);
+  const __m128 t0 = _mm_set1_ps(tf_[0]), t1 = _mm_set1_ps(tf_[1]),
+               t2 = _mm_set1_ps(tf_[2]);
+  for (; i + 4 <= nb; i += 4, src += 12, dst += 12) {
+    // a = x0 y0 z0 x1, b = y1 z1 x2 y2, c = z2 x3 y3 z3
+    const __m128 a = _mm_loadu_ps(src);
+    const __m128 b = _mm_loadu_ps(src + 4);
+    const __m128 c = _mm_loadu_ps(src + 8);
+
+    // Deinterleave
+    const __m128 x2y1x3z2 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(0, 1, 0, 2));
+    const __m128 x = _mm_shuffle_ps(a, x2y1x3z2, _MM_SHUFFLE(2, 0, 3, 0));
+    const __m128 y0x0y1y1 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 0, 1));
+    const __m128 y2y2y3y3 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3));
+    const __m128 y =
+        _mm_shuffle_ps(y0x0y1y1, y2y2y3y3, _MM_SHUFFLE(2, 0, 2, 0));
+    const __m128 z0z0z1z1 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2));
+    const __m128 z2z2z3z3 = _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0));
+    const __m128 z =
+        _mm_shuffle_ps(z0z0z1z1, z2z2z3z3, _MM_SHUFFLE(2, 0, 2, 0));
+
+    const __m128 rx = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(m00, x), _mm_mul_ps(m01, y)),
+        _mm_add_ps(_mm_mul_ps(m02, z), t0));
+    const __m128 ry = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(m10, x), _mm_mul_ps(m11, y)),
+        _mm_add_ps(_mm_mul_ps(m12, z), t1));
+    const __m128 rz = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(m20, x), _mm_mul_ps(m21, y)),
+        _mm_add_ps(_mm_mul_ps(m22, z), t2));
+
+    // Interleave back
+    const __m128 xy01 = _mm_unpacklo_ps(rx, ry);
+    const __m128 xy23 = _mm_unpackhi_ps(rx, ry);
+    const __m128 z0z0x1x1 = _mm_shuffle_ps(rz, rx, _MM_SHUFFLE(1, 1, 0, 0));
+    const __m128 y1y1z1z1 = _mm_shuffle_ps(ry, rz, _MM_SHUFFLE(1, 1, 1, 1));
+    const __m128 z2z2x3x3 = _mm_shuffle_ps(rz, rx, _MM_SHUFFLE(3, 3, 2, 2));
+    const __m128 y3y3z3z3 = _mm_shuffle_ps(ry, rz, _MM_SHUFFLE(3, 3, 3, 3));
+    _mm_storeu_ps(dst, _mm_shuffle_ps(xy01, z0z0x1x1, _MM_SHUFFLE(2, 0, 1, 0)));
+    _mm_storeu_ps(dst + 4,
+                  _mm_shuffle_ps(y1y1z1z1, xy23, _MM_SHUFFLE(1, 0, 2, 0)));
+    _mm_storeu_ps(dst + 8,
+                  _mm_shuffle_ps(z2z2x3x3, y3y3z3z3, _MM_SHUFFLE(2, 0, 2, 0)));
+  }
+#elif defined(QGLVIEWER_BATCH_NEON)
+  for (; i + 4 <= nb; i += 4, src += 12, dst += 12) {
+    const float32x4x3_t p = vld3q_f32(src);
+    float32x4x3_t r;
+    for (int k = 0; k < 3; ++k) {
+      r.val[k] = vmlaq_n_f32(vdupq_n_f32(tf_[k]), p.val[0], mf_[k][0]);
+      r.val[k] = vmlaq_n_f32(r.val[k], p.val[1], mf_[k][1]);
+      r.val[k] = vmlaq_n_f32(r.val[k], p.val[2], mf_[k][2]);
+    }
+    vst3q_f32(dst, r);
+  }
+#endif
+  applyScalar(mf_, tf_, nb - i, src, src + 1, src + 2, dst, dst + 1, dst + 2,
+              3);
+}
+
+void BatchTransform::apply(int nb, const double *src, double *dst) const {
+  applyScalar(m_, t_, nb, src, src + 1, src + 2, dst, dst + 1, dst + 2, 3);
+}
+
+void BatchTransform::apply(int nb, const float *const src[3],
+                           float *const dst[3]) const {
+  int i = 0;
+#if defined(QGLVIEWER_BATCH_SSE)
+  __m128 m[3][3], t[3];
+  for (int k = 0; k < 3; ++k) {
+    for (int l = 0; l < 3; ++l)
+      m[k][l] = _mm_set1_ps(mf_[k][l]);
+    t[k] = _mm_set1_ps(tf_[k]);
+  }
+  for (; i + 4 <= nb; i += 4) {
+    const __m128 x = _mm_loadu_ps(src[0] + i);
+    const __m128 y = _mm_loadu_ps(src[1] + i);
+    const __m128 z = _mm_loadu_ps(src[2] + i);
+    for (int k = 0; k < 3; ++k)
+      _mm_storeu_ps(dst[k] + i,
+                    _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[k][0], x),
+                                          _mm_mul_ps(m[k][1], y)),
+                               _mm_add_ps(_mm_mul_ps(m[k][2], z), t[k])));
+  }
+#elif defined(QGLVIEWER_BATCH_NEON)
+  for (; i + 4 <= nb; i += 4) {
+    const float32x4_t x = vld1q_f32(src[0] + i);
+    const float32x4_t y = vld1q_f32(src[1] + i);
+    const float32x4_t z = vld1q_f32(src[2] + i);
+    float32x4_t r[3];
+    for (int k = 0; k < 3; ++k) {
+      r[k] = vmlaq_n_f32(vdupq_n_f32(tf_[k]), x, mf_[k][0]);
+      r[k] = vmlaq_n_f32(r[k], y, mf_[k][1]);
+      r[k] = vmlaq_n_f32(r[k], z, mf_[k][2]);
+    }
+    // Stored once all the sources are read, in case dst == src
+    for (int k = 0; k < 3; ++k)
+      vst1q_f32(dst[k] + i, r[k]);
+  }
+#endif
+  applyScalar(mf_, tf_, nb - i, src[0] + i, src[1] + i, src[2] + i,
+              dst[0] + i, dst[1] + i, dst[2] + i, 1);
+}
+
+void BatchTransform::apply(int nb, const double *const src[3],
+                           double *const dst[3]) const {
+  applyScalar(m_, t_, nb, src[0], src[1], src[2], dst[0], dst[1], dst[2], 1);
+}
@@ -0,0 +1,34 @@
+#ifndef QGLVIEWER_BATCH_TRANSFORM_H
+#define QGLVIEWER_BATCH_TRANSFORM_H
+
+#include "quaternion.h"
+
+namespace qglviewer {
+#ifndef DOXYGEN
+/* A rigid transformation (rotation followed by a translation) applied to
+arrays of 3D coordinates. Used by the array versions of Quaternion::rotate(),
+Frame::coordinatesOf()...
+
+Coordinates are either interleaved (x0 y0 z0 x1 y1 z1...) or stored in three
+separate arrays. Float arrays are processed with SSE2 or NEON when available,
+four coordinates at a time. Double arrays and remaining elements use the
+scalar path. dst may be equal to src. Not part of the installed API. */
+class BatchTransform {
+public:
+  explicit BatchTransform(const Quaternion &rotation,
+                          const Vec &translation = Vec());
+
+  void apply(int nb, const float *src, float *dst) const;
+  void apply(int nb, const double *src, double *dst) const;
+  void apply(int nb, const float *const src[3], float *const dst[3]) const;
+  void apply(int nb, const double *const src[3], double *const dst[3]) const;
+
+private:
+  qreal m_[3][3]; // row major rotation matrix
+  qreal t_[3];
+  float mf_[3][3], tf_[3]; // float copies, used by the float kernels
+};
+#endif
+} // namespace qglviewer
+
+#endif // QGLVIEWER_BATCH_TRANSFORM_H
@@ -3,6 +3,24 @@
 #include "manipulatedCameraFrame.h"
 #include "qglviewer.h"
 
+#include <QMutexLocker>
+#include <QOpenGLBuffer>
+#include <QOpenGLContext>
+
+#include <string.h> // memcpy
+
+// Vectorized aaBoxesVisibility(), two double boxes at a time
+#if !defined(QT_COORD_TYPE)
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define QGLVIEWER_CULLING_SSE
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define QGLVIEWER_CULLING_NEON
+#include <arm_neon.h>
+#endif
+#endif
+
 using namespace std;
 using namespace qglviewer;
 
@@ -15,7 +33,10 @@ using namespace qglviewer;
  focusDistance() documentations for default stereo parameter values. */
 Camera::Camera()
     : frame_(NULL), fieldOfView_(M_PI / 4.0), modelViewMatrixIsUpToDate_(false),
-      projectionMatrixIsUpToDate_(false) {
+      projectionMatrixIsUpToDate_(false),
+      modelViewProjectionMatrixIsUpToDate_(false), modelViewMatrixVersion_(0),
+      projectionMatrixVersion_(0), frustumPlanesAreUpToDate_(false),
+      depthCache_(NULL), pixelSearchRadius_(2) {
   // #CONNECTION# Camera copy constructor
   interpolationKfi_ = new KeyFrameInterpolator;
   // Requires the interpolationKfi_
@@ -50,12 +71,7 @@ Camera::Camera()
   // focusDistance is set from setFieldOfView()
 
   // #CONNECTION# Camera copy constructor
-  for (unsigned short j = 0; j < 16; ++j) {
-    modelViewMatrix_[j] = ((j % 5 == 0) ? 1.0 : 0.0);
-    // #CONNECTION# computeProjectionMatrix() is lazy and assumes 0.0 almost
-    // everywhere.
-    projectionMatrix_[j] = 0.0;
-  }
+  initMatrices();
   computeProjectionMatrix();
 }
 
@@ -66,23 +82,37 @@ Camera::Camera()
 Camera::~Camera() {
   delete frame_;
   delete interpolationKfi_;
+  clearDepthBufferCache();
 }
 
 /*! Copy constructor. Performs a deep copy using operator=(). */
-Camera::Camera(const Camera &camera) : QObject(), frame_(NULL) {
+Camera::Camera(const Camera &camera)
+    : QObject(), frame_(NULL), modelViewMatrixVersion_(0),
+      projectionMatrixVersion_(0), depthCache_(NULL) {
   // #CONNECTION# Camera constructor
   interpolationKfi_ = new KeyFrameInterpolator;
   // Requires the interpolationKfi_
   setFrame(new ManipulatedCameraFrame(*camera.frame()));
 
+  initMatrices();
+
+  (*this) = camera;
+}
+
+// Resets the buffered matrices, which will be recomputed when needed.
+void Camera::initMatrices() {
   for (unsigned short j = 0; j < 16; ++j) {
     modelViewMatrix_[j] = ((j % 5 == 0) ? 1.0 : 0.0);
+    modelViewMatrixf_[j] = GLfloat(modelViewMatrix_[j]);
     // #CONNECTION# computeProjectionMatrix() is lazy and assumes 0.0 almost
     // everywhere.
     projectionMatrix_[j] = 0.0;
+    projectionMatrixf_[j] = 0.0f;
   }
-
-  (*this) = camera;
+  modelViewMatrixIsUpToDate_ = false;
+  projectionMatrixIsUpToDate_ = false;
+  modelViewProjectionMatrixIsUpToDate_ = false;
+  frustumPlanesAreUpToDate_ = false;
 }
 
 /*! Equal operator.
@@ -112,8 +142,11 @@ Camera &Camera::operator=(const Camera &camera) {
   setFocusDistance(camera.focusDistance());
   setPhysicalScreenWidth(camera.physicalScreenWidth());
 
+  setPixelSearchRadius(camera.pixelSearchRadius());
+
   orthoCoef_ = camera.orthoCoef_;
   projectionMatrixIsUpToDate_ = false;
+  frustumPlanesAreUpToDate_ = false;
 
   // frame_ and interpolationKfi_ pointers are not shared.
   frame_->setReferenceFrame(NULL);
@@ -146,6 +179,7 @@ void Camera::setScreenWidthAndHeight(int width, int height) {
   screenWidth_ = width > 0 ? width : 1;
   screenHeight_ = height > 0 ? height : 1;
   projectionMatrixIsUpToDate_ = false;
+  frustumPlanesAreUpToDate_ = false;
 }
 
 /*! Returns the near clipping plane distance used by the Camera projection
@@ -224,6 +258,7 @@ void Camera::setFieldOfView(qreal fov) {
   fieldOfView_ = fov;
   setFocusDistance(sceneRadius() / tan(fov / 2.0));
   projectionMatrixIsUpToDate_ = false;
+  frustumPlanesAreUpToDate_ = false;
 }
 
 /*! Defines the Camera type().
@@ -245,6 +280,7 @@ void Camera::setType(Type type) {
     orthoCoef_ = tan(fieldOfView() / 2.0);
   type_ = type;
   projectionMatrixIsUpToDate_ = false;
+  frustumPlanesAreUpToDate_ = false;
 }
 
 /*! Sets the Camera frame().
@@ -333,6 +369,13 @@ void Camera::computeProjectionMatrix() const {
   if (projectionMatrixIsUpToDate_)
     return;
 
+  QMutexLocker locker(&buffersMutex_);
+  if (projectionMatrixIsUpToDate_) // computed by an other thread meanwhile
+    return;
+
+  GLdouble previous[16];
+  memcpy(previous, projectionMatrix_, sizeof(previous));
+
   const qreal ZNear = zNear();
   const qreal ZFar = zFar();
 
@@ -364,6 +407,16 @@ void Camera::computeProjectionMatrix() const {
   }
   }
 
+  // Invalidations do not always change the matrix (resize to the same size,
+  // camera moved and back...): versions only change when values do.
+  if (memcmp(previous, projectionMatrix_, sizeof(previous)) != 0) {
+    ++projectionMatrixVersion_;
+    for (unsigned short i = 0; i < 16; ++i)
+      projectionMatrixf_[i] = GLfloat(projectionMatrix_[i]);
+    modelViewProjectionMatrixIsUpToDate_ = false;
+  }
+
+  // Last, so that the other threads see the complete buffers
   projectionMatrixIsUpToDate_ = true;
 }
 
@@ -384,6 +437,13 @@ void Camera::computeModelViewMatrix() const {
   if (modelViewMatrixIsUpToDate_)
     return;
 
+  QMutexLocker locker(&buffersMutex_);
+  if (modelViewMatrixIsUpToDate_) // computed by an other thread meanwhile
+    return;
+
+  GLdouble previous[16];
+  memcpy(previous, modelViewMatrix_, sizeof(previous));
+
   const Quaternion q = frame()->orientation();
 
   const qreal q00 = 2.0 * q[0] * q[0];
@@ -421,9 +481,40 @@ void Camera::computeModelViewMatrix() const {
   modelViewMatrix_[14] = -t.z;
   modelViewMatrix_[15] = 1.0;
 
+  if (memcmp(previous, modelViewMatrix_, sizeof(previous)) != 0) {
+    ++modelViewMatrixVersion_;
+    for (unsigned short i = 0; i < 16; ++i)
+      modelViewMatrixf_[i] = GLfloat(modelViewMatrix_[i]);
+    modelViewProjectionMatrixIsUpToDate_ = false;
+  }
+
   modelViewMatrixIsUpToDate_ = true;
 }
 
+// Updates the buffered product of the projection and modelView matrices.
+void Camera::computeModelViewProjectionMatrix() const {
+  computeModelViewMatrix();
+  computeProjectionMatrix();
+  if (modelViewProjectionMatrixIsUpToDate_)
+    return;
+
+  QMutexLocker locker(&buffersMutex_);
+  if (modelViewProjectionMatrixIsUpToDate_)
+    return;
+
+  for (unsigned short i = 0; i < 4; ++i) {
+    for (unsigned short j = 0; j < 4; ++j) {
+      qreal sum = 0.0;
+      for (unsigned short k = 0; k < 4; ++k)
+        sum += projectionMatrix_[i + 4 * k] * modelViewMatrix_[k + 4 * j];
+      modelViewProjectionMatrix_[i + 4 * j] = sum;
+      modelViewProjectionMatrixf_[i + 4 * j] = GLfloat(sum);
+    }
+  }
+
+  modelViewProjectionMatrixIsUpToDate_ = true;
+}
+
 /*! Loads the OpenGL \c GL_PROJECTION matrix with the Camera projection matrix.
 
  The Camera projection matrix is computed using computeProjectionMatrix().
@@ -512,51 +603,16 @@ void Camera::loadModelViewMatrix(bool reset) const {
  href="../examples/contribs.html#anaglyph">anaglyph</a> examples for an
  illustration.
 
- To retrieve this matrix, use a code like:
- \code
- glMatrixMode(GL_PROJECTION);
- glPushMatrix();
- loadProjectionMatrixStereo(left_or_right);
- glGetDoublev(GL_PROJECTION_MATRIX, m);
- glPopMatrix();
- \endcode
- Note that getProjectionMatrix() always returns the mono-vision matrix.
+ Use getProjectionMatrixStereo() to retrieve the two stereo matrices. Note that
+ getProjectionMatrix() always returns the mono-vision matrix.
 
  \attention glMatrixMode is set to \c GL_PROJECTION. */
 void Camera::loadProjectionMatrixStereo(bool leftBuffer) const {
-  qreal left, right, bottom, top;
-  qreal screenHalfWidth, halfWidth, side, shift, delta;
+  GLdouble left[16], right[16];
+  getProjectionMatrixStereo(left, right);
 
   glMatrixMode(GL_PROJECTION);
-  glLoadIdentity();
-
-  switch (type()) {
-  case Camera::PERSPECTIVE:
-    // compute half width of screen,
-    // corresponding to zero parallax plane to deduce decay of cameras
-    screenHalfWidth = focusDistance() * tan(horizontalFieldOfView() / 2.0);
-    shift = screenHalfWidth * IODistance() / physicalScreenWidth();
-    // should be * current y  / y total
-    // to take into account that the window doesn't cover the entire screen
-
-    // compute half width of "view" at znear and the delta corresponding to
-    // the shifted camera to deduce what to set for asymmetric frustums
-    halfWidth = zNear() * tan(horizontalFieldOfView() / 2.0);
-    delta = shift * zNear() / focusDistance();
-    side = leftBuffer ? -1.0 : 1.0;
-
-    left = -halfWidth + side * delta;
-    right = halfWidth + side * delta;
-    top = halfWidth / aspectRatio();
-    bottom = -top;
-    glFrustum(left, right, bottom, top, zNear(), zFar());
-    break;
-
-  case Camera::ORTHOGRAPHIC:
-    qWarning("Camera::setProjectionMatrixStereo: Stereo not available with "
-             "Ortho mode");
-    break;
-  }
+  glLoadMatrixd(leftBuffer ? left : right);
 }
 
 /*! Same as loadModelViewMatrix() but for a stereo setup.
@@ -571,7 +627,9 @@ void Camera::loadProjectionMatrixStereo(bool leftBuffer) const {
  When \p leftBuffer is \c true, computes the modelView matrix associated to the
  left eye (right eye otherwise).
 
- loadProjectionMatrixStereo() explains how to retrieve to resulting matrix.
+ Use getModelViewMatrixStereo() to retrieve the two stereo matrices. The
+ mono-vision matrix returned by getModelViewMatrix() is not modified by this
+ method.
 
  See the <a href="../examples/stereoViewer.html">stereoViewer</a> and the <a
  href="../examples/contribs.html#anaglyph">anaglyph</a> examples for an
@@ -580,19 +638,95 @@ void Camera::loadProjectionMatrixStereo(bool leftBuffer) const {
  \attention glMatrixMode is set to \c GL_MODELVIEW. */
 void Camera::loadModelViewMatrixStereo(bool leftBuffer) const {
   // WARNING: makeCurrent must be called by every calling method
+  GLdouble left[16], right[16];
+  getModelViewMatrixStereo(left, right);
+
   glMatrixMode(GL_MODELVIEW);
+  glLoadMatrixd(leftBuffer ? left : right);
+}
+
+/*! Fills \p left and \p right with the projection matrices associated with
+ each eye in a stereo setup.
+
+ These are the matrices loaded by loadProjectionMatrixStereo(), computed at
+ once and without any OpenGL call. They are typically used with
+ getModelViewMatrixStereo() when both views are rendered in a single scene
+ traversal (see QGLViewer::setStereoSinglePass()), for instance by passing the
+ two matrices to a shader that renders in a layered or side-by-side target.
+
+ Only the Camera::PERSPECTIVE type() is supported. Both matrices are set to
+ identity with an Camera::ORTHOGRAPHIC type().
+
+ The result are OpenGL 4x4 matrices, which are given in \e column-major order.
+ */
+void Camera::getProjectionMatrixStereo(GLdouble left[16],
+                                       GLdouble right[16]) const {
+  for (unsigned short i = 0; i < 16; ++i)
+    left[i] = right[i] = 0.0;
+
+  switch (type()) {
+  case Camera::PERSPECTIVE: {
+    // compute half width of screen,
+    // corresponding to zero parallax plane to deduce decay of cameras
+    const qreal screenHalfWidth =
+        focusDistance() * tan(horizontalFieldOfView() / 2.0);
+    const qreal shift = screenHalfWidth * IODistance() / physicalScreenWidth();
+    // should be * current y  / y total
+    // to take into account that the window doesn't cover the entire screen
+
+    // compute half width of "view" at znear and the delta corresponding to
+    // the shifted camera to deduce what to set for asymmetric frustums
+    const qreal halfWidth = zNear() * tan(horizontalFieldOfView() / 2.0);
+    const qreal delta = shift * zNear() / focusDistance();
+    const qreal top = halfWidth / aspectRatio();
+    const qreal ZNear = zNear();
+    const qreal ZFar = zFar();
+
+    for (int eye = 0; eye < 2; ++eye) {
+      // Same as glFrustum(-halfWidth + side * delta, halfWidth + side * delta,
+      //                   -top, top, zNear(), zFar())
+      GLdouble *m = (eye == 0) ? left : right;
+      const qreal side = (eye == 0) ? -1.0 : 1.0;
+      m[0] = ZNear / halfWidth;
+      m[5] = ZNear / top;
+      m[8] = side * delta / halfWidth;
+      m[10] = (ZNear + ZFar) / (ZNear - ZFar);
+      m[11] = -1.0;
+      m[14] = 2.0 * ZNear * ZFar / (ZNear - ZFar);
+    }
+    break;
+  }
+
+  case Camera::ORTHOGRAPHIC:
+    qWarning("Camera::getProjectionMatrixStereo: Stereo not available with "
+             "Ortho mode");
+    left[0] = left[5] = left[10] = left[15] = 1.0;
+    right[0] = right[5] = right[10] = right[15] = 1.0;
+    break;
+  }
+}
+
+/*! Fills \p left and \p right with the modelView matrices associated with each
+ eye in a stereo setup.
+
+ These are the matrices loaded by loadModelViewMatrixStereo(): the mono-vision
+ modelView matrix (see getModelViewMatrix()), translated along its horizontal
+ axis by minus (left eye) or plus (right eye) a shift that depends on
+ focusDistance(), IODistance(), and physicalScreenWidth().
 
-  qreal halfWidth = focusDistance() * tan(horizontalFieldOfView() / 2.0);
-  qreal shift =
+ See getProjectionMatrixStereo() for a typical use. */
+void Camera::getModelViewMatrixStereo(GLdouble left[16],
+                                      GLdouble right[16]) const {
+  const qreal halfWidth = focusDistance() * tan(horizontalFieldOfView() / 2.0);
+  const qreal shift =
       halfWidth * IODistance() /
       physicalScreenWidth(); // * current window width / full screen width
 
   computeModelViewMatrix();
-  if (leftBuffer)
-    modelViewMatrix_[12] -= shift;
-  else
-    modelViewMatrix_[12] += shift;
-  glLoadMatrixd(modelViewMatrix_);
+  for (unsigned short i = 0; i < 16; ++i)
+    left[i] = right[i] = modelViewMatrix_[i];
+  left[12] -= shift;
+  right[12] += shift;
 }
 
 /*! Fills \p m with the Camera projection matrix values.
@@ -620,10 +754,8 @@ void Camera::getProjectionMatrix(GLdouble m[16]) const {
 /*! Overloaded getProjectionMatrix(GLdouble m[16]) method using a \c GLfloat
  * array instead. */
 void Camera::getProjectionMatrix(GLfloat m[16]) const {
-  static GLdouble mat[16];
-  getProjectionMatrix(mat);
-  for (unsigned short i = 0; i < 16; ++i)
-    m[i] = float(mat[i]);
+  computeProjectionMatrix();
+  memcpy(m, projectionMatrixf_, sizeof(projectionMatrixf_));
 }
 
 /*! Fills \p m with the Camera modelView matrix values.
@@ -652,39 +784,82 @@ void Camera::getModelViewMatrix(GLdouble m[16]) const {
 /*! Overloaded getModelViewMatrix(GLdouble m[16]) method using a \c GLfloat
  * array instead. */
 void Camera::getModelViewMatrix(GLfloat m[16]) const {
-  static GLdouble mat[16];
-  getModelViewMatrix(mat);
-  for (unsigned short i = 0; i < 16; ++i)
-    m[i] = float(mat[i]);
+  computeModelViewMatrix();
+  memcpy(m, modelViewMatrixf_, sizeof(modelViewMatrixf_));
 }
 
 /*! Fills \p m with the product of the ModelView and Projection matrices.
 
-  Calls getModelViewMatrix() and getProjectionMatrix() and then fills \p m with
-  the product of these two matrices. */
+  The product of getProjectionMatrix() and getModelViewMatrix() is buffered and
+  only recomputed when one of these matrices changes (see
+  modelViewMatrixVersion() and projectionMatrixVersion()). */
 void Camera::getModelViewProjectionMatrix(GLdouble m[16]) const {
-  GLdouble mv[16];
-  GLdouble proj[16];
-  getModelViewMatrix(mv);
-  getProjectionMatrix(proj);
-
-  for (unsigned short i = 0; i < 4; ++i) {
-    for (unsigned short j = 0; j < 4; ++j) {
-      qreal sum = 0.0;
-      for (unsigned short k = 0; k < 4; ++k)
-        sum += proj[i + 4 * k] * mv[k + 4 * j];
-      m[i + 4 * j] = sum;
-    }
-  }
+  computeModelViewProjectionMatrix();
+  memcpy(m, modelViewProjectionMatrix_, sizeof(modelViewProjectionMatrix_));
 }
 
 /*! Overloaded getModelViewProjectionMatrix(GLdouble m[16]) method using a \c
  * GLfloat array instead. */
 void Camera::getModelViewProjectionMatrix(GLfloat m[16]) const {
-  static GLdouble mat[16];
-  getModelViewProjectionMatrix(mat);
-  for (unsigned short i = 0; i < 16; ++i)
-    m[i] = float(mat[i]);
+  computeModelViewProjectionMatrix();
+  memcpy(m, modelViewProjectionMatrixf_, sizeof(modelViewProjectionMatrixf_));
+}
+
+/*! Fills \p m with the 3x3 normal matrix associated with getModelViewMatrix(),
+ in \e column-major order.
+
+ This is the matrix that transforms normals from the world to the Camera
+ coordinate system, typically given to a shader \c mat3 uniform. Since the
+ Camera modelView matrix is a rigid transformation, it is simply the upper left
+ 3x3 part of this matrix (its inverse transpose is itself). */
+void Camera::getNormalMatrix(GLdouble m[9]) const {
+  computeModelViewMatrix();
+  for (unsigned short j = 0; j < 3; ++j)
+    for (unsigned short i = 0; i < 3; ++i)
+      m[3 * j + i] = modelViewMatrix_[4 * j + i];
+}
+
+/*! Overloaded getNormalMatrix(GLdouble m[9]) method using a \c GLfloat array
+ * instead. */
+void Camera::getNormalMatrix(GLfloat m[9]) const {
+  computeModelViewMatrix();
+  for (unsigned short j = 0; j < 3; ++j)
+    for (unsigned short i = 0; i < 3; ++i)
+      m[3 * j + i] = modelViewMatrixf_[4 * j + i];
+}
+
+/*! Returns a number that is incremented each time the modelView matrix (see
+ getModelViewMatrix()) changes.
+
+ Compare with the value saved when the matrix was last used to know if
+ dependent computations need to be updated. A typical use, in a shader based
+ QGLViewer::draw():
+ \code
+ if (camera()->modelViewMatrixVersion() != uploadedVersion_) {
+   GLfloat mv[16];
+   camera()->getModelViewMatrix(mv);
+   program_.setUniformValue("modelView", QMatrix4x4(mv).transposed());
+   uploadedVersion_ = camera()->modelViewMatrixVersion();
+ }
+ \endcode
+
+ The version only changes when the matrix values change, and not each time the
+ Camera is invalidated. It is updated lazily, this method first calls
+ computeModelViewMatrix(). See also projectionMatrixVersion() and
+ Frame::version(). */
+unsigned int Camera::modelViewMatrixVersion() const {
+  computeModelViewMatrix();
+  return modelViewMatrixVersion_;
+}
+
+/*! Returns a number that is incremented each time the projection matrix (see
+ getProjectionMatrix()) changes. See modelViewMatrixVersion() for details.
+
+ getModelViewProjectionMatrix() changes when either of these versions
+ changes. */
+unsigned int Camera::projectionMatrixVersion() const {
+  computeProjectionMatrix();
+  return projectionMatrixVersion_;
 }
 
 /*! Sets the sceneRadius() value. Negative values are ignored.
@@ -699,6 +874,7 @@ void Camera::setSceneRadius(qreal radius) {
 
   sceneRadius_ = radius;
   projectionMatrixIsUpToDate_ = false;
+  frustumPlanesAreUpToDate_ = false;
 
   setFocusDistance(sceneRadius() / tan(fieldOfView() / 2.0));
 
@@ -719,9 +895,11 @@ void Camera::setSceneCenter(const Vec &center) {
   sceneCenter_ = center;
   setPivotPoint(sceneCenter());
   projectionMatrixIsUpToDate_ = false;
+  frustumPlanesAreUpToDate_ = false;
 }
 
-/*! setSceneCenter() to the result of pointUnderPixel(\p pixel).
+/*! setSceneCenter() to the result of pointUnderPixel(\p pixel), searched in a
+  pixelSearchRadius() neighborhood.
 
   Returns \c true if a pointUnderPixel() was found and sceneCenter() was
   actually changed.
@@ -729,7 +907,7 @@ void Camera::setSceneCenter(const Vec &center) {
   See also setPivotPointFromPixel(). See the pointUnderPixel() documentation. */
 bool Camera::setSceneCenterFromPixel(const QPoint &pixel) {
   bool found;
-  Vec point = pointUnderPixel(pixel, found);
+  Vec point = pointUnderPixel(pixel, found, pixelSearchRadius());
   if (found)
     setSceneCenter(point);
   return found;
@@ -768,12 +946,14 @@ void Camera::setPivotPoint(const Vec &point) {
   if ((prevDist > 1E-9) && (newDist > 1E-9))
     orthoCoef_ *= prevDist / newDist;
   projectionMatrixIsUpToDate_ = false;
+  frustumPlanesAreUpToDate_ = false;
 }
 
 /*! The pivotPoint() is set to the point located under \p pixel on screen.
 
-Returns \c true if a pointUnderPixel() was found. If no point was found under \p
-pixel, the pivotPoint() is left unchanged.
+Returns \c true if a pointUnderPixel() was found. If no point was found in the
+pixelSearchRadius() neighborhood of \p pixel, the pivotPoint() is left
+unchanged.
 
 \p pixel is expressed in Qt format (origin in the upper left corner of the
 window). See pointUnderPixel().
@@ -781,7 +961,7 @@ window). See pointUnderPixel().
 See also setSceneCenterFromPixel(). */
 bool Camera::setPivotPointFromPixel(const QPoint &pixel) {
   bool found;
-  Vec point = pointUnderPixel(pixel, found);
+  Vec point = pointUnderPixel(pixel, found, pixelSearchRadius());
   if (found)
     setPivotPoint(point);
   return found;
@@ -853,7 +1033,8 @@ void Camera::setFOVToFitScene() {
 
 /*! Makes the Camera smoothly zoom on the pointUnderPixel() \p pixel.
 
- Nothing happens if no pointUnderPixel() is found. Otherwise a
+ Nothing happens if no pointUnderPixel() is found in the pixelSearchRadius()
+ neighborhood of \p pixel. Otherwise a
  KeyFrameInterpolator is created that animates the Camera on a one second path
  that brings the Camera closer to the point under \p pixel.
 
@@ -862,7 +1043,7 @@ void Camera::interpolateToZoomOnPixel(const QPoint &pixel) {
   const qreal coef = 0.1;
 
   bool found;
-  Vec target = pointUnderPixel(pixel, found);
+  Vec target = pointUnderPixel(pixel, found, pixelSearchRadius());
 
   if (!found)
     return;
@@ -940,16 +1121,175 @@ void Camera::interpolateTo(const Frame &fr, qreal duration) {
   interpolationKfi_->startInterpolation();
 }
 
+#ifndef DOXYGEN
+// Depth buffer read back by cacheDepthBuffer(), in a pixel buffer object. Two
+// buffers are used, so that a new read back never waits for a query on the
+// previous one.
+struct Camera::DepthCache {
+  DepthCache() : context(NULL), current(-1), width(0), height(0) {
+    for (int i = 0; i < 2; ++i)
+      buffers[i] = QOpenGLBuffer(QOpenGLBuffer::PixelPackBuffer);
+  }
+
+  QOpenGLContext *context; // in which the buffers were created
+  QOpenGLBuffer buffers[2];
+  int current; // index of the last read back buffer, -1 if none
+  int width, height;
+  // Matrices of the frame that was read back
+  GLdouble modelView[16], projection[16];
+  GLint viewport[4];
+};
+
+// Depth values of a rectangle of the screen, and the matrices with which they
+// must be unprojected. Rows are stored bottom to top (OpenGL order).
+struct Camera::DepthRegion {
+  QRect rect; // Qt coordinates, origin in the upper left corner
+  QVector<float> depth;
+  GLdouble modelView[16], projection[16];
+  GLint viewport[4];
+
+  float depthAt(int x, int y) const {
+    return depth[(rect.bottom() - y) * rect.width() + x - rect.left()];
+  }
+
+  Vec unproject(int x, int y, float z) const {
+    GLdouble px, py, pz;
+    gluUnProject(x, y, z, modelView, projection, viewport, &px, &py, &pz);
+    return Vec(px, py, pz);
+  }
+};
+#endif
+
+/*! Starts an asynchronous read back of the depth buffer, which will then be
+ used by pointUnderPixel() and pointsUnderPixels().
+
+ The depth buffer is copied in a pixel buffer object, and this method returns
+ without waiting for the copy to complete. The first subsequent query waits for
+ the end of the transfer if needed (which is usually already completed by
+ then), and only reads the needed rows. Queries no longer stall the OpenGL
+ pipeline and several queries between two frames cost a single read back.
+
+ This method is called by QGLViewer::paintGL() at the end of each frame when
+ QGLViewer::depthBufferIsCached(). It requires a current OpenGL context, in
+ which the frame was drawn with this Camera. Pixel buffer objects must be
+ supported, pointUnderPixel() directly reads the depth buffer otherwise.
+
+ Note that the cached depth values are unprojected with the matrices of the
+ frame they were read from: the returned points are those that are displayed,
+ even if the Camera has been moved since then.
+
+ Use clearDepthBufferCache() to release the buffers. */
+void Camera::cacheDepthBuffer() {
+  QOpenGLContext *context = QOpenGLContext::currentContext();
+  if (!context)
+    return;
+
+  if (depthCache_ && (depthCache_->context != context))
+    clearDepthBufferCache();
+  if (!depthCache_) {
+    depthCache_ = new DepthCache();
+    depthCache_->context = context;
+  }
+
+  const int index = (depthCache_->current + 1) % 2;
+  QOpenGLBuffer &buffer = depthCache_->buffers[index];
+  if (!buffer.isCreated() && !buffer.create()) {
+    clearDepthBufferCache();
+    return;
+  }
+
+  const int size = screenWidth() * screenHeight() * sizeof(float);
+  buffer.bind();
+  if (buffer.size() != size)
+    buffer.allocate(size);
+  glReadPixels(0, 0, screenWidth(), screenHeight(), GL_DEPTH_COMPONENT,
+               GL_FLOAT, 0);
+  buffer.release();
+
+  depthCache_->current = index;
+  depthCache_->width = screenWidth();
+  depthCache_->height = screenHeight();
+  getModelViewMatrix(depthCache_->modelView);
+  getProjectionMatrix(depthCache_->projection);
+  getViewport(depthCache_->viewport);
+}
+
+/*! Releases the depth buffer cache created by cacheDepthBuffer().
+ pointUnderPixel() then directly reads the depth buffer again.
+
+ The pixel buffer objects are deleted when their OpenGL context is current, or
+ as soon as possible otherwise. */
+void Camera::clearDepthBufferCache() {
+  delete depthCache_;
+  depthCache_ = NULL;
+}
+
+// Fills region with the depth values of rect (clipped to the screen). Reads
+// the depthCache_ when it is valid, and the current depth buffer otherwise.
+// Returns false if rect is outside of the screen.
+bool Camera::readDepthRegion(const QRect &rect, DepthRegion &region) const {
+  region.rect = rect & QRect(0, 0, screenWidth(), screenHeight());
+  if (region.rect.isEmpty())
+    return false;
+
+  region.depth.resize(region.rect.width() * region.rect.height());
+  // Qt uses upper corner for its origin while GL uses the lower corner.
+  const int glBottom = screenHeight() - 1 - region.rect.bottom();
+
+  if (depthCache_ && (depthCache_->current >= 0) &&
+      (depthCache_->context == QOpenGLContext::currentContext()) &&
+      (depthCache_->width == screenWidth()) &&
+      (depthCache_->height == screenHeight())) {
+    QOpenGLBuffer &buffer = depthCache_->buffers[depthCache_->current];
+    const int rowSize = depthCache_->width * sizeof(float);
+    buffer.bind();
+    const float *rows = static_cast<const float *>(
+        buffer.mapRange(glBottom * rowSize, region.rect.height() * rowSize,
+                        QOpenGLBuffer::RangeRead));
+    if (rows) {
+      for (int j = 0; j < region.rect.height(); ++j)
+        memcpy(region.depth.data() + j * region.rect.width(),
+               rows + j * depthCache_->width + region.rect.left(),
+               region.rect.width() * sizeof(float));
+      buffer.unmap();
+      buffer.release();
+      memcpy(region.modelView, depthCache_->modelView, sizeof(GLdouble) * 16);
+      memcpy(region.projection, depthCache_->projection,
+             sizeof(GLdouble) * 16);
+      memcpy(region.viewport, depthCache_->viewport, sizeof(GLint) * 4);
+      return true;
+    }
+    buffer.release();
+  }
+
+  glReadPixels(region.rect.left(), glBottom, region.rect.width(),
+               region.rect.height(), GL_DEPTH_COMPONENT, GL_FLOAT,
+               region.depth.data());
+  getModelViewMatrix(region.modelView);
+  getProjectionMatrix(region.projection);
+  getViewport(region.viewport);
+  return true;
+}
+
 /*! Returns the coordinates of the 3D point located at pixel (x,y) on screen.
 
- Calls a \c glReadPixel to get the pixel depth and applies an
- unprojectedCoordinatesOf() to the result. \p found indicates whether a point
- was found or not (i.e. background pixel, result's depth is zFar() in that
- case).
+ Reads the pixel depth and applies an unprojectedCoordinatesOf() to the result.
+ \p found indicates whether a point was found or not (i.e. background pixel,
+ result's depth is zFar() in that case).
+
+ When \p radius is positive and \p pixel is on the background, the pixel of
+ the (2 * \p radius + 1) pixels wide square centered on \p pixel which is the
+ closest to \p pixel and that is not on the background is used instead. This
+ makes it possible to pick thin lines or points.
 
  \p x and \p y are expressed in pixel units with an origin in the upper left
  corner. Use screenHeight() - y to convert to OpenGL standard.
 
+ The depth buffer is read with a \c glReadPixels, which stalls the OpenGL
+ pipeline, unless cacheDepthBuffer() was called after the last frame (see
+ QGLViewer::depthBufferIsCached()). Use pointsUnderPixels() to query several
+ pixels at once.
+
  \attention This method assumes that a GL context is available, and that its
  content was drawn using the Camera (i.e. using its projection and modelview
  matrices). This method hence cannot be used for offscreen Camera computations.
@@ -959,15 +1299,68 @@ void Camera::interpolateTo(const Frame &fr, qreal duration) {
  \note The precision of the z-Buffer highly depends on how the zNear() and
  zFar() values are fitted to your scene. Loose boundaries will result in
  imprecision along the viewing direction. */
-Vec Camera::pointUnderPixel(const QPoint &pixel, bool &found) const {
-  float depth;
-  // Qt uses upper corner for its origin while GL uses the lower corner.
-  glReadPixels(pixel.x(), screenHeight() - 1 - pixel.y(), 1, 1,
-               GL_DEPTH_COMPONENT, GL_FLOAT, &depth);
-  found = depth < 1.0;
-  Vec point(pixel.x(), pixel.y(), depth);
-  point = unprojectedCoordinatesOf(point);
-  return point;
+Vec Camera::pointUnderPixel(const QPoint &pixel, bool &found,
+                            int radius) const {
+  found = false;
+  radius = qMax(radius, 0);
+  DepthRegion region;
+  if (!readDepthRegion(QRect(pixel.x() - radius, pixel.y() - radius,
+                             2 * radius + 1, 2 * radius + 1),
+                       region))
+    return unprojectedCoordinatesOf(Vec(pixel.x(), pixel.y(), 1.0));
+
+  QPoint nearest = pixel;
+  float depth = 1.0;
+  int minDistance = 2 * radius * radius + 1;
+  for (int y = region.rect.top(); y <= region.rect.bottom(); ++y)
+    for (int x = region.rect.left(); x <= region.rect.right(); ++x) {
+      const int dx = x - pixel.x();
+      const int dy = y - pixel.y();
+      const int distance = dx * dx + dy * dy;
+      if ((distance < minDistance) && (region.depthAt(x, y) < 1.0)) {
+        minDistance = distance;
+        nearest = QPoint(x, y);
+        depth = region.depthAt(x, y);
+        found = true;
+      }
+    }
+
+  return region.unproject(nearest.x(), nearest.y(), depth);
+}
+
+/*! Same as pointUnderPixel() for the \p nbPixels \p pixels. The result for \p
+ pixels[i] is stored in \p points[i] and \p found[i]. Returns the number of
+ points that were found.
+
+ The depth buffer is read only once, in the rectangle that contains all the \p
+ pixels. It is hence much faster than successive calls to pointUnderPixel(),
+ especially when the depth buffer is not cached (see cacheDepthBuffer()). */
+int Camera::pointsUnderPixels(int nbPixels, const QPoint pixels[],
+                              Vec points[], bool found[]) const {
+  if (nbPixels <= 0)
+    return 0;
+
+  QRect bounds(pixels[0], pixels[0]);
+  for (int i = 1; i < nbPixels; ++i)
+    bounds |= QRect(pixels[i], pixels[i]);
+
+  DepthRegion region;
+  const bool hasRegion = readDepthRegion(bounds, region);
+
+  int nbFound = 0;
+  for (int i = 0; i < nbPixels; ++i) {
+    float depth = 1.0;
+    if (hasRegion && region.rect.contains(pixels[i]))
+      depth = region.depthAt(pixels[i].x(), pixels[i].y());
+    found[i] = depth < 1.0;
+    if (found[i])
+      ++nbFound;
+    points[i] = hasRegion
+                    ? region.unproject(pixels[i].x(), pixels[i].y(), depth)
+                    : unprojectedCoordinatesOf(
+                          Vec(pixels[i].x(), pixels[i].y(), depth));
+  }
+  return nbFound;
 }
 
 /*! Moves the Camera so that the entire scene is visible.
@@ -1589,7 +1982,7 @@ void Camera::getViewport(GLint viewport[4]) const {
  */
 Vec Camera::projectedCoordinatesOf(const Vec &src, const Frame *frame) const {
   GLdouble x, y, z;
-  static GLint viewport[4];
+  GLint viewport[4];
   getViewport(viewport);
 
   if (frame) {
@@ -1637,7 +2030,7 @@ Vec Camera::projectedCoordinatesOf(const Vec &src, const Frame *frame) const {
  the \c gluUnProject man page for details. */
 Vec Camera::unprojectedCoordinatesOf(const Vec &src, const Frame *frame) const {
   GLdouble x, y, z;
-  static GLint viewport[4];
+  GLint viewport[4];
   getViewport(viewport);
   gluUnProject(src.x, src.y, src.z, modelViewMatrix_, projectionMatrix_,
                viewport, &x, &y, &z);
@@ -1952,6 +2345,91 @@ void Camera::initFromDOMElement(const QDomElement &element) {
   }
 }
 
+/*! Writes the Camera state in a binary \c QDataStream.
+
+ This is the binary equivalent of domElement(): the Camera parameters, the
+ frame() state (see ManipulatedCameraFrame::writeToStream()) and the
+ keyFrameInterpolator() paths are written in this order. It is used by
+ QGLViewer::saveStateToFile() when the QGLViewer::stateFileName() has a \c .qglb
+ extension.
+
+ Use readFromStream() to restore the Camera state. */
+void Camera::writeToStream(QDataStream &stream) const {
+  stream << double(fieldOfView()) << double(zNearCoefficient())
+         << double(zClippingCoefficient()) << double(orthoCoef_)
+         << double(sceneRadius()) << sceneCenter() << qint32(type());
+
+  stream << double(IODistance()) << double(focusDistance())
+         << double(physicalScreenWidth());
+
+  frame()->writeToStream(stream);
+
+  // KeyFrame paths
+  stream << quint32(kfi_.count());
+  for (QMap<unsigned int, KeyFrameInterpolator *>::ConstIterator
+           it = kfi_.begin(),
+           end = kfi_.end();
+       it != end; ++it) {
+    stream << quint32(it.key());
+    (it.value())->writeToStream(stream);
+  }
+}
+
+/*! Restores the Camera state from a binary \c QDataStream created by
+ writeToStream().
+
+ As with initFromDOMElement(), the frame() pointer is not modified, but its
+ state is, and the original keyFrameInterpolator() are deleted. The paths'
+ keyFrames are only decoded when they are first used (see
+ KeyFrameInterpolator::readFromStream()). */
+void Camera::readFromStream(QDataStream &stream) {
+  QMutableMapIterator<unsigned int, KeyFrameInterpolator *> it(kfi_);
+  while (it.hasNext()) {
+    it.next();
+    deletePath(it.key());
+  }
+
+  double fov, zNearCoef, zClippingCoef, orthoCoef, radius;
+  Vec center;
+  qint32 cameraType;
+  stream >> fov >> zNearCoef >> zClippingCoef >> orthoCoef >> radius >>
+      center >> cameraType;
+
+  double IODist, focusDist, screenWidth;
+  stream >> IODist >> focusDist >> screenWidth;
+
+  if (stream.status() != QDataStream::Ok) {
+    qWarning("Camera::readFromStream: corrupted data, Camera state not "
+             "restored");
+    return;
+  }
+
+  // #CONNECTION# Same order as in initFromDOMElement()
+  setFieldOfView(fov);
+  setZNearCoefficient(zNearCoef);
+  setZClippingCoefficient(zClippingCoef);
+  orthoCoef_ = orthoCoef;
+  setSceneRadius(radius);
+  setType(cameraType == ORTHOGRAPHIC ? ORTHOGRAPHIC : PERSPECTIVE);
+  setSceneCenter(center);
+
+  setIODistance(IODist);
+  setFocusDistance(focusDist);
+  setPhysicalScreenWidth(screenWidth);
+
+  frame()->readFromStream(stream);
+
+  quint32 nbPaths = 0;
+  stream >> nbPaths;
+  for (quint32 i = 0; i < nbPaths && stream.status() == QDataStream::Ok; ++i) {
+    quint32 index;
+    stream >> index;
+    KeyFrameInterpolator *kfi = new KeyFrameInterpolator(frame());
+    kfi->readFromStream(stream);
+    setKeyFrameInterpolator(index, kfi);
+  }
+}
+
 /*! Gives the coefficients of a 3D half-line passing through the Camera eye and
  pixel (x,y).
 
@@ -2141,6 +2619,26 @@ plane can hence be applied in an other viewer to visualize the culling results:
  glClipPlane(GL_CLIP_PLANE1, coef[3]);
 \endcode */
 void Camera::getFrustumPlanesCoefficients(GLdouble coef[6][4]) const {
+  computeFrustumPlanes();
+  for (int i = 0; i < 6; ++i) {
+    coef[i][0] = GLdouble(frustumPlaneNormal_[i].x);
+    coef[i][1] = GLdouble(frustumPlaneNormal_[i].y);
+    coef[i][2] = GLdouble(frustumPlaneNormal_[i].z);
+    coef[i][3] = GLdouble(frustumPlaneDist_[i]);
+  }
+}
+
+// Updates the cached frustum plane equations returned by
+// getFrustumPlanesCoefficients(). frustumPlanesAreUpToDate_ is reset with
+// projectionMatrixIsUpToDate_.
+void Camera::computeFrustumPlanes() const {
+  if (frustumPlanesAreUpToDate_)
+    return;
+
+  QMutexLocker locker(&buffersMutex_);
+  if (frustumPlanesAreUpToDate_) // computed by an other thread meanwhile
+    return;
+
   // Computed once and for all
   const Vec pos = position();
   const Vec viewDir = viewDirection();
@@ -2148,8 +2646,8 @@ void Camera::getFrustumPlanesCoefficients(GLdouble coef[6][4]) const {
   const Vec right = rightVector();
   const qreal posViewDir = pos * viewDir;
 
-  static Vec normal[6];
-  static GLdouble dist[6];
+  Vec *const normal = frustumPlaneNormal_;
+  qreal *const dist = frustumPlaneDist_;
 
   switch (type()) {
   case Camera::PERSPECTIVE: {
@@ -2214,15 +2712,271 @@ void Camera::getFrustumPlanesCoefficients(GLdouble coef[6][4]) const {
   dist[2] = -posViewDir - zNear();
   dist[3] = posViewDir + zFar();
 
+  frustumPlanesAreUpToDate_ = true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                    F r u s t u m   c u l l i n g                           //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Returns the signed distance from \p pos to the \p index frustum plane (see
+getFrustumPlanesCoefficients() for the plane order), defined in the world
+coordinate system. Distance is positive on the outside of the frustum.
+
+The plane equations are cached and only recomputed when the Camera is modified.
+*/
+qreal Camera::distanceToFrustumPlane(int index, const Vec &pos) const {
+  computeFrustumPlanes();
+  return pos * frustumPlaneNormal_[index] - frustumPlaneDist_[index];
+}
+
+// Classifies a box, defined by its center and its three half edge vectors,
+// against the planes of planeMask. Its projected radius on each plane normal
+// gives the distance of the nearest (n-vertex) and farthest (p-vertex)
+// corners. Planes that are entirely in front of the box are removed from
+// planeMask.
+Camera::Visibility Camera::boxVisibility(const Vec &center, const Vec axis[3],
+                                         int *planeMask) const {
+  computeFrustumPlanes();
+
+  const int mask = planeMask ? *planeMask : AllFrustumPlanes;
+  int intersected = 0;
   for (int i = 0; i < 6; ++i) {
-    coef[i][0] = GLdouble(normal[i].x);
-    coef[i][1] = GLdouble(normal[i].y);
-    coef[i][2] = GLdouble(normal[i].z);
-    coef[i][3] = dist[i];
+    if (!(mask & (1 << i)))
+      continue;
+
+    const Vec &n = frustumPlaneNormal_[i];
+    const qreal distance = center * n - frustumPlaneDist_[i];
+    const qreal radius =
+        fabs(axis[0] * n) + fabs(axis[1] * n) + fabs(axis[2] * n);
+    if (distance > radius)
+      return OUTSIDE;
+    if (distance > -radius)
+      intersected |= (1 << i);
+  }
+
+  if (planeMask)
+    *planeMask = intersected;
+  return intersected ? INTERSECTING : INSIDE;
+}
+
+/*! Returns the Visibility of the sphere of center \p center and radius \p
+radius, both defined in the world coordinate system.
+
+See aaBoxVisibility() for a description of \p planeMask. */
+Camera::Visibility Camera::sphereVisibility(const Vec &center, qreal radius,
+                                            int *planeMask) const {
+  computeFrustumPlanes();
+
+  const int mask = planeMask ? *planeMask : AllFrustumPlanes;
+  int intersected = 0;
+  for (int i = 0; i < 6; ++i) {
+    if (!(mask & (1 << i)))
+      continue;
+
+    const qreal distance =
+        center * frustumPlaneNormal_[i] - frustumPlaneDist_[i];
+    if (distance > radius)
+      return OUTSIDE;
+    if (distance > -radius)
+      intersected |= (1 << i);
+  }
+
+  if (planeMask)
+    *planeMask = intersected;
+  return intersected ? INTERSECTING : INSIDE;
+}
+
+/*! Returns the Visibility of the axis aligned box defined by its two opposite
+corners \p p1 and \p p2, expressed in the world coordinate system.
+
+Only the nearest and the farthest box corners (along the plane normal) are
+considered for each frustum plane, hence the test is much faster than testing
+the 8 corners. It is conservative: a box that intersects two planes outside of
+the frustum is classified as INTERSECTING.
+
+When \p planeMask is not \c NULL, only the frustum planes whose bit is set in
+\c *planeMask are tested (bit \c i corresponds to the plane \c i of
+getFrustumPlanesCoefficients()). On return, \c *planeMask only contains the
+planes that the box intersects. Pass this mask to the children of the box in a
+hierarchy: the planes their parent entirely lies in front of are not tested
+again.
+\code
+void Node::draw(const Camera *camera, int planeMask) const {
+  switch (camera->aaBoxVisibility(min, max, &planeMask)) {
+    case Camera::OUTSIDE : return;
+    case Camera::INSIDE : drawAll(); return;
+    case Camera::INTERSECTING :
+      for (int i = 0; i < nbChildren; ++i)
+        child[i]->draw(camera, planeMask);
+  }
+}
+
+// Called with Camera::AllFrustumPlanes on the root node
+root->draw(camera(), Camera::AllFrustumPlanes);
+\endcode
+See also aaBoxesVisibility() to classify many boxes at once. */
+Camera::Visibility Camera::aaBoxVisibility(const Vec &p1, const Vec &p2,
+                                           int *planeMask) const {
+  const Vec halfSize = (p2 - p1) / 2.0;
+  const Vec axis[3] = {Vec(halfSize.x, 0.0, 0.0), Vec(0.0, halfSize.y, 0.0),
+                       Vec(0.0, 0.0, halfSize.z)};
+  return boxVisibility((p1 + p2) / 2.0, axis, planeMask);
+}
+
+/*! Returns the Visibility of the box defined by its two opposite corners \p p1
+and \p p2, expressed in the \p frame coordinate system.
+
+The box is axis aligned in \p frame, but can have any orientation in the world
+coordinate system. See aaBoxVisibility() for details on \p planeMask. */
+Camera::Visibility Camera::orientedBoxVisibility(const Frame &frame,
+                                                 const Vec &p1, const Vec &p2,
+                                                 int *planeMask) const {
+  const Vec halfSize = (p2 - p1) / 2.0;
+  const Vec axis[3] = {
+      frame.inverseTransformOf(Vec(halfSize.x, 0.0, 0.0)),
+      frame.inverseTransformOf(Vec(0.0, halfSize.y, 0.0)),
+      frame.inverseTransformOf(Vec(0.0, 0.0, halfSize.z))};
+  return boxVisibility(frame.inverseCoordinatesOf((p1 + p2) / 2.0), axis,
+                       planeMask);
+}
+
+/*! Classifies \p nb axis aligned boxes at once. Box \c i is defined by its
+opposite corners \p p1[i] and \p p2[i] and its Visibility is stored in \p
+visibility[i]. All the boxes are tested against the \p planeMask planes (see
+aaBoxVisibility()).
+
+The frustum planes are fetched once for all the boxes, which makes this method
+faster than successive aaBoxVisibility() calls on large arrays. Pairs of boxes
+are classified with SSE2 or NEON (64 bit ARM) when available. */
+void Camera::aaBoxesVisibility(int nb, const Vec p1[], const Vec p2[],
+                               Visibility visibility[], int planeMask) const {
+  computeFrustumPlanes();
+
+  // Only the tested planes, with their normal absolute values
+  Vec normal[6], absNormal[6];
+  qreal dist[6];
+  int nbPlanes = 0;
+  for (int i = 0; i < 6; ++i)
+    if (planeMask & (1 << i)) {
+      normal[nbPlanes] = frustumPlaneNormal_[i];
+      absNormal[nbPlanes] = Vec(fabs(normal[nbPlanes].x),
+                                fabs(normal[nbPlanes].y),
+                                fabs(normal[nbPlanes].z));
+      dist[nbPlanes] = frustumPlaneDist_[i];
+      ++nbPlanes;
+    }
+
+  int b = 0;
+#if defined(QGLVIEWER_CULLING_SSE)
+  // Same operations as the scalar path (halving by 0.5 is exact), on two
+  // boxes at a time. A box is OUTSIDE if any plane rejects it, INTERSECTING if
+  // any plane crosses it. The plane loop stops when both boxes are OUTSIDE.
+  const __m128d half = _mm_set1_pd(0.5), signBit = _mm_set1_pd(-0.0);
+  // Per plane: normal, absolute normal and distance, in both lanes
+  __m128d planes[6][7];
+  for (int i = 0; i < nbPlanes; ++i) {
+    for (int k = 0; k < 3; ++k) {
+      planes[i][k] = _mm_set1_pd(normal[i][k]);
+      planes[i][3 + k] = _mm_set1_pd(absNormal[i][k]);
+    }
+    planes[i][6] = _mm_set1_pd(dist[i]);
+  }
+
+  for (; b + 2 <= nb; b += 2) {
+    __m128d center[3], absHalfSize[3];
+    for (int k = 0; k < 3; ++k) {
+      const __m128d q1 = _mm_set_pd(p1[b + 1][k], p1[b][k]);
+      const __m128d q2 = _mm_set_pd(p2[b + 1][k], p2[b][k]);
+      center[k] = _mm_mul_pd(_mm_add_pd(q1, q2), half);
+      absHalfSize[k] = _mm_andnot_pd(signBit, _mm_sub_pd(q2, center[k]));
+    }
+
+    int outside = 0, intersecting = 0;
+    for (int i = 0; i < nbPlanes && outside != 3; ++i) {
+      const __m128d *plane = planes[i];
+      const __m128d distance = _mm_sub_pd(
+          _mm_add_pd(_mm_add_pd(_mm_mul_pd(center[0], plane[0]),
+                                _mm_mul_pd(center[1], plane[1])),
+                     _mm_mul_pd(center[2], plane[2])),
+          plane[6]);
+      const __m128d radius = _mm_add_pd(
+          _mm_add_pd(_mm_mul_pd(absHalfSize[0], plane[3]),
+                     _mm_mul_pd(absHalfSize[1], plane[4])),
+          _mm_mul_pd(absHalfSize[2], plane[5]));
+      outside |= _mm_movemask_pd(_mm_cmpgt_pd(distance, radius));
+      intersecting |= _mm_movemask_pd(
+          _mm_cmpgt_pd(distance, _mm_xor_pd(radius, signBit)));
+    }
+
+    for (int k = 0; k < 2; ++k)
+      visibility[b + k] =
+          (outside & (1 << k))
+              ? OUTSIDE
+              : ((intersecting & (1 << k)) ? INTERSECTING : INSIDE);
+  }
+#elif defined(QGLVIEWER_CULLING_NEON)
+  const float64x2_t half = vdupq_n_f64(0.5);
+  for (; b + 2 <= nb; b += 2) {
+    float64x2_t center[3], absHalfSize[3];
+    for (int k = 0; k < 3; ++k) {
+      const double c1[2] = {p1[b][k], p1[b + 1][k]};
+      const double c2[2] = {p2[b][k], p2[b + 1][k]};
+      const float64x2_t q2 = vld1q_f64(c2);
+      center[k] = vmulq_f64(vaddq_f64(vld1q_f64(c1), q2), half);
+      absHalfSize[k] = vabsq_f64(vsubq_f64(q2, center[k]));
+    }
+
+    uint64x2_t outside = vdupq_n_u64(0), intersecting = vdupq_n_u64(0);
+    for (int i = 0; i < nbPlanes; ++i) {
+      const float64x2_t distance = vsubq_f64(
+          vaddq_f64(vaddq_f64(vmulq_n_f64(center[0], normal[i].x),
+                              vmulq_n_f64(center[1], normal[i].y)),
+                    vmulq_n_f64(center[2], normal[i].z)),
+          vdupq_n_f64(dist[i]));
+      const float64x2_t radius =
+          vaddq_f64(vaddq_f64(vmulq_n_f64(absHalfSize[0], absNormal[i].x),
+                              vmulq_n_f64(absHalfSize[1], absNormal[i].y)),
+                    vmulq_n_f64(absHalfSize[2], absNormal[i].z));
+      outside = vorrq_u64(outside, vcgtq_f64(distance, radius));
+      intersecting =
+          vorrq_u64(intersecting, vcgtq_f64(distance, vnegq_f64(radius)));
+      if (vgetq_lane_u64(outside, 0) && vgetq_lane_u64(outside, 1))
+        break;
+    }
+
+    const uint64_t out[2] = {vgetq_lane_u64(outside, 0),
+                             vgetq_lane_u64(outside, 1)};
+    const uint64_t in[2] = {vgetq_lane_u64(intersecting, 0),
+                            vgetq_lane_u64(intersecting, 1)};
+    for (int k = 0; k < 2; ++k)
+      visibility[b + k] = out[k] ? OUTSIDE : (in[k] ? INTERSECTING : INSIDE);
+  }
+#endif
+
+  // Scalar path, also used for the last box
+  for (; b < nb; ++b) {
+    const Vec center = (p1[b] + p2[b]) / 2.0;
+    const Vec halfSize = p2[b] - center;
+    const Vec absHalfSize(fabs(halfSize.x), fabs(halfSize.y), fabs(halfSize.z));
+
+    Visibility v = INSIDE;
+    for (int i = 0; i < nbPlanes; ++i) {
+      const qreal distance = center * normal[i] - dist[i];
+      const qreal radius = absHalfSize * absNormal[i];
+      if (distance > radius) {
+        v = OUTSIDE;
+        break;
+      }
+      if (distance > -radius)
+        v = INTERSECTING;
+    }
+    visibility[b] = v;
   }
 }
 
 void Camera::onFrameModified() {
   projectionMatrixIsUpToDate_ = false;
+  frustumPlanesAreUpToDate_ = false;
   modelViewMatrixIsUpToDate_ = false;
 }
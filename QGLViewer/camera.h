@@ -1,9 +1,12 @@
 #ifndef QGLVIEWER_CAMERA_H
 #define QGLVIEWER_CAMERA_H
 
+#include <QAtomicInt>
 #include <QMap>
+#include <QMutex>
 #include "keyFrameInterpolator.h"
 class QGLViewer;
+class QRect;
 
 namespace qglviewer {
 
@@ -67,7 +70,14 @@ class ManipulatedCameraFrame;
 
   A Camera can also be used outside of a QGLViewer or even without OpenGL for
   its coordinate system conversion capabilities. Note however that some of them
-  explicitly rely on the presence of a Z-buffer. \nosubgrouping */
+  explicitly rely on the presence of a Z-buffer.
+
+  The \c const coordinate conversion, projection and matrix query methods are
+  reentrant and can be called concurrently from several threads, as long as no
+  thread modifies the Camera (or its frame()) at the same time. The buffered
+  matrices are computed by the first thread that needs them. Methods that
+  read the OpenGL buffers (pointUnderPixel()...) must be called from the thread
+  of the OpenGL context. \nosubgrouping */
 class QGLVIEWER_EXPORT Camera : public QObject {
 #ifndef DOXYGEN
   friend class ::QGLViewer;
@@ -90,6 +100,17 @@ public:
   affected by this Type. */
   enum Type { PERSPECTIVE, ORTHOGRAPHIC };
 
+  /*! Result of the frustum culling tests, see sphereVisibility() and
+  aaBoxVisibility(). \c OUTSIDE objects are entirely outside of the Camera
+  frustum, \c INSIDE objects are entirely inside. \c INTERSECTING objects
+  intersect at least one frustum plane (and may actually be outside of the
+  frustum, the tests being conservative). */
+  enum Visibility { OUTSIDE, INTERSECTING, INSIDE };
+
+  /*! Frustum plane mask that selects the six planes of the frustum, see
+  aaBoxVisibility(). */
+  enum { AllFrustumPlanes = 0x3F };
+
   /*! @name Position and orientation */
   //@{
 public:
@@ -271,12 +292,51 @@ public Q_SLOTS:
   void setZNearCoefficient(qreal coef) {
     zNearCoef_ = coef;
     projectionMatrixIsUpToDate_ = false;
+    frustumPlanesAreUpToDate_ = false;
   }
   /*! Sets the zClippingCoefficient() value. */
   void setZClippingCoefficient(qreal coef) {
     zClippingCoef_ = coef;
     projectionMatrixIsUpToDate_ = false;
+    frustumPlanesAreUpToDate_ = false;
+  }
+  //@}
+
+  /*! @name Frustum culling */
+  //@{
+public:
+  qreal distanceToFrustumPlane(int index, const Vec &pos) const;
+  Visibility sphereVisibility(const Vec &center, qreal radius,
+                              int *planeMask = NULL) const;
+  /*! Returns \c true when the sphere of center \p center and radius \p
+  radius is not entirely outside of the Camera frustum. See sphereVisibility().
+*/
+  bool sphereIsVisible(const Vec &center, qreal radius) const {
+    return sphereVisibility(center, radius) != OUTSIDE;
   }
+  Visibility aaBoxVisibility(const Vec &p1, const Vec &p2,
+                             int *planeMask = NULL) const;
+  /*! Returns \c true when the axis aligned box of opposite corners \p p1 and
+  \p p2 is not entirely outside of the Camera frustum. When \p entirely is not
+  \c NULL, it is set to \c true if the box is entirely inside the frustum. See
+  aaBoxVisibility(). */
+  bool aaBoxIsVisible(const Vec &p1, const Vec &p2,
+                      bool *entirely = NULL) const {
+    const Visibility v = aaBoxVisibility(p1, p2);
+    if (entirely)
+      *entirely = (v == INSIDE);
+    return v != OUTSIDE;
+  }
+  Visibility orientedBoxVisibility(const Frame &frame, const Vec &p1,
+                                   const Vec &p2, int *planeMask = NULL) const;
+  void aaBoxesVisibility(int nb, const Vec p1[], const Vec p2[],
+                         Visibility visibility[],
+                         int planeMask = AllFrustumPlanes) const;
+
+private:
+  void computeFrustumPlanes() const;
+  Visibility boxVisibility(const Vec &center, const Vec axis[3],
+                           int *planeMask) const;
   //@}
 
   /*! @name Scene radius and center */
@@ -376,6 +436,9 @@ public:
   virtual void loadProjectionMatrixStereo(bool leftBuffer = true) const;
   virtual void loadModelViewMatrixStereo(bool leftBuffer = true) const;
 
+  void getProjectionMatrixStereo(GLdouble left[16], GLdouble right[16]) const;
+  void getModelViewMatrixStereo(GLdouble left[16], GLdouble right[16]) const;
+
   void getProjectionMatrix(GLfloat m[16]) const;
   void getProjectionMatrix(GLdouble m[16]) const;
 
@@ -384,6 +447,12 @@ public:
 
   void getModelViewProjectionMatrix(GLfloat m[16]) const;
   void getModelViewProjectionMatrix(GLdouble m[16]) const;
+
+  void getNormalMatrix(GLfloat m[9]) const;
+  void getNormalMatrix(GLdouble m[9]) const;
+
+  unsigned int modelViewMatrixVersion() const;
+  unsigned int projectionMatrixVersion() const;
 //@}
 
 /*! @name Drawing */
@@ -414,7 +483,23 @@ public:
   void getUnprojectedCoordinatesOf(const qreal src[3], qreal res[3],
                                    const Frame *frame = NULL) const;
   void convertClickToLine(const QPoint &pixel, Vec &orig, Vec &dir) const;
-  Vec pointUnderPixel(const QPoint &pixel, bool &found) const;
+  Vec pointUnderPixel(const QPoint &pixel, bool &found, int radius = 0) const;
+  int pointsUnderPixels(int nbPixels, const QPoint pixels[], Vec points[],
+                        bool found[]) const;
+
+  /*! Returns the radius (in pixels) of the neighborhood in which
+  setPivotPointFromPixel(), setSceneCenterFromPixel() and
+  interpolateToZoomOnPixel() look for a point when the clicked pixel is on the
+  background. See pointUnderPixel().
+
+  This makes it possible to click on thin lines or points. Default value is 2,
+  set using setPixelSearchRadius(). Use 0 to only consider the clicked pixel. */
+  int pixelSearchRadius() const { return pixelSearchRadius_; }
+  /*! Sets the pixelSearchRadius(). */
+  void setPixelSearchRadius(int radius) { pixelSearchRadius_ = radius; }
+
+  void cacheDepthBuffer();
+  void clearDepthBufferCache();
   //@}
 
   /*! @name Fly speed */
@@ -490,19 +575,24 @@ public Q_SLOTS:
   void setFocusDistance(qreal distance) { focusDistance_ = distance; }
   //@}
 
-  /*! @name XML representation */
+  /*! @name XML and binary representations */
   //@{
 public:
   virtual QDomElement domElement(const QString &name,
                                  QDomDocument &document) const;
+  virtual void writeToStream(QDataStream &stream) const;
 public Q_SLOTS:
   virtual void initFromDOMElement(const QDomElement &element);
+  virtual void readFromStream(QDataStream &stream);
   //@}
 
 private Q_SLOTS:
   void onFrameModified();
 
 private:
+  void initMatrices();
+  void computeModelViewProjectionMatrix() const;
+
   // F r a m e
   ManipulatedCameraFrame *frame_;
 
@@ -516,9 +606,33 @@ private:
   qreal orthoCoef_;
   Type type_;                            // PERSPECTIVE or ORTHOGRAPHIC
   mutable GLdouble modelViewMatrix_[16]; // Buffered model view matrix.
-  mutable bool modelViewMatrixIsUpToDate_;
+  mutable QAtomicInt modelViewMatrixIsUpToDate_;
   mutable GLdouble projectionMatrix_[16]; // Buffered projection matrix.
-  mutable bool projectionMatrixIsUpToDate_;
+  mutable QAtomicInt projectionMatrixIsUpToDate_;
+
+  // M a t r i x   c a c h e
+  mutable GLfloat modelViewMatrixf_[16];  // float versions, updated with
+  mutable GLfloat projectionMatrixf_[16]; // the double ones
+  mutable GLdouble modelViewProjectionMatrix_[16];
+  mutable GLfloat modelViewProjectionMatrixf_[16];
+  mutable QAtomicInt modelViewProjectionMatrixIsUpToDate_;
+  mutable unsigned int modelViewMatrixVersion_, projectionMatrixVersion_;
+
+  // F r u s t u m   p l a n e s
+  mutable Vec frustumPlaneNormal_[6]; // Buffered plane equations, see
+  mutable qreal frustumPlaneDist_[6]; // computeFrustumPlanes()
+  mutable QAtomicInt frustumPlanesAreUpToDate_;
+
+  //  Serializes the lazy computation of the buffers above by concurrent const
+  // readers. The IsUpToDate_ flags are read without locking.
+  mutable QMutex buffersMutex_;
+
+  // D e p t h   b u f f e r   c a c h e
+  struct DepthCache;
+  struct DepthRegion;
+  bool readDepthRegion(const QRect &rect, DepthRegion &region) const;
+  DepthCache *depthCache_; // NULL until cacheDepthBuffer() is called
+  int pixelSearchRadius_;
 
   // S t e r e o   p a r a m e t e r s
   qreal IODistance_;          // inter-ocular distance, in meters
@@ -0,0 +1,367 @@
+#include "coreProfileRenderer.h"
+#include "camera.h"
+
+#include <QFont>
+#include <QFontMetrics>
+#include <QImage>
+#include <QOpenGLContext>
+#include <QOpenGLTexture>
+#include <QPainter>
+
+#include <string.h> // memcpy
+
+#ifndef GL_UNIFORM_BUFFER
+#define GL_UNIFORM_BUFFER 0x8A11
+#endif
+#ifndef GL_INVALID_INDEX
+#define GL_INVALID_INDEX 0xFFFFFFFFu
+#endif
+
+using namespace qglviewer;
+
+// std140 layout: three mat4 followed by a mat3, stored as three vec4 columns
+static const int matricesBufferSize = (3 * 16 + 3 * 4) * sizeof(GLfloat);
+
+// #CONNECTION# Declaration given in QGLViewer::coreProfileIsEnabled()
+static const char *const matricesBlock =
+    "layout(std140) uniform QGLViewerMatrices {\n"
+    "  mat4 modelView;\n"
+    "  mat4 projection;\n"
+    "  mat4 modelViewProjection;\n"
+    "  mat3 normalMatrix;\n"
+    "};\n";
+
+static const char *const linesVertexShader =
+    "in vec3 vertex;\n"
+    "void main() {\n"
+    "  gl_Position = modelViewProjection * vec4(vertex, 1.0);\n"
+    "}\n";
+
+static const char *const linesFragmentShader =
+    "#version 140\n"
+    "uniform vec4 color;\n"
+    "out vec4 fragColor;\n"
+    "void main() { fragColor = color; }\n";
+
+// Text quads are given in pixels, origin in the upper left corner
+static const char *const textVertexShader =
+    "#version 140\n"
+    "uniform vec2 viewportSize;\n"
+    "in vec2 vertex;\n"
+    "in vec2 texCoord;\n"
+    "out vec2 uv;\n"
+    "void main() {\n"
+    "  uv = texCoord;\n"
+    "  gl_Position = vec4(2.0 * vertex.x / viewportSize.x - 1.0,\n"
+    "                     1.0 - 2.0 * vertex.y / viewportSize.y, 0.0, 1.0);\n"
+    "}\n";
+
+static const char *const textFragmentShader =
+    "#version 140\n"
+    "uniform sampler2D text;\n"
+    "in vec2 uv;\n"
+    "out vec4 fragColor;\n"
+    "void main() { fragColor = texture(text, uv); }\n";
+
+// Cached text textures are all released when this number is reached
+static const int maxNbTextTextures = 32;
+
+CoreProfileRenderer::CoreProfileRenderer()
+    : context_(NULL), bindBufferBase_(NULL), getUniformBlockIndex_(NULL),
+      uniformBlockBinding_(NULL), matricesBuffer_(QOpenGLBuffer::VertexBuffer),
+      camera_(NULL), modelViewMatrixVersion_(0), projectionMatrixVersion_(0),
+      vertexBuffer_(QOpenGLBuffer::VertexBuffer) {}
+
+CoreProfileRenderer::~CoreProfileRenderer() {
+  Q_FOREACH (const TextTexture &text, textTextures_)
+    delete text.texture;
+}
+
+/* Creates the OpenGL resources in the current context. Returns false (with a
+warning) if the context does not support uniform buffers and GLSL 1.40. */
+bool CoreProfileRenderer::initialize() {
+  context_ = QOpenGLContext::currentContext();
+  if (!context_)
+    return false;
+  initializeOpenGLFunctions();
+
+  bindBufferBase_ = reinterpret_cast<BindBufferBaseFunction>(
+      context_->getProcAddress("glBindBufferBase"));
+  getUniformBlockIndex_ = reinterpret_cast<GetUniformBlockIndexFunction>(
+      context_->getProcAddress("glGetUniformBlockIndex"));
+  uniformBlockBinding_ = reinterpret_cast<UniformBlockBindingFunction>(
+      context_->getProcAddress("glUniformBlockBinding"));
+  if (!bindBufferBase_ || !getUniformBlockIndex_ || !uniformBlockBinding_) {
+    qWarning("Core profile mode requires OpenGL 3.1 uniform buffers");
+    return false;
+  }
+
+  const QByteArray linesVertex =
+      QByteArray("#version 140\n") + matricesBlock + linesVertexShader;
+  linesProgram_.addShaderFromSourceCode(QOpenGLShader::Vertex, linesVertex);
+  linesProgram_.addShaderFromSourceCode(QOpenGLShader::Fragment,
+                                        linesFragmentShader);
+  linesProgram_.bindAttributeLocation("vertex", 0);
+  textProgram_.addShaderFromSourceCode(QOpenGLShader::Vertex,
+                                       textVertexShader);
+  textProgram_.addShaderFromSourceCode(QOpenGLShader::Fragment,
+                                       textFragmentShader);
+  textProgram_.bindAttributeLocation("vertex", 0);
+  textProgram_.bindAttributeLocation("texCoord", 1);
+  if (!linesProgram_.link() || !textProgram_.link()) {
+    qWarning("Unable to compile the core profile shader programs");
+    return false;
+  }
+  bindMatricesUniformBlock(linesProgram_.programId());
+
+  matricesBuffer_.create();
+  glBindBuffer(GL_UNIFORM_BUFFER, matricesBuffer_.bufferId());
+  glBufferData(GL_UNIFORM_BUFFER, matricesBufferSize, NULL, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  bindBufferBase_(GL_UNIFORM_BUFFER, matricesBinding,
+                  matricesBuffer_.bufferId());
+
+  vertexArray_.create();
+  vertexBuffer_.setUsagePattern(QOpenGLBuffer::DynamicDraw);
+  vertexBuffer_.create();
+  return true;
+}
+
+/* Binds the QGLViewerMatrices uniform block of the program to the matrices
+buffer. */
+bool CoreProfileRenderer::bindMatricesUniformBlock(GLuint programId) {
+  const GLuint index = getUniformBlockIndex_(programId, "QGLViewerMatrices");
+  if (index == GL_INVALID_INDEX) {
+    qWarning("No QGLViewerMatrices uniform block in shader program %u",
+             programId);
+    return false;
+  }
+  uniformBlockBinding_(programId, index, matricesBinding);
+  return true;
+}
+
+void CoreProfileRenderer::uploadMatrices(const GLfloat modelView[16],
+                                         const GLfloat projection[16],
+                                         const GLfloat modelViewProjection[16],
+                                         const GLfloat normal[9]) {
+  GLfloat data[3 * 16 + 3 * 4];
+  memcpy(data, modelView, 16 * sizeof(GLfloat));
+  memcpy(data + 16, projection, 16 * sizeof(GLfloat));
+  memcpy(data + 32, modelViewProjection, 16 * sizeof(GLfloat));
+  for (int j = 0; j < 3; ++j) {
+    for (int i = 0; i < 3; ++i)
+      data[48 + 4 * j + i] = normal[3 * j + i];
+    data[48 + 4 * j + 3] = 0.0f;
+  }
+
+  glBindBuffer(GL_UNIFORM_BUFFER, matricesBuffer_.bufferId());
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, matricesBufferSize, data);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+/* Uploads the camera matrices, unless they are already in the buffer (see
+Camera::modelViewMatrixVersion()). */
+void CoreProfileRenderer::setCameraMatrices(const Camera *camera) {
+  if ((camera == camera_) &&
+      (camera->modelViewMatrixVersion() == modelViewMatrixVersion_) &&
+      (camera->projectionMatrixVersion() == projectionMatrixVersion_))
+    return;
+
+  GLfloat modelView[16], projection[16], modelViewProjection[16], normal[9];
+  camera->getModelViewMatrix(modelView);
+  camera->getProjectionMatrix(projection);
+  camera->getModelViewProjectionMatrix(modelViewProjection);
+  camera->getNormalMatrix(normal);
+  uploadMatrices(modelView, projection, modelViewProjection, normal);
+
+  camera_ = camera;
+  modelViewMatrixVersion_ = camera->modelViewMatrixVersion();
+  projectionMatrixVersion_ = camera->projectionMatrixVersion();
+}
+
+/* Uploads arbitrary matrices (stereo views, screen coordinates). modelView
+must be a rigid transformation. */
+void CoreProfileRenderer::setMatrices(const GLdouble modelView[16],
+                                      const GLdouble projection[16]) {
+  GLfloat mv[16], proj[16], mvp[16], normal[9];
+  for (int i = 0; i < 4; ++i)
+    for (int j = 0; j < 4; ++j) {
+      qreal sum = 0.0;
+      for (int k = 0; k < 4; ++k)
+        sum += projection[i + 4 * k] * modelView[k + 4 * j];
+      mvp[i + 4 * j] = GLfloat(sum);
+      mv[i + 4 * j] = GLfloat(modelView[i + 4 * j]);
+      proj[i + 4 * j] = GLfloat(projection[i + 4 * j]);
+    }
+  for (int j = 0; j < 3; ++j)
+    for (int i = 0; i < 3; ++i)
+      normal[3 * j + i] = mv[4 * j + i];
+
+  uploadMatrices(mv, proj, mvp, normal);
+  camera_ = NULL;
+}
+
+/* Same as glOrtho(left, right, bottom, top, 0.0, -1.0) with an identity
+modelView matrix. See QGLViewer::startScreenCoordinatesSystem(). */
+void CoreProfileRenderer::setScreenMatrices(qreal left, qreal right,
+                                            qreal bottom, qreal top) {
+  GLdouble modelView[16], projection[16];
+  for (int i = 0; i < 16; ++i)
+    modelView[i] = projection[i] = ((i % 5 == 0) ? 1.0 : 0.0);
+  projection[0] = 2.0 / (right - left);
+  projection[5] = 2.0 / (top - bottom);
+  projection[10] = 2.0;
+  projection[12] = -(right + left) / (right - left);
+  projection[13] = -(top + bottom) / (top - bottom);
+  projection[14] = -1.0;
+  setMatrices(modelView, projection);
+}
+
+/* Draws vertices (x,y,z triplets) with a uniform color. Wide lines are not
+available in core profile, line width is always 1 pixel. */
+void CoreProfileRenderer::drawLines(GLenum mode,
+                                    const QVector<GLfloat> &vertices,
+                                    const QColor &color) {
+  if (vertices.isEmpty())
+    return;
+
+  linesProgram_.bind();
+  linesProgram_.setUniformValue("color", color);
+  vertexArray_.bind();
+  vertexBuffer_.bind();
+  vertexBuffer_.allocate(vertices.constData(),
+                         vertices.size() * int(sizeof(GLfloat)));
+  linesProgram_.enableAttributeArray(0);
+  linesProgram_.setAttributeBuffer(0, GL_FLOAT, 0, 3);
+  glDrawArrays(mode, 0, vertices.size() / 3);
+  vertexBuffer_.release();
+  vertexArray_.release();
+  linesProgram_.release();
+}
+
+// Same geometry as QGLViewer::drawGrid()
+void CoreProfileRenderer::drawGrid(qreal size, int nbSubdivisions,
+                                   const QColor &color) {
+  QVector<GLfloat> vertices;
+  vertices.reserve(12 * (nbSubdivisions + 1));
+  for (int i = 0; i <= nbSubdivisions; ++i) {
+    const GLfloat pos = GLfloat(size * (2.0 * i / nbSubdivisions - 1.0));
+    const GLfloat s = GLfloat(size);
+    vertices << pos << -s << 0.0f << pos << s << 0.0f;
+    vertices << -s << pos << 0.0f << s << pos << 0.0f;
+  }
+  drawLines(GL_LINES, vertices, color);
+}
+
+/* Same as QGLViewer::drawAxis(), with lines instead of shaded arrows. */
+void CoreProfileRenderer::drawAxis(qreal length, const QColor &letterColor) {
+  const GLfloat l = GLfloat(length);
+  const GLfloat w = GLfloat(length / 40.0);
+  const GLfloat h = GLfloat(length / 30.0);
+  const GLfloat s = GLfloat(1.04 * length);
+
+  QVector<GLfloat> letters;
+  // The X
+  letters << s << w << -h << s << -w << h;
+  letters << s << -w << -h << s << w << h;
+  // The Y
+  letters << w << s << h << 0.0f << s << 0.0f;
+  letters << -w << s << h << 0.0f << s << 0.0f;
+  letters << 0.0f << s << 0.0f << 0.0f << s << -h;
+  // The Z
+  letters << -w << h << s << w << h << s;
+  letters << w << h << s << -w << -h << s;
+  letters << -w << -h << s << w << -h << s;
+  drawLines(GL_LINES, letters, letterColor);
+
+  QVector<GLfloat> axis(6, 0.0f);
+  for (int i = 0; i < 3; ++i) {
+    axis[3 + ((i + 2) % 3)] = 0.0f;
+    axis[3 + i] = l;
+    // Same colors as the drawAxis() arrows
+    drawLines(GL_LINES, axis,
+              QColor::fromRgbF(i == 0 ? 1.0 : 0.7, i == 1 ? 1.0 : 0.7,
+                               i == 2 ? 1.0 : 0.7));
+  }
+}
+
+/* Draws text at x, y (pixels, origin in the upper left corner, y on the
+baseline). The text is rendered once with QPainter in a texture, which is kept
+in a cache. */
+void CoreProfileRenderer::drawText(int x, int y, const QString &text,
+                                   const QFont &font, const QColor &color,
+                                   const QSize &viewportSize) {
+  if (text.isEmpty())
+    return;
+
+  const QString key = text + QChar('\n') + font.key() + QChar('\n') +
+                      QString::number(color.rgba());
+  if (!textTextures_.contains(key)) {
+    if (textTextures_.size() >= maxNbTextTextures) {
+      Q_FOREACH (const TextTexture &cached, textTextures_)
+        delete cached.texture;
+      textTextures_.clear();
+    }
+
+    const QFontMetrics metrics(font);
+    TextTexture textTexture;
+    textTexture.rect = metrics.boundingRect(text).adjusted(-1, -1, 1, 1);
+    QImage image(textTexture.rect.size(), QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::transparent);
+    QPainter painter(&image);
+    painter.setFont(font);
+    painter.setPen(color);
+    painter.drawText(-textTexture.rect.left(), -textTexture.rect.top(), text);
+    painter.end();
+
+    textTexture.texture =
+        new QOpenGLTexture(image, QOpenGLTexture::DontGenerateMipMaps);
+    textTexture.texture->setMinificationFilter(QOpenGLTexture::Linear);
+    textTexture.texture->setMagnificationFilter(QOpenGLTexture::Linear);
+    textTexture.texture->setWrapMode(QOpenGLTexture::ClampToEdge);
+    textTextures_.insert(key, textTexture);
+  }
+  const TextTexture &textTexture = textTextures_[key];
+
+  const QRect r = textTexture.rect.translated(x, y);
+  // Triangle strip, image top row has texture coordinate 0
+  const GLfloat vertices[] = {
+      GLfloat(r.left()),      GLfloat(r.top()),        0.0f, 0.0f,
+      GLfloat(r.left()),      GLfloat(r.bottom() + 1), 0.0f, 1.0f,
+      GLfloat(r.right() + 1), GLfloat(r.top()),        1.0f, 0.0f,
+      GLfloat(r.right() + 1), GLfloat(r.bottom() + 1), 1.0f, 1.0f};
+
+  // Blending state is restored after the draw
+  const GLboolean blend = glIsEnabled(GL_BLEND);
+  GLint blendFunc[4];
+  glGetIntegerv(GL_BLEND_SRC_RGB, &blendFunc[0]);
+  glGetIntegerv(GL_BLEND_DST_RGB, &blendFunc[1]);
+  glGetIntegerv(GL_BLEND_SRC_ALPHA, &blendFunc[2]);
+  glGetIntegerv(GL_BLEND_DST_ALPHA, &blendFunc[3]);
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+  textProgram_.bind();
+  textProgram_.setUniformValue("viewportSize", QSizeF(viewportSize));
+  textProgram_.setUniformValue("text", 0);
+  glActiveTexture(GL_TEXTURE0);
+  textTexture.texture->bind();
+  vertexArray_.bind();
+  vertexBuffer_.bind();
+  vertexBuffer_.allocate(vertices, int(sizeof(vertices)));
+  textProgram_.enableAttributeArray(0);
+  textProgram_.enableAttributeArray(1);
+  textProgram_.setAttributeBuffer(0, GL_FLOAT, 0, 2, 4 * sizeof(GLfloat));
+  textProgram_.setAttributeBuffer(1, GL_FLOAT, 2 * sizeof(GLfloat), 2,
+                                  4 * sizeof(GLfloat));
+  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+  vertexBuffer_.release();
+  vertexArray_.release();
+  textTexture.texture->release();
+  textProgram_.release();
+
+  glBlendFuncSeparate(GLenum(blendFunc[0]), GLenum(blendFunc[1]),
+                      GLenum(blendFunc[2]), GLenum(blendFunc[3]));
+  if (!blend)
+    glDisable(GL_BLEND);
+}
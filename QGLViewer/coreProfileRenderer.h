@@ -0,0 +1,92 @@
+#ifndef QGLVIEWER_CORE_PROFILE_RENDERER_H
+#define QGLVIEWER_CORE_PROFILE_RENDERER_H
+
+#include "config.h"
+
+#include <QColor>
+#include <QHash>
+#include <QOpenGLBuffer>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLVertexArrayObject>
+#include <QRect>
+#include <QVector>
+
+class QFont;
+class QOpenGLContext;
+class QOpenGLTexture;
+
+namespace qglviewer {
+class Camera;
+
+#ifndef DOXYGEN
+/* Replaces the fixed function pipeline when QGLViewer::coreProfileIsEnabled().
+
+The camera matrices are stored in a uniform buffer (the QGLViewerMatrices
+uniform block), which is shared with the user's shader programs. Visual hints
+and text are drawn with small private shader programs. All the methods must be
+called with the context() current. Not part of the installed API. */
+class CoreProfileRenderer : protected QOpenGLFunctions {
+public:
+  CoreProfileRenderer();
+  ~CoreProfileRenderer();
+
+  bool initialize();
+  QOpenGLContext *context() const { return context_; }
+
+  // M a t r i c e s   u n i f o r m   b u f f e r
+  static const GLuint matricesBinding = 0;
+  void setCameraMatrices(const Camera *camera);
+  void setMatrices(const GLdouble modelView[16],
+                   const GLdouble projection[16]);
+  void setScreenMatrices(qreal left, qreal right, qreal bottom, qreal top);
+  bool bindMatricesUniformBlock(GLuint programId);
+
+  // D r a w i n g ,   w i t h   t h e   c u r r e n t   m a t r i c e s
+  void drawLines(GLenum mode, const QVector<GLfloat> &vertices,
+                 const QColor &color);
+  void drawGrid(qreal size, int nbSubdivisions, const QColor &color);
+  void drawAxis(qreal length, const QColor &letterColor);
+  void drawText(int x, int y, const QString &text, const QFont &font,
+                const QColor &color, const QSize &viewportSize);
+
+private:
+  void uploadMatrices(const GLfloat modelView[16], const GLfloat projection[16],
+                      const GLfloat modelViewProjection[16],
+                      const GLfloat normal[9]);
+
+  QOpenGLContext *context_;
+
+  // Uniform buffer functions, not provided by QOpenGLFunctions
+  typedef void(QOPENGLF_APIENTRYP BindBufferBaseFunction)(GLenum, GLuint,
+                                                          GLuint);
+  typedef GLuint(QOPENGLF_APIENTRYP GetUniformBlockIndexFunction)(
+      GLuint, const char *);
+  typedef void(QOPENGLF_APIENTRYP UniformBlockBindingFunction)(GLuint, GLuint,
+                                                               GLuint);
+  BindBufferBaseFunction bindBufferBase_;
+  GetUniformBlockIndexFunction getUniformBlockIndex_;
+  UniformBlockBindingFunction uniformBlockBinding_;
+
+  // M a t r i c e s
+  QOpenGLBuffer matricesBuffer_;
+  const Camera *camera_; // whose matrices are in the buffer, NULL otherwise
+  unsigned int modelViewMatrixVersion_, projectionMatrixVersion_;
+
+  // P r o g r a m s   a n d   g e o m e t r y
+  QOpenGLShaderProgram linesProgram_, textProgram_;
+  QOpenGLVertexArrayObject vertexArray_;
+  QOpenGLBuffer vertexBuffer_;
+
+  // T e x t   c a c h e
+  struct TextTexture {
+    QOpenGLTexture *texture;
+    QRect rect; // relative to the drawText() position, on the baseline
+  };
+  QHash<QString, TextTexture> textTextures_;
+};
+#endif
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_CORE_PROFILE_RENDERER_H
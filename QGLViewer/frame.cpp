@@ -1,15 +1,38 @@
 #include "frame.h"
 #include "domUtils.h"
+#include "batchTransform.h"
+#include <QAtomicInt>
+#include <QThreadStorage>
 #include <math.h>
+#include <string.h>
 
 using namespace qglviewer;
 using namespace std;
 
+// The matrices returned by matrix() and worldMatrix(), one per thread
+struct FrameMatrixBuffer {
+  GLdouble m[4][4];
+};
+static QThreadStorage<FrameMatrixBuffer> matrixBuffer;
+static QThreadStorage<FrameMatrixBuffer> worldMatrixBuffer;
+
+// The buffered matrices, and the versions they were computed for
+struct Frame::MatrixCache {
+  unsigned int version, worldVersion;
+  GLdouble matrix[16], worldMatrix[16];
+  GLfloat matrixf[16], worldMatrixf[16];
+};
+
+// Last value given to a Frame version(), shared by all the Frames
+static QAtomicInt lastVersion;
+
 /*! Creates a default Frame.
 
   Its position() is (0,0,0) and it has an identity orientation() Quaternion. The
   referenceFrame() and the constraint() are \c NULL. */
-Frame::Frame() : constraint_(NULL), referenceFrame_(NULL) {}
+Frame::Frame()
+    : constraint_(NULL), referenceFrame_(NULL), version_(0),
+      matrixCache_(NULL) {}
 
 /*! Creates a Frame with a position() and an orientation().
 
@@ -19,7 +42,11 @@ Frame::Frame() : constraint_(NULL), referenceFrame_(NULL) {}
  The Frame is defined in the world coordinate system (its referenceFrame() is \c
  NULL). It has a \c NULL associated constraint(). */
 Frame::Frame(const Vec &position, const Quaternion &orientation)
-    : t_(position), q_(orientation), constraint_(NULL), referenceFrame_(NULL) {}
+    : t_(position), q_(orientation), constraint_(NULL), referenceFrame_(NULL),
+      version_(0), matrixCache_(NULL) {}
+
+/*! Virtual destructor. */
+Frame::~Frame() { delete matrixCache_; }
 
 /*! Equal operator.
 
@@ -39,7 +66,11 @@ Frame &Frame::operator=(const Frame &frame) {
 
   The translation() and rotation() as well as constraint() and referenceFrame()
   pointers are copied. */
-Frame::Frame(const Frame &frame) : QObject() { (*this) = frame; }
+Frame::Frame(const Frame &frame)
+    : QObject(), constraint_(NULL), referenceFrame_(NULL), version_(0),
+      matrixCache_(NULL) {
+  (*this) = frame;
+}
 
 /////////////////////////////// MATRICES //////////////////////////////////////
 
@@ -85,9 +116,9 @@ Frame::Frame(const Frame &frame) : QObject() { (*this) = frame; }
   transformation matrix (i.e. from the world to the Frame coordinate system).
   These two match when the referenceFrame() is \c NULL.
 
-  The result is only valid until the next call to matrix(), getMatrix(),
-  worldMatrix() or getWorldMatrix(). Use it immediately (as above) or use
-  getMatrix() instead.
+  The result is only valid until the next call to matrix() in the same thread.
+  Use it immediately (as above) or use getMatrix() instead. The matrix is
+  buffered, and only recomputed when the Frame is modified (see version()).
 
   \attention The OpenGL format of the result is the transpose of the actual
   mathematical European representation (translation is on the last \e line
@@ -95,29 +126,29 @@ Frame::Frame(const Frame &frame) : QObject() { (*this) = frame; }
 
   \note The scaling factor of the 4x4 matrix is 1.0. */
 const GLdouble *Frame::matrix() const {
-  static GLdouble m[4][4];
+  GLdouble(&m)[4][4] = matrixBuffer.localData().m;
   getMatrix(m);
   return (const GLdouble *)(m);
 }
 
 /*! \c GLdouble[4][4] version of matrix(). See also getWorldMatrix() and
  * matrix(). */
-void Frame::getMatrix(GLdouble m[4][4]) const {
-  q_.getMatrix(m);
-
-  m[3][0] = t_[0];
-  m[3][1] = t_[1];
-  m[3][2] = t_[2];
-}
+void Frame::getMatrix(GLdouble m[4][4]) const { getMatrix((GLdouble *)(m)); }
 
 /*! \c GLdouble[16] version of matrix(). See also getWorldMatrix() and matrix().
  */
 void Frame::getMatrix(GLdouble m[16]) const {
-  q_.getMatrix(m);
+  QMutexLocker locker(&matrixCacheMutex_);
+  updateMatrixCache();
+  memcpy(m, matrixCache_->matrix, sizeof(matrixCache_->matrix));
+}
 
-  m[12] = t_[0];
-  m[13] = t_[1];
-  m[14] = t_[2];
+/*! \c GLfloat[16] version of matrix(), typically given to a shader \c mat4
+ uniform. The float matrix is buffered with the double one. */
+void Frame::getMatrix(GLfloat m[16]) const {
+  QMutexLocker locker(&matrixCacheMutex_);
+  updateMatrixCache();
+  memcpy(m, matrixCache_->matrixf, sizeof(matrixCache_->matrixf));
 }
 
 /*! Returns a Frame representing the inverse of the Frame space transformation.
@@ -165,38 +196,103 @@ Frame Frame::inverse() const {
   European representation (translation is on the last \e line instead of the
   last \e column).
 
-  \attention The result is only valid until the next call to matrix(),
-  getMatrix(), worldMatrix() or getWorldMatrix(). Use it immediately (as above)
-  or use getWorldMatrix() instead.
+  The matrix is buffered, and only recomputed when the Frame or one of its
+  referenceFrame() is modified (see worldVersion()).
+
+  \attention The result is only valid until the next call to worldMatrix() in
+  the same thread. Use it immediately (as above) or use getWorldMatrix()
+  instead.
 
   \note The scaling factor of the 4x4 matrix is 1.0. */
 const GLdouble *Frame::worldMatrix() const {
-  // This test is done for efficiency reasons (creates lots of temp objects
-  // otherwise).
-  if (referenceFrame()) {
-    static Frame fr;
-    fr.setTranslation(position());
-    fr.setRotation(orientation());
-    return fr.matrix();
-  } else
-    return matrix();
+  GLdouble(&m)[4][4] = worldMatrixBuffer.localData().m;
+  getWorldMatrix(m);
+  return (const GLdouble *)(m);
 }
 
 /*! qreal[4][4] parameter version of worldMatrix(). See also getMatrix() and
  * matrix(). */
 void Frame::getWorldMatrix(GLdouble m[4][4]) const {
-  const GLdouble *mat = worldMatrix();
-  for (int i = 0; i < 4; ++i)
-    for (int j = 0; j < 4; ++j)
-      m[i][j] = mat[i * 4 + j];
+  getWorldMatrix((GLdouble *)(m));
 }
 
 /*! qreal[16] parameter version of worldMatrix(). See also getMatrix() and
  * matrix(). */
 void Frame::getWorldMatrix(GLdouble m[16]) const {
-  const GLdouble *mat = worldMatrix();
-  for (int i = 0; i < 16; ++i)
-    m[i] = mat[i];
+  QMutexLocker locker(&matrixCacheMutex_);
+  updateMatrixCache();
+  memcpy(m, matrixCache_->worldMatrix, sizeof(matrixCache_->worldMatrix));
+}
+
+/*! \c GLfloat[16] version of worldMatrix(), typically given to a shader \c
+ mat4 uniform. Compare worldVersion() with the value saved at the last upload
+ to know whether the uniform needs to be updated:
+ \code
+ if (frame->worldVersion() != uploadedVersion_) {
+   GLfloat m[16];
+   frame->getWorldMatrix(m);
+   program_.setUniformValue("model", QMatrix4x4(m).transposed());
+   uploadedVersion_ = frame->worldVersion();
+ }
+ \endcode */
+void Frame::getWorldMatrix(GLfloat m[16]) const {
+  QMutexLocker locker(&matrixCacheMutex_);
+  updateMatrixCache();
+  memcpy(m, matrixCache_->worldMatrixf, sizeof(matrixCache_->worldMatrixf));
+}
+
+/*! Returns a number that increases each time the Frame or one of its
+  referenceFrame() is modified, or when the referenceFrame() hierarchy changes.
+
+  This is the version of getWorldMatrix(), while version() only reflects the
+  local matrix(). All the Frames share the same increasing counter, so that
+  the largest version() of the referenceFrame() hierarchy, which is returned,
+  increases whenever one of them changes. */
+unsigned int Frame::worldVersion() const {
+  unsigned int res = version_;
+  for (const Frame *f = referenceFrame(); f; f = f->referenceFrame())
+    res = qMax(res, f->version_);
+  return res;
+}
+
+// Returns a new version(), larger than all the previous ones of all the Frames.
+unsigned int Frame::nextVersion() {
+  return (unsigned int)(lastVersion.fetchAndAddRelaxed(1)) + 1;
+}
+
+// Recomputes the buffered matrices whose version is outdated. Must be called
+// with matrixCacheMutex_ locked.
+void Frame::updateMatrixCache() const {
+  const bool created = (matrixCache_ == NULL);
+  if (created)
+    matrixCache_ = new MatrixCache;
+  MatrixCache &cache = *matrixCache_;
+
+  if (created || (cache.version != version_)) {
+    q_.getMatrix(cache.matrix);
+    cache.matrix[12] = t_[0];
+    cache.matrix[13] = t_[1];
+    cache.matrix[14] = t_[2];
+    for (int i = 0; i < 16; ++i)
+      cache.matrixf[i] = GLfloat(cache.matrix[i]);
+    cache.version = version_;
+  }
+
+  const unsigned int world = worldVersion();
+  if (created || (cache.worldVersion != world)) {
+    // Same as the local matrix without referenceFrame()
+    if (referenceFrame()) {
+      orientation().getMatrix(cache.worldMatrix);
+      const Vec t = position();
+      cache.worldMatrix[12] = t[0];
+      cache.worldMatrix[13] = t[1];
+      cache.worldMatrix[14] = t[2];
+    } else
+      memcpy(cache.worldMatrix, cache.matrix, sizeof(cache.matrix));
+    for (int i = 0; i < 16; ++i)
+      cache.worldMatrixf[i] = GLfloat(cache.worldMatrix[i]);
+    cache.worldVersion = world;
+  }
 }
 
 /*! This is an overloaded method provided for convenience. Same as
@@ -215,6 +311,7 @@ void Frame::setFromMatrix(const GLdouble m[4][4]) {
       rot[i][j] = m[j][i] / m[3][3];
   }
   q_.setFromRotationMatrix(rot);
+  version_ = nextVersion();
   Q_EMIT modified();
 }
 
@@ -306,6 +403,7 @@ void Frame::translate(Vec &t) {
   if (constraint())
     constraint()->constrainTranslation(t, this);
   t_ += t;
+  version_ = nextVersion();
   Q_EMIT modified();
 }
 
@@ -346,6 +444,7 @@ void Frame::rotate(Quaternion &q) {
     constraint()->constrainRotation(q, this);
   q_ *= q;
   q_.normalize(); // Prevents numerical drift
+  version_ = nextVersion();
   Q_EMIT modified();
 }
 
@@ -390,6 +489,7 @@ void Frame::rotateAroundPoint(Quaternion &rotation, const Vec &point) {
   if (constraint())
     constraint()->constrainTranslation(trans, this);
   t_ += trans;
+  version_ = nextVersion();
   Q_EMIT modified();
 }
 
@@ -436,6 +536,7 @@ void Frame::setPositionAndOrientation(const Vec &position,
     t_ = position;
     q_ = orientation;
   }
+  version_ = nextVersion();
   Q_EMIT modified();
 }
 
@@ -448,6 +549,7 @@ void Frame::setTranslationAndRotation(const Vec &translation,
                                       const Quaternion &rotation) {
   t_ = translation;
   q_ = rotation;
+  version_ = nextVersion();
   Q_EMIT modified();
 }
 
@@ -543,8 +645,8 @@ void Frame::setRotationWithConstraint(Quaternion &rotation) {
   // Prevent numerical drift
   deltaQ.normalize();
 
-  setRotation(this->rotation() * deltaQ);
-  q_.normalize();
+  // Normalized before setRotation(), which updates version()
+  setRotation((this->rotation() * deltaQ).normalized());
   rotation = this->rotation();
 }
 
@@ -570,6 +672,7 @@ void Frame::setTranslationAndRotationWithConstraint(Vec &translation,
   translation = this->translation();
   rotation = this->rotation();
 
+  version_ = nextVersion();
   Q_EMIT modified();
 }
 
@@ -627,8 +730,10 @@ void Frame::setReferenceFrame(const Frame *const refFrame) {
   else {
     bool identical = (referenceFrame_ == refFrame);
     referenceFrame_ = refFrame;
-    if (!identical)
+    if (!identical) {
+      version_ = nextVersion();
       Q_EMIT modified();
+    }
   }
 }
 
@@ -775,6 +880,78 @@ void Frame::getCoordinatesOfFrom(const qreal src[3], qreal res[3],
     res[i] = r[i];
 }
 
+#ifndef DOXYGEN
+// The world to Frame transformation, composed along the referenceFrame() chain
+static BatchTransform worldToFrame(const Frame *frame) {
+  const Quaternion q = frame->orientation().inverse();
+  return BatchTransform(q, -q.rotate(frame->position()));
+}
+#endif
+
+/*! Converts \p nbPoints points from the world coordinate system to the Frame
+coordinate system, like coordinatesOf(const Vec&) does for a single point.
+
+Coordinates are interleaved: \p src and \p res contain 3 * \p nbPoints
+values (x0 y0 z0 x1 y1 z1...). \p res may be equal to \p src. The Frame
+hierarchy is composed once for the whole array, which is then transformed with
+SIMD instructions when possible (see Quaternion::rotate(int, const float*,
+float*) const). Use this method to transform large point sets such as mesh
+vertices. */
+void Frame::coordinatesOf(int nbPoints, const float *src, float *res) const {
+  worldToFrame(this).apply(nbPoints, src, res);
+}
+
+/*! Same as coordinatesOf(int, const float*, float*) const, with double
+ * precision coordinates. */
+void Frame::coordinatesOf(int nbPoints, const double *src, double *res) const {
+  worldToFrame(this).apply(nbPoints, src, res);
+}
+
+/*! Same as coordinatesOf(int, const float*, float*) const, but the x, y and z
+coordinates are stored in three separate arrays, respectively \p src[0], \p
+src[1] and \p src[2] (and similarly for \p res). */
+void Frame::coordinatesOf(int nbPoints, const float *const src[3],
+                          float *const res[3]) const {
+  worldToFrame(this).apply(nbPoints, src, res);
+}
+
+/*! Same as coordinatesOf(int, const float *const[3], float *const[3]) const,
+ * with double precision coordinates. */
+void Frame::coordinatesOf(int nbPoints, const double *const src[3],
+                          double *const res[3]) const {
+  worldToFrame(this).apply(nbPoints, src, res);
+}
+
+/*! Converts \p nbPoints points from the Frame coordinate system to the world
+coordinate system. Array version of inverseCoordinatesOf(const Vec&), see
+coordinatesOf(int, const float*, float*) const for details. */
+void Frame::inverseCoordinatesOf(int nbPoints, const float *src,
+                                 float *res) const {
+  BatchTransform(orientation(), position()).apply(nbPoints, src, res);
+}
+
+/*! Same as inverseCoordinatesOf(int, const float*, float*) const, with double
+ * precision coordinates. */
+void Frame::inverseCoordinatesOf(int nbPoints, const double *src,
+                                 double *res) const {
+  BatchTransform(orientation(), position()).apply(nbPoints, src, res);
+}
+
+/*! Same as inverseCoordinatesOf(int, const float*, float*) const, with
+separate coordinate arrays. See coordinatesOf(int, const float *const[3], float
+*const[3]) const. */
+void Frame::inverseCoordinatesOf(int nbPoints, const float *const src[3],
+                                 float *const res[3]) const {
+  BatchTransform(orientation(), position()).apply(nbPoints, src, res);
+}
+
+/*! Same as inverseCoordinatesOf(int, const float *const[3], float *const[3])
+ * const, with double precision coordinates. */
+void Frame::inverseCoordinatesOf(int nbPoints, const double *const src[3],
+                                 double *const res[3]) const {
+  BatchTransform(orientation(), position()).apply(nbPoints, src, res);
+}
+
 ///////////////////////// FRAME TRANSFORMATIONS OF VECTORS
 /////////////////////////////////
 
@@ -966,6 +1143,32 @@ void Frame::initFromDOMElement(const QDomElement &element) {
   }
 }
 
+/*! Writes the Frame state in a binary \c QDataStream.
+
+ This is the binary equivalent of domElement(), used by
+ QGLViewer::saveStateToFile() when the QGLViewer::stateFileName() has a \c
+ .qglb extension. The position() and orientation() are written as \c double
+ values. Use readFromStream() to restore the Frame state.
+
+ \attention As with domElement(), the constraint() and referenceFrame() are not
+ saved. */
+void Frame::writeToStream(QDataStream &stream) const {
+  stream << position() << orientation();
+}
+
+/*! Restores the Frame state from a binary \c QDataStream created by
+ writeToStream().
+
+ The Frame is not modified if the \p stream is corrupted. The constraint() and
+ referenceFrame() are left unchanged. */
+void Frame::readFromStream(QDataStream &stream) {
+  Vec pos;
+  Quaternion ori;
+  stream >> pos >> ori;
+  if (stream.status() == QDataStream::Ok)
+    setPositionAndOrientation(pos, ori.normalized());
+}
+
 /////////////////////////////////   ALIGN   /////////////////////////////////
 
 /*! Aligns the Frame with \p frame, so that two of their axis are parallel.
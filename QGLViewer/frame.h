@@ -1,6 +1,7 @@
 #ifndef QGLVIEWER_FRAME_H
 #define QGLVIEWER_FRAME_H
 
+#include <QMutex>
 #include <QObject>
 #include <QString>
 
@@ -108,6 +109,12 @@ namespace qglviewer {
   convertion, so that a Frame (and hence an object) can be manipulated in the
   scene with the mouse.
 
+  <h3>Threads</h3>
+
+  The \c const methods (coordinate system conversions, matrix() queries...)
+  are reentrant: several threads can query the same Frame hierarchy, as long
+  as none of them modifies it.
+
   \nosubgrouping */
 class QGLVIEWER_EXPORT Frame : public QObject {
   Q_OBJECT
@@ -115,8 +122,7 @@ class QGLVIEWER_EXPORT Frame : public QObject {
 public:
   Frame();
 
-  /*! Virtual destructor. Empty. */
-  virtual ~Frame() {}
+  virtual ~Frame();
 
   Frame(const Frame &frame);
   Frame &operator=(const Frame &frame);
@@ -196,6 +202,7 @@ public:
   of the Frame. */
   void setTranslation(const Vec &translation) {
     t_ = translation;
+    version_ = nextVersion();
     Q_EMIT modified();
   }
   void setTranslation(qreal x, qreal y, qreal z);
@@ -213,6 +220,7 @@ public:
    setRotationWithConstraint() instead. */
   void setRotation(const Quaternion &rotation) {
     q_ = rotation;
+    version_ = nextVersion();
     Q_EMIT modified();
   }
   void setRotation(qreal q0, qreal q1, qreal q2, qreal q3);
@@ -295,6 +303,19 @@ public:
   void alignWithFrame(const Frame *const frame, bool move = false,
                       qreal threshold = 0.0);
   void projectOnLine(const Vec &origin, const Vec &direction);
+
+  /*! Returns a number that increases each time the Frame is modified, i.e.
+  each time the modified() signal is emitted.
+
+  Save this value and compare it later to know whether the Frame was modified
+  in between, without connecting to the modified() signal. This is typically
+  used to skip computations that depend on the Frame (culling, sorting, shader
+  uniforms...) when it did not move. Modifications of the referenceFrame() are
+  not taken into account, use worldVersion() instead.
+
+  See also Camera::modelViewMatrixVersion(). */
+  unsigned int version() const { return version_; }
+  unsigned int worldVersion() const;
   //@}
 
   /*! @name Coordinate system transformation of 3D coordinates */
@@ -314,6 +335,20 @@ public:
                           const Frame *const in) const;
   void getCoordinatesOfFrom(const qreal src[3], qreal res[3],
                             const Frame *const from) const;
+
+  void coordinatesOf(int nbPoints, const float *src, float *res) const;
+  void coordinatesOf(int nbPoints, const double *src, double *res) const;
+  void coordinatesOf(int nbPoints, const float *const src[3],
+                     float *const res[3]) const;
+  void coordinatesOf(int nbPoints, const double *const src[3],
+                     double *const res[3]) const;
+  void inverseCoordinatesOf(int nbPoints, const float *src, float *res) const;
+  void inverseCoordinatesOf(int nbPoints, const double *src,
+                            double *res) const;
+  void inverseCoordinatesOf(int nbPoints, const float *const src[3],
+                            float *const res[3]) const;
+  void inverseCoordinatesOf(int nbPoints, const double *const src[3],
+                            double *const res[3]) const;
   //@}
 
   /*! @name Coordinate system transformation of vectors */
@@ -383,10 +418,12 @@ public:
   const GLdouble *matrix() const;
   void getMatrix(GLdouble m[4][4]) const;
   void getMatrix(GLdouble m[16]) const;
+  void getMatrix(GLfloat m[16]) const;
 
   const GLdouble *worldMatrix() const;
   void getWorldMatrix(GLdouble m[4][4]) const;
   void getWorldMatrix(GLdouble m[16]) const;
+  void getWorldMatrix(GLfloat m[16]) const;
 
   void setFromMatrix(const GLdouble m[4][4]);
   void setFromMatrix(const GLdouble m[16]);
@@ -411,16 +448,21 @@ public:
   }
   //@}
 
-  /*! @name XML representation */
+  /*! @name XML and binary representations */
   //@{
 public:
   virtual QDomElement domElement(const QString &name,
                                  QDomDocument &document) const;
+  virtual void writeToStream(QDataStream &stream) const;
 public Q_SLOTS:
   virtual void initFromDOMElement(const QDomElement &element);
+  virtual void readFromStream(QDataStream &stream);
   //@}
 
 private:
+  static unsigned int nextVersion();
+  void updateMatrixCache() const;
+
   // P o s i t i o n   a n d   o r i e n t a t i o n
   Vec t_;
   Quaternion q_;
@@ -430,6 +472,14 @@ private:
 
   // F r a m e   c o m p o s i t i o n
   const Frame *referenceFrame_;
+
+  // M o d i f i c a t i o n s   c o u n t e r
+  unsigned int version_;
+
+  // M a t r i x   c a c h e
+  struct MatrixCache;
+  mutable MatrixCache *matrixCache_; // NULL until a matrix is queried
+  mutable QMutex matrixCacheMutex_;  // serializes concurrent const readers
 };
 
 } // namespace qglviewer
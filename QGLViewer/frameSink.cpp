@@ -0,0 +1,369 @@
+#include "frameSink.h"
+
+#include <QBuffer>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QtEndian>
+
+using namespace qglviewer;
+
+namespace qglviewer {
+#ifndef DOXYGEN
+// Encodes one frame in a FrameSink thread pool thread.
+class FrameEncoder : public QRunnable {
+public:
+  FrameEncoder(FrameSink *sink, int index, const QImage &image)
+      : sink_(sink), index_(index), image_(image) {}
+
+  virtual void run() {
+    if (image_.size() != QSize(sink_->width(), sink_->height()))
+      image_ = image_.scaled(sink_->width(), sink_->height(),
+                             Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    const QByteArray data = sink_->encodeFrame(image_);
+    image_ = QImage();
+    sink_->frameEncoded(index_, data);
+    sink_->pendingFrameSlots_.release();
+  }
+
+private:
+  FrameSink *const sink_;
+  const int index_;
+  QImage image_;
+};
+#endif
+} // namespace qglviewer
+
+////////////////////////////////////////////////////////////////////////////////
+//                           F r a m e S i n k                                //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Creates a closed FrameSink. Use open() to start a new video file. */
+FrameSink::FrameSink()
+    : width_(0), height_(0), frameRate_(0), error_(false), nbAddedFrames_(0),
+      nbWrittenFrames_(0) {
+  // Two frames per thread: one being encoded, one waiting
+  pendingFrameSlots_.release(2 * threadPool_.maxThreadCount());
+}
+
+/*! Waits for the frames being encoded. Derived classes must close() the file
+in their destructor, since writeTrailer() can not be called here. */
+FrameSink::~FrameSink() {
+  threadPool_.waitForDone();
+  file_.close();
+}
+
+/*! Creates the video file \p fileName and writes its header. Its frames will
+be \p width x \p height pixels, displayed at \p frameRate frames per second.
+
+Returns \c false if the file cannot be created. A previously opened file is
+first close()d. */
+bool FrameSink::open(const QString &fileName, int width, int height,
+                     int frameRate) {
+  if (isOpen())
+    close();
+
+  if ((width <= 0) || (height <= 0) || (frameRate <= 0)) {
+    qWarning("FrameSink::open: invalid frame size or rate");
+    return false;
+  }
+
+  width_ = width;
+  height_ = height;
+  frameRate_ = frameRate;
+  error_ = false;
+  nbAddedFrames_ = 0;
+  nbWrittenFrames_ = 0;
+
+  file_.setFileName(fileName);
+  if (!file_.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qWarning("Unable to create video file %s",
+             fileName.toLocal8Bit().constData());
+    return false;
+  }
+
+  if (!writeHeader(file_)) {
+    qWarning("Unable to write video file %s header",
+             fileName.toLocal8Bit().constData());
+    file_.close();
+    return false;
+  }
+
+  return true;
+}
+
+/*! Adds \p image at the end of the video. Images that do not have the
+width() and height() dimensions are scaled.
+
+The image is encoded in a worker thread and this method returns immediately,
+unless too many frames are already waiting to be encoded. Ignored when the
+FrameSink is not isOpen(). */
+void FrameSink::addFrame(const QImage &image) {
+  if (!isOpen())
+    return;
+
+  pendingFrameSlots_.acquire();
+  threadPool_.start(new FrameEncoder(this, nbAddedFrames_++, image));
+}
+
+/*! Waits until all the added frames are written, completes the file (see
+writeTrailer()) and closes it.
+
+Returns \c false if an error occurred while the file was written. */
+bool FrameSink::close() {
+  if (!isOpen())
+    return false;
+
+  threadPool_.waitForDone();
+  const bool ok = (!error_) && writeTrailer(file_);
+  file_.close();
+  return ok;
+}
+
+/*! Writes the encoded \p data of a frame at the end of \p file. Frames are
+written in the order they were added, one at a time.
+
+Default implementation simply writes \p data. Returns \c false on error. */
+bool FrameSink::writeFrame(QFile &file, const QByteArray &data) {
+  return file.write(data) == data.size();
+}
+
+// Called by the encoding threads. Frames are written as soon as all the
+// previous ones have been written.
+void FrameSink::frameEncoded(int index, const QByteArray &data) {
+  QMutexLocker locker(&writeMutex_);
+  encodedFrames_.insert(index, data);
+  while (encodedFrames_.contains(nbWrittenFrames_)) {
+    const QByteArray frame = encodedFrames_.take(nbWrittenFrames_);
+    if ((!error_) && (!writeFrame(file_, frame))) {
+      qWarning("Unable to write frame %d in video file %s", nbWrittenFrames_,
+               file_.fileName().toLocal8Bit().constData());
+      error_ = true;
+    }
+    ++nbWrittenFrames_;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                        Y 4 M F r a m e S i n k                             //
+////////////////////////////////////////////////////////////////////////////////
+
+bool Y4MFrameSink::writeHeader(QFile &file) {
+  const QByteArray header =
+      QString("YUV4MPEG2 W%1 H%2 F%3:1 Ip A1:1 C420jpeg\n")
+          .arg(width())
+          .arg(height())
+          .arg(frameRate())
+          .toLatin1();
+  return file.write(header) == header.size();
+}
+
+// Full range BT.601 conversion (JFIF), with 8 bits fixed point coefficients.
+QByteArray Y4MFrameSink::encodeFrame(const QImage &image) const {
+  const QImage rgb = image.convertToFormat(QImage::Format_RGB32);
+  const int w = rgb.width();
+  const int h = rgb.height();
+  const int cw = (w + 1) / 2;
+  const int ch = (h + 1) / 2;
+
+  static const char frameHeader[] = "FRAME\n";
+  QByteArray data(sizeof(frameHeader) - 1 + w * h + 2 * cw * ch, 0);
+  memcpy(data.data(), frameHeader, sizeof(frameHeader) - 1);
+  uchar *Y = reinterpret_cast<uchar *>(data.data()) + sizeof(frameHeader) - 1;
+  uchar *Cb = Y + w * h;
+  uchar *Cr = Cb + cw * ch;
+
+  for (int y = 0; y < h; ++y) {
+    const QRgb *line = reinterpret_cast<const QRgb *>(rgb.constScanLine(y));
+    for (int x = 0; x < w; ++x)
+      *Y++ = uchar((77 * qRed(line[x]) + 150 * qGreen(line[x]) +
+                    29 * qBlue(line[x]) + 128) >>
+                   8);
+  }
+
+  // Chroma of the average color of each 2x2 block
+  for (int y = 0; y < ch; ++y) {
+    const QRgb *line0 =
+        reinterpret_cast<const QRgb *>(rgb.constScanLine(2 * y));
+    const QRgb *line1 = reinterpret_cast<const QRgb *>(
+        rgb.constScanLine(qMin(2 * y + 1, h - 1)));
+    for (int x = 0; x < cw; ++x) {
+      const int x0 = 2 * x;
+      const int x1 = qMin(2 * x + 1, w - 1);
+      const int r = qRed(line0[x0]) + qRed(line0[x1]) + qRed(line1[x0]) +
+                    qRed(line1[x1]);
+      const int g = qGreen(line0[x0]) + qGreen(line0[x1]) +
+                    qGreen(line1[x0]) + qGreen(line1[x1]);
+      const int b = qBlue(line0[x0]) + qBlue(line0[x1]) + qBlue(line1[x0]) +
+                    qBlue(line1[x1]);
+      // Sums of 4 pixels: divide by 4 * 256
+      *Cb++ = uchar(qBound(0, (-43 * r - 85 * g + 128 * b + 512) / 1024 + 128,
+                           255));
+      *Cr++ = uchar(qBound(0, (128 * r - 107 * g - 21 * b + 512) / 1024 + 128,
+                           255));
+    }
+  }
+
+  return data;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                      M J P E G F r a m e S i n k                           //
+////////////////////////////////////////////////////////////////////////////////
+
+static void appendFourCC(QByteArray &data, const char fourCC[5]) {
+  data.append(fourCC, 4);
+}
+
+static void appendUInt32(QByteArray &data, quint32 value) {
+  uchar bytes[4];
+  qToLittleEndian(value, bytes);
+  data.append(reinterpret_cast<const char *>(bytes), 4);
+}
+
+static void appendUInt16(QByteArray &data, quint16 value) {
+  uchar bytes[2];
+  qToLittleEndian(value, bytes);
+  data.append(reinterpret_cast<const char *>(bytes), 2);
+}
+
+// AVI 1.0 header, up to the 'movi' list identifier. nbFrames, moviSize and
+// riffSize are only known when the file is closed, the header is then
+// written again with the same size.
+static QByteArray aviHeader(int width, int height, int frameRate,
+                            quint32 nbFrames, quint32 maxFrameSize,
+                            quint32 moviSize, quint32 riffSize) {
+  QByteArray header;
+  appendFourCC(header, "RIFF");
+  appendUInt32(header, riffSize);
+  appendFourCC(header, "AVI ");
+
+  appendFourCC(header, "LIST");
+  appendUInt32(header, 4 + (8 + 56) + (12 + (8 + 56) + (8 + 40)));
+  appendFourCC(header, "hdrl");
+
+  // Main AVI header
+  appendFourCC(header, "avih");
+  appendUInt32(header, 56);
+  appendUInt32(header, 1000000 / frameRate);       // microseconds per frame
+  appendUInt32(header, maxFrameSize * frameRate); // max bytes per second
+  appendUInt32(header, 0);                        // padding granularity
+  appendUInt32(header, 0x10);                     // AVIF_HASINDEX
+  appendUInt32(header, nbFrames);
+  appendUInt32(header, 0); // initial frames
+  appendUInt32(header, 1); // streams
+  appendUInt32(header, maxFrameSize);
+  appendUInt32(header, width);
+  appendUInt32(header, height);
+  for (int i = 0; i < 4; ++i)
+    appendUInt32(header, 0); // reserved
+
+  // Video stream
+  appendFourCC(header, "LIST");
+  appendUInt32(header, 4 + (8 + 56) + (8 + 40));
+  appendFourCC(header, "strl");
+
+  appendFourCC(header, "strh");
+  appendUInt32(header, 56);
+  appendFourCC(header, "vids");
+  appendFourCC(header, "MJPG");
+  appendUInt32(header, 0); // flags
+  appendUInt16(header, 0); // priority
+  appendUInt16(header, 0); // language
+  appendUInt32(header, 0); // initial frames
+  appendUInt32(header, 1); // scale
+  appendUInt32(header, frameRate);
+  appendUInt32(header, 0); // start
+  appendUInt32(header, nbFrames);
+  appendUInt32(header, maxFrameSize);
+  appendUInt32(header, quint32(-1)); // default quality
+  appendUInt32(header, 0);           // sample size
+  appendUInt16(header, 0);
+  appendUInt16(header, 0);
+  appendUInt16(header, width);
+  appendUInt16(header, height);
+
+  // BITMAPINFOHEADER
+  appendFourCC(header, "strf");
+  appendUInt32(header, 40);
+  appendUInt32(header, 40);
+  appendUInt32(header, width);
+  appendUInt32(header, height);
+  appendUInt16(header, 1);  // planes
+  appendUInt16(header, 24); // bit count
+  appendFourCC(header, "MJPG");
+  appendUInt32(header, width * height * 3);
+  for (int i = 0; i < 4; ++i)
+    appendUInt32(header, 0); // resolution and palette
+
+  appendFourCC(header, "LIST");
+  appendUInt32(header, moviSize);
+  appendFourCC(header, "movi");
+
+  return header;
+}
+
+/*! Creates a closed MJPEGFrameSink, with a quality() of 90. */
+MJPEGFrameSink::MJPEGFrameSink()
+    : quality_(90), moviPosition_(0), maxFrameSize_(0) {}
+
+/*! Closes the file, see FrameSink::close(). */
+MJPEGFrameSink::~MJPEGFrameSink() { close(); }
+
+bool MJPEGFrameSink::writeHeader(QFile &file) {
+  index_.clear();
+  maxFrameSize_ = 0;
+  const QByteArray header =
+      aviHeader(width(), height(), frameRate(), 0, 0, 4, 0);
+  // Offsets in the index are relative to the 'movi' identifier
+  moviPosition_ = header.size() - 4;
+  return file.write(header) == header.size();
+}
+
+QByteArray MJPEGFrameSink::encodeFrame(const QImage &image) const {
+  QByteArray data;
+  QBuffer buffer(&data);
+  buffer.open(QIODevice::WriteOnly);
+  image.save(&buffer, "JPG", quality());
+  return data;
+}
+
+bool MJPEGFrameSink::writeFrame(QFile &file, const QByteArray &data) {
+  // AVI 1.0 offsets and sizes are 32 bits, some readers even use signed ones
+  if (file.pos() + data.size() > (Q_INT64_C(1) << 30)) {
+    qWarning("MJPEGFrameSink: maximum AVI file size reached");
+    return false;
+  }
+
+  index_.append(quint32(file.pos() - moviPosition_));
+  index_.append(quint32(data.size()));
+  maxFrameSize_ = qMax(maxFrameSize_, quint32(data.size()));
+
+  QByteArray chunk;
+  appendFourCC(chunk, "00dc");
+  appendUInt32(chunk, data.size());
+  chunk.append(data);
+  if (data.size() % 2)
+    chunk.append('\0'); // chunks are word aligned
+  return file.write(chunk) == chunk.size();
+}
+
+bool MJPEGFrameSink::writeTrailer(QFile &file) {
+  const quint32 moviSize = quint32(file.pos() - moviPosition_);
+
+  QByteArray idx1;
+  appendFourCC(idx1, "idx1");
+  appendUInt32(idx1, 16 * (index_.size() / 2));
+  for (int i = 0; i < index_.size(); i += 2) {
+    appendFourCC(idx1, "00dc");
+    appendUInt32(idx1, 0x10); // AVIIF_KEYFRAME
+    appendUInt32(idx1, index_[i]);
+    appendUInt32(idx1, index_[i + 1]);
+  }
+  if (file.write(idx1) != idx1.size())
+    return false;
+
+  const QByteArray header =
+      aviHeader(width(), height(), frameRate(), index_.size() / 2,
+                maxFrameSize_, moviSize, quint32(file.pos() - 8));
+  return file.seek(0) && (file.write(header) == header.size());
+}
@@ -0,0 +1,149 @@
+#ifndef QGLVIEWER_FRAME_SINK_H
+#define QGLVIEWER_FRAME_SINK_H
+
+#include "config.h"
+
+#include <QFile>
+#include <QImage>
+#include <QMap>
+#include <QMutex>
+#include <QSemaphore>
+#include <QThreadPool>
+#include <QVector>
+
+namespace qglviewer {
+/*! \brief An abstract video file writer, fed with the frames of a QGLViewer.
+\class FrameSink frameSink.h QGLViewer/frameSink.h
+
+A FrameSink writes a sequence of images in a single video file. Once open(),
+frames are given with addFrame(). Use QGLViewer::setFrameSink() so that the
+viewer's QGLViewer::saveSnapshot() sends its frames to the FrameSink instead of
+saving numbered image files:
+\code
+qglviewer::MJPEGFrameSink sink;
+if (sink.open("movie.avi", viewer->width(), viewer->height(), 25)) {
+  viewer->setFrameSink(&sink);
+  // ... saveSnapshot() is called after each frame (see its documentation)
+  viewer->setFrameSink(NULL);
+  sink.close();
+}
+\endcode
+
+Frames are encoded by encodeFrame() in worker threads, so that addFrame() only
+costs an image copy. The encoded frames are written in the file in the order
+they were added. addFrame() blocks when too many frames are waiting to be
+encoded, which bounds memory usage.
+
+Y4MFrameSink and MJPEGFrameSink are the provided implementations. Derive from
+this class to support an other file format: implement encodeFrame(),
+writeHeader() and optionally writeFrame() and writeTrailer().
+\nosubgrouping */
+class QGLVIEWER_EXPORT FrameSink {
+public:
+  FrameSink();
+  virtual ~FrameSink();
+
+  bool open(const QString &fileName, int width, int height, int frameRate);
+  void addFrame(const QImage &image);
+  bool close();
+
+  /*! Returns \c true between open() and close(). */
+  bool isOpen() const { return file_.isOpen(); }
+  /*! Returns the width of the video frames, as given to open(). Frames of a
+  different size are scaled by addFrame(). */
+  int width() const { return width_; }
+  /*! Returns the height of the video frames, as given to open(). */
+  int height() const { return height_; }
+  /*! Returns the number of frames per second of the video, as given to open().
+   */
+  int frameRate() const { return frameRate_; }
+  /*! Returns the number of frames written in the file so far. */
+  int numberOfFrames() const { return nbWrittenFrames_; }
+
+protected:
+  /*! Encodes \p image, whose dimensions are width() and height(), into the
+  data that writeFrame() will write in the file.
+
+  This method is called in worker threads and must hence be thread-safe. */
+  virtual QByteArray encodeFrame(const QImage &image) const = 0;
+  /*! Writes the file header in \p file. Called by open(). Returns \c false on
+  error. */
+  virtual bool writeHeader(QFile &file) = 0;
+  virtual bool writeFrame(QFile &file, const QByteArray &data);
+  /*! Completes the file when it is closed. Called by close() once all the
+  frames are written. Default implementation does nothing. */
+  virtual bool writeTrailer(QFile &file) {
+    Q_UNUSED(file);
+    return true;
+  }
+
+#ifndef DOXYGEN
+private:
+  friend class FrameEncoder;
+  void frameEncoded(int index, const QByteArray &data);
+
+  QFile file_;
+  int width_, height_, frameRate_;
+  bool error_;
+
+  // Encoding threads and ordered writes
+  QThreadPool threadPool_;
+  QSemaphore pendingFrameSlots_;
+  QMutex writeMutex_;
+  QMap<int, QByteArray> encodedFrames_; // waiting for the previous ones
+  int nbAddedFrames_, nbWrittenFrames_;
+#endif
+};
+
+/*! \brief A FrameSink that writes an uncompressed YUV4MPEG2 (.y4m) stream.
+\class Y4MFrameSink frameSink.h QGLViewer/frameSink.h
+
+Frames are converted to 4:2:0 full range YCbCr (\c C420jpeg). This format is
+read by most video tools (ffmpeg, mpv, x264...), but files are large: use it as
+an intermediate format. */
+class QGLVIEWER_EXPORT Y4MFrameSink : public FrameSink {
+public:
+  /*! Closes the file, see FrameSink::close(). */
+  virtual ~Y4MFrameSink() { close(); }
+
+protected:
+  virtual QByteArray encodeFrame(const QImage &image) const;
+  virtual bool writeHeader(QFile &file);
+};
+
+/*! \brief A FrameSink that writes a Motion-JPEG AVI file.
+\class MJPEGFrameSink frameSink.h QGLViewer/frameSink.h
+
+Each frame is a JPEG image, with the quality(). The file is an AVI 1.0 file,
+with an index, and is hence limited to 1 GB. */
+class QGLVIEWER_EXPORT MJPEGFrameSink : public FrameSink {
+public:
+  MJPEGFrameSink();
+  virtual ~MJPEGFrameSink();
+
+  /*! Returns the JPEG quality of the frames, in 0..100. Default value is 90.
+   */
+  int quality() const { return quality_; }
+  /*! Sets the quality(). Must be called before open(). */
+  void setQuality(int quality) { quality_ = quality; }
+
+protected:
+  virtual QByteArray encodeFrame(const QImage &image) const;
+  virtual bool writeHeader(QFile &file);
+  virtual bool writeFrame(QFile &file, const QByteArray &data);
+  virtual bool writeTrailer(QFile &file);
+
+#ifndef DOXYGEN
+private:
+  int quality_;
+  // Positions of the header values that are only known at the end
+  qint64 moviPosition_;
+  quint32 maxFrameSize_;
+  // idx1 chunk content: offset and size of each frame
+  QVector<quint32> index_;
+#endif
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_FRAME_SINK_H
@@ -0,0 +1,179 @@
+#include "geometrySink.h"
+#include "camera.h"
+
+using namespace qglviewer;
+
+/*! Creates a GeometrySink for a window of \p width x \p height pixels, without
+camera(). Only window coordinates primitives can then be added, until
+setCamera() is called. */
+GeometrySink::GeometrySink(int width, int height)
+    : camera_(NULL), width_(width), height_(height), color_(Qt::black),
+      backgroundColor_(Qt::white), lineWidth_(1.0), pointSize_(1.0),
+      nbPrimitives_(0) {
+  for (int i = 0; i < 16; ++i)
+    modelViewProjection_[i] = (i % 5 == 0) ? 1.0 : 0.0;
+}
+
+/*! Creates a GeometrySink that projects the world coordinates primitives
+using \p camera. See setCamera(). */
+GeometrySink::GeometrySink(const Camera *camera)
+    : camera_(NULL), width_(0), height_(0), color_(Qt::black),
+      backgroundColor_(Qt::white), lineWidth_(1.0), pointSize_(1.0),
+      nbPrimitives_(0) {
+  setCamera(camera);
+}
+
+/*! Sets the camera() used to project the world coordinates primitives.
+
+The current Camera::getModelViewProjectionMatrix() is computed and copied, as
+well as the Camera::screenWidth() and Camera::screenHeight() window size. Call
+this method again if the camera is modified. */
+void GeometrySink::setCamera(const Camera *camera) {
+  camera_ = camera;
+  if (!camera)
+    return;
+
+  camera->computeProjectionMatrix();
+  camera->computeModelViewMatrix();
+  camera->getModelViewProjectionMatrix(modelViewProjection_);
+  width_ = camera->screenWidth();
+  height_ = camera->screenHeight();
+}
+
+/*! Removes all the primitives. The rendering state is not modified. */
+void GeometrySink::clear() {
+  buffer_.clear();
+  nbPrimitives_ = 0;
+}
+
+void GeometrySink::addVertex(const Vec &window) {
+  buffer_ << float(window.x) << float(window.y) << float(window.z)
+          << float(color_.redF()) << float(color_.greenF())
+          << float(color_.blueF()) << float(color_.alphaF());
+}
+
+/*! Adds a point, in window coordinates.
+
+The \c x and \c y coordinates of \p p are in pixels, with the origin in the
+lower left corner of the window (OpenGL convention). \c z is the depth, in
+[0,1], with the same convention as the depth buffer: the sort uses it to
+determine which primitives are hidden. */
+void GeometrySink::addPoint(const Vec &p) {
+  buffer_ << float(GL_POINT_TOKEN);
+  addVertex(p);
+  ++nbPrimitives_;
+}
+
+/*! Adds a segment, in window coordinates. See addPoint(). */
+void GeometrySink::addSegment(const Vec &a, const Vec &b) {
+  buffer_ << float(GL_LINE_TOKEN);
+  addVertex(a);
+  addVertex(b);
+  ++nbPrimitives_;
+}
+
+/*! Adds a triangle, in window coordinates. See addPoint(). */
+void GeometrySink::addTriangle(const Vec &a, const Vec &b, const Vec &c) {
+  buffer_ << float(GL_POLYGON_TOKEN) << 3.0f;
+  addVertex(a);
+  addVertex(b);
+  addVertex(c);
+  ++nbPrimitives_;
+}
+
+void GeometrySink::projectToClip(const Vec &world, double clip[4]) const {
+  const double *m = modelViewProjection_;
+  for (int i = 0; i < 4; ++i)
+    clip[i] = m[i] * world.x + m[4 + i] * world.y + m[8 + i] * world.z +
+              m[12 + i];
+}
+
+// Perspective division and viewport transformation
+void GeometrySink::clipToWindow(const double clip[4], Vec &window) const {
+  window.x = width_ * (clip[0] / clip[3] + 1.0) / 2.0;
+  window.y = height_ * (clip[1] / clip[3] + 1.0) / 2.0;
+  window.z = (clip[2] / clip[3] + 1.0) / 2.0;
+}
+
+// Signed distance to the near plane, in clip coordinates
+static double nearDistance(const double clip[4]) { return clip[2] + clip[3]; }
+
+static void interpolate(const double a[4], const double b[4], double t,
+                        double res[4]) {
+  for (int i = 0; i < 4; ++i)
+    res[i] = a[i] + t * (b[i] - a[i]);
+}
+
+/*! Adds a point, in world coordinates. It is projected using the camera()
+matrices, and ignored when it is in front of the near plane. */
+void GeometrySink::addWorldPoint(const Vec &p) {
+  double clip[4];
+  projectToClip(p, clip);
+  if (nearDistance(clip) < 0.0)
+    return;
+
+  Vec window;
+  clipToWindow(clip, window);
+  addPoint(window);
+}
+
+/*! Adds a segment, in world coordinates. It is projected using the camera()
+matrices and clipped by the near plane. */
+void GeometrySink::addWorldSegment(const Vec &a, const Vec &b) {
+  double clip[2][4];
+  projectToClip(a, clip[0]);
+  projectToClip(b, clip[1]);
+
+  const double da = nearDistance(clip[0]);
+  const double db = nearDistance(clip[1]);
+  if ((da < 0.0) && (db < 0.0))
+    return;
+
+  if (da < 0.0)
+    interpolate(clip[0], clip[1], da / (da - db), clip[0]);
+  else if (db < 0.0)
+    interpolate(clip[1], clip[0], db / (db - da), clip[1]);
+
+  Vec window[2];
+  clipToWindow(clip[0], window[0]);
+  clipToWindow(clip[1], window[1]);
+  addSegment(window[0], window[1]);
+}
+
+/*! Adds a triangle, in world coordinates. It is projected using the camera()
+matrices and clipped by the near plane, which may result in two triangles. */
+void GeometrySink::addWorldTriangle(const Vec &a, const Vec &b, const Vec &c) {
+  double clip[3][4];
+  projectToClip(a, clip[0]);
+  projectToClip(b, clip[1]);
+  projectToClip(c, clip[2]);
+
+  // Sutherland-Hodgman clipping by the near plane: at most 4 vertices remain
+  double polygon[4][4];
+  int nbVertices = 0;
+  for (int i = 0; i < 3; ++i) {
+    const double *current = clip[i];
+    const double *next = clip[(i + 1) % 3];
+    const double dc = nearDistance(current);
+    const double dn = nearDistance(next);
+    if (dc >= 0.0) {
+      for (int k = 0; k < 4; ++k)
+        polygon[nbVertices][k] = current[k];
+      ++nbVertices;
+    }
+    if ((dc >= 0.0) != (dn >= 0.0))
+      interpolate(current, next, dc / (dc - dn), polygon[nbVertices++]);
+  }
+
+  if (nbVertices < 3)
+    return;
+
+  Vec window[4];
+  for (int i = 0; i < nbVertices; ++i)
+    clipToWindow(polygon[i], window[i]);
+
+  // VRender only handles triangles
+  addTriangle(window[0], window[1], window[2]);
+  if (nbVertices == 4)
+    addTriangle(window[0], window[2], window[3]);
+}
@@ -0,0 +1,123 @@
+#ifndef QGLVIEWER_GEOMETRY_SINK_H
+#define QGLVIEWER_GEOMETRY_SINK_H
+
+#include "config.h"
+#include "vec.h"
+
+#include <QColor>
+#include <QVector>
+
+namespace qglviewer {
+class Camera;
+
+/*! \brief Collects the points, segments and triangles of a vectorial snapshot,
+without using OpenGL.
+\class GeometrySink geometrySink.h QGLViewer/geometrySink.h
+
+Vectorial snapshots (see QGLViewer::saveSnapshot()) are by default created by
+rendering the scene again in the deprecated OpenGL feedback mode, which only
+sees the fixed function pipeline primitives. When
+QGLViewer::geometrySinkIsUsed(), QGLViewer::drawVectorial(GeometrySink &) is
+called instead, and sends the scene primitives to a GeometrySink:
+\code
+void Viewer::drawVectorial(qglviewer::GeometrySink &sink) {
+  sink.setColor(Qt::red);
+  for (int i = 0; i < nbTriangles; ++i)
+    sink.addWorldTriangle(vertex[3 * i], vertex[3 * i + 1], vertex[3 * i + 2]);
+}
+\endcode
+This is the only way to create vectorial snapshots of a scene drawn with shader
+programs.
+
+Primitives are either given in world coordinates (addWorldPoint(),
+addWorldSegment() and addWorldTriangle()) and projected using the camera()
+matrices, or already projected in window coordinates (addPoint(), addSegment()
+and addTriangle()). World primitives are clipped by the camera near plane.
+
+The primitives are then sorted and exported by the VRender library as if they
+had been rendered in feedback mode. */
+class QGLVIEWER_EXPORT GeometrySink {
+public:
+  GeometrySink(int width, int height);
+  explicit GeometrySink(const Camera *camera);
+
+  void setCamera(const Camera *camera);
+  /*! Returns the Camera used to project world coordinates primitives, or \c
+  NULL if none was set. */
+  const Camera *camera() const { return camera_; }
+
+  /*! @name Rendering state */
+  //@{
+public:
+  /*! Returns the color of the primitives added from now on. Default value is
+  black. */
+  QColor color() const { return color_; }
+  /*! Sets the color(). */
+  void setColor(const QColor &color) { color_ = color; }
+  /*! Returns the background color, used when the exported image has a
+  background. Default value is white. */
+  QColor backgroundColor() const { return backgroundColor_; }
+  /*! Sets the backgroundColor(). */
+  void setBackgroundColor(const QColor &color) { backgroundColor_ = color; }
+  /*! Returns the width of the exported segments, in pixels. Default value is
+  1.0. */
+  qreal lineWidth() const { return lineWidth_; }
+  /*! Sets the lineWidth(). */
+  void setLineWidth(qreal width) { lineWidth_ = width; }
+  /*! Returns the size of the exported points, in pixels. Default value is 1.0.
+   */
+  qreal pointSize() const { return pointSize_; }
+  /*! Sets the pointSize(). */
+  void setPointSize(qreal size) { pointSize_ = size; }
+  //@}
+
+  /*! @name Primitives */
+  //@{
+public:
+  void addPoint(const Vec &p);
+  void addSegment(const Vec &a, const Vec &b);
+  void addTriangle(const Vec &a, const Vec &b, const Vec &c);
+
+  void addWorldPoint(const Vec &p);
+  void addWorldSegment(const Vec &a, const Vec &b);
+  void addWorldTriangle(const Vec &a, const Vec &b, const Vec &c);
+
+  /*! Returns the number of primitives added since the creation or the last
+  clear(). */
+  int numberOfPrimitives() const { return nbPrimitives_; }
+  void clear();
+  //@}
+
+  /*! @name Internal data */
+  //@{
+public:
+  /*! Returns the primitives, in the OpenGL \c GL_3D_COLOR feedback buffer
+  format. Used by the VRender library. */
+  const QVector<float> &feedbackBuffer() const { return buffer_; }
+  /*! Returns the width of the window, in pixels. */
+  int width() const { return width_; }
+  /*! Returns the height of the window, in pixels. */
+  int height() const { return height_; }
+  //@}
+
+#ifndef DOXYGEN
+private:
+  void addVertex(const Vec &window);
+  void clipToWindow(const double clip[4], Vec &window) const;
+  void projectToClip(const Vec &world, double clip[4]) const;
+
+  const Camera *camera_;
+  double modelViewProjection_[16];
+  int width_, height_;
+
+  QColor color_, backgroundColor_;
+  qreal lineWidth_, pointSize_;
+
+  QVector<float> buffer_;
+  int nbPrimitives_;
+#endif
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_GEOMETRY_SINK_H
@@ -1,6 +1,10 @@
 #include "domUtils.h"
 #include "qglviewer.h" // for QGLViewer::drawAxis and Camera::drawCamera
 
+#include <QMutexLocker>
+#include <QtEndian>
+#include <string.h> // memcpy
+
 using namespace qglviewer;
 using namespace std;
 
@@ -51,9 +55,16 @@ void KeyFrameInterpolator::setFrame(Frame *const frame) {
   interpolationTime() reaches firstTime() or lastTime(), unless
   loopInterpolation() is \c true. */
 void KeyFrameInterpolator::update() {
+  advanceInterpolation(interpolationPeriod());
+}
+
+/*! Same as update(), but interpolationTime() is advanced by \p elapsed
+  milliseconds (times interpolationSpeed()) instead of interpolationPeriod().
+  Used by the QGLViewer::frameClockIsEnabled() frame clock. */
+void KeyFrameInterpolator::advanceInterpolation(qreal elapsed) {
   interpolateAtTime(interpolationTime());
 
-  interpolationTime_ += interpolationSpeed() * interpolationPeriod() / 1000.0;
+  interpolationTime_ += interpolationSpeed() * elapsed / 1000.0;
 
   if (interpolationTime() > keyFrame_.last()->time()) {
     if (loopInterpolation())
@@ -104,6 +115,8 @@ void KeyFrameInterpolator::update() {
   startInterpolation(), or else the interpolation will naturally immediately
   stop. */
 void KeyFrameInterpolator::startInterpolation(int period) {
+  loadPendingKeyFrames();
+
   if (period >= 0)
     setInterpolationPeriod(period);
 
@@ -153,6 +166,8 @@ void KeyFrameInterpolator::addKeyFrame(const Frame *const frame, qreal time) {
   if (!frame)
     return;
 
+  loadPendingKeyFrames();
+
   if (keyFrame_.isEmpty())
     interpolationTime_ = time;
 
@@ -177,6 +192,8 @@ void KeyFrameInterpolator::addKeyFrame(const Frame *const frame, qreal time) {
 
   The keyFrameTime() have to be monotonously increasing over keyFrames. */
 void KeyFrameInterpolator::addKeyFrame(const Frame &frame, qreal time) {
+  loadPendingKeyFrames();
+
   if (keyFrame_.isEmpty())
     interpolationTime_ = time;
 
@@ -199,7 +216,7 @@ void KeyFrameInterpolator::addKeyFrame(const Frame &frame, qreal time) {
  previous keyFrame). */
 void KeyFrameInterpolator::addKeyFrame(const Frame *const frame) {
   qreal time;
-  if (keyFrame_.isEmpty())
+  if (numberOfKeyFrames() == 0)
     time = 0.0;
   else
     time = lastTime() + 1.0;
@@ -214,10 +231,10 @@ void KeyFrameInterpolator::addKeyFrame(const Frame *const frame) {
  there is no previous keyFrame). */
 void KeyFrameInterpolator::addKeyFrame(const Frame &frame) {
   qreal time;
-  if (keyFrame_.isEmpty())
+  if (numberOfKeyFrames() == 0)
     time = 0.0;
   else
-    time = keyFrame_.last()->time() + 1.0;
+    time = lastTime() + 1.0;
 
   addKeyFrame(frame, time);
 }
@@ -227,6 +244,8 @@ void KeyFrameInterpolator::deletePath() {
   stopInterpolation();
   qDeleteAll(keyFrame_);
   keyFrame_.clear();
+  pendingKeyFrames_.clear();
+  keyFramesArePending_ = false;
   pathIsValid_ = false;
   valuesAreValid_ = false;
   currentFrameValid_ = false;
@@ -313,6 +332,7 @@ static void drawCamera(qreal scale) {
   \endcode */
 void KeyFrameInterpolator::drawPath(int mask, int nbFrames, qreal scale) {
   const int nbSteps = 30;
+  loadPendingKeyFrames();
   if (!pathIsValid_) {
     path_.clear();
 
@@ -326,7 +346,7 @@ void KeyFrameInterpolator::drawPath(int mask, int nbFrames, qreal scale) {
       path_.push_back(Frame(keyFrame_.first()->position(),
                             keyFrame_.first()->orientation()));
     else {
-      static Frame fr;
+      Frame fr;
       KeyFrame *kf_[4];
       kf_[0] = keyFrame_.first();
       kf_[1] = kf_[0];
@@ -431,6 +451,7 @@ void KeyFrameInterpolator::updateModifiedFrameValues() {
  addKeyFrame(const Frame* const)), the \e current pointed Frame state is
  returned. */
 Frame KeyFrameInterpolator::keyFrame(int index) const {
+  loadPendingKeyFrames();
   const KeyFrame *const kf = keyFrame_.at(index);
   return Frame(kf->position(), kf->orientation());
 }
@@ -440,9 +461,21 @@ Frame KeyFrameInterpolator::keyFrame(int index) const {
  See also keyFrame(). \p index has to be in the range 0..numberOfKeyFrames()-1.
  */
 qreal KeyFrameInterpolator::keyFrameTime(int index) const {
+  loadPendingKeyFrames();
   return keyFrame_.at(index)->time();
 }
 
+/*! Returns the number of keyFrames used by the interpolation. Use
+ addKeyFrame() to add new keyFrames. */
+int KeyFrameInterpolator::numberOfKeyFrames() const {
+  if (keyFramesArePending_) {
+    // Not decoded yet, unless an other thread is doing it
+    QMutexLocker locker(&pendingKeyFramesMutex_);
+    return keyFrame_.count() + pendingKeyFrames_.size() / PackedKeyFrameSize;
+  }
+  return keyFrame_.count();
+}
+
 /*! Returns the duration of the KeyFrameInterpolator path, expressed in seconds.
 
  Simply corresponds to lastTime() - firstTime(). Returns 0.0 if the path has
@@ -456,6 +489,7 @@ qreal KeyFrameInterpolator::duration() const {
 Returns 0.0 if the path is empty. See also lastTime(), duration() and
 keyFrameTime(). */
 qreal KeyFrameInterpolator::firstTime() const {
+  loadPendingKeyFrames();
   if (keyFrame_.isEmpty())
     return 0.0;
   else
@@ -467,6 +501,7 @@ qreal KeyFrameInterpolator::firstTime() const {
 Returns 0.0 if the path is empty. See also firstTime(), duration() and
 keyFrameTime(). */
 qreal KeyFrameInterpolator::lastTime() const {
+  loadPendingKeyFrames();
   if (keyFrame_.isEmpty())
     return 0.0;
   else
@@ -543,6 +578,7 @@ void KeyFrameInterpolator::updateSplineCache() {
   Frame::interpolated() signal. */
 void KeyFrameInterpolator::interpolateAtTime(qreal time) {
   setInterpolationTime(time);
+  loadPendingKeyFrames();
 
   if ((keyFrame_.isEmpty()) || (!frame()))
     return;
@@ -597,6 +633,7 @@ void KeyFrameInterpolator::interpolateAtTime(qreal time) {
  QGLViewer::saveStateToFile() when a QGLViewer is closed. */
 QDomElement KeyFrameInterpolator::domElement(const QString &name,
                                              QDomDocument &document) const {
+  loadPendingKeyFrames();
   QDomElement de = document.createElement(name);
   int count = 0;
   Q_FOREACH (KeyFrame *kf, keyFrame_) {
@@ -628,6 +665,8 @@ QDomElement KeyFrameInterpolator::domElement(const QString &name,
 void KeyFrameInterpolator::initFromDOMElement(const QDomElement &element) {
   qDeleteAll(keyFrame_);
   keyFrame_.clear();
+  pendingKeyFrames_.clear();
+  keyFramesArePending_ = false;
   QDomElement child = element.firstChild().toElement();
   while (!child.isNull()) {
     if (child.tagName() == "KeyFrame") {
@@ -655,6 +694,105 @@ void KeyFrameInterpolator::initFromDOMElement(const QDomElement &element) {
   stopInterpolation();
 }
 
+/*! Writes the KeyFrameInterpolator state in a binary \c QDataStream.
+
+ This is the binary equivalent of domElement(), used by
+ QGLViewer::saveStateToFile() when the QGLViewer::stateFileName() has a \c
+ .qglb extension. The keyFrames are written as a single packed array of \c
+ double values (position, orientation and time of each keyFrame), that
+ readFromStream() can load without any parsing. */
+void KeyFrameInterpolator::writeToStream(QDataStream &stream) const {
+  stream << double(interpolationTime()) << double(interpolationSpeed())
+         << qint32(interpolationPeriod()) << closedPath()
+         << loopInterpolation();
+
+  // No concurrent loadPendingKeyFrames()
+  QMutexLocker locker(&pendingKeyFramesMutex_);
+  if (keyFramesArePending_) {
+    // Not decoded since it was read: written back as is
+    stream << pendingKeyFrames_;
+    return;
+  }
+
+  QByteArray packed(keyFrame_.count() * PackedKeyFrameSize, Qt::Uninitialized);
+  uchar *data = reinterpret_cast<uchar *>(packed.data());
+  Q_FOREACH (KeyFrame *kf, keyFrame_) {
+    const double values[8] = {kf->position().x,    kf->position().y,
+                              kf->position().z,    kf->orientation()[0],
+                              kf->orientation()[1], kf->orientation()[2],
+                              kf->orientation()[3], kf->time()};
+    for (int i = 0; i < 8; ++i, data += sizeof(double)) {
+      quint64 bits;
+      memcpy(&bits, &values[i], sizeof(double));
+      qToLittleEndian(bits, data);
+    }
+  }
+  stream << packed;
+}
+
+/*! Restores the KeyFrameInterpolator state from a binary \c QDataStream
+ created by writeToStream().
+
+ The keyFrames are not decoded by this method. They are kept in their packed
+ form and only converted when they are first needed (interpolation, path
+ drawing, keyFrame() query...), so that restoring a state file with long
+ Camera paths is fast when these paths are not used. numberOfKeyFrames() is
+ however immediately valid.
+
+ As with initFromDOMElement(), the frame() pointer is not modified. */
+void KeyFrameInterpolator::readFromStream(QDataStream &stream) {
+  deletePath();
+
+  double time, speed;
+  qint32 period;
+  bool closed, loop;
+  QByteArray packed;
+  stream >> time >> speed >> period >> closed >> loop >> packed;
+  if ((stream.status() != QDataStream::Ok) ||
+      (packed.size() % PackedKeyFrameSize != 0)) {
+    qWarning("KeyFrameInterpolator::readFromStream: corrupted data, path not "
+             "restored");
+    return;
+  }
+
+  pendingKeyFrames_ = packed;
+  keyFramesArePending_ = !packed.isEmpty();
+
+  // #CONNECTION# Values cut pasted from constructor
+  setInterpolationTime(time);
+  setInterpolationSpeed(speed);
+  setInterpolationPeriod(period);
+  setClosedPath(closed);
+  setLoopInterpolation(loop);
+}
+
+// Decodes the keyFrames read by readFromStream(), if any. Const readers may
+// call it concurrently: the first one decodes, the others wait.
+void KeyFrameInterpolator::loadPendingKeyFrames() const {
+  if (!keyFramesArePending_)
+    return;
+
+  QMutexLocker locker(&pendingKeyFramesMutex_);
+  if (!keyFramesArePending_) // decoded by an other thread meanwhile
+    return;
+
+  const int nbKeyFrames = pendingKeyFrames_.size() / PackedKeyFrameSize;
+  const uchar *data =
+      reinterpret_cast<const uchar *>(pendingKeyFrames_.constData());
+  for (int k = 0; k < nbKeyFrames; ++k) {
+    double values[8];
+    for (int i = 0; i < 8; ++i, data += sizeof(double)) {
+      const quint64 bits = qFromLittleEndian<quint64>(data);
+      memcpy(&values[i], &bits, sizeof(double));
+    }
+    keyFrame_.append(new KeyFrame(
+        Vec(values[0], values[1], values[2]),
+        Quaternion(values[3], values[4], values[5], values[6]), values[7]));
+  }
+  pendingKeyFrames_.clear();
+  keyFramesArePending_ = false;
+}
+
 #ifndef DOXYGEN
 
 //////////// KeyFrame private class implementation /////////
@@ -669,6 +807,10 @@ KeyFrameInterpolator::KeyFrame::KeyFrame(const Frame *fr, qreal t)
   updateValuesFromPointer();
 }
 
+KeyFrameInterpolator::KeyFrame::KeyFrame(const Vec &pos, const Quaternion &ori,
+                                         qreal t)
+    : p_(pos), q_(ori), time_(t), frame_(NULL) {}
+
 void KeyFrameInterpolator::KeyFrame::updateValuesFromPointer() {
   p_ = frame()->position();
   q_ = frame()->orientation();
@@ -1,6 +1,8 @@
 #ifndef QGLVIEWER_KEY_FRAME_INTERPOLATOR_H
 #define QGLVIEWER_KEY_FRAME_INTERPOLATOR_H
 
+#include <QAtomicInt>
+#include <QMutex>
 #include <QObject>
 #include <QTimer>
 
@@ -12,6 +14,8 @@
 // #include "frame.h"
 // and comment "class Frame;" 3 lines below
 
+class QGLViewer;
+
 namespace qglviewer {
 class Camera;
 class Frame;
@@ -106,11 +110,17 @@ class Frame;
   }
   \endcode
   You may want to temporally disconnect the \c kfi interpolated() signal from
-  the QGLViewer::update() slot before calling this code. \nosubgrouping */
+  the QGLViewer::update() slot before calling this code.
+
+  The \c const methods (keyFrame(), keyFrameTime(), duration()...) can be
+  called concurrently from several threads, as long as none of them modifies
+  the path. \nosubgrouping */
 class QGLVIEWER_EXPORT KeyFrameInterpolator : public QObject {
   // todo closedPath, insertKeyFrames, deleteKeyFrame, replaceKeyFrame
   Q_OBJECT
 
+  friend class ::QGLViewer; // frame clock, see advanceInterpolation()
+
 public:
   KeyFrameInterpolator(Frame *fr = NULL);
   virtual ~KeyFrameInterpolator();
@@ -173,9 +183,7 @@ public Q_SLOTS:
 public:
   Frame keyFrame(int index) const;
   qreal keyFrameTime(int index) const;
-  /*! Returns the number of keyFrames used by the interpolation. Use
-   * addKeyFrame() to add new keyFrames. */
-  int numberOfKeyFrames() const { return keyFrame_.count(); }
+  int numberOfKeyFrames() const;
   qreal duration() const;
   qreal firstTime() const;
   qreal lastTime() const;
@@ -276,12 +284,14 @@ public:
   virtual void drawPath(int mask = 1, int nbFrames = 6, qreal scale = 1.0);
   //@}
 
-  /*! @name XML representation */
+  /*! @name XML and binary representations */
   //@{
 public:
   virtual QDomElement domElement(const QString &name,
                                  QDomDocument &document) const;
   virtual void initFromDOMElement(const QDomElement &element);
+  virtual void writeToStream(QDataStream &stream) const;
+  virtual void readFromStream(QDataStream &stream);
   //@}
 
 private Q_SLOTS:
@@ -301,6 +311,8 @@ private:
   void updateCurrentKeyFrameForTime(qreal time);
   void updateModifiedFrameValues();
   void updateSplineCache();
+  void loadPendingKeyFrames() const;
+  void advanceInterpolation(qreal elapsed);
 
 #ifndef DOXYGEN
   // Internal private KeyFrame representation
@@ -308,6 +320,7 @@ private:
   public:
     KeyFrame(const Frame &fr, qreal t);
     KeyFrame(const Frame *fr, qreal t);
+    KeyFrame(const Vec &pos, const Quaternion &ori, qreal t);
 
     Vec position() const { return p_; }
     Quaternion orientation() const { return q_; }
@@ -329,6 +342,12 @@ private:
 
   // K e y F r a m e s
   mutable QList<KeyFrame *> keyFrame_;
+  // Packed keyFrames read by readFromStream(), decoded on first use
+  enum { PackedKeyFrameSize = 8 * sizeof(double) };
+  mutable QByteArray pendingKeyFrames_;
+  // Read without locking, pendingKeyFrames_ is decoded under the mutex
+  mutable QAtomicInt keyFramesArePending_;
+  mutable QMutex pendingKeyFramesMutex_;
   QMutableListIterator<KeyFrame *> *currentFrame_[4];
   QList<Frame> path_;
 
@@ -162,6 +162,38 @@ void ManipulatedCameraFrame::initFromDOMElement(const QDomElement &element) {
   }
 }
 
+/*! Writes the ManipulatedCameraFrame state in a binary \c QDataStream.
+
+ Appends the ManipulatedCameraFrame specific parameters to
+ ManipulatedFrame::writeToStream(). Use readFromStream() to restore the state.
+ */
+void ManipulatedCameraFrame::writeToStream(QDataStream &stream) const {
+  ManipulatedFrame::writeToStream(stream);
+  stream << double(flySpeed()) << rotatesAroundUpVector()
+         << zoomsOnPivotPoint() << sceneUpVector();
+}
+
+/*! Restores the ManipulatedCameraFrame state from a binary \c QDataStream
+created by writeToStream().
+
+First calls ManipulatedFrame::readFromStream() and then restores the
+ManipulatedCameraFrame specific parameters. */
+void ManipulatedCameraFrame::readFromStream(QDataStream &stream) {
+  ManipulatedFrame::readFromStream(stream);
+
+  double speed;
+  bool aroundUpVector, onPivotPoint;
+  Vec upVector;
+  stream >> speed >> aroundUpVector >> onPivotPoint >> upVector;
+  if (stream.status() != QDataStream::Ok)
+    return;
+
+  setFlySpeed(speed);
+  setRotatesAroundUpVector(aroundUpVector);
+  setZoomsOnPivotPoint(onPivotPoint);
+  setSceneUpVector(upVector);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //                 M o u s e    h a n d l i n g                               //
 ////////////////////////////////////////////////////////////////////////////////
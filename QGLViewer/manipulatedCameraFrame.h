@@ -194,13 +194,15 @@ protected Q_SLOTS:
   virtual void spin();
   //@}
 
-  /*! @name XML representation */
+  /*! @name XML and binary representations */
   //@{
 public:
   virtual QDomElement domElement(const QString &name,
                                  QDomDocument &document) const;
+  virtual void writeToStream(QDataStream &stream) const;
 public Q_SLOTS:
   virtual void initFromDOMElement(const QDomElement &element);
+  virtual void readFromStream(QDataStream &stream);
 //@}
 
 #ifndef DOXYGEN
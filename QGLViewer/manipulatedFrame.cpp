@@ -139,6 +139,39 @@ void ManipulatedFrame::initFromDOMElement(const QDomElement &element) {
   }
 }
 
+/*! Writes the ManipulatedFrame state in a binary \c QDataStream.
+
+ Appends the ManipulatedFrame sensitivities to Frame::writeToStream(). Use
+ readFromStream() to restore the ManipulatedFrame state. */
+void ManipulatedFrame::writeToStream(QDataStream &stream) const {
+  Frame::writeToStream(stream);
+  stream << double(rotationSensitivity()) << double(translationSensitivity())
+         << double(spinningSensitivity()) << double(wheelSensitivity())
+         << double(zoomSensitivity());
+}
+
+/*! Restores the ManipulatedFrame state from a binary \c QDataStream created by
+ writeToStream().
+
+ First calls Frame::readFromStream() and then restores the ManipulatedFrame
+ specific parameters. */
+void ManipulatedFrame::readFromStream(QDataStream &stream) {
+  Frame::readFromStream(stream);
+
+  stopSpinning();
+
+  double rotSens, transSens, spinSens, wheelSens, zoomSens;
+  stream >> rotSens >> transSens >> spinSens >> wheelSens >> zoomSens;
+  if (stream.status() != QDataStream::Ok)
+    return;
+
+  setRotationSensitivity(rotSens);
+  setTranslationSensitivity(transSens);
+  setSpinningSensitivity(spinSens);
+  setWheelSensitivity(wheelSens);
+  setZoomSensitivity(zoomSens);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //                 M o u s e    h a n d l i n g                               //
 ////////////////////////////////////////////////////////////////////////////////
@@ -286,13 +286,15 @@ public:
   virtual void checkIfGrabsMouse(int x, int y, const Camera *const camera);
   //@}
 
-  /*! @name XML representation */
+  /*! @name XML and binary representations */
   //@{
 public:
   virtual QDomElement domElement(const QString &name,
                                  QDomDocument &document) const;
+  virtual void writeToStream(QDataStream &stream) const;
 public Q_SLOTS:
   virtual void initFromDOMElement(const QDomElement &element);
+  virtual void readFromStream(QDataStream &stream);
 //@}
 
 #ifndef DOXYGEN
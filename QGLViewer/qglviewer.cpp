@@ -1,8 +1,10 @@
 #include "qglviewer.h"
 #include "camera.h"
+#include "coreProfileRenderer.h"
 #include "domUtils.h"
 #include "keyFrameInterpolator.h"
 #include "manipulatedCameraFrame.h"
+#include "reprojectionCache.h"
 
 #include <QApplication>
 #include <QDateTime>
@@ -12,6 +14,7 @@
 #include <QImage>
 #include <QMessageBox>
 #include <QMouseEvent>
+#include <QOpenGLContext>
 #include <QPushButton>
 #include <QTabWidget>
 #include <QTextEdit>
@@ -71,6 +74,11 @@ void QGLViewer::defaultConstructor() {
   initializeSnapshotFormats();
   setSnapshotCounter(0);
   setSnapshotQuality(95);
+  setSnapshotsAreAsynchronous(false);
+  snapshotThreadPool_ = NULL;
+  snapshotEncoderSlots_ = NULL;
+  frameSink_ = NULL;
+  setGeometrySinkIsUsed(false);
 
   fpsTime_.start();
   fpsCounter_ = 0;
@@ -92,6 +100,9 @@ void QGLViewer::defaultConstructor() {
   messageTimer_.setSingleShot(true);
   helpWidget_ = NULL;
   setMouseGrabber(NULL);
+  pendingMouseMoveEvent_ = NULL;
+  nbUndrawnMouseMoveEvents_ = 0;
+  setMouseMoveEventsAreCoalesced(true);
 
   setSceneRadius(1.0);
   showEntireScene();
@@ -103,19 +114,25 @@ void QGLViewer::defaultConstructor() {
   setFPSIsDisplayed(false);
   setCameraIsEdited(false);
   setTextIsEnabled(true);
+  stereoLeftBuffer_ = true;
+  stereoDisplayList_ = 0;
   setStereoDisplay(false);
+  setStereoSinglePass(false);
   // Make sure move() is not called, which would call initializeGL()
   fullScreen_ = false;
   setFullScreen(false);
 
   animationTimerId_ = 0;
   stopAnimation();
+  frameClockIsEnabled_ = false;
+  frameClockIsRunning_ = false;
   setAnimationPeriod(40); // 25Hz
 
   selectBuffer_ = NULL;
   setSelectBufferSize(4 * 1000);
   setSelectRegionWidth(3);
   setSelectRegionHeight(3);
+  depthBufferIsCached_ = false;
   setSelectedName(-1);
 
   bufferTextureId_ = 0;
@@ -130,6 +147,26 @@ void QGLViewer::defaultConstructor() {
   setAttribute(Qt::WA_NoSystemBackground);
 
   tileRegion_ = NULL;
+
+  offscreenContext_ = NULL;
+  offscreenSurface_ = NULL;
+  offscreenFrameBuffer_ = NULL;
+  offscreenPaintDevice_ = NULL;
+
+  coreProfileIsEnabled_ = false;
+  coreProfileRenderer_ = NULL;
+  offscreenCoreProfileRenderer_ = NULL;
+
+  fastDrawIsReprojected_ = false;
+  fastDrawRefreshPeriod_ = 8;
+  nbReprojectedFrames_ = 0;
+
+  sceneIsCached_ = false;
+  cachedSceneIsValid_ = false;
+  cachedModelViewVersion_ = cachedProjectionVersion_ = 0;
+  cachedManipulatedFrame_ = NULL;
+  cachedManipulatedFrameVersion_ = 0;
+  sceneCache_ = NULL;
 }
 
 #ifndef DOXYGEN
@@ -197,8 +234,51 @@ QGLViewer::~QGLViewer() {
   QGLViewer::QGLViewerPool_.replace(QGLViewer::QGLViewerPool_.indexOf(this),
                                     NULL);
 
+  waitForPendingSnapshots();
+  delete snapshotThreadPool_;
+  delete snapshotEncoderSlots_;
+
+  if (offscreenContext_) {
+    // The stereo display list was created by renderFrame()
+    offscreenContext_->makeCurrent(offscreenSurface_);
+    if (stereoDisplayList_ != 0)
+      glDeleteLists(stereoDisplayList_, 1);
+    stereoDisplayList_ = 0;
+    delete offscreenCoreProfileRenderer_;
+    delete offscreenPaintDevice_;
+    delete offscreenFrameBuffer_;
+    offscreenContext_->doneCurrent();
+    delete offscreenContext_;
+    delete offscreenSurface_;
+  }
+
+  if (stereoDisplayList_ != 0) {
+    makeCurrent();
+    glDeleteLists(stereoDisplayList_, 1);
+    doneCurrent();
+  }
+
+  if (coreProfileRenderer_) {
+    makeCurrent();
+    delete coreProfileRenderer_;
+    doneCurrent();
+  }
+
+  if (sceneCache_) {
+    makeCurrent();
+    delete sceneCache_;
+    doneCurrent();
+  }
+
+  if (depthBufferIsCached() && isValid()) {
+    makeCurrent();
+    camera()->clearDepthBufferCache();
+    doneCurrent();
+  }
+
   delete camera();
   delete[] selectBuffer_;
+  delete pendingMouseMoveEvent_;
   if (helpWidget()) {
     // Needed for Qt 4 which has no main widget.
     helpWidget()->close();
@@ -240,12 +320,29 @@ glEnable(GL_COLOR_MATERIAL);
 
 If you port an existing application to QGLViewer and your display changes, you
 probably want to disable these flags in init() to get back to a standard OpenGL
-state. */
+state.
+
+When coreProfileIsEnabled(), only \c GL_DEPTH_TEST is enabled and the
+library's shader programs and matrices uniform buffer are created. */
 void QGLViewer::initializeGL() {
-  glEnable(GL_LIGHT0);
-  glEnable(GL_LIGHTING);
-  glEnable(GL_DEPTH_TEST);
-  glEnable(GL_COLOR_MATERIAL);
+  if (coreProfileIsEnabled()) {
+    // Also called when the widget is reparented, with a new context
+    CoreProfileRenderer *&renderer = rendersOffscreen()
+                                         ? offscreenCoreProfileRenderer_
+                                         : coreProfileRenderer_;
+    delete renderer;
+    renderer = new CoreProfileRenderer();
+    if (!renderer->initialize()) {
+      delete renderer;
+      renderer = NULL;
+    }
+    glEnable(GL_DEPTH_TEST);
+  } else {
+    glEnable(GL_LIGHT0);
+    glEnable(GL_LIGHTING);
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_COLOR_MATERIAL);
+  }
 
   // Default colors
   setForegroundColor(QColor(180, 180, 180));
@@ -274,30 +371,61 @@ Calls the following methods, in that order:
 \arg preDraw() (or preDrawStereo() if viewer displaysInStereo()) : places the
 camera in the world coordinate system. \arg draw() (or fastDraw() when the
 camera is manipulated) : main drawing method. Should be overloaded. \arg
-postDraw() : display of visual hints (world axis, FPS...) */
+postDraw() : display of visual hints (world axis, FPS...)
+
+When sceneIsCached() and the scene did not change since the previous frame,
+draw() is replaced by a copy of the previously drawn scene.
+
+In stereo, these methods are called once for each eye, unless
+stereoIsSinglePass(), in which case drawStereo() is called instead.
+
+When mouseMoveEventsAreCoalesced(), the last mouse move event received since
+the previous frame is first applied to the manipulated frame. */
 void QGLViewer::paintGL() {
+  applyPendingMouseMoveEvent();
+
   if (displaysInStereo()) {
-    for (int view = 1; view >= 0; --view) {
-      // Clears screen, set model view matrix with shifted matrix for ith buffer
-      preDrawStereo(view);
-      // Used defined method. Default is empty
-      if (camera()->frame()->isManipulated())
-        fastDraw();
-      else
-        draw();
-      postDraw();
-    }
+    if (stereoIsSinglePass())
+      drawStereo();
+    else
+      for (int view = 1; view >= 0; --view) {
+        // Clears screen, set model view matrix with shifted matrix for ith
+        // buffer
+        preDrawStereo(view);
+        // Used defined method. Default is empty
+        if (camera()->frame()->isManipulated())
+          fastDraw();
+        else
+          draw();
+        postDraw();
+      }
   } else {
     // Clears screen, set model view matrix...
     preDraw();
     // Used defined method. Default calls draw()
     if (camera()->frame()->isManipulated())
       fastDraw();
-    else
+    else if (!restoreCachedScene()) {
       draw();
+      updateSceneCache();
+    }
     // Add visual hints: axis, camera, grid...
     postDraw();
   }
+
+  if (depthBufferIsCached()) {
+    if (displaysInStereo())
+      camera()->clearDepthBufferCache();
+    else
+      camera()->cacheDepthBuffer();
+  }
+
+  if (nbUndrawnMouseMoveEvents_ > 0) {
+    Q_EMIT mouseMoveLatency(nbUndrawnMouseMoveEvents_,
+                            mouseMoveLatencyTimer_.nsecsElapsed() / 1.0e6);
+    nbUndrawnMouseMoveEvents_ = 0;
+  }
+
   Q_EMIT drawFinished(true);
 }
 
@@ -311,15 +439,22 @@ camera()->loadProjectionMatrix();
 camera()->loadModelViewMatrix();
 \endcode
 
+When coreProfileIsEnabled(), the camera matrices are written in the matrices
+uniform buffer instead (only when they changed since the previous frame).
+
 Emits the drawNeeded() signal once this is done (see the <a
 href="../examples/callback.html">callback example</a>). */
 void QGLViewer::preDraw() {
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-  // GL_PROJECTION matrix
-  camera()->loadProjectionMatrix();
-  // GL_MODELVIEW matrix
-  camera()->loadModelViewMatrix();
+  if (coreProfileIsEnabled())
+    loadCoreProfileMatrices();
+  else {
+    // GL_PROJECTION matrix
+    camera()->loadProjectionMatrix();
+    // GL_MODELVIEW matrix
+    camera()->loadModelViewMatrix();
+  }
 
   Q_EMIT drawNeeded();
 }
@@ -336,13 +471,24 @@ overloading illustration.
 The GLContext (color, LIGHTING, BLEND...) is \e not modified by this method, so
 that in draw(), the user can rely on the OpenGL context he defined. Respect this
 convention (by pushing/popping the different attributes) if you overload this
-method. */
+method.
+
+When coreProfileIsEnabled(), the visual hints are drawn with the library's
+shader programs, and only the \c GL_DEPTH_TEST and \c GL_BLEND states are
+saved and restored. */
 void QGLViewer::postDraw() {
+  if (coreProfileIsEnabled()) {
+    postDrawCoreProfile();
+    return;
+  }
+
   // Reset model view matrix to world coordinates origin
   glMatrixMode(GL_MODELVIEW);
   glPushMatrix();
-  camera()->loadModelViewMatrix();
-  // TODO restore model loadProjectionMatrixStereo
+  if (displaysInStereo())
+    camera()->loadModelViewMatrixStereo(stereoLeftBuffer_);
+  else
+    camera()->loadModelViewMatrix();
 
   // Save OpenGL state
   glPushAttrib(GL_ALL_ATTRIB_BITS);
@@ -382,14 +528,7 @@ void QGLViewer::postDraw() {
     drawAxis(camera()->sceneRadius());
   }
 
-  // FPS computation
-  const unsigned int maxCounter = 20;
-  if (++fpsCounter_ == maxCounter) {
-    f_p_s_ = 1000.0 * maxCounter / fpsTime_.restart();
-    fpsString_ = tr("%1Hz", "Frames per seconds, in Hertz")
-                     .arg(f_p_s_, 0, 'f', ((f_p_s_ < 10.0) ? 1 : 0));
-    fpsCounter_ = 0;
-  }
+  updateFPS();
 
   // Restore foregroundColor
   float color[4];
@@ -411,6 +550,47 @@ void QGLViewer::postDraw() {
   glPopMatrix();
 }
 
+// FPS computation, called by postDraw()
+void QGLViewer::updateFPS() {
+  const unsigned int maxCounter = 20;
+  if (++fpsCounter_ == maxCounter) {
+    f_p_s_ = 1000.0 * maxCounter / fpsTime_.restart();
+    fpsString_ = tr("%1Hz", "Frames per seconds, in Hertz")
+                     .arg(f_p_s_, 0, 'f', ((f_p_s_ < 10.0) ? 1 : 0));
+    fpsCounter_ = 0;
+  }
+}
+
+// postDraw() without the fixed function pipeline
+void QGLViewer::postDrawCoreProfile() {
+  updateFPS();
+
+  CoreProfileRenderer *renderer = coreProfileRenderer();
+  if (!renderer)
+    return;
+
+  // draw() may have changed the matrices, with startScreenCoordinatesSystem()
+  loadCoreProfileMatrices();
+  const GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+
+  // Pivot point, line when camera rolls, zoom region
+  drawVisualHints();
+
+  if (gridIsDrawn())
+    renderer->drawGrid(camera()->sceneRadius(), 10, foregroundColor());
+  if (axisIsDrawn())
+    renderer->drawAxis(camera()->sceneRadius(), foregroundColor());
+
+  glDisable(GL_DEPTH_TEST);
+  if (FPSIsDisplayed())
+    displayFPS();
+  if (displayMessage_)
+    drawText(10, height() - 10, message_);
+
+  if (depthTest)
+    glEnable(GL_DEPTH_TEST);
+}
+
 /*! Called before draw() (instead of preDraw()) when viewer displaysInStereo().
 
 Same as preDraw() except that the glDrawBuffer() is set to \c GL_BACK_LEFT or \c
@@ -418,6 +598,8 @@ GL_BACK_RIGHT depending on \p leftBuffer, and it uses
 qglviewer::Camera::loadProjectionMatrixStereo() and
 qglviewer::Camera::loadModelViewMatrixStereo() instead. */
 void QGLViewer::preDrawStereo(bool leftBuffer) {
+  stereoLeftBuffer_ = leftBuffer;
+
   // Set buffer to draw in
   // Seems that SGI and Crystal Eyes are not synchronized correctly !
   // That's why we don't draw in the appropriate buffer...
@@ -428,25 +610,128 @@ void QGLViewer::preDrawStereo(bool leftBuffer) {
 
   // Clear the buffer where we're going to draw
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-  // GL_PROJECTION matrix
-  camera()->loadProjectionMatrixStereo(leftBuffer);
-  // GL_MODELVIEW matrix
-  camera()->loadModelViewMatrixStereo(leftBuffer);
+
+  if (coreProfileIsEnabled())
+    loadCoreProfileMatrices();
+  else {
+    // GL_PROJECTION matrix
+    camera()->loadProjectionMatrixStereo(leftBuffer);
+    // GL_MODELVIEW matrix
+    camera()->loadModelViewMatrixStereo(leftBuffer);
+  }
 
   Q_EMIT drawNeeded();
 }
 
+/*! Draws the two stereo views with a single traversal of the scene.
+
+This method is called by paintGL() instead of the preDrawStereo(), draw() and
+postDraw() sequence of each eye when displaysInStereo() and
+stereoIsSinglePass().
+
+The default implementation records the scene in an OpenGL display list while it
+is drawn for the left eye (using draw(), or fastDraw() when the camera is
+manipulated), and simply replays this display list for the right eye:
+\code
+preDrawStereo(true);
+glNewList(list, GL_COMPILE_AND_EXECUTE);
+draw();
+glEndList();
+postDraw();
+
+preDrawStereo(false);
+glCallList(list);
+postDraw();
+\endcode
+The CPU cost of the scene traversal (culling, state sorting, immediate mode
+calls...) is hence only paid once per frame. Your draw() method must in that
+case only use commands that can be compiled in a display list: it should not
+read back OpenGL state (\c glGet, \c glReadPixels...) nor load an absolute
+\c GL_MODELVIEW matrix (use \c glPushMatrix() and \c glMultMatrix() instead of
+camera()->loadModelViewMatrix()).
+
+Overload this method to render the two views yourself, for instance in a single
+instanced draw call that targets a layered or side-by-side framebuffer. The two
+eyes' matrices are provided together by
+qglviewer::Camera::getModelViewMatrixStereo() and
+qglviewer::Camera::getProjectionMatrixStereo().
+
+When coreProfileIsEnabled(), display lists are not available and the scene is
+simply drawn once for each eye. */
+void QGLViewer::drawStereo() {
+  if (coreProfileIsEnabled()) {
+    for (int view = 1; view >= 0; --view) {
+      preDrawStereo(view);
+      if (camera()->frame()->isManipulated())
+        fastDraw();
+      else
+        draw();
+      postDraw();
+    }
+    return;
+  }
+
+  if (stereoDisplayList_ == 0)
+    stereoDisplayList_ = glGenLists(1);
+
+  // Left eye: the scene is traversed and recorded while it is drawn
+  preDrawStereo(true);
+  glNewList(stereoDisplayList_, GL_COMPILE_AND_EXECUTE);
+  if (camera()->frame()->isManipulated())
+    fastDraw();
+  else
+    draw();
+  glEndList();
+  postDraw();
+
+  // Right eye: the recorded scene is simply replayed
+  preDrawStereo(false);
+  glCallList(stereoDisplayList_);
+  postDraw();
+}
+
 /*! Draws a simplified version of the scene to guarantee interactive camera
 displacements.
 
 This method is called instead of draw() when the qglviewer::Camera::frame() is
 qglviewer::ManipulatedCameraFrame::isManipulated(). Default implementation
-simply calls draw().
+simply calls draw(), unless fastDrawIsReprojected(): the last frame drawn by
+draw() is then displayed from the new camera position, and the scene is only
+redrawn every fastDrawRefreshPeriod() frames.
 
 Overload this method if your scene is too complex to allow for interactive
 camera manipulation. See the <a href="../examples/fastDraw.html">fastDraw
 example</a> for an illustration. */
-void QGLViewer::fastDraw() { draw(); }
+void QGLViewer::fastDraw() {
+  if (sceneCache_ && sceneCache_->isValid() &&
+      (sceneCache_->context() == QOpenGLContext::currentContext()) &&
+      fastDrawIsReprojected() && !displaysInStereo() && !rendersOffscreen() &&
+      ((fastDrawRefreshPeriod() == 0) ||
+       (++nbReprojectedFrames_ < fastDrawRefreshPeriod()))) {
+    sceneCache_->draw(camera());
+    return;
+  }
+
+  draw();
+  updateSceneCache();
+}
+
+/*! Sends the scene primitives to \p sink, to create a vectorial snapshot
+without the OpenGL feedback mode. Only used when geometrySinkIsUsed().
+
+The \p sink camera is the camera(). Typical implementations give the same
+primitives as draw(), in world coordinates:
+\code
+void Viewer::drawVectorial(qglviewer::GeometrySink &sink) {
+  sink.setColor(QColor(200, 100, 50));
+  Q_FOREACH (const Triangle &t, triangles_)
+    sink.addWorldTriangle(t.a, t.b, t.c);
+}
+\endcode
+Overlays can be added in window coordinates with
+qglviewer::GeometrySink::addSegment(). The default implementation does nothing.
+*/
+void QGLViewer::drawVectorial(qglviewer::GeometrySink &sink) { Q_UNUSED(sink); }
 
 /*! Starts (\p edit = \c true, default) or stops (\p edit=\c false) the edition
 of the camera().
@@ -652,6 +937,7 @@ void QGLViewer::setCamera(Camera *const camera) {
   connectAllCameraKFIInterpolatedSignals(false);
   camera_ = camera;
   connectAllCameraKFIInterpolatedSignals();
+  cachedSceneIsValid_ = false;
 
   previousCameraZClippingCoefficient_ = this->camera()->zClippingCoefficient();
 }
@@ -747,6 +1033,14 @@ void QGLViewer::drawLight(GLenum light, qreal scale) const {
 #if (QT_VERSION >= QT_VERSION_CHECK(5, 4, 0))
 void QGLViewer::renderText(int x, int y, const QString &str,
                            const QFont &font) {
+  if (coreProfileIsEnabled()) {
+    // No current color: the foregroundColor() is used
+    if (CoreProfileRenderer *renderer = coreProfileRenderer())
+      renderer->drawText(x, y, str, font, foregroundColor(),
+                         QSize(width(), height()));
+    return;
+  }
+
   // Retrieve last OpenGL color to use as a font color
   GLdouble glColor[4];
   glGetDoublev(GL_CURRENT_COLOR, glColor);
@@ -754,7 +1048,11 @@ void QGLViewer::renderText(int x, int y, const QString &str,
                             255 * glColor[2], 255 * glColor[3]);
 
   // Render text
-  QPainter painter(this);
+  QPainter painter;
+  if (rendersOffscreen())
+    painter.begin(offscreenPaintDevice_);
+  else
+    painter.begin(this);
   painter.setPen(fontColor);
   painter.setFont(font);
   painter.drawText(x, y, str);
@@ -895,8 +1193,26 @@ corresponding to the near clipping plane and 1.0 being just beyond the far
 clipping plane). This interval matches the values that can be read from the
 z-buffer. Note that if you use the convenient \c glVertex2i() to provide
 coordinates, the implicit 0.0 z coordinate will make your drawings appear \e on
-\e top of the rest of the scene. */
+\e top of the rest of the scene.
+
+When coreProfileIsEnabled(), the screen matrices are written in the matrices
+uniform buffer instead (see bindMatricesUniformBlock()). */
 void QGLViewer::startScreenCoordinatesSystem(bool upward) const {
+  if (coreProfileIsEnabled()) {
+    // The matrices uniform buffer is modified instead
+    if (CoreProfileRenderer *renderer = coreProfileRenderer()) {
+      if (tileRegion_ != NULL)
+        renderer->setScreenMatrices(
+            tileRegion_->xMin, tileRegion_->xMax,
+            upward ? tileRegion_->yMin : tileRegion_->yMax,
+            upward ? tileRegion_->yMax : tileRegion_->yMin);
+      else
+        renderer->setScreenMatrices(0.0, width(), upward ? 0.0 : height(),
+                                    upward ? height() : 0.0);
+    }
+    return;
+  }
+
   glMatrixMode(GL_PROJECTION);
   glPushMatrix();
   glLoadIdentity();
@@ -924,6 +1240,11 @@ The \c GL_MODELVIEW and \c GL_PROJECTION matrices modified in
 startScreenCoordinatesSystem() are restored. \c glMatrixMode is set to \c
 GL_MODELVIEW. */
 void QGLViewer::stopScreenCoordinatesSystem() const {
+  if (coreProfileIsEnabled()) {
+    loadCoreProfileMatrices();
+    return;
+  }
+
   glMatrixMode(GL_PROJECTION);
   glPopMatrix();
 
@@ -941,9 +1262,15 @@ void QGLViewer::timerEvent(QTimerEvent *) {
   }
 }
 
-/*! Starts the animation loop. See animationIsStarted(). */
+/*! Starts the animation loop. See animationIsStarted().
+
+When frameClockIsEnabled(), animate() is called once per displayed frame
+instead of every animationPeriod() milliseconds. */
 void QGLViewer::startAnimation() {
-  animationTimerId_ = startTimer(animationPeriod());
+  if (frameClockIsEnabled())
+    update();
+  else
+    animationTimerId_ = startTimer(animationPeriod());
   animationStarted_ = true;
 }
 
@@ -952,6 +1279,140 @@ void QGLViewer::stopAnimation() {
   animationStarted_ = false;
   if (animationTimerId_ != 0)
     killTimer(animationTimerId_);
+  animationTimerId_ = 0;
+}
+
+/*! Enables or disables the viewer frame clock. See frameClockIsEnabled().
+
+When the frame clock is disabled, the timers of the motions that are still in
+progress are restarted. */
+void QGLViewer::setFrameClockIsEnabled(bool enabled) {
+  if (enabled == frameClockIsEnabled_)
+    return;
+
+  frameClockIsEnabled_ = enabled;
+  frameClockIsRunning_ = false;
+
+  if (enabled) {
+    connect(this, SIGNAL(frameSwapped()), SLOT(frameClockTick()));
+    frameClock_.start();
+    update();
+  } else {
+    disconnect(this, SIGNAL(frameSwapped()), this, SLOT(frameClockTick()));
+    restartFrameClockTimers();
+  }
+}
+
+// Returns frame as a ManipulatedCameraFrame when it is in a fly mode, in which
+// case its flyTimer_ moves it continuously. Returns NULL otherwise.
+static ManipulatedCameraFrame *flyingCameraFrame(ManipulatedFrame *frame) {
+  ManipulatedCameraFrame *const cameraFrame =
+      dynamic_cast<ManipulatedCameraFrame *>(frame);
+  if ((cameraFrame) &&
+      ((cameraFrame->currentMouseAction() == QGLViewer::MOVE_FORWARD) ||
+       (cameraFrame->currentMouseAction() == QGLViewer::MOVE_BACKWARD) ||
+       (cameraFrame->currentMouseAction() == QGLViewer::DRIVE)))
+    return cameraFrame;
+  return NULL;
+}
+
+// Called after each presented frame when frameClockIsEnabled(). Stops the
+// timers of the viewer's time-based motions and advances them according to the
+// time elapsed since the previous frame. A single update() is then requested,
+// which results in the next tick.
+void QGLViewer::frameClockTick() {
+  const qreal elapsed = frameClock_.nsecsElapsed() / 1.0e6;
+  frameClock_.restart();
+
+  // When a motion starts, the time spent before the previous frame is not
+  // significant: the first step is a regular timer step.
+  const bool wasRunning = frameClockIsRunning_;
+  bool running = false;
+
+  // S p i n n i n g   a n d   f l y
+  ManipulatedFrame *frames[2] = {camera()->frame(), manipulatedFrame()};
+  for (int i = 0; i < 2; ++i) {
+    ManipulatedFrame *const frame = frames[i];
+    if ((!frame) || ((i == 1) && (frame == camera()->frame())))
+      continue;
+
+    if (frame->isSpinning()) {
+      frame->spinningTimer_.stop();
+      const Quaternion spinningQuaternion = frame->spinningQuaternion();
+      if (wasRunning) {
+        const int interval = qMax(frame->spinningTimer_.interval(), 1);
+        frame->setSpinningQuaternion(
+            Quaternion(spinningQuaternion.axis(),
+                       spinningQuaternion.angle() * elapsed / interval));
+      }
+      frame->spinUpdate();
+      frame->setSpinningQuaternion(spinningQuaternion);
+      running = true;
+    }
+
+    ManipulatedCameraFrame *const cameraFrame = flyingCameraFrame(frame);
+    if (cameraFrame) {
+      // The single shot timer used by wheelEvent() is left untouched.
+      if (!cameraFrame->flyTimer_.isSingleShot())
+        cameraFrame->flyTimer_.stop();
+      const qreal flySpeed = cameraFrame->flySpeed_;
+      // flyUpdate() is called every 10 milliseconds, see startAction()
+      if (wasRunning)
+        cameraFrame->flySpeed_ = flySpeed * elapsed / 10.0;
+      cameraFrame->flyUpdate();
+      cameraFrame->flySpeed_ = flySpeed;
+      running = true;
+    }
+  }
+
+  // C a m e r a   p a t h s
+  Q_FOREACH (KeyFrameInterpolator *kfi, camera()->kfi_)
+    if (kfi->interpolationIsStarted()) {
+      kfi->timer_.stop();
+      kfi->advanceInterpolation(wasRunning ? elapsed
+                                           : kfi->interpolationPeriod());
+      running = true;
+    }
+
+  // A n i m a t i o n
+  if (animationIsStarted()) {
+    if (animationTimerId_ != 0) {
+      killTimer(animationTimerId_);
+      animationTimerId_ = 0;
+    }
+    animate();
+    running = true;
+  }
+
+  frameClockIsRunning_ = running;
+  if (running)
+    update();
+}
+
+// Gives back their timers to the motions that were driven by the frame clock.
+void QGLViewer::restartFrameClockTimers() {
+  ManipulatedFrame *frames[2] = {camera()->frame(), manipulatedFrame()};
+  for (int i = 0; i < 2; ++i) {
+    ManipulatedFrame *const frame = frames[i];
+    if (!frame)
+      continue;
+
+    if ((frame->isSpinning()) && (!frame->spinningTimer_.isActive()))
+      frame->spinningTimer_.start();
+
+    ManipulatedCameraFrame *const cameraFrame = flyingCameraFrame(frame);
+    if ((cameraFrame) && (!cameraFrame->flyTimer_.isActive())) {
+      cameraFrame->flyTimer_.setSingleShot(false);
+      cameraFrame->flyTimer_.start(10);
+    }
+  }
+
+  Q_FOREACH (KeyFrameInterpolator *kfi, camera()->kfi_)
+    if ((kfi->interpolationIsStarted()) && (!kfi->timer_.isActive()))
+      kfi->timer_.start(kfi->interpolationPeriod());
+
+  if ((animationIsStarted()) && (animationTimerId_ == 0))
+    animationTimerId_ = startTimer(animationPeriod());
 }
 
 /*! Overloading of the \c QWidget method.
@@ -1182,6 +1643,19 @@ void QGLViewer::endSelection(const QPoint &point) {
   }
 }
 
+/*! Sets the depthBufferIsCached() value.
+
+The depth buffer cache of the camera() is released when \p cached is \c false.
+*/
+void QGLViewer::setDepthBufferIsCached(bool cached) {
+  depthBufferIsCached_ = cached;
+  if (!cached && isValid()) {
+    makeCurrent();
+    camera()->clearDepthBufferCache();
+    doneCurrent();
+  }
+}
+
 /*! Sets the selectBufferSize().
 
 The previous selectBuffer() is deleted and a new one is created. */
@@ -1222,6 +1696,8 @@ void QGLViewer::performClickAction(ClickAction ca, const QMouseEvent *const e) {
   case NO_CLICK_ACTION:
     break;
   case ZOOM_ON_PIXEL:
+    // Reads the depth buffer, which requires the OpenGL context
+    makeCurrent();
     camera()->interpolateToZoomOnPixel(e->pos());
     break;
   case ZOOM_TO_FIT:
@@ -1232,6 +1708,7 @@ void QGLViewer::performClickAction(ClickAction ca, const QMouseEvent *const e) {
     update();
     break;
   case RAP_FROM_PIXEL:
+    makeCurrent();
     if (!camera()->setPivotPointFromPixel(e->pos()))
       camera()->setPivotPoint(sceneCenter());
     setVisualHintsMask(1);
@@ -1291,6 +1768,11 @@ void QGLViewer::mousePressEvent(QMouseEvent *e) {
                           (Qt::MouseButtons)(e->buttons() & ~(e->button())),
                           currentlyPressedKey_);
 
+  if (pendingMouseMoveEvent_) {
+    applyPendingMouseMoveEvent();
+    update();
+  }
+
   if (clickBinding_.contains(cbp)) {
     performClickAction(clickBinding_[cbp], e);
   } else if (mouseGrabber()) {
@@ -1395,7 +1877,23 @@ void QGLViewer::mouseMoveEvent(QMouseEvent *e) {
   }
 
   if (!mouseGrabber()) {
-    //#CONNECTION# mouseReleaseEvent has the same structure
+    if ((camera()->frame()->isManipulated()) ||
+        ((manipulatedFrame()) && (manipulatedFrame()->isManipulated()))) {
+      if (nbUndrawnMouseMoveEvents_++ == 0)
+        mouseMoveLatencyTimer_.start();
+
+      if (mouseMoveEventsAreCoalesced()) {
+        // Only the last event is kept. The frame is moved once, right before
+        // the next preDraw(). See applyPendingMouseMoveEvent().
+        delete pendingMouseMoveEvent_;
+        pendingMouseMoveEvent_ = new QMouseEvent(*e);
+        update();
+        return;
+      }
+    }
+
+    //#CONNECTION# mouseReleaseEvent and applyPendingMouseMoveEvent have the
+    // same structure
     if (camera()->frame()->isManipulated()) {
       camera()->frame()->mouseMoveEvent(e, camera());
       // #CONNECTION# manipulatedCameraFrame::mouseMoveEvent specific if at the
@@ -1424,6 +1922,42 @@ void QGLViewer::mouseMoveEvent(QMouseEvent *e) {
   }
 }
 
+// Moves the manipulated frame according to the last mouse move event that was
+// stored by mouseMoveEvent() when mouseMoveEventsAreCoalesced(). The frame
+// computes its displacement from its previous mouse position, hence all the
+// intermediate events that were skipped are taken into account.
+void QGLViewer::applyPendingMouseMoveEvent() {
+  if (!pendingMouseMoveEvent_)
+    return;
+
+  QMouseEvent *const e = pendingMouseMoveEvent_;
+  pendingMouseMoveEvent_ = NULL;
+
+  ManipulatedFrame *frame = NULL;
+  if (camera()->frame()->isManipulated())
+    frame = camera()->frame();
+  else if ((manipulatedFrame()) && (manipulatedFrame()->isManipulated()))
+    frame = manipulatedFrame();
+
+  if (frame) {
+    // Called right before the display or with an explicit update(): the
+    // update() triggered by the frame signal would only result in an other
+    // useless frame.
+    const bool connected =
+        disconnect(frame, SIGNAL(manipulated()), this, SLOT(update()));
+    if (frame == camera()->frame())
+      camera()->frame()->mouseMoveEvent(e, camera());
+    else if (manipulatedFrameIsACamera_)
+      manipulatedFrame()->ManipulatedFrame::mouseMoveEvent(e, camera());
+    else
+      manipulatedFrame()->mouseMoveEvent(e, camera());
+    if (connected)
+      connect(frame, SIGNAL(manipulated()), this, SLOT(update()));
+  }
+
+  delete e;
+}
+
 /*! Overloading of the \c QWidget method.
 
 Calls the mouseGrabber(), camera() or manipulatedFrame \c mouseReleaseEvent
@@ -1432,6 +1966,10 @@ method.
 See the mouseMoveEvent() documentation for an example of mouse behavior
 customization. */
 void QGLViewer::mouseReleaseEvent(QMouseEvent *e) {
+  // The final position must be taken into account before the release (spinning
+  // speed...). update() is called below.
+  applyPendingMouseMoveEvent();
+
   if (mouseGrabber()) {
     if (mouseGrabberIsAManipulatedCameraFrame_)
       (dynamic_cast<ManipulatedFrame *>(mouseGrabber()))
@@ -1558,6 +2096,165 @@ void QGLViewer::setStereoDisplay(bool stereo) {
     stereo_ = false;
 }
 
+/*! Sets the coreProfileIsEnabled() state.
+
+This method must be called before the viewer is first shown (or rendered with
+renderFrame()), typically in your viewer constructor. When \p enabled is \c
+true, the QOpenGLWidget::format() is modified to ask for an OpenGL 3.3 core
+profile context (unless a core profile version was already requested with
+QOpenGLWidget::setFormat()). */
+void QGLViewer::setCoreProfileIsEnabled(bool enabled) {
+  if (isValid() || offscreenContext_) {
+    qWarning("setCoreProfileIsEnabled must be called before the viewer is "
+             "shown - Ignored");
+    return;
+  }
+
+  QSurfaceFormat surfaceFormat = format();
+  if (enabled) {
+    if (surfaceFormat.version() < qMakePair(3, 2))
+      surfaceFormat.setVersion(3, 3);
+    surfaceFormat.setProfile(QSurfaceFormat::CoreProfile);
+  } else
+    surfaceFormat.setProfile(QSurfaceFormat::NoProfile);
+  setFormat(surfaceFormat);
+  coreProfileIsEnabled_ = enabled;
+}
+
+/*! Sets the fastDrawIsReprojected() state.
+
+The stored color and depth buffers are released when \p reprojected is \c
+false. */
+void QGLViewer::setFastDrawIsReprojected(bool reprojected) {
+  fastDrawIsReprojected_ = reprojected;
+  if (!reprojected && !sceneIsCached())
+    releaseSceneCache();
+  nbReprojectedFrames_ = 0;
+}
+
+/*! Sets the sceneIsCached() state.
+
+The stored color and depth buffers are released when \p cached is \c false. */
+void QGLViewer::setSceneIsCached(bool cached) {
+  sceneIsCached_ = cached;
+  if (!cached && !fastDrawIsReprojected())
+    releaseSceneCache();
+  invalidateScene();
+}
+
+/*! Forces the next paintGL() to call draw(), and calls \c update().
+
+Only useful when sceneIsCached(): call this method when something drawn by
+your draw() method has changed, other than the camera() and the
+manipulatedFrame() positions. */
+void QGLViewer::invalidateScene() {
+  cachedSceneIsValid_ = false;
+  update();
+}
+
+void QGLViewer::releaseSceneCache() {
+  if (!sceneCache_)
+    return;
+  if (isValid()) {
+    makeCurrent();
+    delete sceneCache_;
+    doneCurrent();
+  } else
+    delete sceneCache_;
+  sceneCache_ = NULL;
+  cachedSceneIsValid_ = false;
+}
+
+// Stores the frame that draw() just drew, for the reprojected fastDraw() and
+// for restoreCachedScene().
+void QGLViewer::updateSceneCache() {
+  nbReprojectedFrames_ = 0;
+  cachedSceneIsValid_ = false;
+  if ((!fastDrawIsReprojected() && !sceneIsCached()) || displaysInStereo() ||
+      rendersOffscreen() || tileRegion_ != NULL)
+    return;
+
+  // A new context is created when the widget is reparented
+  if (sceneCache_ &&
+      (sceneCache_->context() != QOpenGLContext::currentContext())) {
+    delete sceneCache_;
+    sceneCache_ = NULL;
+  }
+  if (!sceneCache_)
+    sceneCache_ = new ReprojectionCache();
+
+  if (sceneCache_->capture(camera())) {
+    cachedSceneIsValid_ = true;
+    cachedModelViewVersion_ = camera()->modelViewMatrixVersion();
+    cachedProjectionVersion_ = camera()->projectionMatrixVersion();
+    cachedManipulatedFrame_ = manipulatedFrame();
+    cachedManipulatedFrameVersion_ =
+        manipulatedFrame() ? manipulatedFrame()->worldVersion() : 0;
+  } else if (!sceneCache_->isSupported()) {
+    delete sceneCache_;
+    sceneCache_ = NULL;
+    fastDrawIsReprojected_ = false;
+    sceneIsCached_ = false;
+  }
+}
+
+// Replaces draw() by a copy of the cached scene when nothing changed since it
+// was stored. Returns false if draw() has to be called.
+bool QGLViewer::restoreCachedScene() {
+  if (!sceneIsCached() || !cachedSceneIsValid_ || !sceneCache_ ||
+      animationIsStarted() || displaysInStereo() || rendersOffscreen() ||
+      tileRegion_ != NULL ||
+      (sceneCache_->context() != QOpenGLContext::currentContext()))
+    return false;
+
+  if ((camera()->modelViewMatrixVersion() != cachedModelViewVersion_) ||
+      (camera()->projectionMatrixVersion() != cachedProjectionVersion_) ||
+      (manipulatedFrame() != cachedManipulatedFrame_) ||
+      (manipulatedFrame() &&
+       (manipulatedFrame()->worldVersion() != cachedManipulatedFrameVersion_)))
+    return false;
+
+  return sceneCache_->restore();
+}
+
+/*! Binds the \c QGLViewerMatrices uniform block of the shader program \p
+programId to the viewer's matrices uniform buffer. See coreProfileIsEnabled().
+
+Call this method once your program is linked, typically in init(). Returns \c
+false if coreProfileIsEnabled() is \c false or if the program does not declare
+the uniform block. The OpenGL context must be current. */
+bool QGLViewer::bindMatricesUniformBlock(GLuint programId) const {
+  CoreProfileRenderer *renderer = coreProfileRenderer();
+  if (!renderer) {
+    qWarning("bindMatricesUniformBlock: core profile mode is not enabled");
+    return false;
+  }
+  return renderer->bindMatricesUniformBlock(programId);
+}
+
+// The renderer of the current context (the widget's or renderFrame()'s one).
+CoreProfileRenderer *QGLViewer::coreProfileRenderer() const {
+  return rendersOffscreen() ? offscreenCoreProfileRenderer_
+                            : coreProfileRenderer_;
+}
+
+// Writes the camera matrices, for the current stereo eye if needed, in the
+// matrices uniform buffer.
+void QGLViewer::loadCoreProfileMatrices() const {
+  CoreProfileRenderer *renderer = coreProfileRenderer();
+  if (!renderer)
+    return;
+
+  if (displaysInStereo()) {
+    GLdouble modelView[2][16], projection[2][16];
+    camera()->getModelViewMatrixStereo(modelView[0], modelView[1]);
+    camera()->getProjectionMatrixStereo(projection[0], projection[1]);
+    const int eye = stereoLeftBuffer_ ? 0 : 1;
+    renderer->setMatrices(modelView[eye], projection[eye]);
+  } else
+    renderer->setCameraMatrices(camera());
+}
+
 /*! Sets the isFullScreen() state.
 
 If the QGLViewer is embedded in an other QWidget (see
@@ -3407,18 +4104,10 @@ void QGLViewer::drawVisualHints() {
   if (visualHint_ & 1) {
     const qreal size = 15.0;
     Vec proj = camera()->projectedCoordinatesOf(camera()->pivotPoint());
-    startScreenCoordinatesSystem();
-    glDisable(GL_LIGHTING);
-    glDisable(GL_DEPTH_TEST);
-    glLineWidth(3.0);
-    glBegin(GL_LINES);
-    glVertex2d(proj.x - size, proj.y);
-    glVertex2d(proj.x + size, proj.y);
-    glVertex2d(proj.x, proj.y - size);
-    glVertex2d(proj.x, proj.y + size);
-    glEnd();
-    glEnable(GL_DEPTH_TEST);
-    stopScreenCoordinatesSystem();
+    QVector<QPointF> cross;
+    cross << QPointF(proj.x - size, proj.y) << QPointF(proj.x + size, proj.y)
+          << QPointF(proj.x, proj.y - size) << QPointF(proj.x, proj.y + size);
+    drawScreenLines(GL_LINES, cross, 3.0);
   }
 
   // if (visualHint_ & 2)
@@ -3440,37 +4129,46 @@ void QGLViewer::drawVisualHints() {
 
   if (mf) {
     pnt = camera()->projectedCoordinatesOf(pnt);
-    startScreenCoordinatesSystem();
-    glDisable(GL_LIGHTING);
-    glDisable(GL_DEPTH_TEST);
-    glLineWidth(3.0);
-    glBegin(GL_LINES);
-    glVertex2d(pnt.x, pnt.y);
-    glVertex2i(mf->prevPos_.x(), mf->prevPos_.y());
-    glEnd();
-    glEnable(GL_DEPTH_TEST);
-    stopScreenCoordinatesSystem();
+    QVector<QPointF> line;
+    line << QPointF(pnt.x, pnt.y) << QPointF(mf->prevPos_);
+    drawScreenLines(GL_LINES, line, 3.0);
   }
 
   // Zoom on region: draw a rectangle
   if (camera()->frame()->action_ == ZOOM_ON_REGION) {
-    startScreenCoordinatesSystem();
+    const QPoint &pressPos = camera()->frame()->pressPos_;
+    const QPoint &prevPos = camera()->frame()->prevPos_;
+    QVector<QPointF> rectangle;
+    rectangle << QPointF(pressPos.x(), pressPos.y())
+              << QPointF(prevPos.x(), pressPos.y())
+              << QPointF(prevPos.x(), prevPos.y())
+              << QPointF(pressPos.x(), prevPos.y());
+    drawScreenLines(GL_LINE_LOOP, rectangle, 2.0);
+  }
+}
+
+// Draws a visual hint made of lines, given in screen coordinates, with the
+// foregroundColor() and without depth test.
+void QGLViewer::drawScreenLines(GLenum mode, const QVector<QPointF> &points,
+                                qreal lineWidth) {
+  startScreenCoordinatesSystem();
+  glDisable(GL_DEPTH_TEST);
+  if (coreProfileIsEnabled()) {
+    QVector<GLfloat> vertices;
+    Q_FOREACH (const QPointF &point, points)
+      vertices << GLfloat(point.x()) << GLfloat(point.y()) << 0.0f;
+    if (CoreProfileRenderer *renderer = coreProfileRenderer())
+      renderer->drawLines(mode, vertices, foregroundColor());
+  } else {
     glDisable(GL_LIGHTING);
-    glDisable(GL_DEPTH_TEST);
-    glLineWidth(2.0);
-    glBegin(GL_LINE_LOOP);
-    glVertex2i(camera()->frame()->pressPos_.x(),
-               camera()->frame()->pressPos_.y());
-    glVertex2i(camera()->frame()->prevPos_.x(),
-               camera()->frame()->pressPos_.y());
-    glVertex2i(camera()->frame()->prevPos_.x(),
-               camera()->frame()->prevPos_.y());
-    glVertex2i(camera()->frame()->pressPos_.x(),
-               camera()->frame()->prevPos_.y());
+    glLineWidth(lineWidth);
+    glBegin(mode);
+    Q_FOREACH (const QPointF &point, points)
+      glVertex2d(point.x(), point.y());
     glEnd();
-    glEnable(GL_DEPTH_TEST);
-    stopScreenCoordinatesSystem();
   }
+  glEnable(GL_DEPTH_TEST);
+  stopScreenCoordinatesSystem();
 }
 
 /*! Defines the mask that will be used to drawVisualHints(). The only available
@@ -3695,8 +4393,92 @@ QString QGLViewer::stateFileName() const {
   return name;
 }
 
-/*! Saves in stateFileName() an XML representation of the QGLViewer state,
-obtained from domElement().
+// Binary state files start with this magic number ("QGLB") and a format
+// version. See QGLViewer::writeToStream().
+static const quint32 binaryStateFileMagic = 0x51474C42;
+static const quint16 binaryStateFileVersion = 1;
+
+// Chunks of QGLViewer::writeToStream(). Never renumber.
+enum BinaryStateChunk {
+  EndChunk = 0,
+  StateChunk,
+  DisplayChunk,
+  GeometryChunk,
+  CameraChunk,
+  ManipulatedFrameChunk
+};
+
+static bool isBinaryStateFileName(const QString &name) {
+  return QFileInfo(name).suffix().toLower() == "qglb";
+}
+
+static void setBinaryStateStreamFormat(QDataStream &stream) {
+  stream.setVersion(QDataStream::Qt_5_4);
+  stream.setFloatingPointPrecision(QDataStream::DoublePrecision);
+}
+
+static void writeBinaryStateHeader(QDataStream &stream) {
+  setBinaryStateStreamFormat(stream);
+  stream << binaryStateFileMagic << binaryStateFileVersion;
+}
+
+// Checks the header of a binary state file. Leaves the device untouched and
+// returns false if it is not a binary state file.
+static bool readBinaryStateHeader(QIODevice *device, QDataStream &stream) {
+  const QByteArray magic = device->peek(sizeof(binaryStateFileMagic));
+  QDataStream magicStream(magic);
+  quint32 value = 0;
+  magicStream >> value;
+  if (value != binaryStateFileMagic)
+    return false;
+
+  quint16 version;
+  setBinaryStateStreamFormat(stream);
+  stream >> value >> version;
+  if (version > binaryStateFileVersion)
+    qWarning("State file created with a newer binary format (%d) may not be "
+             "correctly read.",
+             int(version));
+  return true;
+}
+
+static void writeBinaryStateChunk(QDataStream &stream, BinaryStateChunk type,
+                                  const QByteArray &data) {
+  stream << quint32(type) << data;
+}
+
+static QByteArray stateChunkData(const QColor &foregroundColor,
+                                 const QColor &backgroundColor, bool stereo) {
+  QByteArray data;
+  QDataStream stream(&data, QIODevice::WriteOnly);
+  setBinaryStateStreamFormat(stream);
+  stream << foregroundColor << backgroundColor << stereo;
+  return data;
+}
+
+static QByteArray displayChunkData(bool axisIsDrawn, bool gridIsDrawn,
+                                   bool FPSIsDisplayed, bool cameraIsEdited) {
+  QByteArray data;
+  QDataStream stream(&data, QIODevice::WriteOnly);
+  setBinaryStateStreamFormat(stream);
+  stream << axisIsDrawn << gridIsDrawn << FPSIsDisplayed << cameraIsEdited;
+  return data;
+}
+
+static QByteArray geometryChunkData(bool fullScreen, const QPoint &prevPos,
+                                    const QSize &size, const QPoint &pos) {
+  QByteArray data;
+  QDataStream stream(&data, QIODevice::WriteOnly);
+  setBinaryStateStreamFormat(stream);
+  stream << fullScreen << prevPos << size << pos;
+  return data;
+}
+
+/*! Saves in stateFileName() a representation of the QGLViewer state.
+
+When the stateFileName() has a \c .qglb extension, the state is saved in a
+compact binary format using writeToStream(). An XML representation obtained
+from domElement() is saved otherwise.
 
 Use restoreStateFromFile() to restore this viewer state.
 
@@ -3730,9 +4512,15 @@ void QGLViewer::saveStateToFile() {
     }
   }
 
-  // Write the DOM tree to file
   QFile f(name);
-  if (f.open(QIODevice::WriteOnly)) {
+  if (f.open(QIODevice::WriteOnly) && isBinaryStateFileName(name)) {
+    QDataStream out(&f);
+    writeBinaryStateHeader(out);
+    writeToStream(out);
+    f.flush();
+    f.close();
+  } else if (f.isOpen()) {
+    // Write the DOM tree to file
     QTextStream out(&f);
     QDomDocument doc("QGLVIEWER");
     doc.appendChild(domElement("QGLViewer", doc));
@@ -3746,7 +4534,9 @@ void QGLViewer::saveStateToFile() {
 }
 
 /*! Restores the QGLViewer state from the stateFileName() file using
-initFromDOMElement().
+initFromDOMElement() (or readFromStream() for a binary state file).
+
+The format of the file is detected from its content, whatever its extension.
 
 States are saved using saveStateToFile(), which is automatically called on
 viewer exit.
@@ -3787,9 +4577,13 @@ bool QGLViewer::restoreStateFromFile() {
     return false;
   }
 
-  // Read the DOM tree form file
   QFile f(name);
-  if (f.open(QIODevice::ReadOnly)) {
+  QDataStream in(&f);
+  if (f.open(QIODevice::ReadOnly) && readBinaryStateHeader(&f, in)) {
+    readFromStream(in);
+    f.close();
+  } else if (f.isOpen()) {
+    // Read the DOM tree form file
     QDomDocument doc;
     doc.setContent(&f);
     f.close();
@@ -4011,6 +4805,252 @@ void QGLViewer::initFromDOMElement(const QDomElement &element) {
   }
 }
 
+/*! Writes the QGLViewer state in a binary \c QDataStream.
+
+This is the binary equivalent of domElement(), used by saveStateToFile() when
+the stateFileName() has a \c .qglb extension. It saves the same state values,
+the camera() (see qglviewer::Camera::writeToStream()) and the manipulatedFrame()
+(see qglviewer::ManipulatedFrame::writeToStream()). Binary state files are
+faster to read back than the XML ones: numbers are not parsed from text and
+the keyFrames of the camera paths are only decoded when they are used.
+
+The state is written as a list of typed and sized chunks, terminated by an end
+marker, so that chunks added by future versions of the format can be skipped.
+If you overloaded domElement() to save custom values, overload this method as
+well and append your data \e after the QGLViewer state:
+\code
+void Viewer::writeToStream(QDataStream& stream) const
+{
+  QGLViewer::writeToStream(stream);
+  stream << lightIsOn();
+  lightManipulatedFrame()->writeToStream(stream);
+}
+\endcode
+readFromStream() should then read these values back in the same order.
+
+Use convertStateFile() to convert an existing XML state file. */
+void QGLViewer::writeToStream(QDataStream &stream) const {
+  writeBinaryStateChunk(stream, StateChunk,
+                        stateChunkData(foregroundColor(), backgroundColor(),
+                                       displaysInStereo()));
+  writeBinaryStateChunk(stream, DisplayChunk,
+                        displayChunkData(axisIsDrawn(), gridIsDrawn(),
+                                         FPSIsDisplayed(), cameraIsEdited()));
+
+  const QWidget *tlw = topLevelWidget();
+  writeBinaryStateChunk(
+      stream, GeometryChunk,
+      geometryChunkData(isFullScreen(), prevPos_, tlw->size(), tlw->pos()));
+
+  QByteArray data;
+  QDataStream cameraStream(&data, QIODevice::WriteOnly);
+  setBinaryStateStreamFormat(cameraStream);
+  // Restore original Camera zClippingCoefficient before saving.
+  if (cameraIsEdited())
+    camera()->setZClippingCoefficient(previousCameraZClippingCoefficient_);
+  camera()->writeToStream(cameraStream);
+  if (cameraIsEdited())
+    // #CONNECTION# 5.0 from setCameraIsEdited()
+    camera()->setZClippingCoefficient(5.0);
+  writeBinaryStateChunk(stream, CameraChunk, data);
+
+  if (manipulatedFrame()) {
+    data.clear();
+    QDataStream frameStream(&data, QIODevice::WriteOnly);
+    setBinaryStateStreamFormat(frameStream);
+    manipulatedFrame()->writeToStream(frameStream);
+    writeBinaryStateChunk(stream, ManipulatedFrameChunk, data);
+  }
+
+  writeBinaryStateChunk(stream, EndChunk, QByteArray());
+}
+
+/*! Restores the QGLViewer state from a binary \c QDataStream created by
+writeToStream().
+
+Used by restoreStateFromFile() when the state file is a binary one. Unknown
+chunks are skipped. As with initFromDOMElement(), the manipulatedFrame() \e
+pointer is not modified: its state is simply restored if it is defined. */
+void QGLViewer::readFromStream(QDataStream &stream) {
+  bool tmpCameraIsEdited = cameraIsEdited();
+  while (stream.status() == QDataStream::Ok) {
+    quint32 type;
+    QByteArray data;
+    stream >> type;
+    if ((type == EndChunk) || (stream.status() != QDataStream::Ok))
+      break;
+    stream >> data;
+
+    QDataStream chunk(data);
+    setBinaryStateStreamFormat(chunk);
+    switch (type) {
+    case StateChunk: {
+      QColor foreground, background;
+      bool stereo;
+      chunk >> foreground >> background >> stereo;
+      if (chunk.status() == QDataStream::Ok) {
+        setForegroundColor(foreground);
+        setBackgroundColor(background);
+        setStereoDisplay(stereo);
+      }
+      break;
+    }
+    case DisplayChunk: {
+      bool axis, grid, fps;
+      chunk >> axis >> grid >> fps >> tmpCameraIsEdited;
+      if (chunk.status() == QDataStream::Ok) {
+        setAxisIsDrawn(axis);
+        setGridIsDrawn(grid);
+        setFPSIsDisplayed(fps);
+      }
+      break;
+    }
+    case GeometryChunk: {
+      bool fullScreen;
+      QPoint prevPos, pos;
+      QSize size;
+      chunk >> fullScreen >> prevPos >> size >> pos;
+      if (chunk.status() != QDataStream::Ok)
+        break;
+      setFullScreen(fullScreen);
+      if (isFullScreen())
+        prevPos_ = prevPos;
+      else {
+        topLevelWidget()->resize(size);
+        camera()->setScreenWidthAndHeight(this->width(), this->height());
+        topLevelWidget()->move(pos);
+      }
+      break;
+    }
+    case CameraChunk:
+      connectAllCameraKFIInterpolatedSignals(false);
+      camera()->readFromStream(chunk);
+      connectAllCameraKFIInterpolatedSignals();
+      break;
+    case ManipulatedFrameChunk:
+      if (manipulatedFrame())
+        manipulatedFrame()->readFromStream(chunk);
+      break;
+    default:
+      // Chunk added by a newer version of the format
+      break;
+    }
+  }
+
+  // See the same code in initFromDOMElement()
+  cameraIsEdited_ = tmpCameraIsEdited;
+  if (cameraIsEdited_) {
+    previousCameraZClippingCoefficient_ = camera()->zClippingCoefficient();
+    // #CONNECTION# 5.0 from setCameraIsEdited.
+    camera()->setZClippingCoefficient(5.0);
+  }
+}
+
+/*! Converts the XML state file \p xmlFileName into the binary state file \p
+binaryFileName (see saveStateToFile()).
+
+The XML file is read as initFromDOMElement() would, and the binary file is
+written as writeToStream() would, without using any QGLViewer. Returns \c false
+and displays a warning if one of the files cannot be opened.
+
+\attention Custom values added to the XML state file by an overloaded
+domElement() are not converted. */
+bool QGLViewer::convertStateFile(const QString &xmlFileName,
+                                 const QString &binaryFileName) {
+  QFile in(xmlFileName);
+  if (!in.open(QIODevice::ReadOnly)) {
+    qWarning("Unable to open state file %s: %s",
+             xmlFileName.toLatin1().constData(),
+             in.errorString().toLatin1().constData());
+    return false;
+  }
+  QDomDocument doc;
+  doc.setContent(&in);
+  in.close();
+
+  QFile out(binaryFileName);
+  if (!out.open(QIODevice::WriteOnly)) {
+    qWarning("Unable to save state file %s: %s",
+             binaryFileName.toLatin1().constData(),
+             out.errorString().toLatin1().constData());
+    return false;
+  }
+  QDataStream stream(&out);
+  writeBinaryStateHeader(stream);
+
+  // #CONNECTION# default values and syntax from initFromDOMElement()
+  QDomElement child = doc.documentElement().firstChild().toElement();
+  while (!child.isNull()) {
+    if (child.tagName() == "State") {
+      QColor foreground, background;
+      QDomElement ch = child.firstChild().toElement();
+      while (!ch.isNull()) {
+        if (ch.tagName() == "foregroundColor")
+          foreground = DomUtils::QColorFromDom(ch);
+        if (ch.tagName() == "backgroundColor")
+          background = DomUtils::QColorFromDom(ch);
+        ch = ch.nextSibling().toElement();
+      }
+      writeBinaryStateChunk(
+          stream, StateChunk,
+          stateChunkData(foreground, background,
+                         DomUtils::boolFromDom(child, "stereo", false)));
+    }
+
+    if (child.tagName() == "Display")
+      writeBinaryStateChunk(
+          stream, DisplayChunk,
+          displayChunkData(
+              DomUtils::boolFromDom(child, "axisIsDrawn", false),
+              DomUtils::boolFromDom(child, "gridIsDrawn", false),
+              DomUtils::boolFromDom(child, "FPSIsDisplayed", false),
+              DomUtils::boolFromDom(child, "cameraIsEdited", false)));
+
+    if (child.tagName() == "Geometry") {
+      const bool fullScreen = DomUtils::boolFromDom(child, "fullScreen", false);
+      QPoint prevPos, pos;
+      QSize size(600, 400);
+      if (fullScreen)
+        prevPos = QPoint(DomUtils::intFromDom(child, "prevPosX", 0),
+                         DomUtils::intFromDom(child, "prevPosY", 0));
+      else {
+        size = QSize(DomUtils::intFromDom(child, "width", 600),
+                     DomUtils::intFromDom(child, "height", 400));
+        pos = QPoint(DomUtils::intFromDom(child, "posX", 0),
+                     DomUtils::intFromDom(child, "posY", 0));
+      }
+      writeBinaryStateChunk(stream, GeometryChunk,
+                            geometryChunkData(fullScreen, prevPos, size, pos));
+    }
+
+    if (child.tagName() == "Camera") {
+      Camera camera;
+      camera.initFromDOMElement(child);
+      QByteArray data;
+      QDataStream cameraStream(&data, QIODevice::WriteOnly);
+      setBinaryStateStreamFormat(cameraStream);
+      camera.writeToStream(cameraStream);
+      writeBinaryStateChunk(stream, CameraChunk, data);
+    }
+
+    if (child.tagName() == "ManipulatedFrame") {
+      ManipulatedFrame frame;
+      frame.initFromDOMElement(child);
+      QByteArray data;
+      QDataStream frameStream(&data, QIODevice::WriteOnly);
+      setBinaryStateStreamFormat(frameStream);
+      frame.writeToStream(frameStream);
+      writeBinaryStateChunk(stream, ManipulatedFrameChunk, data);
+    }
+
+    child = child.nextSibling().toElement();
+  }
+
+  writeBinaryStateChunk(stream, EndChunk, QByteArray());
+  out.close();
+  return true;
+}
+
 #ifndef DOXYGEN
 /*! This method is deprecated since version 1.3.9-5. Use saveStateToFile() and
 setStateFileName() instead. */
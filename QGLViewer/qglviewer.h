@@ -5,15 +5,25 @@
 
 #include <QClipboard>
 #include <QGL>
+#include <QElapsedTimer>
 #include <QMap>
 #include <QTime>
 
 class QTabWidget;
+class QOffscreenSurface;
+class QSemaphore;
+class QThreadPool;
+class QOpenGLFramebufferObject;
+class QOpenGLPaintDevice;
 
 namespace qglviewer {
 class MouseGrabber;
 class ManipulatedFrame;
 class ManipulatedCameraFrame;
+class FrameSink;
+class GeometrySink;
+class CoreProfileRenderer;
+class ReprojectionCache;
 } // namespace qglviewer
 
 /*! \brief A versatile 3D OpenGL viewer based on QOpenGLWidget.
@@ -207,6 +217,7 @@ public Q_SLOTS:
      also setForegroundColor(). */
   void setBackgroundColor(const QColor &color) {
     backgroundColor_ = color;
+    cachedSceneIsValid_ = false;
     glClearColor(color.redF(), color.greenF(), color.blueF(), color.alphaF());
   }
   /*! Sets the foregroundColor() of the viewer, used to draw visual hints. See
@@ -392,6 +403,86 @@ public:
   qglviewer::Camera::setPhysicalScreenWidth() and
   qglviewer::Camera::setFocusDistance(). */
   bool displaysInStereo() const { return stereo_; }
+  /*! Returns \c true when the two stereo views are rendered using a single
+  traversal of the scene.
+
+  When displaysInStereo(), paintGL() then calls drawStereo() once per frame
+  instead of calling draw() once for each eye. See drawStereo() for details.
+
+  Set by setStereoSinglePass(). Default value is \c false. */
+  bool stereoIsSinglePass() const { return stereoSinglePass_; }
+  /*! Returns \c true when the viewer renders without the fixed function
+  pipeline, so that it can be used with an OpenGL core profile context.
+
+  In this mode, preDraw() and postDraw() do not use the \c GL_PROJECTION and \c
+  GL_MODELVIEW matrix stacks nor \c glPushAttrib(). The camera() matrices are
+  instead stored in a uniform buffer, only updated when the camera changes (see
+  qglviewer::Camera::modelViewMatrixVersion()). Your shader programs access
+  them by declaring this uniform block:
+  \code
+  layout(std140) uniform QGLViewerMatrices {
+    mat4 modelView;
+    mat4 projection;
+    mat4 modelViewProjection;
+    mat3 normalMatrix;
+  };
+  \endcode
+  and by calling bindMatricesUniformBlock() once they are linked. Visual hints
+  (axis, grid, pivot point...), drawText() and startScreenCoordinatesSystem()
+  use the library's own shader programs and the uniform buffer.
+
+  The fixed function methods cannot be used in this mode: drawAxis(),
+  drawGrid(), drawArrow(), drawLight(), the default select() (based on \c
+  GL_SELECT, overload it) and the camera paths display of cameraIsEdited().
+  drawStereo() draws the two views separately, since display lists are not
+  available. OpenGL 3.1 is required.
+
+  Set using setCoreProfileIsEnabled(). Default value is \c false. */
+  bool coreProfileIsEnabled() const { return coreProfileIsEnabled_; }
+  /*! Returns \c true when the default fastDraw() reprojects the last frame
+  drawn by draw() instead of drawing the scene again.
+
+  The color and depth buffers are copied after each draw(). While the camera is
+  manipulated, fastDraw() displays them from the new camera position, as a mesh
+  whose vertices are displaced according to the stored depth. Its cost only
+  depends on the viewer size, so that camera motion remains smooth with
+  arbitrarily complex scenes, without writing a specific fastDraw().
+
+  Since only the visible surfaces are stored, parts of the scene that were
+  hidden become stretched when the camera moves. Objects moving during the
+  manipulation are also frozen. The scene is hence fully redrawn every
+  fastDrawRefreshPeriod() frames.
+
+  The reprojection is not used when displaysInStereo() or when your fastDraw()
+  is overloaded. OpenGL 3.0 frame buffer blits are required.
+
+  Set using setFastDrawIsReprojected(). Default value is \c false. */
+  bool fastDrawIsReprojected() const { return fastDrawIsReprojected_; }
+  /*! Returns the number of reprojected frames after which fastDraw() calls
+  draw() again, refreshing the stored frame. Only used when
+  fastDrawIsReprojected().
+
+  A value of 0 means that the scene is never redrawn during the camera
+  manipulation. Set using setFastDrawRefreshPeriod(). Default value is 8. */
+  int fastDrawRefreshPeriod() const { return fastDrawRefreshPeriod_; }
+  /*! Returns \c true when the rendered scene is kept between two frames, so
+  that draw() is not called when only the visual hints change.
+
+  The color and depth buffers are copied after each draw(). When paintGL() is
+  called again with the same camera() position and projection, the same
+  manipulatedFrame() position and no call to invalidateScene() in between, they
+  are simply copied back instead of calling draw(). postDraw() is then called as
+  usual, so that displayMessage(), the FPS display, the zoom on region rectangle
+  or the axis and grid hints are updated at the cost of a screen copy.
+
+  You must call invalidateScene() whenever something drawn by your draw()
+  changes for another reason, typically when your scene is edited or when its
+  display depends on qglviewer::MouseGrabber::grabsMouse(). The scene is always
+  drawn when animationIsStarted() and when displaysInStereo(). OpenGL 3.0 frame
+  buffer blits are required.
+
+  Set using setSceneIsCached(). Default value is \c false. */
+  bool sceneIsCached() const { return sceneIsCached_; }
   /*! Returns the recommended size for the QGLViewer. Default value is 600x400
    * pixels. */
   virtual QSize sizeHint() const { return QSize(600, 400); }
@@ -403,7 +494,21 @@ public Q_SLOTS:
   void toggleFullScreen() { setFullScreen(!isFullScreen()); }
   /*! Toggles the state of displaysInStereo(). See setStereoDisplay(). */
   void toggleStereoDisplay() { setStereoDisplay(!stereo_); }
+  /*! Sets the stereoIsSinglePass() state. Only used when displaysInStereo().
+   */
+  void setStereoSinglePass(bool singlePass = true) {
+    stereoSinglePass_ = singlePass;
+    update();
+  }
   void toggleCameraMode();
+  void setCoreProfileIsEnabled(bool enabled = true);
+  void setFastDrawIsReprojected(bool reprojected = true);
+  /*! Sets the fastDrawRefreshPeriod(). Negative values are clamped to 0. */
+  void setFastDrawRefreshPeriod(int period) {
+    fastDrawRefreshPeriod_ = qMax(period, 0);
+  }
+  void setSceneIsCached(bool cached = true);
+  void invalidateScene();
 
 private:
   bool cameraIsInRotateMode() const;
@@ -424,6 +529,8 @@ public:
 
   void drawText(int x, int y, const QString &text, const QFont &fnt = QFont());
   void displayMessage(const QString &message, int delay = 2000);
+
+  bool bindMatricesUniformBlock(GLuint programId) const;
   // void draw3DText(const qglviewer::Vec& pos, const qglviewer::Vec& normal,
   // const QString& string, GLfloat height=0.1);
 
@@ -538,6 +645,47 @@ public:
 
   \note This value has no impact on the images produced in vectorial format. */
   int snapshotQuality() { return snapshotQuality_; }
+  /*! Returns \c true when the image snapshots of saveSnapshot() are encoded
+  and written in background threads.
+
+  In that case, saveSnapshot() only grabs the frame buffer and returns
+  immediately. The snapshot file name is determined (and snapshotCounter() is
+  incremented) at that moment, so that files are named in the order the
+  snapshots were taken, although they may be written in a different order.
+  Use waitForPendingSnapshots() to make sure all the files are written.
+
+  The number of images waiting to be encoded is bounded: when the encoding
+  threads cannot keep up, saveSnapshot() blocks until one of them is done.
+
+  This is especially useful to save a sequence of snapshots (see
+  saveSnapshot()), when the encoding time would otherwise limit the frame rate.
+  Errors are then reported using \c qWarning() instead of a message box.
+
+  Only the snapshots saved in \p automatic mode in a non vectorial
+  snapshotFormat() are concerned. Default value is \c false, use
+  setSnapshotsAreAsynchronous() to change it. */
+  bool snapshotsAreAsynchronous() const { return snapshotsAreAsynchronous_; }
+  /*! Returns the qglviewer::FrameSink that receives the \p automatic
+  snapshots, instead of numbered image files.
+
+  When it is non \c NULL and qglviewer::FrameSink::isOpen(), saveSnapshot()
+  simply grabs the frame buffer and gives the image to
+  qglviewer::FrameSink::addFrame(): a whole video file is created in process,
+  without the intermediate images. snapshotFileName(), snapshotFormat() and
+  snapshotCounter() are then ignored.
+
+  Default value is \c NULL. Set using setFrameSink(). */
+  qglviewer::FrameSink *frameSink() const { return frameSink_; }
+  /*! Returns \c true when the vectorial snapshots (EPS, PS and XFIG
+  snapshotFormat()) are created from the primitives given to
+  drawVectorial(qglviewer::GeometrySink &).
+
+  When \c false (default), the scene is rendered again in OpenGL feedback
+  mode, which only captures the primitives of the fixed function pipeline and
+  is very slow with some drivers. Set this value to \c true when your scene is
+  drawn with shader programs, and overload drawVectorial(). Set using
+  setGeometrySinkIsUsed(). */
+  bool geometrySinkIsUsed() const { return geometrySinkIsUsed_; }
 
   // Qt 2.3 does not support qreal default value parameters in slots.
   // Remove "Q_SLOTS" from the following line to compile with Qt 2.3
@@ -554,11 +702,28 @@ public Q_SLOTS:
   void setSnapshotCounter(int counter) { snapshotCounter_ = counter; }
   /*! Sets the snapshotQuality(). */
   void setSnapshotQuality(int quality) { snapshotQuality_ = quality; }
+  /*! Sets the snapshotsAreAsynchronous() value. */
+  void setSnapshotsAreAsynchronous(bool asynchronous = true) {
+    snapshotsAreAsynchronous_ = asynchronous;
+  }
+  void waitForPendingSnapshots();
+  /*! Sets the frameSink(). The QGLViewer does not take ownership of \p sink,
+  which must be open()ed and close()d by the caller. Use \c NULL to go back to
+  image files. */
+  void setFrameSink(qglviewer::FrameSink *sink) { frameSink_ = sink; }
+  /*! Sets the geometrySinkIsUsed() value. */
+  void setGeometrySinkIsUsed(bool used = true) { geometrySinkIsUsed_ = used; }
   bool openSnapshotFormatDialog();
   void snapshotToClipboard();
 
+public:
+  QImage renderFrame();
+  bool renderFrame(unsigned char *buffer);
+
 private:
   bool saveImageSnapshot(const QString &fileName);
+  void saveSnapshotAsynchronously(const QImage &image,
+                                  const QString &fileName);
 
 #ifndef DOXYGEN
   /* This class is used internally for screenshot that require tiling (image
@@ -672,12 +837,38 @@ public:
   startAnimation(). If animationIsStarted(), you should stopAnimation() first.
 */
   int animationPeriod() const { return animationPeriod_; }
+  /*! Returns \c true when the viewer frame clock is enabled.
+
+  The frame clock drives all the time-based motions of the viewer once per
+  displayed frame, right after it has been presented (see the \c
+  QOpenGLWidget::frameSwapped() signal):
+  \arg the spinning of the camera() frame and of the manipulatedFrame() (see
+  qglviewer::ManipulatedFrame::startSpinning()),
+  \arg the camera fly modes (QGLViewer::MOVE_FORWARD, QGLViewer::MOVE_BACKWARD
+  and QGLViewer::DRIVE),
+  \arg the camera() qglviewer::KeyFrameInterpolator paths,
+  \arg animate(), when animationIsStarted().
+
+  The individual timers of these objects are stopped and a single update() is
+  requested for all of them, so that the display is refreshed at most once per
+  screen refresh (when vertical synchronization is on) instead of once per
+  timer tick.
+
+  Motions are advanced according to the actual time elapsed since the
+  previous frame, and hence no longer depend on the frame rate. animate() is
+  called once per frame and animationPeriod() is ignored: use actual time in
+  animate() for frame-rate independent animations.
+
+  Other ManipulatedFrame and KeyFrameInterpolator keep their own timer. Default
+  value is \c false, use setFrameClockIsEnabled() to change it. */
+  bool frameClockIsEnabled() const { return frameClockIsEnabled_; }
 
 public Q_SLOTS:
   /*! Sets the animationPeriod(), in milliseconds. */
   void setAnimationPeriod(int period) { animationPeriod_ = period; }
   virtual void startAnimation();
   virtual void stopAnimation();
+  void setFrameClockIsEnabled(bool enabled = true);
   /*! Scene animation method.
 
     When animationIsStarted(), this method is in charge of the scene update
@@ -766,6 +957,18 @@ Q_SIGNALS:
   mouse. */
   void mouseGrabberChanged(qglviewer::MouseGrabber *mouseGrabber);
 
+  /*! Signal emitted at the end of paintGL() when the displayed frame takes
+  into account new mouse move events that manipulate the camera() or the
+  manipulatedFrame().
+
+  \p nbEvents is the number of mouse move events received since the previous
+  frame and \p latency is the time (in milliseconds) elapsed between the
+  reception of the first of these events and the end of the frame rendering.
+
+  Use this signal to measure the input latency of your application, and
+  compare it when mouseMoveEventsAreCoalesced() or not. */
+  void mouseMoveLatency(int nbEvents, qreal latency);
+
   /*! @name Help window */
   //@{
 public:
@@ -859,11 +1062,41 @@ protected:
   GL_MODELVIEW matrix can be modified and left in a arbitrary state. */
   virtual void draw() {}
   virtual void fastDraw();
+  virtual void drawStereo();
   virtual void postDraw();
+  virtual void drawVectorial(qglviewer::GeometrySink &sink);
   //@}
 
   /*! @name Mouse, keyboard and event handlers */
   //@{
+public:
+  /*! Returns \c true when the mouse move events that manipulate the camera()
+  or the manipulatedFrame() are coalesced.
+
+  High-rate mice and tablets send several hundreds of mouse move events per
+  second, many more than the number of frames that can be displayed. When this
+  value is \c true (default), mouseMoveEvent() simply stores the last mouse
+  move event and requests an update(). The frame is then moved only once per
+  displayed frame, right before preDraw() (see paintGL()), using the
+  displacement accumulated since the previous frame. The frame signals are
+  hence emitted once per frame, and rendering is not delayed by the processing
+  of events that would never be displayed.
+
+  Set to \c false using setMouseMoveEventsAreCoalesced() to apply each mouse
+  move event as soon as it is received. The mouseGrabber() always receives all
+  the mouse move events.
+
+  The mouseMoveLatency() signal can be used to compare the latency of the two
+  modes. */
+  bool mouseMoveEventsAreCoalesced() const {
+    return mouseMoveEventsAreCoalesced_;
+  }
+public Q_SLOTS:
+  /*! Sets the mouseMoveEventsAreCoalesced() value. */
+  void setMouseMoveEventsAreCoalesced(bool coalesced = true) {
+    mouseMoveEventsAreCoalesced_ = coalesced;
+  }
+
 protected:
   virtual void mousePressEvent(QMouseEvent *);
   virtual void mouseMoveEvent(QMouseEvent *);
@@ -926,6 +1159,16 @@ public:
   overload endSelection(), you will analyze the content of this buffer. See the
   \c glSelectBuffer() man page for details. */
   GLuint *selectBuffer() { return selectBuffer_; }
+  /*! Returns \c true when the depth buffer is read back at the end of each
+  frame, so that qglviewer::Camera::pointUnderPixel() no longer stalls the
+  OpenGL pipeline. See qglviewer::Camera::cacheDepthBuffer().
+
+  This is useful when points are picked very often (on each mouse move for
+  instance). The asynchronous read back of the entire depth buffer costs some
+  bandwidth for each frame though. Ignored in stereo mode.
+
+  Default value is \c false. Set using setDepthBufferIsCached(). */
+  bool depthBufferIsCached() const { return depthBufferIsCached_; }
 
 public Q_SLOTS:
   virtual void select(const QMouseEvent *event);
@@ -936,6 +1179,7 @@ public Q_SLOTS:
   void setSelectRegionWidth(int width) { selectRegionWidth_ = width; }
   /*! Sets the selectRegionHeight(). */
   void setSelectRegionHeight(int height) { selectRegionHeight_ = height; }
+  void setDepthBufferIsCached(bool cached = true);
   /*! Set the selectedName() value.
 
     Used in endSelection() during a selection. You should only call this method
@@ -1200,9 +1444,13 @@ public:
   QString stateFileName() const;
   virtual QDomElement domElement(const QString &name,
                                  QDomDocument &document) const;
+  virtual void writeToStream(QDataStream &stream) const;
+  static bool convertStateFile(const QString &xmlFileName,
+                               const QString &binaryFileName);
 
 public Q_SLOTS:
   virtual void initFromDOMElement(const QDomElement &element);
+  virtual void readFromStream(QDataStream &stream);
   virtual void saveStateToFile(); // cannot be const because of QMessageBox
   virtual bool restoreStateFromFile();
 
@@ -1219,7 +1467,13 @@ public Q_SLOTS:
 
     // Files are stored in a dedicated directory under user's home directory.
     setStateFileName(QDir::homeDirPath + "/.config/myApp.xml");
-    \endcode */
+
+    // Binary format, faster to read back, especially with long camera paths.
+    setStateFileName(".qglviewer.qglb");
+    \endcode
+
+    A \c .qglb extension selects the binary state file format (see
+    writeToStream()). The XML format (see domElement()) is used otherwise. */
   void setStateFileName(const QString &name) { stateFileName_ = name; }
 
 #ifndef DOXYGEN
@@ -1282,6 +1536,7 @@ private Q_SLOTS:
     setFullScreen();
   }
   void hideMessage();
+  void frameClockTick();
 
 private:
   // Copy constructor and operator= are declared private and undefined
@@ -1313,12 +1568,50 @@ private:
   bool fullScreen_;     // full screen mode
   QPoint prevPos_;      // Previous window position, used for full screen mode
 
+  // S t e r e o
+  bool stereoSinglePass_;    // both eyes drawn in one scene traversal
+  bool stereoLeftBuffer_;    // eye being drawn, used by postDraw()
+  GLuint stereoDisplayList_; // scene recorded by drawStereo()
+
+  // C o r e   p r o f i l e
+  bool coreProfileIsEnabled_;
+  qglviewer::CoreProfileRenderer *coreProfileRenderer_;
+  qglviewer::CoreProfileRenderer *offscreenCoreProfileRenderer_;
+  qglviewer::CoreProfileRenderer *coreProfileRenderer() const;
+  void loadCoreProfileMatrices() const;
+  void postDrawCoreProfile();
+  void drawScreenLines(GLenum mode, const QVector<QPointF> &points,
+                       qreal lineWidth);
+
+  // F a s t   d r a w   r e p r o j e c t i o n
+  bool fastDrawIsReprojected_;
+  int fastDrawRefreshPeriod_;
+  int nbReprojectedFrames_; // since the last draw()
+
+  // S c e n e   c a c h e
+  bool sceneIsCached_;
+  bool cachedSceneIsValid_; // reset by invalidateScene()
+  unsigned int cachedModelViewVersion_, cachedProjectionVersion_;
+  const qglviewer::ManipulatedFrame *cachedManipulatedFrame_;
+  unsigned int cachedManipulatedFrameVersion_;
+  qglviewer::ReprojectionCache *sceneCache_; // also used by fastDraw()
+  void updateSceneCache();
+  bool restoreCachedScene();
+  void releaseSceneCache();
+
   // A n i m a t i o n
   bool animationStarted_; // animation mode started
   int animationPeriod_;   // period in msecs
   int animationTimerId_;
 
+  // F r a m e   c l o c k
+  bool frameClockIsEnabled_;
+  bool frameClockIsRunning_; // a motion was advanced by the last tick
+  QElapsedTimer frameClock_;
+  void restartFrameClockTimers();
+
   // F P S    d i s p l a y
+  void updateFPS();
   QTime fpsTime_;
   unsigned int fpsCounter_;
   QString fpsString_;
@@ -1333,6 +1626,13 @@ private:
   qglviewer::ManipulatedFrame *manipulatedFrame_;
   bool manipulatedFrameIsACamera_;
 
+  // M o u s e   m o v e   c o a l e s c i n g
+  void applyPendingMouseMoveEvent();
+  bool mouseMoveEventsAreCoalesced_;
+  QMouseEvent *pendingMouseMoveEvent_;
+  int nbUndrawnMouseMoveEvents_;
+  QElapsedTimer mouseMoveLatencyTimer_;
+
   // M o u s e   G r a b b e r
   qglviewer::MouseGrabber *mouseGrabber_;
   bool mouseGrabberIsAManipulatedFrame_;
@@ -1344,6 +1644,7 @@ private:
   int selectBufferSize_;
   GLuint *selectBuffer_;
   int selectedObjectId_;
+  bool depthBufferIsCached_;
 
   // V i s u a l   h i n t s
   int visualHint_;
@@ -1455,6 +1756,20 @@ private:
   QString snapshotFileName_, snapshotFormat_;
   int snapshotCounter_, snapshotQuality_;
   TileRegion *tileRegion_;
+  bool snapshotsAreAsynchronous_;
+  QThreadPool *snapshotThreadPool_;   // created on first asynchronous snapshot
+  QSemaphore *snapshotEncoderSlots_; // bounds the number of pending images
+  qglviewer::FrameSink *frameSink_;
+  bool geometrySinkIsUsed_;
+
+  // O f f s c r e e n   r e n d e r i n g
+  bool renderOffscreenFrame();
+  bool rendersOffscreen() const;
+  QOpenGLContext *offscreenContext_;
+  QOffscreenSurface *offscreenSurface_;
+  QOpenGLFramebufferObject *offscreenFrameBuffer_;
+  QOpenGLPaintDevice *offscreenPaintDevice_; // used by renderText()
+  QSize offscreenSize_; // invalid until initializeGL() is called
 
   // Q G L V i e w e r   p o o l
   static QList<QGLViewer *> QGLViewerPool_;
@@ -1,11 +1,20 @@
 #include "quaternion.h"
 #include "domUtils.h"
+#include "batchTransform.h"
+#include <QThreadStorage>
 #include <stdlib.h> // RAND_MAX
 
 // All the methods are declared inline in Quaternion.h
 using namespace qglviewer;
 using namespace std;
 
+// The matrices returned by matrix() and inverseMatrix(), one per thread
+struct QuaternionMatrixBuffer {
+  GLdouble m[4][4];
+};
+static QThreadStorage<QuaternionMatrixBuffer> matrixBuffer;
+static QThreadStorage<QuaternionMatrixBuffer> inverseMatrixBuffer;
+
 /*! Constructs a Quaternion that will rotate from the \p from direction to the
 \p to direction.
 
@@ -68,6 +77,70 @@ Vec Quaternion::rotate(const Vec &v) const {
                  (1.0 - q11 - q00) * v[2]);
 }
 
+/*! Rotates the \p nbVectors vectors stored in \p src and writes the result in
+\p dst.
+
+Coordinates are interleaved: \p src and \p dst contain 3 * \p nbVectors
+values (x0 y0 z0 x1 y1 z1...). \p dst may be equal to \p src to rotate the
+array in place. Same as calling rotate(const Vec&) on each vector, but much
+faster on large arrays: the rotation matrix is computed once and float arrays
+are processed four vectors at a time with SSE2 or NEON instructions when
+available. */
+void Quaternion::rotate(int nbVectors, const float *src, float *dst) const {
+  BatchTransform(*this).apply(nbVectors, src, dst);
+}
+
+/*! Same as rotate(int, const float*, float*) const, with double precision
+ * coordinates. */
+void Quaternion::rotate(int nbVectors, const double *src, double *dst) const {
+  BatchTransform(*this).apply(nbVectors, src, dst);
+}
+
+/*! Same as rotate(int, const float*, float*) const, but the x, y and z
+coordinates are stored in three separate arrays, respectively \p src[0], \p
+src[1] and \p src[2] (and similarly for \p dst). */
+void Quaternion::rotate(int nbVectors, const float *const src[3],
+                        float *const dst[3]) const {
+  BatchTransform(*this).apply(nbVectors, src, dst);
+}
+
+/*! Same as rotate(int, const float *const[3], float *const[3]) const, with
+ * double precision coordinates. */
+void Quaternion::rotate(int nbVectors, const double *const src[3],
+                        double *const dst[3]) const {
+  BatchTransform(*this).apply(nbVectors, src, dst);
+}
+
+/*! Array version of inverseRotate(const Vec&). See rotate(int, const float*,
+ * float*) const for details. */
+void Quaternion::inverseRotate(int nbVectors, const float *src,
+                               float *dst) const {
+  BatchTransform(inverse()).apply(nbVectors, src, dst);
+}
+
+/*! Array version of inverseRotate(const Vec&). See rotate(int, const double*,
+ * double*) const for details. */
+void Quaternion::inverseRotate(int nbVectors, const double *src,
+                               double *dst) const {
+  BatchTransform(inverse()).apply(nbVectors, src, dst);
+}
+
+/*! Array version of inverseRotate(const Vec&), with separate coordinate
+arrays. See rotate(int, const float *const[3], float *const[3]) const for
+details. */
+void Quaternion::inverseRotate(int nbVectors, const float *const src[3],
+                               float *const dst[3]) const {
+  BatchTransform(inverse()).apply(nbVectors, src, dst);
+}
+
+/*! Array version of inverseRotate(const Vec&), with separate coordinate
+arrays. See rotate(int, const double *const[3], double *const[3]) const for
+details. */
+void Quaternion::inverseRotate(int nbVectors, const double *const src[3],
+                               double *const dst[3]) const {
+  BatchTransform(inverse()).apply(nbVectors, src, dst);
+}
+
 /*! Set the Quaternion from a (supposedly correct) 3x3 rotation matrix.
 
   The matrix is expressed in European format: its three \e columns are the
@@ -253,14 +326,15 @@ Quaternion::Quaternion(const QDomElement &element) {
 
  See also getMatrix(), getRotationMatrix() and inverseMatrix().
 
- \attention The result is only valid until the next call to matrix(). Use it
- immediately (as shown above) or consider using getMatrix() instead.
+ \attention The result is only valid until the next call to matrix() in the
+ same thread. Use it immediately (as shown above) or consider using getMatrix()
+ instead.
 
  \attention The matrix is given in OpenGL format (row-major order) and is the
  transpose of the actual mathematical European representation. Consider using
  getRotationMatrix() instead. */
 const GLdouble *Quaternion::matrix() const {
-  static GLdouble m[4][4];
+  GLdouble(&m)[4][4] = matrixBuffer.localData().m;
   getMatrix(m);
   return (const GLdouble *)(m);
 }
@@ -309,7 +383,7 @@ void Quaternion::getMatrix(GLdouble m[4][4]) const {
 /*! Same as getMatrix(), but with a \c GLdouble[16] parameter. See also
  * getInverseMatrix() and Frame::getMatrix(). */
 void Quaternion::getMatrix(GLdouble m[16]) const {
-  static GLdouble mat[4][4];
+  GLdouble mat[4][4];
   getMatrix(mat);
   int count = 0;
   for (int i = 0; i < 4; ++i)
@@ -325,7 +399,7 @@ void Quaternion::getMatrix(GLdouble m[16]) const {
   matrix. Use matrix() and getMatrix() to retrieve the OpenGL transposed
   version. */
 void Quaternion::getRotationMatrix(qreal m[3][3]) const {
-  static GLdouble mat[4][4];
+  GLdouble mat[4][4];
   getMatrix(mat);
   for (int i = 0; i < 3; ++i)
     for (int j = 0; j < 3; ++j)
@@ -336,15 +410,15 @@ void Quaternion::getRotationMatrix(qreal m[3][3]) const {
 /*! Returns the associated 4x4 OpenGL \e inverse rotation matrix. This is simply
   the matrix() of the inverse().
 
-  \attention The result is only valid until the next call to inverseMatrix().
-  Use it immediately (as in \c glMultMatrixd(q.inverseMatrix())) or use
-  getInverseMatrix() instead.
+  \attention The result is only valid until the next call to inverseMatrix()
+  in the same thread. Use it immediately (as in \c
+  glMultMatrixd(q.inverseMatrix())) or use getInverseMatrix() instead.
 
   \attention The matrix is given in OpenGL format (row-major order) and is the
   transpose of the actual mathematical European representation. Consider using
   getInverseRotationMatrix() instead. */
 const GLdouble *Quaternion::inverseMatrix() const {
-  static GLdouble m[4][4];
+  GLdouble(&m)[4][4] = inverseMatrixBuffer.localData().m;
   getInverseMatrix(m);
   return (const GLdouble *)(m);
 }
@@ -370,7 +444,7 @@ void Quaternion::getInverseMatrix(GLdouble m[16]) const {
  format uses its transposed version. See inverseMatrix() and getInverseMatrix().
  */
 void Quaternion::getInverseRotationMatrix(qreal m[3][3]) const {
-  static GLdouble mat[4][4];
+  GLdouble mat[4][4];
   getInverseMatrix(mat);
   for (int i = 0; i < 3; ++i)
     for (int j = 0; j < 3; ++j)
@@ -481,6 +555,22 @@ ostream &operator<<(ostream &o, const Quaternion &Q) {
   return o << Q[0] << '\t' << Q[1] << '\t' << Q[2] << '\t' << Q[3];
 }
 
+/*! Writes the Quaternion values in a binary \c QDataStream, as four \c double.
+ Used by the binary state files (see QGLViewer::saveStateToFile()). */
+QDataStream &operator<<(QDataStream &stream, const Quaternion &Q) {
+  return stream << double(Q[0]) << double(Q[1]) << double(Q[2])
+                << double(Q[3]);
+}
+
+/*! Reads a Quaternion written by operator<<(QDataStream&, const Quaternion&).
+ */
+QDataStream &operator>>(QDataStream &stream, Quaternion &Q) {
+  double q0, q1, q2, q3;
+  stream >> q0 >> q1 >> q2 >> q3;
+  Q.setValue(q0, q1, q2, q3);
+  return stream;
+}
+
 /*! Returns a random unit Quaternion.
 
 You can create a randomly directed unit vector using:
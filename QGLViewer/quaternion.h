@@ -183,6 +183,19 @@ public:
 
   Vec rotate(const Vec &v) const;
   Vec inverseRotate(const Vec &v) const;
+
+  void rotate(int nbVectors, const float *src, float *dst) const;
+  void rotate(int nbVectors, const double *src, double *dst) const;
+  void rotate(int nbVectors, const float *const src[3],
+              float *const dst[3]) const;
+  void rotate(int nbVectors, const double *const src[3],
+              double *const dst[3]) const;
+  void inverseRotate(int nbVectors, const float *src, float *dst) const;
+  void inverseRotate(int nbVectors, const double *src, double *dst) const;
+  void inverseRotate(int nbVectors, const float *const src[3],
+                     float *const dst[3]) const;
+  void inverseRotate(int nbVectors, const double *const src[3],
+                     double *const dst[3]) const;
   //@}
 
   /*! @name Inversion */
@@ -315,4 +328,9 @@ private:
 
 std::ostream &operator<<(std::ostream &o, const qglviewer::Quaternion &);
 
+QGLVIEWER_EXPORT QDataStream &operator<<(QDataStream &stream,
+                                         const qglviewer::Quaternion &q);
+QGLVIEWER_EXPORT QDataStream &operator>>(QDataStream &stream,
+                                         qglviewer::Quaternion &q);
+
 #endif // QGLVIEWER_QUATERNION_H
@@ -0,0 +1,439 @@
+#include "reprojectionCache.h"
+#include "camera.h"
+
+#include <QOpenGLContext>
+#include <QVector>
+
+#include <math.h>
+
+#ifndef GL_READ_FRAMEBUFFER
+#define GL_READ_FRAMEBUFFER 0x8CA8
+#endif
+#ifndef GL_DRAW_FRAMEBUFFER
+#define GL_DRAW_FRAMEBUFFER 0x8CA9
+#endif
+#ifndef GL_DEPTH24_STENCIL8
+#define GL_DEPTH24_STENCIL8 0x88F0
+#endif
+#ifndef GL_DEPTH_STENCIL
+#define GL_DEPTH_STENCIL 0x84F9
+#endif
+#ifndef GL_UNSIGNED_INT_24_8
+#define GL_UNSIGNED_INT_24_8 0x84FA
+#endif
+#ifndef GL_DEPTH_STENCIL_ATTACHMENT
+#define GL_DEPTH_STENCIL_ATTACHMENT 0x821A
+#endif
+
+using namespace qglviewer;
+
+// Distance between two vertices of the warped mesh, in pixels
+static const int meshStep = 2;
+
+// GLSL 1.20 sources, also valid in 1.40 (core profile) thanks to the defines
+static const char *const vertexShader =
+    "#if __VERSION__ >= 140\n"
+    "#define attribute in\n"
+    "#define varying out\n"
+    "#define texture2D texture\n"
+    "#endif\n"
+    "uniform mat4 reprojection;\n"
+    "uniform sampler2D depth;\n"
+    "attribute vec2 uv;\n"
+    "varying vec2 texCoord;\n"
+    "void main() {\n"
+    "  texCoord = uv;\n"
+    "  float z = 2.0 * texture2D(depth, uv).r - 1.0;\n"
+    "  gl_Position = reprojection * vec4(2.0 * uv - 1.0, z, 1.0);\n"
+    "}\n";
+
+static const char *const fragmentShader =
+    "#if __VERSION__ >= 140\n"
+    "#define varying in\n"
+    "#define texture2D texture\n"
+    "out vec4 fragColor;\n"
+    "#else\n"
+    "#define fragColor gl_FragColor\n"
+    "#endif\n"
+    "uniform sampler2D color;\n"
+    "varying vec2 texCoord;\n"
+    "void main() { fragColor = texture2D(color, texCoord); }\n";
+
+// Full screen quad, writing the captured color and depth of each pixel
+static const char *const restoreVertexShader =
+    "#if __VERSION__ >= 140\n"
+    "#define attribute in\n"
+    "#endif\n"
+    "attribute vec2 position;\n"
+    "void main() { gl_Position = vec4(position, 0.0, 1.0); }\n";
+
+static const char *const restoreFragmentShader =
+    "#if __VERSION__ >= 140\n"
+    "#define texture2D texture\n"
+    "out vec4 fragColor;\n"
+    "#else\n"
+    "#define fragColor gl_FragColor\n"
+    "#endif\n"
+    "uniform sampler2D color;\n"
+    "uniform sampler2D depth;\n"
+    "uniform vec4 viewport;\n"
+    "void main() {\n"
+    "  vec2 uv = (gl_FragCoord.xy - viewport.xy) / viewport.zw;\n"
+    "  fragColor = texture2D(color, uv);\n"
+    "  gl_FragDepth = texture2D(depth, uv).r;\n"
+    "}\n";
+
+// Inverts the column-major matrix m. Returns false if it is singular.
+static bool invertMatrix(const GLdouble m[16], GLdouble inverse[16]) {
+  GLdouble a[4][8];
+  for (int i = 0; i < 4; ++i)
+    for (int j = 0; j < 4; ++j) {
+      a[i][j] = m[i + 4 * j];
+      a[i][j + 4] = (i == j) ? 1.0 : 0.0;
+    }
+
+  // Gauss-Jordan elimination with partial pivoting
+  for (int c = 0; c < 4; ++c) {
+    int pivot = c;
+    for (int r = c + 1; r < 4; ++r)
+      if (fabs(a[r][c]) > fabs(a[pivot][c]))
+        pivot = r;
+    if (fabs(a[pivot][c]) < 1e-300)
+      return false;
+    for (int j = 0; j < 8; ++j)
+      qSwap(a[c][j], a[pivot][j]);
+
+    const GLdouble scale = 1.0 / a[c][c];
+    for (int j = 0; j < 8; ++j)
+      a[c][j] *= scale;
+    for (int r = 0; r < 4; ++r)
+      if (r != c) {
+        const GLdouble factor = a[r][c];
+        for (int j = 0; j < 8; ++j)
+          a[r][j] -= factor * a[c][j];
+      }
+  }
+
+  for (int i = 0; i < 4; ++i)
+    for (int j = 0; j < 4; ++j)
+      inverse[i + 4 * j] = a[i][j + 4];
+  return true;
+}
+
+ReprojectionCache::ReprojectionCache()
+    : context_(NULL), initialized_(false), supported_(true), valid_(false),
+      blitFramebuffer_(NULL), width_(0), height_(0), frameBuffer_(0),
+      colorTexture_(0), depthTexture_(0),
+      vertexBuffer_(QOpenGLBuffer::VertexBuffer),
+      indexBuffer_(QOpenGLBuffer::IndexBuffer), nbIndices_(0),
+      quadBuffer_(QOpenGLBuffer::VertexBuffer) {}
+
+ReprojectionCache::~ReprojectionCache() {
+  if (initialized_ && (QOpenGLContext::currentContext() == context_))
+    releaseBuffers();
+}
+
+void ReprojectionCache::releaseBuffers() {
+  if (frameBuffer_ != 0)
+    glDeleteFramebuffers(1, &frameBuffer_);
+  if (colorTexture_ != 0)
+    glDeleteTextures(1, &colorTexture_);
+  if (depthTexture_ != 0)
+    glDeleteTextures(1, &depthTexture_);
+  frameBuffer_ = colorTexture_ = depthTexture_ = 0;
+  width_ = height_ = 0;
+  valid_ = false;
+}
+
+// Compiles the programs. Returns false if frame buffer blits are not supported.
+bool ReprojectionCache::initialize() {
+  initialized_ = true;
+  context_ = QOpenGLContext::currentContext();
+  initializeOpenGLFunctions();
+
+  blitFramebuffer_ = reinterpret_cast<BlitFramebufferFunction>(
+      context_->getProcAddress("glBlitFramebuffer"));
+  if (!blitFramebuffer_) {
+    qWarning("The scene cache requires OpenGL 3.0 frame buffer blits");
+    supported_ = false;
+    return false;
+  }
+
+  const bool core = context_->format().profile() == QSurfaceFormat::CoreProfile;
+  const QByteArray version(core ? "#version 140\n" : "#version 120\n");
+  program_.addShaderFromSourceCode(QOpenGLShader::Vertex,
+                                   version + vertexShader);
+  program_.addShaderFromSourceCode(QOpenGLShader::Fragment,
+                                   version + fragmentShader);
+  program_.bindAttributeLocation("uv", 0);
+  restoreProgram_.addShaderFromSourceCode(QOpenGLShader::Vertex,
+                                          version + restoreVertexShader);
+  restoreProgram_.addShaderFromSourceCode(QOpenGLShader::Fragment,
+                                          version + restoreFragmentShader);
+  restoreProgram_.bindAttributeLocation("position", 0);
+  if (!program_.link() || !restoreProgram_.link()) {
+    qWarning("Unable to compile the scene cache shader programs");
+    supported_ = false;
+    return false;
+  }
+
+  vertexArray_.create();
+  vertexBuffer_.create();
+  indexBuffer_.create();
+
+  static const GLfloat quad[8] = {-1.0f, -1.0f, 1.0f, -1.0f,
+                                  -1.0f, 1.0f,  1.0f, 1.0f};
+  quadArray_.create();
+  quadArray_.bind();
+  quadBuffer_.create();
+  quadBuffer_.bind();
+  quadBuffer_.allocate(quad, int(sizeof(quad)));
+  restoreProgram_.enableAttributeArray(0);
+  restoreProgram_.setAttributeBuffer(0, GL_FLOAT, 0, 2);
+  quadArray_.release();
+  quadBuffer_.release();
+  return true;
+}
+
+// (Re)creates the textures, frame buffer and mesh for a new viewport size.
+bool ReprojectionCache::resize(int width, int height) {
+  releaseBuffers();
+
+  GLint previousTexture;
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTexture);
+  glGenTextures(1, &colorTexture_);
+  glBindTexture(GL_TEXTURE_2D, colorTexture_);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA,
+               GL_UNSIGNED_BYTE, NULL);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+  // Same format as the QOpenGLWidget buffer, as required by the depth blit
+  glGenTextures(1, &depthTexture_);
+  glBindTexture(GL_TEXTURE_2D, depthTexture_);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, width, height, 0,
+               GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glBindTexture(GL_TEXTURE_2D, GLuint(previousTexture));
+
+  GLint previousFrameBuffer;
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFrameBuffer);
+  glGenFramebuffers(1, &frameBuffer_);
+  glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer_);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         colorTexture_, 0);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
+                         GL_TEXTURE_2D, depthTexture_, 0);
+  const bool complete =
+      glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+  glBindFramebuffer(GL_FRAMEBUFFER, previousFrameBuffer);
+  if (!complete) {
+    qWarning("Unable to create the scene cache frame buffer");
+    releaseBuffers();
+    supported_ = false;
+    return false;
+  }
+
+  // Mesh vertices at pixel centers, every meshStep pixels and on the borders
+  QVector<GLfloat> vertices;
+  const int nx = (width - 1 + meshStep - 1) / meshStep + 1;
+  const int ny = (height - 1 + meshStep - 1) / meshStep + 1;
+  vertices.reserve(2 * nx * ny);
+  for (int j = 0; j < ny; ++j)
+    for (int i = 0; i < nx; ++i)
+      vertices << (qMin(i * meshStep, width - 1) + 0.5f) / width
+               << (qMin(j * meshStep, height - 1) + 0.5f) / height;
+
+  QVector<GLuint> indices;
+  indices.reserve(6 * (nx - 1) * (ny - 1));
+  for (int j = 0; j < ny - 1; ++j)
+    for (int i = 0; i < nx - 1; ++i) {
+      const GLuint v = GLuint(j * nx + i);
+      indices << v << v + 1 << v + nx << v + 1 << v + nx + 1 << v + nx;
+    }
+  nbIndices_ = indices.size();
+
+  vertexArray_.bind();
+  vertexBuffer_.bind();
+  vertexBuffer_.allocate(vertices.constData(),
+                         vertices.size() * int(sizeof(GLfloat)));
+  program_.enableAttributeArray(0);
+  program_.setAttributeBuffer(0, GL_FLOAT, 0, 2);
+  indexBuffer_.bind();
+  indexBuffer_.allocate(indices.constData(),
+                        indices.size() * int(sizeof(GLuint)));
+  vertexArray_.release();
+  vertexBuffer_.release();
+  indexBuffer_.release();
+
+  width_ = width;
+  height_ = height;
+  return true;
+}
+
+/* Binds the captured color and depth textures on units 0 and 1. The active
+unit and the textures bound by the application are saved, and restored by
+releaseTextures(). */
+void ReprojectionCache::bindTextures() {
+  glGetIntegerv(GL_ACTIVE_TEXTURE, &previousActiveTexture_);
+  glActiveTexture(GL_TEXTURE1);
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTextures_[1]);
+  glBindTexture(GL_TEXTURE_2D, depthTexture_);
+  glActiveTexture(GL_TEXTURE0);
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTextures_[0]);
+  glBindTexture(GL_TEXTURE_2D, colorTexture_);
+}
+
+void ReprojectionCache::releaseTextures() {
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, GLuint(previousTextures_[1]));
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, GLuint(previousTextures_[0]));
+  glActiveTexture(GLenum(previousActiveTexture_));
+}
+
+/* Copies the color and depth of the current viewport, drawn with the camera
+matrices. Returns false if the cache could not be created. */
+bool ReprojectionCache::capture(const Camera *camera) {
+  if (!initialized_ && !initialize())
+    return false;
+  if (!supported_)
+    return false;
+
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  if ((viewport[2] != width_) || (viewport[3] != height_))
+    if (!resize(viewport[2], viewport[3]))
+      return false;
+
+  GLdouble modelViewProjection[16];
+  camera->getModelViewProjectionMatrix(modelViewProjection);
+  if (!invertMatrix(modelViewProjection, inverseModelViewProjection_)) {
+    valid_ = false;
+    return false;
+  }
+
+  // Also resolves multisampled buffers
+  GLint drawFrameBuffer;
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &drawFrameBuffer);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, drawFrameBuffer);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, frameBuffer_);
+  blitFramebuffer_(viewport[0], viewport[1], viewport[0] + viewport[2],
+                   viewport[1] + viewport[3], 0, 0, width_, height_,
+                   GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+  glBindFramebuffer(GL_FRAMEBUFFER, drawFrameBuffer);
+
+  valid_ = true;
+  return true;
+}
+
+/* Draws the captured frame as seen from the current camera position. The
+depth buffer is written, so that postDraw() hints are correctly occluded. */
+void ReprojectionCache::draw(const Camera *camera) {
+  if (!valid_)
+    return;
+
+  // Captured normalized device coordinates -> current clip coordinates
+  GLdouble modelViewProjection[16];
+  camera->getModelViewProjectionMatrix(modelViewProjection);
+  GLfloat reprojection[16];
+  for (int i = 0; i < 4; ++i)
+    for (int j = 0; j < 4; ++j) {
+      GLdouble sum = 0.0;
+      for (int k = 0; k < 4; ++k)
+        sum += modelViewProjection[i + 4 * k] *
+               inverseModelViewProjection_[k + 4 * j];
+      reprojection[i + 4 * j] = GLfloat(sum);
+    }
+
+  // The captured colors are opaque, whatever the application blending
+  const GLboolean blend = glIsEnabled(GL_BLEND);
+  glDisable(GL_BLEND);
+
+  program_.bind();
+  // QMatrix4x4 takes row-major values
+  program_.setUniformValue("reprojection",
+                           QMatrix4x4(reprojection).transposed());
+  program_.setUniformValue("color", 0);
+  program_.setUniformValue("depth", 1);
+  bindTextures();
+
+  vertexArray_.bind();
+  if (!vertexArray_.isCreated()) {
+    // No vertex array object: attributes are set at each draw
+    vertexBuffer_.bind();
+    program_.enableAttributeArray(0);
+    program_.setAttributeBuffer(0, GL_FLOAT, 0, 2);
+    indexBuffer_.bind();
+  }
+  glDrawElements(GL_TRIANGLES, nbIndices_, GL_UNSIGNED_INT, NULL);
+  if (!vertexArray_.isCreated()) {
+    program_.disableAttributeArray(0);
+    vertexBuffer_.release();
+    indexBuffer_.release();
+  }
+  vertexArray_.release();
+
+  releaseTextures();
+  program_.release();
+
+  if (blend)
+    glEnable(GL_BLEND);
+}
+
+/* Copies the captured color and depth buffers back in the current viewport,
+which must have the captured size. Returns false if nothing was drawn. */
+bool ReprojectionCache::restore() {
+  if (!valid_)
+    return false;
+
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  if ((viewport[2] != width_) || (viewport[3] != height_))
+    return false;
+
+  // Depth test must be enabled for the depth to be written
+  const GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+  const GLboolean blend = glIsEnabled(GL_BLEND);
+  GLint depthFunc;
+  GLboolean depthMask;
+  glGetIntegerv(GL_DEPTH_FUNC, &depthFunc);
+  glGetBooleanv(GL_DEPTH_WRITEMASK, &depthMask);
+  glEnable(GL_DEPTH_TEST);
+  glDepthFunc(GL_ALWAYS);
+  glDepthMask(GL_TRUE);
+  glDisable(GL_BLEND);
+
+  restoreProgram_.bind();
+  restoreProgram_.setUniformValue("color", 0);
+  restoreProgram_.setUniformValue("depth", 1);
+  restoreProgram_.setUniformValue("viewport", GLfloat(viewport[0]),
+                                  GLfloat(viewport[1]), GLfloat(width_),
+                                  GLfloat(height_));
+  bindTextures();
+
+  quadArray_.bind();
+  if (!quadArray_.isCreated()) {
+    quadBuffer_.bind();
+    restoreProgram_.enableAttributeArray(0);
+    restoreProgram_.setAttributeBuffer(0, GL_FLOAT, 0, 2);
+  }
+  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+  if (!quadArray_.isCreated()) {
+    restoreProgram_.disableAttributeArray(0);
+    quadBuffer_.release();
+  }
+  quadArray_.release();
+
+  releaseTextures();
+  restoreProgram_.release();
+
+  glDepthFunc(GLenum(depthFunc));
+  glDepthMask(depthMask);
+  if (!depthTest)
+    glDisable(GL_DEPTH_TEST);
+  if (blend)
+    glEnable(GL_BLEND);
+  return true;
+}
@@ -0,0 +1,78 @@
+#ifndef QGLVIEWER_REPROJECTION_CACHE_H
+#define QGLVIEWER_REPROJECTION_CACHE_H
+
+#include "config.h"
+
+#include <QOpenGLBuffer>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLVertexArrayObject>
+
+class QOpenGLContext;
+
+namespace qglviewer {
+class Camera;
+
+#ifndef DOXYGEN
+/* The color and depth buffers of the last fully drawn frame, used by
+QGLViewer::fastDraw() when QGLViewer::fastDrawIsReprojected() and by paintGL()
+when QGLViewer::sceneIsCached().
+
+capture() copies the current frame buffer in textures. draw() renders them from
+the new camera position, as a mesh whose vertices (one every few pixels) are
+displaced according to the captured depth. restore() copies them back unchanged
+when the camera did not move. All the methods must be called with the context()
+current. Not part of the installed API. */
+class ReprojectionCache : protected QOpenGLFunctions {
+public:
+  ReprojectionCache();
+  ~ReprojectionCache();
+
+  QOpenGLContext *context() const { return context_; }
+  bool isValid() const { return valid_; }
+  // false once the frame buffer or the program could not be created
+  bool isSupported() const { return supported_; }
+
+  bool capture(const Camera *camera);
+  void draw(const Camera *camera);
+  bool restore();
+
+private:
+  bool initialize();
+  bool resize(int width, int height);
+  void releaseBuffers();
+  void bindTextures();
+  void releaseTextures();
+
+  QOpenGLContext *context_;
+  bool initialized_, supported_, valid_;
+
+  typedef void(QOPENGLF_APIENTRYP BlitFramebufferFunction)(
+      GLint, GLint, GLint, GLint, GLint, GLint, GLint, GLint, GLbitfield,
+      GLenum);
+  BlitFramebufferFunction blitFramebuffer_;
+
+  // C a p t u r e d   f r a m e
+  int width_, height_;
+  GLuint frameBuffer_, colorTexture_, depthTexture_;
+  GLdouble inverseModelViewProjection_[16];
+
+  // Application state, saved by bindTextures()
+  GLint previousActiveTexture_, previousTextures_[2];
+
+  // W a r p e d   m e s h
+  QOpenGLShaderProgram program_;
+  QOpenGLVertexArrayObject vertexArray_;
+  QOpenGLBuffer vertexBuffer_, indexBuffer_;
+  int nbIndices_;
+
+  // F u l l   s c r e e n   c o p y
+  QOpenGLShaderProgram restoreProgram_;
+  QOpenGLVertexArrayObject quadArray_;
+  QOpenGLBuffer quadBuffer_;
+};
+#endif
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_REPROJECTION_CACHE_H
@@ -1,4 +1,6 @@
 #include "qglviewer.h"
+#include "frameSink.h"
+#include "geometrySink.h"
 
 #ifndef NO_VECTORIAL_RENDER
 #include "VRender/VRender.h"
@@ -10,6 +12,19 @@
 // Output format list
 #include <QImageWriter>
 
+// Asynchronous snapshots
+#include <QEventLoop>
+#include <QPointer>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThreadPool>
+
+// Offscreen rendering
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLPaintDevice>
+
 #include <qapplication.h>
 #include <qcursor.h>
 #include <qfiledialog.h>
@@ -19,6 +34,8 @@
 #include <qmessagebox.h>
 #include <qprogressdialog.h>
 
+#include <string.h>
+
 using namespace std;
 
 ////// Static global variables - local to this file //////
@@ -173,42 +190,6 @@ static bool checkFileName(QString &fileName, QWidget *widget,
 void drawVectorial(void *param) { ((QGLViewer *)param)->drawVectorial(); }
 
 #ifndef DOXYGEN
-class ProgressDialog {
-public:
-  static void showProgressDialog(QOpenGLWidget *parent);
-  static void updateProgress(float progress, const QString &stepString);
-  static void hideProgressDialog();
-
-private:
-  static QProgressDialog *progressDialog;
-};
-
-QProgressDialog *ProgressDialog::progressDialog = NULL;
-
-void ProgressDialog::showProgressDialog(QOpenGLWidget *parent) {
-  progressDialog = new QProgressDialog(parent);
-  progressDialog->setWindowTitle("Image rendering progress");
-  progressDialog->setMinimumSize(300, 40);
-  progressDialog->setCancelButton(NULL);
-  progressDialog->show();
-}
-
-void ProgressDialog::updateProgress(float progress, const QString &stepString) {
-  progressDialog->setValue(int(progress * 100));
-  QString message(stepString);
-  if (message.length() > 33)
-    message = message.left(17) + "..." + message.right(12);
-  progressDialog->setLabelText(message);
-  progressDialog->update();
-  qApp->processEvents();
-}
-
-void ProgressDialog::hideProgressDialog() {
-  progressDialog->close();
-  delete progressDialog;
-  progressDialog = NULL;
-}
-
 class VRenderInterface : public QDialog, public Ui::VRenderInterface {
 public:
   VRenderInterface(QWidget *parent) : QDialog(parent) { setupUi(this); }
@@ -218,10 +199,21 @@ public:
 
 // Pops-up a vectorial output option dialog box and save to fileName
 // Returns -1 in case of Cancel, 0 for success and (todo) error code in case of
-// problem.
+// problem. The primitives of geometry are used when it is not NULL, instead of
+// an OpenGL feedback rendering. The export is canceled if widget is destroyed
+// meanwhile, and -1 is returned: the caller must not use widget anymore.
 static int saveVectorialSnapshot(const QString &fileName, QOpenGLWidget *widget,
-                                 const QString &snapshotFormat) {
-  static VRenderInterface *VRinterface = NULL;
+                                 const QString &snapshotFormat,
+                                 const qglviewer::GeometrySink *geometry) {
+  // Deleted with the widget it was created for
+  static QPointer<VRenderInterface> VRinterface;
+  // The viewer remains interactive during the export
+  static bool exporting = false;
+
+  if (exporting) {
+    qWarning("saveSnapshot: a vectorial snapshot is already being saved");
+    return 1;
+  }
 
   if (!VRinterface)
     VRinterface = new VRenderInterface(widget);
@@ -276,15 +268,63 @@ static int saveVectorialSnapshot(const QString &fileName, QOpenGLWidget *widget,
     qWarning("VRenderInterface::saveVectorialSnapshot: Unknown SortMethod");
   }
 
-  vparams.setProgressFunction(&ProgressDialog::updateProgress);
-  ProgressDialog::showProgressDialog(widget);
-  widget->makeCurrent();
-  widget->raise();
-  vrender::VectorialRender(drawVectorial, (void *)widget, vparams);
-  ProgressDialog::hideProgressDialog();
+  // Only the feedback rendering is done here. The primitives are sorted and
+  // exported in a worker thread, while the viewer remains interactive.
+  vrender::VectorialRenderJob job(vparams);
+  bool started;
+  if (geometry)
+    started = job.start(*geometry);
+  else {
+    widget->makeCurrent();
+    widget->raise();
+    started = job.start(drawVectorial, (void *)widget);
+  }
+  if (!started) {
+    qWarning("Vectorial rendering failed: %s",
+             job.errorMessage().toLocal8Bit().constData());
+    return 1;
+  }
+
+  // The viewer may be closed and deleted during the export, together with the
+  // progress dialog: the export is then canceled.
+  QPointer<QOpenGLWidget> viewer(widget);
+  QPointer<QProgressDialog> progressDialog = new QProgressDialog(widget);
+  progressDialog->setWindowTitle("Image rendering progress");
+  progressDialog->setMinimumSize(300, 40);
+  progressDialog->setMinimumDuration(0);
+  // Each step goes from 0 to 100%
+  progressDialog->setAutoReset(false);
+  progressDialog->setAutoClose(false);
+  QObject::connect(&job, SIGNAL(progressChanged(int)), progressDialog,
+                   SLOT(setValue(int)));
+  QObject::connect(&job, SIGNAL(stepChanged(const QString &)), progressDialog,
+                   SLOT(setLabelText(const QString &)));
+  QObject::connect(progressDialog, SIGNAL(canceled()), &job, SLOT(cancel()));
+  QObject::connect(widget, SIGNAL(destroyed()), &job, SLOT(cancel()));
+
+  QEventLoop eventLoop;
+  QObject::connect(&job, SIGNAL(finished(bool)), &eventLoop, SLOT(quit()));
+  QObject::connect(widget, SIGNAL(destroyed()), &eventLoop, SLOT(quit()));
+  progressDialog->show();
+  exporting = true;
+  eventLoop.exec();
+  exporting = false;
+
+  // The job, canceled by the widget deletion, waits for its thread when it is
+  // destroyed
+  if (!viewer)
+    return -1;
+
+  delete progressDialog;
   widget->setCursor(QCursor(Qt::ArrowCursor));
 
-  // Should return vparams.error(), but this is currently not set.
+  if (job.isCanceled())
+    return -1;
+  if (!job.errorMessage().isEmpty()) {
+    qWarning("Vectorial rendering failed: %s",
+             job.errorMessage().toLocal8Bit().constData());
+    return 1;
+  }
   return 0;
 }
 #endif // NO_VECTORIAL_RENDER
@@ -496,6 +536,9 @@ bool QGLViewer::saveImageSnapshot(const QString &fileName) {
  Then call draw() in a loop (for instance using animate() and/or a camera()
  KeyFrameInterpolator replay) to create your image sequence.
 
+ Use setFrameSink() to directly create a video file from these frames instead
+ of an image sequence (see qglviewer::FrameSink).
+
  If you want to create a Quicktime VR panoramic sequence, simply use code like
  this: \code void Viewer::createQuicktime()
  {
@@ -520,11 +563,18 @@ bool QGLViewer::saveImageSnapshot(const QString &fileName) {
 
  The VRender library was written by Cyril Soler (Cyril dot Soler at imag dot
  fr). If the generated PS or EPS file is not properly displayed, remove the
- anti-aliasing option in your postscript viewer.
+ anti-aliasing option in your postscript viewer. The viewer remains interactive
+ while a vectorial snapshot is saved. The export is canceled if the viewer is
+ deleted meanwhile, and this method then returns without using it.
 
  \note In order to correctly grab the frame buffer, the QGLViewer window is
  raised in front of other windows by this method. */
 void QGLViewer::saveSnapshot(bool automatic, bool overwrite) {
+  if (automatic && frameSink() && frameSink()->isOpen()) {
+    frameSink()->addFrame(frameBufferSnapshot());
+    return;
+  }
+
   // Ask for file name
   if (snapshotFileName().isEmpty() || !automatic) {
     QString fileName;
@@ -567,17 +617,32 @@ void QGLViewer::saveSnapshot(bool automatic, bool overwrite) {
   bool saveOK;
 #ifndef NO_VECTORIAL_RENDER
   if ((snapshotFormat() == "EPS") || (snapshotFormat() == "PS") ||
-      (snapshotFormat() == "XFIG"))
-    // Vectorial snapshot. -1 means cancel, 0 is ok, >0 (should be) an error
-    saveOK = (saveVectorialSnapshot(fileInfo.filePath(), this,
-                                    snapshotFormat()) <= 0);
-  else
+      (snapshotFormat() == "XFIG")) {
+    // Vectorial snapshot. -1 means cancel, 0 is ok, >0 (should be) an error.
+    // The viewer remains interactive, and may be deleted meanwhile.
+    QPointer<QGLViewer> viewer(this);
+    if (geometrySinkIsUsed()) {
+      qglviewer::GeometrySink sink(camera());
+      sink.setBackgroundColor(backgroundColor());
+      drawVectorial(sink);
+      saveOK = (saveVectorialSnapshot(fileInfo.filePath(), this,
+                                      snapshotFormat(), &sink) <= 0);
+    } else
+      saveOK = (saveVectorialSnapshot(fileInfo.filePath(), this,
+                                      snapshotFormat(), NULL) <= 0);
+    if (!viewer)
+      return;
+  } else
 #endif
       if (automatic) {
     QImage snapshot = frameBufferSnapshot();
-    saveOK = snapshot.save(fileInfo.filePath(),
-                           snapshotFormat().toLatin1().constData(),
-                           snapshotQuality());
+    if (snapshotsAreAsynchronous()) {
+      saveSnapshotAsynchronously(snapshot, fileInfo.filePath());
+      saveOK = true;
+    } else
+      saveOK = snapshot.save(fileInfo.filePath(),
+                             snapshotFormat().toLatin1().constData(),
+                             snapshotQuality());
   } else
     saveOK = saveImageSnapshot(fileInfo.filePath());
 
@@ -586,7 +651,68 @@ void QGLViewer::saveSnapshot(bool automatic, bool overwrite) {
                          "Unable to save snapshot in\n" + fileInfo.filePath());
 }
 
+#ifndef DOXYGEN
+// Encodes and writes an image in a snapshotThreadPool_ thread.
+class SnapshotEncoder : public QRunnable {
+public:
+  SnapshotEncoder(const QImage &image, const QString &fileName,
+                  const QByteArray &format, int quality, QSemaphore *slots)
+      : image_(image), fileName_(fileName), format_(format),
+        quality_(quality), slots_(slots) {}
+
+  virtual void run() {
+    if (!image_.save(fileName_, format_.constData(), quality_))
+      qWarning("Unable to save snapshot in %s",
+               fileName_.toLocal8Bit().constData());
+    // The image is released before a new one can be queued
+    image_ = QImage();
+    slots_->release();
+  }
+
+private:
+  QImage image_;
+  const QString fileName_;
+  const QByteArray format_;
+  const int quality_;
+  QSemaphore *const slots_;
+};
+#endif
+
+void QGLViewer::saveSnapshotAsynchronously(const QImage &image,
+                                           const QString &fileName) {
+  if (!snapshotThreadPool_) {
+    snapshotThreadPool_ = new QThreadPool();
+    // Two images per thread: one being encoded, one waiting
+    snapshotEncoderSlots_ =
+        new QSemaphore(2 * snapshotThreadPool_->maxThreadCount());
+  }
+
+  // Back pressure: waits for an encoder when too many images are pending
+  snapshotEncoderSlots_->acquire();
+  snapshotThreadPool_->start(new SnapshotEncoder(
+      image, fileName, snapshotFormat().toLatin1(), snapshotQuality(),
+      snapshotEncoderSlots_));
+}
+
+/*! Waits until all the snapshots saved by saveSnapshot() are written on disk,
+when snapshotsAreAsynchronous(). Returns immediately otherwise.
+
+Call this method at the end of a snapshot sequence, before the files are used.
+It is also called by the QGLViewer destructor. */
+void QGLViewer::waitForPendingSnapshots() {
+  if (snapshotThreadPool_)
+    snapshotThreadPool_->waitForDone();
+}
+
 QImage QGLViewer::frameBufferSnapshot() {
+  // saveSnapshot() called from draw() or a drawFinished() slot in renderFrame()
+  if (rendersOffscreen())
+    return offscreenFrameBuffer_->toImage();
+
+  // Viewer that has never been displayed
+  if ((!isValid()) || (offscreenContext_))
+    return renderFrame();
+
   // Viewer must be on top of other windows.
   makeCurrent();
   raise();
@@ -630,3 +756,156 @@ void QGLViewer::snapshotToClipboard() {
   QClipboard *cb = QApplication::clipboard();
   cb->setImage(frameBufferSnapshot());
 }
+
+////////////////////////////////////////////////////////////////////////////////
+//                O f f s c r e e n   r e n d e r i n g                       //
+////////////////////////////////////////////////////////////////////////////////
+
+/*! Renders a frame and returns the resulting image, whose size is the viewer's
+width() and height().
+
+This method is mainly intended for batch rendering: the viewer does not need to
+be shown, nor the Qt event loop to be running (a \c QApplication is still
+needed). Simply resize() the viewer and call renderFrame() in a loop:
+\code
+QApplication application(argc, argv);
+Viewer viewer; // never shown
+viewer.resize(256, 256);
+for (int i = 0; i < nbModels; ++i) {
+  viewer.setModel(i); // Your own method
+  viewer.showEntireScene();
+  viewer.renderFrame().save(QString("thumbnail-%1.png").arg(i));
+}
+\endcode
+
+When the viewer has not been shown, a private OpenGL context (with the viewer's
+\c format()) is created on a \c QOffscreenSurface and the frame is rendered in
+a frame buffer object. The regular pipeline is used: initializeGL() (and hence
+init()) is called on the first call, resizeGL() when the viewer size changes,
+and then paintGL(), with preDraw(), draw() and postDraw(). renderText() and
+drawText() are supported, as well as saveSnapshot() in \p automatic mode.
+
+No display or GPU is needed. Use the \c offscreen or \c eglfs Qt platform
+plugins (\c -platform command line option or \c QT_QPA_PLATFORM environment
+variable) when no X server is available. With Mesa, \c
+LIBGL_ALWAYS_SOFTWARE=1 renders on the CPU with llvmpipe.
+
+When the viewer has already been shown, its own frame buffer is rendered and
+returned using \c QOpenGLWidget::grabFramebuffer().
+
+A null image is returned if the OpenGL context cannot be created. */
+QImage QGLViewer::renderFrame() {
+  if ((isValid()) && (!offscreenContext_))
+    return QOpenGLWidget::grabFramebuffer();
+
+  if (!renderOffscreenFrame())
+    return QImage();
+
+  const QImage image = offscreenFrameBuffer_->toImage();
+  offscreenFrameBuffer_->release();
+  offscreenContext_->doneCurrent();
+  return image;
+}
+
+/*! Same as renderFrame(), but the pixels are written in \p buffer, without
+any QImage allocation or conversion.
+
+\p buffer must be at least \c 4*width()*height() bytes long. Pixels are
+stored as RGBA bytes, from the bottom row to the top row of the image (\c
+glReadPixels() convention).
+
+Returns \c false if the frame could not be rendered. */
+bool QGLViewer::renderFrame(unsigned char *buffer) {
+  if ((isValid()) && (!offscreenContext_)) {
+    const QImage image = QOpenGLWidget::grabFramebuffer()
+                             .convertToFormat(QImage::Format_RGBA8888)
+                             .mirrored();
+    for (int y = 0; y < image.height(); ++y)
+      memcpy(buffer + 4 * y * image.width(), image.constScanLine(y),
+             4 * image.width());
+    return !image.isNull();
+  }
+
+  if (!renderOffscreenFrame())
+    return false;
+
+  if (offscreenFrameBuffer_->format().samples() > 0) {
+    // Multisampled buffers cannot be read directly
+    QOpenGLFramebufferObject resolved(offscreenFrameBuffer_->size());
+    QOpenGLFramebufferObject::blitFramebuffer(&resolved, offscreenFrameBuffer_);
+    resolved.bind();
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, resolved.width(), resolved.height(), GL_RGBA,
+                 GL_UNSIGNED_BYTE, buffer);
+    resolved.release();
+  } else {
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, offscreenFrameBuffer_->width(),
+                 offscreenFrameBuffer_->height(), GL_RGBA, GL_UNSIGNED_BYTE,
+                 buffer);
+  }
+
+  offscreenFrameBuffer_->release();
+  offscreenContext_->doneCurrent();
+  return true;
+}
+
+// Returns true when the current OpenGL context is the renderFrame() one.
+bool QGLViewer::rendersOffscreen() const {
+  return (offscreenContext_) &&
+         (QOpenGLContext::currentContext() == offscreenContext_);
+}
+
+// Creates the offscreen context and frame buffer if needed, makes them current
+// and calls paintGL(). The context is left current.
+bool QGLViewer::renderOffscreenFrame() {
+  if (!offscreenContext_) {
+    offscreenSurface_ = new QOffscreenSurface();
+    offscreenSurface_->setFormat(format());
+    offscreenSurface_->create();
+
+    offscreenContext_ = new QOpenGLContext();
+    offscreenContext_->setFormat(format());
+    if (!offscreenContext_->create()) {
+      qWarning("Unable to create an offscreen OpenGL context");
+      delete offscreenContext_;
+      offscreenContext_ = NULL;
+      delete offscreenSurface_;
+      offscreenSurface_ = NULL;
+      return false;
+    }
+  }
+
+  if (!offscreenContext_->makeCurrent(offscreenSurface_)) {
+    qWarning("Unable to make the offscreen OpenGL context current");
+    return false;
+  }
+
+  const QSize size(width(), height());
+  if ((!offscreenFrameBuffer_) || (offscreenFrameBuffer_->size() != size)) {
+    delete offscreenPaintDevice_;
+    delete offscreenFrameBuffer_;
+
+    QOpenGLFramebufferObjectFormat frameBufferFormat;
+    frameBufferFormat.setAttachment(
+        QOpenGLFramebufferObject::CombinedDepthStencil);
+    frameBufferFormat.setSamples(qMax(format().samples(), 0));
+    offscreenFrameBuffer_ =
+        new QOpenGLFramebufferObject(size, frameBufferFormat);
+    offscreenPaintDevice_ = new QOpenGLPaintDevice(size);
+  }
+  offscreenFrameBuffer_->bind();
+
+  if (!offscreenSize_.isValid()) {
+    initializeGL();
+    offscreenSize_ = QSize(0, 0);
+  }
+
+  if (offscreenSize_ != size) {
+    resizeGL(size.width(), size.height());
+    offscreenSize_ = size;
+  }
+
+  paintGL();
+  return true;
+}
@@ -140,3 +140,17 @@ void Vec::initFromDOMElement(const QDomElement &element) {
 ostream &operator<<(ostream &o, const Vec &v) {
   return o << v.x << '\t' << v.y << '\t' << v.z;
 }
+
+/*! Writes the Vec coordinates in a binary \c QDataStream, as three \c double.
+ Used by the binary state files (see QGLViewer::saveStateToFile()). */
+QDataStream &operator<<(QDataStream &stream, const Vec &v) {
+  return stream << double(v.x) << double(v.y) << double(v.z);
+}
+
+/*! Reads a Vec written by operator<<(QDataStream&, const Vec&). */
+QDataStream &operator>>(QDataStream &stream, Vec &v) {
+  double x, y, z;
+  stream >> x >> y >> z;
+  v.setValue(x, y, z);
+  return stream;
+}
@@ -4,6 +4,7 @@
 #include <iostream>
 #include <math.h>
 
+#include <QDataStream>
 #include <QDomElement>
 
 // Included by all files as vec.h is at the end of the include hierarchy
@@ -358,4 +359,9 @@ cout << "Position=" << pos << endl;
 
 std::ostream &operator<<(std::ostream &o, const qglviewer::Vec &);
 
+QGLVIEWER_EXPORT QDataStream &operator<<(QDataStream &stream,
+                                         const qglviewer::Vec &v);
+QGLVIEWER_EXPORT QDataStream &operator>>(QDataStream &stream,
+                                         qglviewer::Vec &v);
+
 #endif // QGLVIEWER_VEC_H
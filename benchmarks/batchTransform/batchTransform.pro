@@ -0,0 +1,15 @@
+# Measures the throughput of the array versions of Frame::coordinatesOf(),
+# compared to the per-point Vec version.
+
+# Points are transformed by a Frame with a reference Frame, using interleaved
+# and separated coordinate arrays, in float and double precision. The maximum
+# difference with the per-point results is printed for each method.
+
+# Usage: batchTransform [nbPoints [nbIterations]]
+
+TEMPLATE = app
+TARGET   = batchTransform
+
+SOURCES  = main.cpp
+
+include( ../../examples/examples.pri )
@@ -0,0 +1,111 @@
+#include <QGLViewer/frame.h>
+
+#include <QElapsedTimer>
+#include <QVector>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace qglviewer;
+
+// Per-point reference results, used to check the array versions
+static QVector<Vec> reference;
+
+// Coordinate j of point i is res[i * pointStride + j * coordinateStride]
+template <typename Real>
+static double maxError(const Real *res, int pointStride, int coordinateStride) {
+  double error = 0.0;
+  for (int i = 0; i < reference.size(); ++i)
+    for (int j = 0; j < 3; ++j) {
+      const Real r = res[i * pointStride + j * coordinateStride];
+      error = qMax(error, fabs(double(r) - reference[i][j]));
+    }
+  return error;
+}
+
+static void report(const char *name, int nbPoints, int nbIterations,
+                   qint64 nsecs, double error) {
+  const double pointsPerSecond = 1.0e9 * nbPoints * nbIterations / nsecs;
+  printf("%-28s %10.1f Mpoints/s   max error %g\n", name,
+         pointsPerSecond / 1.0e6, error);
+}
+
+template <typename Real>
+static void benchmarkInterleaved(const char *name, const Frame &frame,
+                                 const QVector<Vec> &points, int nbIterations) {
+  const int nb = points.size();
+  QVector<Real> src(3 * nb), res(3 * nb);
+  for (int i = 0; i < nb; ++i)
+    for (int j = 0; j < 3; ++j)
+      src[3 * i + j] = Real(points[i][j]);
+
+  QElapsedTimer timer;
+  timer.start();
+  for (int it = 0; it < nbIterations; ++it)
+    frame.coordinatesOf(nb, src.constData(), res.data());
+  report(name, nb, nbIterations, timer.nsecsElapsed(),
+         maxError(res.constData(), 3, 1));
+}
+
+template <typename Real>
+static void benchmarkSeparated(const char *name, const Frame &frame,
+                               const QVector<Vec> &points, int nbIterations) {
+  const int nb = points.size();
+  // x, y and z arrays, stored one after the other
+  QVector<Real> src(3 * nb), res(3 * nb);
+  for (int i = 0; i < nb; ++i)
+    for (int j = 0; j < 3; ++j)
+      src[j * nb + i] = Real(points[i][j]);
+  const Real *const s[3] = {src.constData(), src.constData() + nb,
+                            src.constData() + 2 * nb};
+  Real *const r[3] = {res.data(), res.data() + nb, res.data() + 2 * nb};
+
+  QElapsedTimer timer;
+  timer.start();
+  for (int it = 0; it < nbIterations; ++it)
+    frame.coordinatesOf(nb, s, r);
+  report(name, nb, nbIterations, timer.nsecsElapsed(),
+         maxError(res.constData(), 1, nb));
+}
+
+int main(int argc, char **argv) {
+  const int nbPoints = (argc > 1) ? atoi(argv[1]) : 1000000;
+  const int nbIterations = (argc > 2) ? atoi(argv[2]) : 20;
+  if (nbPoints <= 0 || nbIterations <= 0) {
+    fprintf(stderr, "Usage: %s [nbPoints [nbIterations]]\n", argv[0]);
+    return 1;
+  }
+
+  Frame referenceFrame(Vec(1.0, -2.0, 0.5),
+                       Quaternion(Vec(1.0, 1.0, 0.0), 0.7));
+  Frame frame(Vec(-0.3, 0.2, 4.0), Quaternion(Vec(0.0, 0.2, 1.0), -1.3));
+  frame.setReferenceFrame(&referenceFrame);
+
+  srand(1);
+  QVector<Vec> points(nbPoints);
+  for (int i = 0; i < nbPoints; ++i)
+    points[i] = Vec(10.0 * rand() / RAND_MAX - 5.0,
+                    10.0 * rand() / RAND_MAX - 5.0,
+                    10.0 * rand() / RAND_MAX - 5.0);
+
+  printf("%d points, %d iterations\n", nbPoints, nbIterations);
+
+  reference.resize(nbPoints);
+  QElapsedTimer timer;
+  timer.start();
+  for (int it = 0; it < nbIterations; ++it)
+    for (int i = 0; i < nbPoints; ++i)
+      reference[i] = frame.coordinatesOf(points[i]);
+  report("Vec coordinatesOf", nbPoints, nbIterations, timer.nsecsElapsed(),
+         0.0);
+
+  benchmarkInterleaved<float>("float interleaved", frame, points,
+                              nbIterations);
+  benchmarkSeparated<float>("float separated", frame, points, nbIterations);
+  benchmarkInterleaved<double>("double interleaved", frame, points,
+                               nbIterations);
+  benchmarkSeparated<double>("double separated", frame, points, nbIterations);
+
+  return 0;
+}
@@ -0,0 +1,8 @@
+# Shared by the benchmarks: the micro-benchmark harness (common/benchmark.h),
+# which reports warmup, iterations, percentiles and optionally a JSON file.
+
+INCLUDEPATH *= $$PWD/common
+HEADERS *= $$PWD/common/benchmark.h
+SOURCES *= $$PWD/common/benchmark.cpp
+
+include( $$PWD/../examples/examples.pri )
@@ -0,0 +1,8 @@
+TEMPLATE      = subdirs
+SUBDIRS       = batchTransform concurrency core dvonn quarto
+
+# The VRender classes are internal to the library: they are not exported from
+# the Windows dll, and are missing when it is built with NO_VECTORIAL_RENDER.
+!win32:!contains( DEFINES, NO_VECTORIAL_RENDER ) {
+  SUBDIRS    += positioning
+}
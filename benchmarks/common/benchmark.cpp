@@ -0,0 +1,187 @@
+#include "benchmark.h"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStringList>
+#include <QSysInfo>
+
+#include <algorithm>
+#include <stdio.h>
+
+Benchmark::Benchmark(const QString &name, int itemsPerRun, int iterations)
+    : name_(name), itemsPerRun_(qMax(itemsPerRun, 1)),
+      iterations_(qMax(iterations, 1)) {}
+
+BenchmarkRunner::BenchmarkRunner()
+    : warmup_(-1), iterations_(-1), list_(false) {}
+
+BenchmarkRunner::~BenchmarkRunner() { qDeleteAll(benchmarks_); }
+
+void BenchmarkRunner::add(Benchmark *benchmark) {
+  benchmarks_.append(benchmark);
+}
+
+void BenchmarkRunner::usage() const {
+  fprintf(stderr,
+          "Usage: %s [--warmup N] [--iterations N] [--filter TEXT] "
+          "[--json FILE] [--list]\n",
+          qPrintable(QCoreApplication::applicationName()));
+}
+
+bool BenchmarkRunner::parseArguments() {
+  const QStringList arguments = QCoreApplication::arguments();
+  for (int i = 1; i < arguments.size(); ++i) {
+    const QString &option = arguments[i];
+    if (option == "--list") {
+      list_ = true;
+      continue;
+    }
+
+    if (i + 1 >= arguments.size())
+      return false;
+    const QString value = arguments[++i];
+    bool ok = true;
+    if (option == "--warmup")
+      warmup_ = value.toInt(&ok);
+    else if (option == "--iterations")
+      iterations_ = value.toInt(&ok);
+    else if (option == "--filter")
+      filter_ = value;
+    else if (option == "--json")
+      jsonFileName_ = value;
+    else
+      return false;
+
+    if (!ok || warmup_ < -1 || iterations_ == 0 || iterations_ < -1)
+      return false;
+  }
+  return true;
+}
+
+qint64 BenchmarkRunner::Result::percentile(double p) const {
+  // Nearest rank
+  const int rank = int(p / 100.0 * samples.size() + 0.5);
+  return samples[qBound(0, rank - 1, samples.size() - 1)];
+}
+
+BenchmarkRunner::Result BenchmarkRunner::measure(Benchmark *benchmark) const {
+  const int iterations =
+      (iterations_ > 0) ? iterations_ : benchmark->iterations();
+
+  Result result;
+  result.name = benchmark->name();
+  result.items = benchmark->itemsPerRun();
+  result.warmup = (warmup_ >= 0) ? warmup_ : qMax(iterations / 10, 1);
+
+  for (int i = 0; i < result.warmup; ++i) {
+    benchmark->setUp();
+    benchmark->run();
+    benchmark->tearDown();
+  }
+
+  QElapsedTimer timer;
+  result.samples.reserve(iterations);
+  for (int i = 0; i < iterations; ++i) {
+    benchmark->setUp();
+    timer.start();
+    benchmark->run();
+    result.samples.append(timer.nsecsElapsed());
+    benchmark->tearDown();
+  }
+
+  std::sort(result.samples.begin(), result.samples.end());
+  double sum = 0.0;
+  for (int i = 0; i < result.samples.size(); ++i)
+    sum += result.samples[i];
+  result.mean = sum / result.samples.size();
+  return result;
+}
+
+void BenchmarkRunner::print(const Result &result) const {
+  const double median = result.percentile(50.0);
+  printf("%-36s %12.0f %12.0f %12.0f %12.0f %12.1f\n",
+         qPrintable(result.name), double(result.samples.first()), median,
+         double(result.percentile(90.0)), double(result.percentile(99.0)),
+         median / result.items);
+  fflush(stdout);
+}
+
+bool BenchmarkRunner::saveJSON(const QString &fileName) const {
+  QJsonObject machine;
+  machine["cpuArchitecture"] = QSysInfo::currentCpuArchitecture();
+  machine["buildAbi"] = QSysInfo::buildAbi();
+  machine["kernelType"] = QSysInfo::kernelType();
+  machine["kernelVersion"] = QSysInfo::kernelVersion();
+  machine["product"] = QSysInfo::prettyProductName();
+  machine["qtVersion"] = QString(qVersion());
+
+  QJsonArray benchmarks;
+  Q_FOREACH (const Result &result, results_) {
+    QJsonObject times;
+    times["min"] = double(result.samples.first());
+    times["mean"] = result.mean;
+    times["median"] = double(result.percentile(50.0));
+    times["p90"] = double(result.percentile(90.0));
+    times["p99"] = double(result.percentile(99.0));
+    times["max"] = double(result.samples.last());
+
+    QJsonObject benchmark;
+    benchmark["name"] = result.name;
+    benchmark["itemsPerRun"] = result.items;
+    benchmark["warmup"] = result.warmup;
+    benchmark["iterations"] = result.samples.size();
+    benchmark["nanoseconds"] = times;
+    benchmark["medianNanosecondsPerItem"] =
+        result.percentile(50.0) / double(result.items);
+    benchmarks.append(benchmark);
+  }
+
+  QJsonObject root;
+  root["executable"] = QCoreApplication::applicationName();
+  root["date"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+  root["machine"] = machine;
+  root["benchmarks"] = benchmarks;
+
+  QFile file(fileName);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    fprintf(stderr, "Unable to write %s\n", qPrintable(fileName));
+    return false;
+  }
+  file.write(QJsonDocument(root).toJson());
+  return true;
+}
+
+int BenchmarkRunner::exec() {
+  if (!parseArguments()) {
+    usage();
+    return 1;
+  }
+
+  QList<Benchmark *> selected;
+  Q_FOREACH (Benchmark *benchmark, benchmarks_)
+    if (benchmark->name().contains(filter_))
+      selected.append(benchmark);
+
+  if (list_) {
+    Q_FOREACH (Benchmark *benchmark, selected)
+      printf("%s\n", qPrintable(benchmark->name()));
+    return 0;
+  }
+
+  printf("%-36s %12s %12s %12s %12s %12s\n", "Benchmark (ns)", "min",
+         "median", "p90", "p99", "median/item");
+  results_.clear();
+  Q_FOREACH (Benchmark *benchmark, selected) {
+    results_.append(measure(benchmark));
+    print(results_.last());
+  }
+
+  if (!jsonFileName_.isEmpty() && !saveJSON(jsonFileName_))
+    return 1;
+  return 0;
+}
@@ -0,0 +1,75 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <QList>
+#include <QString>
+#include <QVector>
+
+// A micro-benchmark. run() is timed, setUp() and tearDown() are called before
+// and after each timed run and are not measured.
+class Benchmark {
+public:
+  // itemsPerRun is the number of elementary operations (points, primitives...)
+  // done by each run(), used to report a time per item.
+  Benchmark(const QString &name, int itemsPerRun = 1, int iterations = 100);
+  virtual ~Benchmark() {}
+
+  QString name() const { return name_; }
+  int itemsPerRun() const { return itemsPerRun_; }
+  int iterations() const { return iterations_; }
+
+  virtual void setUp() {}
+  virtual void run() = 0;
+  virtual void tearDown() {}
+
+private:
+  QString name_;
+  int itemsPerRun_;
+  int iterations_;
+};
+
+// Runs the benchmarks, prints a summary table and optionally saves the
+// results in a JSON file. Command line options (see usage()):
+//   --warmup N      untimed runs before the measures (default iterations/10)
+//   --iterations N  timed runs, overrides each Benchmark::iterations()
+//   --filter TEXT   only runs the benchmarks whose name contains TEXT
+//   --json FILE     saves the results in FILE
+//   --list          lists the benchmark names and exits
+// A QCoreApplication must have been created.
+class BenchmarkRunner {
+public:
+  BenchmarkRunner();
+  ~BenchmarkRunner();
+
+  // Takes ownership of benchmark.
+  void add(Benchmark *benchmark);
+
+  // Returns the process exit code.
+  int exec();
+
+private:
+  struct Result {
+    QString name;
+    int items;
+    int warmup;
+    QVector<qint64> samples; // sorted, in nanoseconds
+    double mean;
+
+    qint64 percentile(double p) const;
+  };
+
+  bool parseArguments();
+  void usage() const;
+  Result measure(Benchmark *benchmark) const;
+  void print(const Result &result) const;
+  bool saveJSON(const QString &fileName) const;
+
+  QList<Benchmark *> benchmarks_;
+  QList<Result> results_;
+
+  int warmup_, iterations_;
+  QString filter_, jsonFileName_;
+  bool list_;
+};
+
+#endif // BENCHMARK_H
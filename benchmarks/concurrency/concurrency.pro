@@ -0,0 +1,35 @@
+# A stress test of the thread safety of the const query API: many threads
+# simultaneously query a shared Camera, Frame hierarchy and KeyFrameInterpolator
+# (whose lazily computed matrices and keyFrames are reset before each round),
+# and run independent VRender BSP sorts and EPS exports. Every result is
+# compared to the one computed by the main thread, the program returns 1 when
+# one of them differs.
+
+# No window or OpenGL context is created, the test runs on a headless box.
+
+# Data races may give the expected results: build the library and this program
+# with ThreadSanitizer to detect them, with
+#   qmake CONFIG+=sanitizer CONFIG+=sanitize_thread
+# in both the QGLViewer and the benchmarks directories.
+
+# Usage: concurrencyStress [--rounds N] [--threads N] [--filter TEXT]
+
+TEMPLATE = app
+TARGET   = concurrencyStress
+
+QT *= concurrent
+
+HEADERS  = stressTest.h
+SOURCES  = main.cpp
+
+# The VRender classes are internal to the library: they are not exported from
+# the Windows dll, and are missing when it is built with NO_VECTORIAL_RENDER.
+win32|contains( DEFINES, NO_VECTORIAL_RENDER ) {
+  DEFINES *= NO_VECTORIAL_RENDER
+} else {
+  INCLUDEPATH *= ../../QGLViewer/VRender
+  HEADERS *= vrender.h
+  SOURCES *= vrender.cpp
+}
+
+include( ../benchmarks.pri )
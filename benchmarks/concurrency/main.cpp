@@ -0,0 +1,313 @@
+#include "stressTest.h"
+#ifndef NO_VECTORIAL_RENDER
+#include "vrender.h"
+#endif
+
+#include <QGLViewer/camera.h>
+#include <QGLViewer/keyFrameInterpolator.h>
+
+#include <QBuffer>
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QThread>
+#include <QThreadPool>
+#include <QtConcurrentMap>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace qglviewer;
+
+static qreal randomReal(qreal min, qreal max) {
+  return min + (max - min) * rand() / RAND_MAX;
+}
+
+static Vec randomVec(qreal size) {
+  return Vec(randomReal(-size, size), randomReal(-size, size),
+             randomReal(-size, size));
+}
+
+static Quaternion randomRotation() {
+  return Quaternion(randomVec(1.0), randomReal(-3.0, 3.0));
+}
+
+// The results are computed by the same code: they must be bitwise identical.
+static bool same(const Vec &a, const Vec &b) {
+  return (a.x == b.x) && (a.y == b.y) && (a.z == b.z);
+}
+
+static bool same(const Quaternion &a, const Quaternion &b) {
+  return (a[0] == b[0]) && (a[1] == b[1]) && (a[2] == b[2]) && (a[3] == b[3]);
+}
+
+static bool same(const GLdouble *a, const GLdouble *b, int size) {
+  for (int i = 0; i < size; ++i)
+    if (a[i] != b[i])
+      return false;
+  return true;
+}
+
+//   C a m e r a
+
+//  Projections, matrices and frustum planes of a shared Camera, whose lazily
+// computed matrices are invalidated before each round.
+class CameraQueries : public StressTest {
+public:
+  CameraQueries(int nbPoints) : StressTest("camera/queries") {
+    camera_.setScreenWidthAndHeight(1280, 720);
+    camera_.setSceneRadius(10.0);
+    camera_.setPosition(Vec(3.0, -25.0, 12.0));
+    camera_.lookAt(Vec(0.0, 0.0, 0.0));
+
+    camera_.getModelViewMatrix(modelView_);
+    camera_.getModelViewProjectionMatrix(modelViewProjection_);
+    for (int i = 0; i < nbPoints; ++i) {
+      const Vec point = randomVec(10.0);
+      points_.append(point);
+      projected_.append(camera_.projectedCoordinatesOf(point));
+      unprojected_.append(camera_.unprojectedCoordinatesOf(point));
+      distance_.append(camera_.distanceToFrustumPlane(i % 6, point));
+    }
+  }
+
+  virtual void prepare() {
+    // Emits the Frame modified() signal, which invalidates the matrices
+    camera_.setPosition(camera_.position());
+  }
+
+  virtual bool check(int) const {
+    GLdouble m[16];
+    camera_.getModelViewProjectionMatrix(m);
+    bool ok = same(m, modelViewProjection_, 16);
+    camera_.getModelViewMatrix(m);
+    ok = ok && same(m, modelView_, 16);
+
+    for (int i = 0; i < points_.size(); ++i) {
+      ok = ok &&
+           same(camera_.projectedCoordinatesOf(points_[i]), projected_[i]);
+      ok = ok &&
+           same(camera_.unprojectedCoordinatesOf(points_[i]), unprojected_[i]);
+      ok = ok && (camera_.distanceToFrustumPlane(i % 6, points_[i]) ==
+                  distance_[i]);
+    }
+    return ok;
+  }
+
+private:
+  Camera camera_;
+  GLdouble modelView_[16], modelViewProjection_[16];
+  QVector<Vec> points_, projected_, unprojected_;
+  QVector<qreal> distance_;
+};
+
+//   F r a m e s   a n d   Q u a t e r n i o n s
+
+//  A shared chain of Frames, each one defined in the previous one. The
+// matrices returned by pointer are per thread buffers: they must not be
+// overwritten by the other threads.
+class FrameQueries : public StressTest {
+public:
+  FrameQueries(int depth, int nbPoints) : StressTest("frame/queries") {
+    for (int i = 0; i < depth; ++i) {
+      Frame *frame = new Frame(randomVec(1.0), randomRotation());
+      if (i > 0)
+        frame->setReferenceFrame(frames_.last());
+      frames_.append(frame);
+    }
+
+    const Frame &leaf = *frames_.last();
+    memcpy(worldMatrix_, leaf.worldMatrix(), sizeof(worldMatrix_));
+    memcpy(matrix_, leaf.matrix(), sizeof(matrix_));
+    memcpy(rotation_, leaf.orientation().matrix(), sizeof(rotation_));
+    memcpy(inverseRotation_, leaf.orientation().inverseMatrix(),
+           sizeof(inverseRotation_));
+    for (int i = 0; i < nbPoints; ++i) {
+      const Vec point = randomVec(5.0);
+      points_.append(point);
+      coordinates_.append(leaf.coordinatesOf(point));
+      inverseCoordinates_.append(leaf.inverseCoordinatesOf(point));
+    }
+  }
+
+  ~FrameQueries() { qDeleteAll(frames_); }
+
+  virtual bool check(int) const {
+    const Frame &leaf = *frames_.last();
+    const Quaternion q = leaf.orientation();
+
+    const GLdouble *worldMatrix = leaf.worldMatrix();
+    const GLdouble *matrix = leaf.matrix();
+    const GLdouble *rotation = q.matrix();
+    const GLdouble *inverseRotation = q.inverseMatrix();
+
+    bool ok = true;
+    for (int i = 0; i < points_.size(); ++i) {
+      ok = ok && same(leaf.coordinatesOf(points_[i]), coordinates_[i]);
+      ok = ok &&
+           same(leaf.inverseCoordinatesOf(points_[i]), inverseCoordinates_[i]);
+    }
+
+    GLdouble m[16];
+    leaf.getWorldMatrix(m);
+    ok = ok && same(m, worldMatrix_, 16);
+
+    // Checked last, so that the other threads had time to use their buffers
+    return ok && same(worldMatrix, worldMatrix_, 16) &&
+           same(matrix, matrix_, 16) && same(rotation, rotation_, 16) &&
+           same(inverseRotation, inverseRotation_, 16);
+  }
+
+private:
+  QList<Frame *> frames_;
+  GLdouble worldMatrix_[16], matrix_[16], rotation_[16], inverseRotation_[16];
+  QVector<Vec> points_, coordinates_, inverseCoordinates_;
+};
+
+//   K e y F r a m e s
+
+//  A shared KeyFrameInterpolator, restored with readFromStream() before each
+// round: its keyFrames are decoded by the first thread that queries them.
+class KeyFrameQueries : public StressTest {
+public:
+  KeyFrameQueries(int nbKeyFrames) : StressTest("keyFrame/queries") {
+    KeyFrameInterpolator original;
+    for (int i = 0; i < nbKeyFrames; ++i)
+      original.addKeyFrame(Frame(randomVec(10.0), randomRotation()), i);
+
+    QBuffer buffer(&data_);
+    buffer.open(QIODevice::WriteOnly);
+    QDataStream stream(&buffer);
+    original.writeToStream(stream);
+
+    // References decoded by the main thread
+    prepare();
+    duration_ = interpolator_.duration();
+    for (int i = 0; i < interpolator_.numberOfKeyFrames(); ++i) {
+      const Frame keyFrame = interpolator_.keyFrame(i);
+      positions_.append(keyFrame.position());
+      orientations_.append(keyFrame.orientation());
+      times_.append(interpolator_.keyFrameTime(i));
+    }
+  }
+
+  virtual void prepare() {
+    QDataStream stream(data_);
+    interpolator_.readFromStream(stream);
+  }
+
+  virtual bool check(int task) const {
+    // Half of the threads start with a query which does not decode
+    if ((task % 2 == 0) &&
+        (interpolator_.numberOfKeyFrames() != positions_.size()))
+      return false;
+
+    bool ok = (interpolator_.duration() == duration_);
+    for (int i = 0; i < positions_.size(); ++i) {
+      const Frame keyFrame = interpolator_.keyFrame(i);
+      ok = ok && same(keyFrame.position(), positions_[i]) &&
+           same(keyFrame.orientation(), orientations_[i]) &&
+           (interpolator_.keyFrameTime(i) == times_[i]);
+    }
+    return ok && (interpolator_.numberOfKeyFrames() == positions_.size());
+  }
+
+private:
+  QByteArray data_;
+  KeyFrameInterpolator interpolator_;
+  qreal duration_;
+  QVector<Vec> positions_;
+  QVector<Quaternion> orientations_;
+  QVector<qreal> times_;
+};
+
+//   R u n n e r
+
+struct Task {
+  const StressTest *test;
+  int index;
+  bool ok;
+};
+
+static void runTask(Task &task) { task.ok = task.test->check(task.index); }
+
+//  Runs rounds of nbTasks simultaneous check(). Returns the number of failed
+// tasks.
+static int runStressTest(StressTest *test, int rounds, int nbTasks) {
+  QVector<Task> tasks(nbTasks);
+  int failures = 0;
+  for (int r = 0; r < rounds; ++r) {
+    test->prepare();
+    for (int i = 0; i < nbTasks; ++i) {
+      tasks[i].test = test;
+      tasks[i].index = i;
+      tasks[i].ok = false;
+    }
+    QtConcurrent::blockingMap(tasks, runTask);
+    for (int i = 0; i < nbTasks; ++i)
+      if (!tasks[i].ok)
+        ++failures;
+  }
+  return failures;
+}
+
+static void usage() {
+  fprintf(stderr, "Usage: %s [--rounds N] [--threads N] [--filter TEXT]\n",
+          qPrintable(QCoreApplication::applicationName()));
+}
+
+int main(int argc, char **argv) {
+  // No window and no OpenGL context: runs on a headless box
+  QCoreApplication application(argc, argv);
+  srand(1);
+
+  int rounds = 50;
+  int threads = QThread::idealThreadCount();
+  QString filter;
+  const QStringList arguments = QCoreApplication::arguments();
+  for (int i = 1; i < arguments.size(); i += 2) {
+    bool ok = (i + 1 < arguments.size());
+    const QString value = ok ? arguments[i + 1] : QString();
+    if (arguments[i] == "--rounds")
+      rounds = value.toInt(&ok);
+    else if (arguments[i] == "--threads")
+      threads = value.toInt(&ok);
+    else if (arguments[i] == "--filter")
+      filter = value;
+    else
+      ok = false;
+
+    if (!ok || rounds < 1 || threads < 1) {
+      usage();
+      return 1;
+    }
+  }
+
+  // At least two threads, even on a single core box
+  threads = qMax(threads, 2);
+  QThreadPool::globalInstance()->setMaxThreadCount(threads);
+
+  QList<StressTest *> tests;
+  tests.append(new CameraQueries(200));
+  tests.append(new FrameQueries(8, 200));
+  tests.append(new KeyFrameQueries(20));
+#ifndef NO_VECTORIAL_RENDER
+  tests.append(createVRenderStressTest(300));
+#endif
+
+  int res = 0;
+  Q_FOREACH (StressTest *test, tests) {
+    if (!test->name().contains(filter))
+      continue;
+    // More tasks than threads, so that threads start in the middle of a round
+    const int failures = runStressTest(test, rounds, 4 * threads);
+    printf("%-28s %d rounds of %d tasks on %d threads: %s\n",
+           qPrintable(test->name()), rounds, 4 * threads, threads,
+           failures ? qPrintable(QString("%1 FAILED").arg(failures)) : "ok");
+    if (failures)
+      res = 1;
+  }
+
+  qDeleteAll(tests);
+  return res;
+}
@@ -0,0 +1,28 @@
+#ifndef STRESS_TEST_H
+#define STRESS_TEST_H
+
+#include <QString>
+
+//  A concurrency stress test. check() is called simultaneously by many
+// threads on the same instance, and compares the results of const queries on
+// shared objects to references computed by the main thread.
+class StressTest {
+public:
+  explicit StressTest(const QString &name) : name_(name) {}
+  virtual ~StressTest() {}
+
+  QString name() const { return name_; }
+
+  //  Called by the main thread before each round. Resets the lazily computed
+  // state of the shared objects, so that the threads race to compute it.
+  virtual void prepare() {}
+
+  //  Called concurrently, task ranging from 0 to the number of tasks of the
+  // round. Returns false when a result differs from its reference.
+  virtual bool check(int task) const = 0;
+
+private:
+  QString name_;
+};
+
+#endif // STRESS_TEST_H
@@ -0,0 +1,114 @@
+#include "vrender.h"
+#include "stressTest.h"
+
+#include <QGLViewer/camera.h>
+#include <QGLViewer/geometrySink.h>
+
+// Internal VRender headers, not installed with the library
+#include "Exporter.h"
+#include "ParserGL.h"
+#include "Primitive.h"
+#include "SortMethod.h"
+#include "VRender.h"
+
+#include <QFile>
+#include <QTemporaryDir>
+
+#include <math.h>
+#include <stdlib.h>
+#include <vector>
+
+using namespace qglviewer;
+using namespace vrender;
+
+static qreal randomReal(qreal min, qreal max) {
+  return min + (max - min) * rand() / RAND_MAX;
+}
+
+static Vec randomVec(qreal size) {
+  return Vec(randomReal(-size, size), randomReal(-size, size),
+             randomReal(-size, size));
+}
+
+class VRenderStressTest : public StressTest {
+public:
+  VRenderStressTest(int nbTriangles) : StressTest("vrender/sort and export") {
+    Camera camera;
+    camera.setScreenWidthAndHeight(1280, 720);
+    camera.setSceneRadius(10.0);
+    camera.setPosition(Vec(3.0, -25.0, 12.0));
+    camera.lookAt(Vec(0.0, 0.0, 0.0));
+
+    GeometrySink sink(&camera);
+    for (int i = 0; i < nbTriangles; ++i) {
+      sink.setColor(QColor::fromRgbF(randomReal(0.0, 1.0),
+                                     randomReal(0.0, 1.0),
+                                     randomReal(0.0, 1.0)));
+      const Vec center = randomVec(5.0);
+      sink.addWorldTriangle(center + randomVec(1.0), center + randomVec(1.0),
+                            center + randomVec(1.0));
+    }
+    buffer_ = sink.feedbackBuffer();
+    width_ = sink.width();
+    height_ = sink.height();
+
+    reference_ = sortAndExport(-1);
+  }
+
+  virtual bool check(int task) const {
+    return !reference_.isEmpty() && (sortAndExport(task) == reference_);
+  }
+
+private:
+  //  Parses the scene, adds a tilted disk of 150 vertices which crosses it
+  // (split by the BSP, which used to overflow a static array of 100 vertex
+  // signs), sorts and exports it. Returns the content of the EPS file.
+  QByteArray sortAndExport(int task) const {
+    QVector<float> work = buffer_;
+    work.detach();
+    std::vector<PtrPrimitive> primitives;
+    VRenderParams params;
+    ParserGL parser;
+    parser.parseFeedbackBuffer(work.data(), work.size(), primitives, params);
+
+    std::vector<Feedback3DColor> disk;
+    const int nbVertices = 150;
+    for (int i = 0; i < nbVertices; ++i) {
+      const float angle = 2.0f * float(M_PI) * i / nbVertices;
+      const float x = 0.5f * width_ + 300.0f * cosf(angle);
+      const float y = 0.5f * height_ + 300.0f * sinf(angle);
+      // Position, depth increasing with x, and color
+      GLfloat vertex[7] = {x, y, x, 0.2f, 0.4f, 0.8f, 1.0f};
+      disk.push_back(Feedback3DColor(vertex));
+    }
+    primitives.push_back(new Polygone(disk));
+
+    BSPSortMethod sort;
+    sort.sortPrimitives(primitives, params);
+
+    const QString fileName =
+        directory_.path() + QString("/task%1.eps").arg(task);
+    EPSExporter exporter;
+    exporter.setBoundingBox(0.0f, 0.0f, width_, height_);
+    exporter.setClearBackground(true);
+    exporter.setClearColor(1.0f, 1.0f, 1.0f);
+    exporter.exportToFile(fileName, primitives, params);
+
+    for (unsigned int i = 0; i < primitives.size(); ++i)
+      delete primitives[i];
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+      return QByteArray();
+    return file.readAll();
+  }
+
+  QVector<float> buffer_;
+  int width_, height_;
+  QTemporaryDir directory_;
+  QByteArray reference_;
+};
+
+StressTest *createVRenderStressTest(int nbTriangles) {
+  return new VRenderStressTest(nbTriangles);
+}
@@ -0,0 +1,11 @@
+#ifndef VRENDER_STRESS_TEST_H
+#define VRENDER_STRESS_TEST_H
+
+class StressTest;
+
+//  Concurrent VRender BSP sorts and EPS exports of a synthetic scene captured
+// with a GeometrySink. Each task sorts and exports its own copy of the scene,
+// which must be identical to the one exported by the main thread.
+StressTest *createVRenderStressTest(int nbTriangles);
+
+#endif // VRENDER_STRESS_TEST_H
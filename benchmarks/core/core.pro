@@ -0,0 +1,25 @@
+# Micro-benchmarks of the core library: Frame hierarchy transforms, Camera
+# point projection, KeyFrameInterpolator and Quaternion::squad() evaluation,
+# MouseGrabber hit-testing, and the VRender parsing, sorting and export stages
+# on a synthetic scene.
+
+# No window or OpenGL context is created, the benchmarks run on a headless box.
+
+# Usage: coreBenchmarks [--warmup N] [--iterations N] [--filter TEXT] [--json FILE] [--list]
+
+TEMPLATE = app
+TARGET   = coreBenchmarks
+
+SOURCES  = main.cpp
+
+# The VRender classes are internal to the library: they are not exported from
+# the Windows dll, and are missing when it is built with NO_VECTORIAL_RENDER.
+win32|contains( DEFINES, NO_VECTORIAL_RENDER ) {
+  DEFINES *= NO_VECTORIAL_RENDER
+} else {
+  INCLUDEPATH *= ../../QGLViewer/VRender
+  HEADERS *= vrender.h
+  SOURCES *= vrender.cpp
+}
+
+include( ../benchmarks.pri )
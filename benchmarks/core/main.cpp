@@ -0,0 +1,218 @@
+#include "benchmark.h"
+#ifndef NO_VECTORIAL_RENDER
+#include "vrender.h"
+#endif
+
+#include <QGLViewer/camera.h>
+#include <QGLViewer/keyFrameInterpolator.h>
+#include <QGLViewer/manipulatedFrame.h>
+
+#include <QCoreApplication>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace qglviewer;
+
+// Accumulates the results, so that the compiler cannot discard the measured
+// computations. Printed at the end.
+static double sink = 0.0;
+
+static void consume(const Vec &v) { sink += v.x + v.y + v.z; }
+
+static qreal randomReal(qreal min, qreal max) {
+  return min + (max - min) * rand() / RAND_MAX;
+}
+
+static Vec randomVec(qreal size) {
+  return Vec(randomReal(-size, size), randomReal(-size, size),
+             randomReal(-size, size));
+}
+
+static Quaternion randomRotation() {
+  return Quaternion(randomVec(1.0), randomReal(-3.0, 3.0));
+}
+
+static void initCamera(Camera &camera) {
+  camera.setScreenWidthAndHeight(1280, 720);
+  camera.setSceneRadius(10.0);
+  camera.setPosition(Vec(3.0, -25.0, 12.0));
+  camera.lookAt(Vec(0.0, 0.0, 0.0));
+  camera.computeProjectionMatrix();
+  camera.computeModelViewMatrix();
+}
+
+//   F r a m e   h i e r a r c h y
+
+// A chain of Frames, each one defined in the previous one.
+class FrameHierarchy : public Benchmark {
+public:
+  FrameHierarchy(const QString &name, bool inverse, int depth, int nbPoints)
+      : Benchmark(name, nbPoints, 200), inverse_(inverse) {
+    for (int i = 0; i < depth; ++i) {
+      Frame *frame = new Frame(randomVec(1.0), randomRotation());
+      if (i > 0)
+        frame->setReferenceFrame(frames_.last());
+      frames_.append(frame);
+    }
+    for (int i = 0; i < nbPoints; ++i)
+      points_.append(randomVec(5.0));
+  }
+
+  ~FrameHierarchy() { qDeleteAll(frames_); }
+
+  virtual void run() {
+    const Frame &leaf = *frames_.last();
+    if (inverse_)
+      for (int i = 0; i < points_.size(); ++i)
+        consume(leaf.inverseCoordinatesOf(points_[i]));
+    else
+      for (int i = 0; i < points_.size(); ++i)
+        consume(leaf.coordinatesOf(points_[i]));
+  }
+
+private:
+  bool inverse_;
+  QList<Frame *> frames_;
+  QVector<Vec> points_;
+};
+
+//   P o i n t   p r o j e c t i o n
+
+class Projection : public Benchmark {
+public:
+  Projection(const QString &name, bool unproject, int nbPoints)
+      : Benchmark(name, nbPoints, 200), unproject_(unproject) {
+    initCamera(camera_);
+    for (int i = 0; i < nbPoints; ++i)
+      if (unproject)
+        points_.append(Vec(randomReal(0.0, 1280.0), randomReal(0.0, 720.0),
+                           randomReal(0.0, 1.0)));
+      else
+        points_.append(randomVec(10.0));
+  }
+
+  virtual void run() {
+    if (unproject_)
+      for (int i = 0; i < points_.size(); ++i)
+        consume(camera_.unprojectedCoordinatesOf(points_[i]));
+    else
+      for (int i = 0; i < points_.size(); ++i)
+        consume(camera_.projectedCoordinatesOf(points_[i]));
+  }
+
+private:
+  bool unproject_;
+  Camera camera_;
+  QVector<Vec> points_;
+};
+
+//   K e y F r a m e s
+
+// Evaluates a KeyFrameInterpolator path at regularly spaced times.
+class KeyFrameEvaluation : public Benchmark {
+public:
+  KeyFrameEvaluation(const QString &name, int nbKeyFrames, int nbEvaluations)
+      : Benchmark(name, nbEvaluations, 200), interpolator_(&frame_) {
+    for (int i = 0; i < nbKeyFrames; ++i)
+      interpolator_.addKeyFrame(
+          Frame(randomVec(10.0), randomRotation()), i);
+  }
+
+  virtual void run() {
+    const int nb = itemsPerRun();
+    const qreal duration = interpolator_.duration();
+    for (int i = 0; i < nb; ++i) {
+      interpolator_.interpolateAtTime(duration * i / nb);
+      consume(frame_.position());
+    }
+  }
+
+private:
+  Frame frame_;
+  KeyFrameInterpolator interpolator_;
+};
+
+class Squad : public Benchmark {
+public:
+  Squad(const QString &name, int nbEvaluations)
+      : Benchmark(name, nbEvaluations, 200) {
+    Quaternion q[4];
+    for (int i = 0; i < 4; ++i)
+      q[i] = randomRotation();
+    a_ = q[1];
+    b_ = q[2];
+    tgA_ = Quaternion::squadTangent(q[0], q[1], q[2]);
+    tgB_ = Quaternion::squadTangent(q[1], q[2], q[3]);
+  }
+
+  virtual void run() {
+    const int nb = itemsPerRun();
+    for (int i = 0; i < nb; ++i) {
+      const Quaternion q =
+          Quaternion::squad(a_, tgA_, tgB_, b_, qreal(i) / nb);
+      sink += q[0] + q[1] + q[2] + q[3];
+    }
+  }
+
+private:
+  Quaternion a_, tgA_, tgB_, b_;
+};
+
+//   M o u s e G r a b b e r   h i t - t e s t i n g
+
+//  Calls checkIfGrabsMouse() on all the MouseGrabberPool(), as
+// QGLViewer::mouseMoveEvent() does when no MouseGrabber is under the mouse.
+class GrabberHitTest : public Benchmark {
+public:
+  GrabberHitTest(const QString &name, int nbGrabbers, int nbMoves)
+      : Benchmark(name, nbGrabbers * nbMoves, 100), nbMoves_(nbMoves) {
+    initCamera(camera_);
+    for (int i = 0; i < nbGrabbers; ++i) {
+      ManipulatedFrame *frame = new ManipulatedFrame();
+      frame->setPosition(randomVec(10.0));
+      grabbers_.append(frame);
+    }
+  }
+
+  ~GrabberHitTest() { qDeleteAll(grabbers_); }
+
+  virtual void run() {
+    for (int i = 0; i < nbMoves_; ++i) {
+      const int x = (37 * i) % camera_.screenWidth();
+      const int y = (91 * i) % camera_.screenHeight();
+      Q_FOREACH (MouseGrabber *mg, MouseGrabber::MouseGrabberPool()) {
+        mg->checkIfGrabsMouse(x, y, &camera_);
+        if (mg->grabsMouse())
+          sink += 1.0;
+      }
+    }
+  }
+
+private:
+  int nbMoves_;
+  Camera camera_;
+  QList<ManipulatedFrame *> grabbers_;
+};
+
+int main(int argc, char **argv) {
+  // No window and no OpenGL context: runs on a headless box
+  QCoreApplication application(argc, argv);
+  srand(1);
+
+  BenchmarkRunner runner;
+  runner.add(new FrameHierarchy("frame/coordinatesOf", false, 8, 1000));
+  runner.add(new FrameHierarchy("frame/inverseCoordinatesOf", true, 8, 1000));
+  runner.add(new Projection("camera/projectedCoordinatesOf", false, 1000));
+  runner.add(new Projection("camera/unprojectedCoordinatesOf", true, 1000));
+  runner.add(new KeyFrameEvaluation("keyFrame/interpolateAtTime", 20, 1000));
+  runner.add(new Squad("quaternion/squad", 10000));
+  runner.add(new GrabberHitTest("grabber/checkIfGrabsMouse", 1000, 10));
+#ifndef NO_VECTORIAL_RENDER
+  addVRenderBenchmarks(runner);
+#endif
+
+  const int res = runner.exec();
+  fprintf(stderr, "checksum %g\n", sink);
+  return res;
+}
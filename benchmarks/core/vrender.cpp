@@ -0,0 +1,165 @@
+#include "vrender.h"
+#include "benchmark.h"
+
+#include <QGLViewer/camera.h>
+#include <QGLViewer/geometrySink.h>
+
+// Internal VRender headers, not installed with the library
+#include "Exporter.h"
+#include "ParserGL.h"
+#include "SortMethod.h"
+#include "VRender.h"
+
+#include <QTemporaryDir>
+
+#include <stdlib.h>
+#include <vector>
+
+using namespace qglviewer;
+using namespace vrender;
+
+static qreal randomReal(qreal min, qreal max) {
+  return min + (max - min) * rand() / RAND_MAX;
+}
+
+static Vec randomVec(qreal size) {
+  return Vec(randomReal(-size, size), randomReal(-size, size),
+             randomReal(-size, size));
+}
+
+// Small random triangles, segments and points in a cube, seen by a camera.
+static void createScene(GeometrySink &sink, int nbTriangles) {
+  for (int i = 0; i < nbTriangles; ++i) {
+    sink.setColor(QColor::fromRgbF(randomReal(0.0, 1.0),
+                                   randomReal(0.0, 1.0),
+                                   randomReal(0.0, 1.0)));
+    const Vec center = randomVec(5.0);
+    sink.addWorldTriangle(center + randomVec(1.0), center + randomVec(1.0),
+                          center + randomVec(1.0));
+  }
+
+  sink.setColor(Qt::black);
+  for (int i = 0; i < nbTriangles / 5; ++i) {
+    const Vec center = randomVec(5.0);
+    sink.addWorldSegment(center, center + randomVec(1.0));
+  }
+  for (int i = 0; i < nbTriangles / 10; ++i)
+    sink.addWorldPoint(randomVec(5.0));
+}
+
+static void deletePrimitives(std::vector<PtrPrimitive> &primitives) {
+  for (unsigned int i = 0; i < primitives.size(); ++i)
+    delete primitives[i];
+  primitives.clear();
+}
+
+//  Base class of the VRender benchmarks: owns the scene feedback buffer,
+// parses it in setUp() when parseInSetUp, and releases the primitives after
+// each run.
+class VRenderBenchmark : public Benchmark {
+public:
+  VRenderBenchmark(const QString &name, const GeometrySink &sink,
+                   bool parseInSetUp, int iterations)
+      : Benchmark(name, sink.numberOfPrimitives(), iterations),
+        buffer_(sink.feedbackBuffer()), parseInSetUp_(parseInSetUp),
+        width_(sink.width()), height_(sink.height()) {}
+
+  virtual void setUp() {
+    // The parser normalizes the coordinates in place
+    work_ = buffer_;
+    work_.detach();
+    if (parseInSetUp_)
+      parse();
+  }
+
+  virtual void tearDown() { deletePrimitives(primitives_); }
+
+protected:
+  void parse() {
+    ParserGL parser;
+    parser.parseFeedbackBuffer(work_.data(), work_.size(), primitives_,
+                               params_);
+  }
+
+  QVector<float> buffer_, work_;
+  bool parseInSetUp_;
+  int width_, height_;
+  std::vector<PtrPrimitive> primitives_;
+  VRenderParams params_;
+};
+
+class VRenderParse : public VRenderBenchmark {
+public:
+  VRenderParse(const QString &name, const GeometrySink &sink)
+      : VRenderBenchmark(name, sink, false, 50) {}
+
+  virtual void run() { parse(); }
+};
+
+class VRenderSort : public VRenderBenchmark {
+public:
+  VRenderSort(const QString &name, const GeometrySink &sink,
+              VRenderParams::VRenderSortMethod method)
+      : VRenderBenchmark(name, sink, true, 10), method_(method) {}
+
+  virtual void run() {
+    switch (method_) {
+    case VRenderParams::BSPSort: {
+      BSPSortMethod sort;
+      sort.sortPrimitives(primitives_, params_);
+    } break;
+    case VRenderParams::TopologicalSort:
+    case VRenderParams::AdvancedTopologicalSort: {
+      TopologicalSortMethod sort;
+      sort.setBreakCycles(method_ == VRenderParams::AdvancedTopologicalSort);
+      sort.sortPrimitives(primitives_, params_);
+    } break;
+    case VRenderParams::NoSorting:
+      break;
+    }
+  }
+
+private:
+  VRenderParams::VRenderSortMethod method_;
+};
+
+class VRenderExport : public VRenderBenchmark {
+public:
+  VRenderExport(const QString &name, const GeometrySink &sink,
+                const QString &fileName)
+      : VRenderBenchmark(name, sink, true, 10), fileName_(fileName) {}
+
+  virtual void run() {
+    EPSExporter exporter;
+    exporter.setBoundingBox(0.0f, 0.0f, width_, height_);
+    exporter.setClearBackground(true);
+    exporter.setClearColor(1.0f, 1.0f, 1.0f);
+    exporter.exportToFile(fileName_, primitives_, params_);
+  }
+
+private:
+  QString fileName_;
+};
+
+void addVRenderBenchmarks(BenchmarkRunner &runner) {
+  Camera camera;
+  camera.setScreenWidthAndHeight(1280, 720);
+  camera.setSceneRadius(10.0);
+  camera.setPosition(Vec(3.0, -25.0, 12.0));
+  camera.lookAt(Vec(0.0, 0.0, 0.0));
+
+  GeometrySink sink(&camera);
+  createScene(sink, 1000);
+
+  // Removed with the application
+  static QTemporaryDir directory;
+
+  runner.add(new VRenderParse("vrender/parse", sink));
+  runner.add(new VRenderSort("vrender/sort BSP", sink, VRenderParams::BSPSort));
+  runner.add(new VRenderSort("vrender/sort topological", sink,
+                             VRenderParams::TopologicalSort));
+  runner.add(new VRenderSort("vrender/sort advanced topological", sink,
+                             VRenderParams::AdvancedTopologicalSort));
+  runner.add(new VRenderExport("vrender/export EPS", sink,
+                               directory.path() + "/benchmark.eps"));
+}
@@ -0,0 +1,10 @@
+#ifndef VRENDER_BENCHMARKS_H
+#define VRENDER_BENCHMARKS_H
+
+class BenchmarkRunner;
+
+// VRender parsing, sorting and export stages, on a synthetic scene captured
+// with a GeometrySink (no OpenGL context needed).
+void addVRenderBenchmarks(BenchmarkRunner &runner);
+
+#endif // VRENDER_BENCHMARKS_H
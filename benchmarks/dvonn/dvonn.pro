@@ -0,0 +1,17 @@
+# Playout speed of the dvonn example game logic: random games played from a
+# random placement, as a self-playing engine would, with and without undoing
+# them afterwards.
+
+# No window or OpenGL context is created, the benchmarks run on a headless box.
+
+# Usage: dvonnBenchmarks [--warmup N] [--iterations N] [--filter TEXT] [--json FILE] [--list]
+
+TEMPLATE = app
+TARGET   = dvonnBenchmarks
+
+DVONN = ../../examples/contribs/dvonn
+INCLUDEPATH *= $$DVONN
+HEADERS  = $$DVONN/board.h $$DVONN/game.h
+SOURCES  = main.cpp $$DVONN/board.cpp $$DVONN/game.cpp
+
+include( ../benchmarks.pri )
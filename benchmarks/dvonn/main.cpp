@@ -0,0 +1,77 @@
+#include "benchmark.h"
+
+#include "game.h"
+
+#include <QCoreApplication>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+using namespace dvonn;
+
+// Accumulates the results, so that the compiler cannot discard the measured
+// computations. Printed at the end.
+static double sink = 0.0;
+
+//   P l a y o u t s
+
+//  Plays nbGames random games to the end from a random placement, which is
+// done in setUp(). With undo, all the moves are then undone, as a search
+// would do to get back to its root position.
+class Playout : public Benchmark {
+public:
+  Playout(const QString &name, bool undo, int nbGames)
+      : Benchmark(name, nbGames, 50), undo_(undo) {
+    for (int i = 0; i < nbGames; ++i)
+      games_.push_back(new Game());
+  }
+
+  ~Playout() {
+    for (unsigned int i = 0; i < games_.size(); ++i)
+      delete games_[i];
+  }
+
+  virtual void setUp() {
+    for (unsigned int i = 0; i < games_.size(); ++i) {
+      games_[i]->reinit();
+      games_[i]->randomlyFinishPlacement();
+    }
+  }
+
+  virtual void run() {
+    for (unsigned int i = 0; i < games_.size(); ++i) {
+      Game &game = *games_[i];
+      Game::Move m;
+      int nbMoves = 0;
+      while (!game.isOver() && game.getRandomMove(game.theOnePlaying(), m)) {
+        game.doMove(m);
+        ++nbMoves;
+      }
+      sink += nbMoves + game.score(WhitePlayer) - game.score(BlackPlayer);
+      if (undo_) {
+        // Back to the position after the placement
+        for (int j = 0; j < nbMoves; ++j)
+          game.undo();
+        sink += game.board().heightMax();
+      }
+    }
+  }
+
+private:
+  bool undo_;
+  std::vector<Game *> games_;
+};
+
+int main(int argc, char **argv) {
+  QCoreApplication application(argc, argv);
+  srand(1);
+
+  BenchmarkRunner runner;
+  runner.add(new Playout("dvonn/playout", false, 20));
+  runner.add(new Playout("dvonn/playoutAndUndo", true, 20));
+
+  const int res = runner.exec();
+  fprintf(stderr, "checksum %g\n", sink);
+  return res;
+}
@@ -0,0 +1,41 @@
+#ifndef GPC_POSITIONING_H
+#define GPC_POSITIONING_H
+
+// Internal VRender headers, not installed with the library
+#include "Primitive.h"
+#include "gpc.h"
+
+//  The gpc based vrender::PrimitivePositioning::computeRelativePosition() of
+// libQGLViewer 2.7.0, the reference of the regression test.
+class GPCPositioning {
+public:
+  typedef enum { Independent = 0x0, Upper = 0x1, Lower = 0x2 } RelativePosition;
+
+  static int computeRelativePosition(const vrender::Primitive *p1,
+                                     const vrender::Primitive *p2);
+
+private:
+  static int computeRelativePosition(const vrender::Polygone *p1,
+                                     const vrender::Polygone *p2);
+  static int computeRelativePosition(const vrender::Polygone *p1,
+                                     const vrender::Segment *p2);
+  static int computeRelativePosition(const vrender::Polygone *p1,
+                                     const vrender::Point *p2);
+  static int computeRelativePosition(const vrender::Segment *p1,
+                                     const vrender::Segment *p2);
+
+  static bool pointOutOfPolygon_XY(const vrender::Vector3 &P,
+                                   const vrender::Polygone *Q, double I_EPS);
+  static bool intersectSegments_XY(const vrender::Vector2 &P1,
+                                   const vrender::Vector2 &Q1,
+                                   const vrender::Vector2 &P2,
+                                   const vrender::Vector2 &Q2, double I_EPS,
+                                   double &t1, double &t2);
+  static gpc_polygon createGPCPolygon_XY(const vrender::Polygone *P);
+
+  static int inverseRP(int);
+
+  static double _EPS;
+};
+
+#endif // GPC_POSITIONING_H
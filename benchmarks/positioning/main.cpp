@@ -0,0 +1,249 @@
+#include "benchmark.h"
+#include "gpcPositioning.h"
+
+#include <QGLViewer/geometrySink.h>
+
+// Internal VRender headers, not installed with the library
+#include "ParserGL.h"
+#include "Primitive.h"
+#include "PrimitivePositioning.h"
+#include "SortMethod.h"
+#include "VRender.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdexcept>
+#include <vector>
+
+using namespace qglviewer;
+using namespace vrender;
+
+// The primitives given to the sort methods: parsed, and possibly split.
+struct Corpus {
+  QString name;
+  std::vector<PtrPrimitive> primitives;
+};
+
+static QList<Corpus *> corpora;
+
+static qreal randomReal(qreal min, qreal max) {
+  return min + (max - min) * rand() / RAND_MAX;
+}
+
+//   C o r p u s
+
+// Reads a feedback buffer saved as text, with # comment lines.
+static bool loadFixture(const QString &fileName, QVector<float> &buffer) {
+  QFile file(fileName);
+  if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    return false;
+
+  QTextStream stream(&file);
+  while (!stream.atEnd()) {
+    const QString line = stream.readLine().trimmed();
+    if (line.isEmpty() || line.startsWith('#'))
+      continue;
+    Q_FOREACH (const QString &value, line.split(' ', QString::SkipEmptyParts))
+      buffer.append(value.toFloat());
+  }
+  return true;
+}
+
+static void addCorpus(const QString &name, QVector<float> buffer,
+                      bool split) {
+  Corpus *corpus = new Corpus;
+  corpus->name = name;
+  VRenderParams params;
+  ParserGL parser;
+  // The coordinates are normalized in place
+  buffer.detach();
+  parser.parseFeedbackBuffer(buffer.data(), buffer.size(), corpus->primitives,
+                             params);
+
+  //  The BSP splits the primitives by the planes of the polygons, which
+  // creates polygons of more than 3 vertices.
+  if (split) {
+    corpus->name += " (BSP split)";
+    BSPSortMethod sort;
+    sort.sortPrimitives(corpus->primitives, params);
+  }
+  corpora.append(corpus);
+}
+
+//  Random scenes, in window coordinates: overlapping triangles, triangles in
+// a common plane, a height field mesh whose triangles share their edges, with
+// segments and points lying on it.
+static void addRandomCorpus(int seed) {
+  srand(seed);
+  GeometrySink sink(640, 480);
+
+  for (int i = 0; i < 150; ++i) {
+    const Vec center(randomReal(0.0, 640.0), randomReal(0.0, 480.0),
+                     randomReal(0.1, 0.9));
+    sink.setColor(QColor::fromRgbF(randomReal(0.0, 1.0), 0.5, 0.5));
+    Vec v[3];
+    for (int j = 0; j < 3; ++j)
+      v[j] = center + Vec(randomReal(-60.0, 60.0), randomReal(-60.0, 60.0),
+                          randomReal(-0.1, 0.1));
+    sink.addTriangle(v[0], v[1], v[2]);
+  }
+
+  // z = a x + b y + c
+  const qreal a = randomReal(-1e-4, 1e-4), b = randomReal(-1e-4, 1e-4);
+  sink.setColor(Qt::green);
+  for (int i = 0; i < 50; ++i) {
+    Vec v[3];
+    for (int j = 0; j < 3; ++j) {
+      v[j] = Vec(randomReal(100.0, 540.0), randomReal(100.0, 380.0), 0.0);
+      v[j].z = a * v[j].x + b * v[j].y + 0.5;
+    }
+    sink.addTriangle(v[0], v[1], v[2]);
+  }
+
+  const int n = 8;
+  Vec grid[n + 1][n + 1];
+  for (int i = 0; i <= n; ++i)
+    for (int j = 0; j <= n; ++j)
+      grid[i][j] = Vec(120.0 + 50.0 * i, 40.0 + 50.0 * j,
+                       0.5 + 0.05 * sin(0.7 * i + randomReal(0.0, 0.3)) +
+                           0.05 * cos(0.9 * j));
+  sink.setColor(Qt::blue);
+  for (int i = 0; i < n; ++i)
+    for (int j = 0; j < n; ++j) {
+      sink.addTriangle(grid[i][j], grid[i + 1][j], grid[i + 1][j + 1]);
+      sink.addTriangle(grid[i][j], grid[i + 1][j + 1], grid[i][j + 1]);
+    }
+
+  sink.setColor(Qt::black);
+  for (int i = 0; i < n; ++i) {
+    sink.addSegment(grid[i][i], grid[i + 1][i + 1]);
+    sink.addSegment(grid[i][0], grid[i][n]);
+    sink.addPoint(grid[i][n - i]);
+  }
+  for (int i = 0; i < 50; ++i) {
+    const Vec p(randomReal(0.0, 640.0), randomReal(0.0, 480.0),
+                randomReal(0.0, 1.0));
+    sink.addSegment(p, p + Vec(randomReal(-100.0, 100.0),
+                               randomReal(-100.0, 100.0),
+                               randomReal(-0.2, 0.2)));
+    sink.addPoint(Vec(randomReal(0.0, 640.0), randomReal(0.0, 480.0),
+                      randomReal(0.0, 1.0)));
+  }
+
+  const QString name = QString("random %1").arg(seed);
+  addCorpus(name, sink.feedbackBuffer(), false);
+  addCorpus(name, sink.feedbackBuffer(), true);
+}
+
+//   C o m p a r i s o n
+
+// -1 when the positioning throws (polygon seen edge on).
+static int position(const Primitive *p1, const Primitive *p2, bool gpc) {
+  try {
+    return gpc ? GPCPositioning::computeRelativePosition(p1, p2)
+               : PrimitivePositioning::computeRelativePosition(p1, p2);
+  } catch (std::runtime_error &) {
+    return -1;
+  }
+}
+
+// Compares the classification of all the ordered pairs. Returns the number of
+// mismatches.
+static int compare(const Corpus &corpus) {
+  const std::vector<PtrPrimitive> &p = corpus.primitives;
+  int mismatches = 0;
+  for (unsigned int i = 0; i < p.size(); ++i)
+    for (unsigned int j = 0; j < p.size(); ++j) {
+      if (i == j)
+        continue;
+      const int expected = position(p[i], p[j], true);
+      const int result = position(p[i], p[j], false);
+      if (result != expected) {
+        if (mismatches < 10)
+          fprintf(stderr,
+                  "%s: primitives %u (%u vertices) and %u (%u vertices): "
+                  "%d instead of %d\n",
+                  qPrintable(corpus.name), i, (unsigned)p[i]->nbVertices(), j,
+                  (unsigned)p[j]->nbVertices(), result, expected);
+        ++mismatches;
+      }
+    }
+  return mismatches;
+}
+
+//   B e n c h m a r k
+
+// Classifies all the ordered pairs of a corpus.
+class Positioning : public Benchmark {
+public:
+  Positioning(const Corpus &corpus, bool gpc)
+      : Benchmark(QString("positioning/%1 %2")
+                      .arg(gpc ? "gpc" : "current")
+                      .arg(corpus.name),
+                  int(corpus.primitives.size() *
+                      (corpus.primitives.size() - 1)),
+                  5),
+        corpus_(corpus), gpc_(gpc), sink_(0) {}
+
+  virtual void run() {
+    const std::vector<PtrPrimitive> &p = corpus_.primitives;
+    for (unsigned int i = 0; i < p.size(); ++i)
+      for (unsigned int j = 0; j < p.size(); ++j)
+        if (i != j)
+          sink_ += position(p[i], p[j], gpc_);
+  }
+
+private:
+  const Corpus &corpus_;
+  bool gpc_;
+  int sink_; // so that the calls are not discarded
+};
+
+int main(int argc, char **argv) {
+  // No window and no OpenGL context: runs on a headless box
+  QCoreApplication application(argc, argv);
+
+  const QDir fixtures(FIXTURES_PATH);
+  Q_FOREACH (const QString &fileName,
+             fixtures.entryList(QStringList("*.txt"), QDir::Files)) {
+    QVector<float> buffer;
+    if (!loadFixture(fixtures.filePath(fileName), buffer)) {
+      fprintf(stderr, "Unable to read %s\n", qPrintable(fileName));
+      return 1;
+    }
+    addCorpus(QFileInfo(fileName).baseName(), buffer, false);
+    addCorpus(QFileInfo(fileName).baseName(), buffer, true);
+  }
+  for (int seed = 1; seed <= 3; ++seed)
+    addRandomCorpus(seed);
+
+  int mismatches = 0;
+  Q_FOREACH (const Corpus *corpus, corpora) {
+    const int n = compare(*corpus);
+    printf("%-36s %5u primitives: %s\n", qPrintable(corpus->name),
+           (unsigned)corpus->primitives.size(),
+           n ? qPrintable(QString("%1 mismatches").arg(n)) : "identical");
+    mismatches += n;
+  }
+
+  BenchmarkRunner runner;
+  Q_FOREACH (const Corpus *corpus, corpora) {
+    runner.add(new Positioning(*corpus, true));
+    runner.add(new Positioning(*corpus, false));
+  }
+  const int res = mismatches ? 1 : runner.exec();
+
+  Q_FOREACH (Corpus *corpus, corpora) {
+    for (unsigned int i = 0; i < corpus->primitives.size(); ++i)
+      delete corpus->primitives[i];
+    delete corpus;
+  }
+  return res;
+}
@@ -0,0 +1,25 @@
+# A regression test of the VRender primitive positioning: classifies all the
+# pairs of primitives of a corpus with PrimitivePositioning and with the
+# previous gpc based implementation (gpcPositioning.cpp, copied from
+# libQGLViewer 2.7.0), and returns 1 when one of the results differs. It then
+# benchmarks both implementations on each corpus.
+
+# The corpora are the feedback buffers of the fixtures directory (scenes of the
+# simpleViewer, clippingPlane and frameTransform examples), as parsed and as
+# split by the BSP sort, and random scenes.
+
+# No window or OpenGL context is created, the test runs on a headless box.
+
+# Usage: positioningRegression [--warmup N] [--iterations N] [--filter TEXT] [--json FILE] [--list]
+
+TEMPLATE = app
+TARGET   = positioningRegression
+
+HEADERS  = gpcPositioning.h
+SOURCES  = main.cpp gpcPositioning.cpp
+
+# Internal VRender headers, not installed with the library
+INCLUDEPATH *= ../../QGLViewer/VRender
+DEFINES *= FIXTURES_PATH=\\\"$$PWD/fixtures\\\"
+
+include( ../benchmarks.pri )
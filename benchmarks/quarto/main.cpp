@@ -0,0 +1,127 @@
+#include "benchmark.h"
+
+#include "solveur.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+//  A position reached by random play, without giving a piece that wins
+// immediately, with nbEmpty cells left and piece to be placed.
+struct Probleme {
+  Position position;
+  int piece;
+};
+
+static bool randomPosition(int nbEmpty, Probleme &probleme) {
+  Position &position = probleme.position;
+  position.init();
+  int piece = rand() % 16;
+  while (position.nbEmpty() > nbEmpty) {
+    int cell;
+    do
+      cell = rand() % 16;
+    while (!position.isEmpty(cell));
+    if (position.wins(cell, piece))
+      return false;
+    position.placePiece(cell, piece);
+
+    const quint16 donnables =
+        position.disponibles & ~position.dangerousPieces();
+    if (!donnables)
+      return false;
+    do
+      piece = rand() % 16;
+    while (!(donnables & (1 << piece)));
+  }
+  probleme.piece = piece;
+  return true;
+}
+
+static QVector<Probleme> randomPositions(int nbEmpty, int nbPositions) {
+  QVector<Probleme> problemes;
+  while (problemes.size() < nbPositions) {
+    Probleme probleme;
+    if (randomPosition(nbEmpty, probleme))
+      problemes.append(probleme);
+  }
+  return problemes;
+}
+
+//  Solves the positions, from an empty transposition table. Also counts the
+// explored positions, which the harness does not report.
+class Solve : public Benchmark {
+public:
+  Solve(const QString &name, Solveur &solveur,
+        const QVector<Probleme> &problemes, bool parallel)
+      : Benchmark(name, problemes.size(), 10), solveur_(solveur),
+        parallel_(parallel), problemes_(problemes), nbNodes_(0),
+        nanoseconds_(0) {}
+
+  virtual void setUp() { solveur_.clear(); }
+
+  virtual void run() {
+    QElapsedTimer timer;
+    timer.start();
+    valeurs_.clear();
+    for (int i = 0; i < problemes_.size(); ++i) {
+      const Solveur::Coup coup = solveur_.solve(
+          problemes_[i].position, problemes_[i].piece, parallel_);
+      nbNodes_ += solveur_.nbNodes();
+      valeurs_.append(coup.valeur);
+    }
+    nanoseconds_ += timer.nsecsElapsed();
+  }
+
+  bool hasRun() const { return nanoseconds_ > 0; }
+
+  void printNodes() const {
+    QString valeurs;
+    for (int i = 0; i < valeurs_.size(); ++i)
+      valeurs += QString::number(valeurs_[i]) + " ";
+    printf("%-36s %12.2f   values %s\n", qPrintable(name()),
+           nbNodes_ * 1000.0 / nanoseconds_,
+           qPrintable(valeurs));
+  }
+
+private:
+  Solveur &solveur_;
+  bool parallel_;
+  QVector<Probleme> problemes_;
+  QVector<int> valeurs_;
+  quint64 nbNodes_;
+  qint64 nanoseconds_;
+};
+
+int main(int argc, char **argv) {
+  QCoreApplication application(argc, argv);
+  srand(1);
+
+  const QVector<Probleme> empty8 = randomPositions(8, 20);
+  const QVector<Probleme> empty9 = randomPositions(9, 10);
+  const QVector<Probleme> empty10 = randomPositions(10, 5);
+
+  Solveur solveur(20);
+  QList<Solve *> solves;
+  solves << new Solve("quarto/solve8", solveur, empty8, false)
+         << new Solve("quarto/solve9", solveur, empty9, false)
+         << new Solve("quarto/solve10", solveur, empty10, false)
+         << new Solve("quarto/solve10Parallel", solveur, empty10, true);
+
+  BenchmarkRunner runner;
+  Q_FOREACH (Solve *solve, solves)
+    runner.add(solve);
+  const int res = runner.exec();
+
+  bool header = false;
+  Q_FOREACH (Solve *solve, solves)
+    if (solve->hasRun()) {
+      if (!header)
+        printf("\n%-36s %12s\n", "Solve", "Mnodes/s");
+      header = true;
+      solve->printNodes();
+    }
+  return res;
+}
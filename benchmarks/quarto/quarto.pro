@@ -0,0 +1,19 @@
+# Exact solving speed of the quarto example computer player, on positions
+# reached by random play, with 8 to 10 empty cells left. The explored
+# positions per second and the values found are printed after the timings.
+
+# No window or OpenGL context is created, the benchmarks run on a headless box.
+
+# Usage: quartoBenchmarks [--warmup N] [--iterations N] [--filter TEXT] [--json FILE] [--list]
+
+TEMPLATE = app
+TARGET   = quartoBenchmarks
+
+QUARTO = ../../examples/contribs/quarto
+INCLUDEPATH *= $$QUARTO
+HEADERS  = $$QUARTO/solveur.h
+SOURCES  = main.cpp $$QUARTO/solveur.cpp
+
+QT *= concurrent
+
+include( ../benchmarks.pri )
@@ -1,6 +1,7 @@
 #include "3dsViewer.h"
 
 #include <QKeyEvent>
+#include <QtConcurrentRun>
 #include <lib3ds/camera.h>
 #include <lib3ds/light.h>
 #include <lib3ds/material.h>
@@ -15,6 +16,20 @@
 using namespace std;
 using namespace qglviewer;
 
+Viewer::~Viewer() {
+  meshWatcher.waitForFinished();
+  makeCurrent();
+  clearMeshes();
+  doneCurrent();
+  if (file)
+    lib3ds_file_free(file);
+}
+
+void Viewer::clearMeshes() {
+  qDeleteAll(meshes);
+  meshes.clear();
+}
+
 void Viewer::keyPressEvent(QKeyEvent *e) {
   switch (e->key()) {
   case Qt::Key_L:
@@ -31,7 +46,10 @@ QString Viewer::helpString() const {
       "This example uses the lib3ds library to load a 3ds object file.<br><br>";
   text += "Press <b>L</b>(oad) to open a 3ds file.<br><br>";
   text += "Note that certain 3ds files contain animated sequences that can ";
-  text += "be played using the <b>Return</b> (animate) key.";
+  text += "be played using the <b>Return</b> (animate) key.<br><br>";
+  text += "Meshes are converted in a background thread into vertex buffers. ";
+  text += "The result is cached on disk, so that a file opens faster the ";
+  text += "next time.";
   return text;
 }
 
@@ -50,6 +68,14 @@ void Viewer::loadFile() {
   if (name.isEmpty())
     return;
 
+  // The previous file may still be used by the mesh conversion
+  meshWatcher.waitForFinished();
+  meshCache.clear();
+  makeCurrent();
+  clearMeshes();
+  if (file)
+    lib3ds_file_free(file);
+
 #if QT_VERSION < 0x040000
   file = lib3ds_file_load(name.latin1());
 #else
@@ -77,8 +103,29 @@ void Viewer::loadFile() {
   if (!file->cameras)
     camera()->showEntireScene();
   else
-    updateGL();
+    update();
   stopAnimation();
+
+  // Meshes are converted in a worker thread, the GUI remains responsive.
+  // Only the node hierarchy is used by the main thread in the meantime.
+  meshWatcher.setFuture(
+      QtConcurrent::run(&meshCache, &MeshCache::load, file, name));
+}
+
+void Viewer::meshesLoaded() {
+  makeCurrent();
+  Q_FOREACH (const MeshData &data, meshCache.meshes())
+    meshes.insert(data.name, new GLMesh(data));
+  doneCurrent();
+
+  displayMessage(QString("%1 triangles %2 in %3 ms")
+                     .arg(meshCache.numberOfTriangles())
+                     .arg(meshCache.isFromCache() ? "read from cache"
+                                                  : "converted")
+                     .arg(meshCache.loadingTime()));
+  // Releases the converted data or the mapped cache file
+  meshCache.clear();
+  update();
 }
 
 void Viewer::init() {
@@ -94,6 +141,8 @@ void Viewer::init() {
 
   setKeyDescription(Qt::Key_L, "Loads a new 3ds file");
 
+  connect(&meshWatcher, SIGNAL(finished()), SLOT(meshesLoaded()));
+
   restoreStateFromFile();
   help();
   loadFile();
@@ -164,70 +213,17 @@ void Viewer::renderNode(Lib3dsNode *node) {
     if (strcmp(node->name, "$$$DUMMY") == 0)
       return;
 
-    if (!node->user.d) {
-      Lib3dsMesh *mesh = lib3ds_file_mesh_by_name(file, node->name);
-      if (!mesh)
-        return;
-
-      node->user.d = glGenLists(1);
-      glNewList(node->user.d, GL_COMPILE);
-
-      Lib3dsVector *normalL = new Lib3dsVector[3 * mesh->faces];
-
-      Lib3dsMatrix M;
-      lib3ds_matrix_copy(M, mesh->matrix);
-      lib3ds_matrix_inv(M);
-      glMultMatrixf(&M[0][0]);
-
-      lib3ds_mesh_calculate_normals(mesh, normalL);
-
-      for (unsigned int p = 0; p < mesh->faces; ++p) {
-        Lib3dsFace *f = &mesh->faceL[p];
-        Lib3dsMaterial *mat = 0;
-        if (f->material[0])
-          mat = lib3ds_file_material_by_name(file, f->material);
-
-        if (mat) {
-          static GLfloat a[4] = {0, 0, 0, 1};
-          float s;
-          glMaterialfv(GL_FRONT, GL_AMBIENT, a);
-          glMaterialfv(GL_FRONT, GL_DIFFUSE, mat->diffuse);
-          glMaterialfv(GL_FRONT, GL_SPECULAR, mat->specular);
-          s = pow(2, 10.0 * mat->shininess);
-          if (s > 128.0)
-            s = 128.0;
-          glMaterialf(GL_FRONT, GL_SHININESS, s);
-        } else {
-          Lib3dsRgba a = {0.2, 0.2, 0.2, 1.0};
-          Lib3dsRgba d = {0.8, 0.8, 0.8, 1.0};
-          Lib3dsRgba s = {0.0, 0.0, 0.0, 1.0};
-          glMaterialfv(GL_FRONT, GL_AMBIENT, a);
-          glMaterialfv(GL_FRONT, GL_DIFFUSE, d);
-          glMaterialfv(GL_FRONT, GL_SPECULAR, s);
-        }
-
-        glBegin(GL_TRIANGLES);
-        glNormal3fv(f->normal);
-        for (int i = 0; i < 3; ++i) {
-          glNormal3fv(normalL[3 * p + i]);
-          glVertex3fv(mesh->pointL[f->points[i]].pos);
-        }
-        glEnd();
-      }
-
-      delete[] normalL;
-
-      glEndList();
-    }
-
-    if (node->user.d) {
-      glPushMatrix();
-      Lib3dsObjectData *d = &node->data.object;
-      glMultMatrixf(&node->matrix[0][0]);
-      glTranslatef(-d->pivot[0], -d->pivot[1], -d->pivot[2]);
-      glCallList(node->user.d);
-      glPopMatrix();
-    }
+    // Not yet loaded, or no associated mesh
+    GLMesh *mesh = meshes.value(node->name, NULL);
+    if (!mesh)
+      return;
+
+    glPushMatrix();
+    Lib3dsObjectData *d = &node->data.object;
+    glMultMatrixf(&node->matrix[0][0]);
+    glTranslatef(-d->pivot[0], -d->pivot[1], -d->pivot[2]);
+    mesh->draw();
+    glPopMatrix();
   }
 }
 
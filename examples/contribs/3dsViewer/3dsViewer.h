@@ -1,11 +1,19 @@
 #include <QGLViewer/qglviewer.h>
 
+#include <QFutureWatcher>
+#include <QHash>
+
 #include <lib3ds/file.h>
 #include <lib3ds/node.h>
 
+#include "meshCache.h"
+
 class Viewer : public QGLViewer {
+  Q_OBJECT
+
 public:
   Viewer() : file(NULL), current_frame(0.0), camera_name(NULL){};
+  virtual ~Viewer();
 
 protected:
   virtual void draw();
@@ -18,8 +26,18 @@ protected:
   void loadFile();
   void initScene();
 
+private Q_SLOTS:
+  void meshesLoaded();
+
 private:
+  void clearMeshes();
+
   Lib3dsFile *file;
   float current_frame;
   char *camera_name;
+
+  // Meshes are converted (or read from the cache) in a worker thread
+  MeshCache meshCache;
+  QFutureWatcher<void> meshWatcher;
+  QHash<QByteArray, GLMesh *> meshes;
 };
@@ -11,9 +11,10 @@
 # (or in <code>lib3ds/file.h</code>) :
 # <pre>extern "C" { LIB3DSAPI void lib3ds_file_bounding_box(Lib3dsFile *file, Lib3dsVector min, Lib3dsVector max); }</pre>
 
-# This example is simply a translation of a lib3ds example. Although it uses display lists, the
-# rendering speed does not seem to be as good as with other 3ds libraries (10 factor speed up). Note
-# however that this is due to the lib3ds library and not QGLViewer.
+# This example is originally a translation of a lib3ds example. Meshes are converted in a background
+# thread into welded, material sorted vertex and index buffers. The result is cached in a binary file
+# (in the user's cache directory), which is simply mapped in memory and uploaded the next time the
+# same file is opened.
 
 # Press '<b>L</b>' (load) to load a new 3DS scene.
 
@@ -36,8 +37,10 @@ TARGET   = 3dsViewer
 
 # win32:LIBS  *= C:\code\lib\lib3ds.lib
 
-HEADERS  = 3dsViewer.h
-SOURCES  = 3dsViewer.cpp main.cpp
+QT *= concurrent
+
+HEADERS  = 3dsViewer.h meshCache.h
+SOURCES  = 3dsViewer.cpp meshCache.cpp main.cpp
 
 DISTFILES += *.3DS
 
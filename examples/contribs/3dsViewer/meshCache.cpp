@@ -0,0 +1,378 @@
+#include "meshCache.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QHash>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include <lib3ds/material.h>
+#include <lib3ds/matrix.h>
+#include <lib3ds/mesh.h>
+
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////
+//                    C a c h e   f i l e   f o r m a t                       //
+////////////////////////////////////////////////////////////////////////////////
+
+// The cache file is written in native byte order. A cache created on a machine
+// with a different endianness has an invalid magic number and is rebuilt.
+//
+// CacheHeader
+// meshCount times:
+//   CacheMeshHeader
+//   batchCount MeshBatch
+//   vertexCount MeshVertex
+//   indexCount quint32
+//
+// All these sizes are multiples of 4, so that the mapped arrays are aligned.
+
+static const quint32 cacheMagic = 0x33445343; // "3DSC"
+static const quint32 cacheVersion = 1;
+
+struct CacheHeader {
+  quint32 magic;
+  quint32 version;
+  qint64 sourceSize;
+  qint64 sourceModified;
+  quint32 meshCount;
+  quint32 reserved;
+};
+
+struct CacheMeshHeader {
+  char name[64];
+  quint32 vertexCount;
+  quint32 indexCount;
+  quint32 batchCount;
+  quint32 reserved;
+};
+
+MeshCache::MeshCache() : fromCache_(false), loadingTime_(0) {}
+
+QString MeshCache::cacheFileName(const QString &fileName) {
+  const QString dir =
+      QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+  const QByteArray key = QCryptographicHash::hash(
+      QFileInfo(fileName).absoluteFilePath().toUtf8(),
+      QCryptographicHash::Sha1);
+  return dir + "/3dsViewer-" + key.toHex() + ".mesh";
+}
+
+void MeshCache::load(Lib3dsFile *file, const QString &fileName) {
+  QElapsedTimer timer;
+  timer.start();
+
+  clear();
+  fromCache_ = readCache(fileName);
+  if (!fromCache_) {
+    convert(file);
+    // Map the cache that was just written, so that the converted data can be
+    // released. The converted data is used directly if the cache cannot be
+    // written.
+    if (writeCache(fileName)) {
+      QList<MeshData> converted = meshes_;
+      meshes_.clear();
+      if (!readCache(fileName))
+        meshes_ = converted;
+    }
+  }
+
+  loadingTime_ = timer.elapsed();
+}
+
+void MeshCache::clear() {
+  meshes_.clear();
+  if (cacheFile_.isOpen())
+    cacheFile_.close(); // also unmaps
+}
+
+quint32 MeshCache::numberOfTriangles() const {
+  quint32 nb = 0;
+  Q_FOREACH (const MeshData &mesh, meshes_)
+    nb += mesh.indexCount / 3;
+  return nb;
+}
+
+bool MeshCache::readCache(const QString &fileName) {
+  const QFileInfo source(fileName);
+  cacheFile_.setFileName(cacheFileName(fileName));
+  if (!cacheFile_.open(QIODevice::ReadOnly))
+    return false;
+
+  const qint64 size = cacheFile_.size();
+  const uchar *data = cacheFile_.map(0, size);
+  if (!data || size < qint64(sizeof(CacheHeader))) {
+    cacheFile_.close();
+    return false;
+  }
+
+  CacheHeader header;
+  memcpy(&header, data, sizeof(header));
+  if ((header.magic != cacheMagic) || (header.version != cacheVersion) ||
+      (header.sourceSize != source.size()) ||
+      (header.sourceModified != source.lastModified().toMSecsSinceEpoch())) {
+    cacheFile_.close();
+    return false;
+  }
+
+  qint64 offset = sizeof(CacheHeader);
+  for (quint32 m = 0; m < header.meshCount; ++m) {
+    CacheMeshHeader meshHeader;
+    if (offset + qint64(sizeof(meshHeader)) > size)
+      break;
+    memcpy(&meshHeader, data + offset, sizeof(meshHeader));
+    offset += sizeof(meshHeader);
+
+    const qint64 batchesSize =
+        qint64(meshHeader.batchCount) * sizeof(MeshBatch);
+    const qint64 verticesSize =
+        qint64(meshHeader.vertexCount) * sizeof(MeshVertex);
+    const qint64 indicesSize = qint64(meshHeader.indexCount) * sizeof(quint32);
+    if (offset + batchesSize + verticesSize + indicesSize > size)
+      break;
+
+    MeshData mesh;
+    meshHeader.name[sizeof(meshHeader.name) - 1] = '\0';
+    mesh.name = meshHeader.name;
+    mesh.batches.resize(meshHeader.batchCount);
+    memcpy(mesh.batches.data(), data + offset, batchesSize);
+    offset += batchesSize;
+    mesh.vertices = reinterpret_cast<const MeshVertex *>(data + offset);
+    mesh.vertexCount = meshHeader.vertexCount;
+    offset += verticesSize;
+    mesh.indices = reinterpret_cast<const quint32 *>(data + offset);
+    mesh.indexCount = meshHeader.indexCount;
+    offset += indicesSize;
+    meshes_.append(mesh);
+  }
+
+  if (meshes_.size() != int(header.meshCount)) {
+    qWarning("Corrupted mesh cache file %s",
+             cacheFile_.fileName().toLatin1().constData());
+    clear();
+    return false;
+  }
+
+  return true;
+}
+
+bool MeshCache::writeCache(const QString &fileName) const {
+  const QFileInfo source(fileName);
+  QDir().mkpath(QFileInfo(cacheFileName(fileName)).absolutePath());
+  QSaveFile cache(cacheFileName(fileName));
+  if (!cache.open(QIODevice::WriteOnly))
+    return false;
+
+  CacheHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = cacheMagic;
+  header.version = cacheVersion;
+  header.sourceSize = source.size();
+  header.sourceModified = source.lastModified().toMSecsSinceEpoch();
+  header.meshCount = meshes_.size();
+  cache.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+  Q_FOREACH (const MeshData &mesh, meshes_) {
+    CacheMeshHeader meshHeader;
+    memset(&meshHeader, 0, sizeof(meshHeader));
+    strncpy(meshHeader.name, mesh.name.constData(),
+            sizeof(meshHeader.name) - 1);
+    meshHeader.vertexCount = mesh.vertexCount;
+    meshHeader.indexCount = mesh.indexCount;
+    meshHeader.batchCount = mesh.batches.size();
+    cache.write(reinterpret_cast<const char *>(&meshHeader),
+                sizeof(meshHeader));
+    cache.write(reinterpret_cast<const char *>(mesh.batches.constData()),
+                mesh.batches.size() * sizeof(MeshBatch));
+    cache.write(reinterpret_cast<const char *>(mesh.vertices),
+                mesh.vertexCount * sizeof(MeshVertex));
+    cache.write(reinterpret_cast<const char *>(mesh.indices),
+                mesh.indexCount * sizeof(quint32));
+  }
+
+  return cache.commit();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                         C o n v e r s i o n                                //
+////////////////////////////////////////////////////////////////////////////////
+
+// A welded vertex is identified by its lib3ds point and its normal, which
+// depends on the face smoothing group. Normals are compared bitwise.
+struct VertexKey {
+  quint32 point;
+  quint32 normal[3];
+
+  bool operator==(const VertexKey &other) const {
+    return memcmp(this, &other, sizeof(VertexKey)) == 0;
+  }
+};
+
+inline uint qHash(const VertexKey &key) {
+  return qHash(key.point) ^ (qHash(key.normal[0]) << 1) ^
+         (qHash(key.normal[1]) << 2) ^ (qHash(key.normal[2]) << 3);
+}
+
+static void setBatchMaterial(MeshBatch &batch, Lib3dsMaterial *mat) {
+  if (mat) {
+    const float a[4] = {0.0, 0.0, 0.0, 1.0};
+    memcpy(batch.ambient, a, sizeof(a));
+    memcpy(batch.diffuse, mat->diffuse, sizeof(batch.diffuse));
+    memcpy(batch.specular, mat->specular, sizeof(batch.specular));
+    batch.shininess = pow(2, 10.0 * mat->shininess);
+    if (batch.shininess > 128.0)
+      batch.shininess = 128.0;
+  } else {
+    const float a[4] = {0.2f, 0.2f, 0.2f, 1.0};
+    const float d[4] = {0.8f, 0.8f, 0.8f, 1.0};
+    const float s[4] = {0.0, 0.0, 0.0, 1.0};
+    memcpy(batch.ambient, a, sizeof(a));
+    memcpy(batch.diffuse, d, sizeof(d));
+    memcpy(batch.specular, s, sizeof(s));
+    batch.shininess = 0.0;
+  }
+}
+
+void MeshCache::convert(Lib3dsFile *file) {
+  for (Lib3dsMesh *mesh = file->meshes; mesh != 0; mesh = mesh->next) {
+    MeshData data;
+    data.name = mesh->name;
+
+    Lib3dsVector *normalL = new Lib3dsVector[3 * mesh->faces];
+    lib3ds_mesh_calculate_normals(mesh, normalL);
+
+    Lib3dsMatrix M;
+    lib3ds_matrix_copy(M, mesh->matrix);
+    lib3ds_matrix_inv(M);
+
+    //  Normals are transformed by the inverse transpose of the 3x3 of M, that
+    // is the transpose of the 3x3 of mesh->matrix, as the fixed function
+    // pipeline did. Differs from M with non uniform scales.
+    float N[3][3];
+    for (int i = 0; i < 3; ++i)
+      for (int j = 0; j < 3; ++j)
+        N[i][j] = mesh->matrix[j][i];
+
+    // Sort faces by material
+    QList<QByteArray> materials;
+    QHash<QByteArray, QVector<quint32> > facesOfMaterial;
+    for (quint32 f = 0; f < mesh->faces; ++f) {
+      const QByteArray material = mesh->faceL[f].material;
+      if (!facesOfMaterial.contains(material))
+        materials.append(material);
+      facesOfMaterial[material].append(f);
+    }
+
+    QHash<VertexKey, quint32> vertexIndex;
+    vertexIndex.reserve(3 * mesh->faces);
+    data.ownedIndices.reserve(3 * mesh->faces);
+
+    Q_FOREACH (const QByteArray &material, materials) {
+      MeshBatch batch;
+      setBatchMaterial(batch, material.isEmpty()
+                                  ? NULL
+                                  : lib3ds_file_material_by_name(
+                                        file, material.constData()));
+      batch.firstIndex = data.ownedIndices.size();
+
+      Q_FOREACH (quint32 f, facesOfMaterial[material])
+        for (int i = 0; i < 3; ++i) {
+          const float *n = normalL[3 * f + i];
+          VertexKey key;
+          key.point = mesh->faceL[f].points[i];
+          memcpy(key.normal, n, sizeof(key.normal));
+
+          QHash<VertexKey, quint32>::const_iterator it =
+              vertexIndex.constFind(key);
+          if (it == vertexIndex.constEnd()) {
+            const float *p = mesh->pointL[key.point].pos;
+            MeshVertex v;
+            for (int j = 0; j < 3; ++j) {
+              v.position[j] =
+                  M[0][j] * p[0] + M[1][j] * p[1] + M[2][j] * p[2] + M[3][j];
+              v.normal[j] = N[0][j] * n[0] + N[1][j] * n[1] + N[2][j] * n[2];
+            }
+            const float norm =
+                sqrt(v.normal[0] * v.normal[0] + v.normal[1] * v.normal[1] +
+                     v.normal[2] * v.normal[2]);
+            if (norm > 0.0)
+              for (int j = 0; j < 3; ++j)
+                v.normal[j] /= norm;
+
+            it = vertexIndex.insert(key, data.ownedVertices.size());
+            data.ownedVertices.append(v);
+          }
+          data.ownedIndices.append(it.value());
+        }
+
+      batch.indexCount = data.ownedIndices.size() - batch.firstIndex;
+      data.batches.append(batch);
+    }
+
+    delete[] normalL;
+
+    data.vertices = data.ownedVertices.constData();
+    data.vertexCount = data.ownedVertices.size();
+    data.indices = data.ownedIndices.constData();
+    data.indexCount = data.ownedIndices.size();
+    meshes_.append(data);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                       O p e n G L   b u f f e r s                          //
+////////////////////////////////////////////////////////////////////////////////
+
+GLMesh::GLMesh(const MeshData &data)
+    : vertexBuffer_(QOpenGLBuffer::VertexBuffer),
+      indexBuffer_(QOpenGLBuffer::IndexBuffer), batches_(data.batches) {
+  vertexBuffer_.create();
+  vertexBuffer_.bind();
+  vertexBuffer_.allocate(data.vertices, data.vertexCount * sizeof(MeshVertex));
+  vertexBuffer_.release();
+
+  indexBuffer_.create();
+  indexBuffer_.bind();
+  indexBuffer_.allocate(data.indices, data.indexCount * sizeof(quint32));
+  indexBuffer_.release();
+}
+
+GLMesh::~GLMesh() {
+  vertexBuffer_.destroy();
+  indexBuffer_.destroy();
+}
+
+void GLMesh::draw() {
+  vertexBuffer_.bind();
+  indexBuffer_.bind();
+
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_NORMAL_ARRAY);
+  glVertexPointer(3, GL_FLOAT, sizeof(MeshVertex),
+                  (const GLvoid *)offsetof(MeshVertex, position));
+  glNormalPointer(GL_FLOAT, sizeof(MeshVertex),
+                  (const GLvoid *)offsetof(MeshVertex, normal));
+
+  Q_FOREACH (const MeshBatch &batch, batches_) {
+    glMaterialfv(GL_FRONT, GL_AMBIENT, batch.ambient);
+    glMaterialfv(GL_FRONT, GL_DIFFUSE, batch.diffuse);
+    glMaterialfv(GL_FRONT, GL_SPECULAR, batch.specular);
+    glMaterialf(GL_FRONT, GL_SHININESS, batch.shininess);
+    glDrawElements(GL_TRIANGLES, batch.indexCount, GL_UNSIGNED_INT,
+                   (const GLvoid *)(batch.firstIndex * sizeof(quint32)));
+  }
+
+  glDisableClientState(GL_NORMAL_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
+
+  indexBuffer_.release();
+  vertexBuffer_.release();
+}
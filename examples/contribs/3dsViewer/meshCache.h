@@ -0,0 +1,84 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <QFile>
+#include <QList>
+#include <QOpenGLBuffer>
+#include <QVector>
+
+#include <lib3ds/file.h>
+
+// Interleaved vertex, as stored in the vertex buffer and in the cache file.
+struct MeshVertex {
+  float position[3];
+  float normal[3];
+};
+
+// A range of the index buffer that is drawn with the same material.
+struct MeshBatch {
+  float ambient[4];
+  float diffuse[4];
+  float specular[4];
+  float shininess;
+  quint32 firstIndex;
+  quint32 indexCount;
+};
+
+// Welded and material sorted version of a lib3ds mesh, expressed in its node
+// coordinate system (the inverse mesh matrix is applied).
+struct MeshData {
+  QByteArray name;
+  QVector<MeshBatch> batches;
+
+  // Point either inside the mapped cache file or inside the owned vectors.
+  const MeshVertex *vertices;
+  quint32 vertexCount;
+  const quint32 *indices;
+  quint32 indexCount;
+
+  QVector<MeshVertex> ownedVertices;
+  QVector<quint32> ownedIndices;
+};
+
+// Converts the meshes of a lib3ds file into MeshData. The result is saved in a
+// binary cache file, so that opening the same file again only maps the cache.
+// load() is meant to be run in a worker thread.
+class MeshCache {
+public:
+  MeshCache();
+
+  void load(Lib3dsFile *file, const QString &fileName);
+  // Releases the meshes and the mapped cache file, once they are uploaded.
+  void clear();
+
+  const QList<MeshData> &meshes() const { return meshes_; }
+  bool isFromCache() const { return fromCache_; }
+  qint64 loadingTime() const { return loadingTime_; }
+  quint32 numberOfTriangles() const;
+
+private:
+  static QString cacheFileName(const QString &fileName);
+  bool readCache(const QString &fileName);
+  bool writeCache(const QString &fileName) const;
+  void convert(Lib3dsFile *file);
+
+  QList<MeshData> meshes_;
+  QFile cacheFile_;
+  bool fromCache_;
+  qint64 loadingTime_;
+};
+
+// OpenGL buffers of a MeshData. Requires a current OpenGL context.
+class GLMesh {
+public:
+  explicit GLMesh(const MeshData &data);
+  ~GLMesh();
+
+  void draw();
+
+private:
+  QOpenGLBuffer vertexBuffer_, indexBuffer_;
+  QVector<MeshBatch> batches_;
+};
+
+#endif // MESH_CACHE_H
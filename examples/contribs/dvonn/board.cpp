@@ -86,7 +86,24 @@ unsigned int Board::nbPieces(Color c) {
   }
   return 0;
 }
-Board::Board() : spaces_(nbSpacesMaxOnRow() * nbRows()) {
+Board::Board()
+    : spaces_(nbSpacesMaxOnRow() * nbRows()),
+      neighbours_(6 * nbSpacesMaxOnRow() * nbRows(), -1),
+      visit_(nbSpacesMaxOnRow() * nbRows(), 0),
+      owner_(nbSpacesMaxOnRow() * nbRows(), -1), generation_(0) {
+  for (unsigned int i = 0; i < spaces_.size(); ++i) {
+    const Coord c = idx2coord(i);
+    if (!isValid(c))
+      continue;
+    // Same order as the propagation of the original updateStatus()
+    const Coord n[6] = {Coord(c.x() - 1, c.y()),     Coord(c.x() + 1, c.y()),
+                        Coord(c.x(), c.y() - 1),     Coord(c.x(), c.y() + 1),
+                        Coord(c.x() - 1, c.y() - 1),
+                        Coord(c.x() + 1, c.y() + 1)};
+    for (unsigned int j = 0; j < 6; ++j)
+      if (isValid(n[j]))
+        neighbours_[6 * i + j] = coord2idx(n[j]);
+  }
   reinit();
   for (unsigned int n = 0; n < nbColors; ++n) {
     Color c = static_cast<Color>(n);
@@ -106,6 +123,8 @@ void Board::reinit() {
   for_each(spaces_.begin(), spaces_.end(), resetStatus);
   for_each(spaces_.begin(), spaces_.end(), clearStacks);
   redSpaces_.clear();
+  statusIsValid_ = false;
+  journal_.clear();
 }
 Board::~Board() {}
 unsigned int Board::coord2idx(Coord c) {
@@ -170,11 +189,14 @@ const Piece *Board::getUnplacedPiece(Color c) const {
  */
 void Board::place(const Piece *p, Coord c) {
   if (p && p == getUnplacedPiece(p->color()) && isValid(c)) {
+    journal_.push_back(Change(Change::Placed, coord2idx(c), p->color()));
     spaces_[coord2idx(c)].first.push_back(p);
     unplaced_[p->color()].pop();
     if (p->color() == Red) {
       redSpaces_[p] = c;
     }
+    // Connects components: recomputed from scratch on next move
+    setStatusIsValid(false);
   }
 }
 /*!
@@ -183,101 +205,311 @@ void Board::place(const Piece *p, Coord c) {
 Board::Ghosts Board::move(Coord src, Coord dst, bool killDeads) {
   Ghosts ghosts;
   if (isValid(src) && isValid(dst)) {
-    Stack &s = spaces_[coord2idx(src)].first;
-    Stack &d = spaces_[coord2idx(dst)].first;
-    // If the src destination was containing a red
-    Stack::const_iterator fter =
-        find_if(s.begin(), s.end(), mem_fun(&Piece::isRed));
-    if (fter != s.end()) {
-      redSpaces_[*fter] = dst;
+    const unsigned int si = coord2idx(src);
+    const unsigned int di = coord2idx(dst);
+    Stack &s = spaces_[si].first;
+    Stack &d = spaces_[di].first;
+    Change change(Change::Moved, si, di);
+    change.height = s.height();
+    journal_.push_back(change);
+    // If the src destination was containing reds
+    for (Stack::const_iterator iter = s.begin(); iter != s.end(); ++iter) {
+      if ((*iter)->isRed()) {
+        redSpaces_[*iter] = dst;
+      }
     }
     // Move the pieces from src to dst
     d.insert(d.end(), s.begin(), s.end());
     s.clear();
-    updateStatus(ghosts, killDeads);
+    updateStatus(ghosts, killDeads, si);
   }
   return ghosts;
 }
-void Board::updateStatus(Ghosts &ghosts, bool killDeads) {
+/*!
+ * The status of a space is the index of a space holding a red piece which
+ * it is connected to, or -1 if it is empty or not connected to any red.
+ *
+ * Only the source of a move is emptied by the move itself, so that only the
+ * component it belonged to can be split (see splitStatus()). The status is
+ * fully computed the first time, after placements, and after deads were
+ * not killed.
+ */
+void Board::updateStatus(Ghosts &ghosts, bool killDeads, unsigned int src) {
+  vector<unsigned int> deads;
+  if (statusIsValid_ && splitStatus(src, deads)) {
+    sort(deads.begin(), deads.end());
+  } else {
+    computeStatus();
+    deads.clear();
+    for (unsigned int i = 0; i < spaces_.size(); ++i) {
+      if (spaces_[i].second == -1 && spaces_[i].first.hasPieces()) {
+        deads.push_back(i);
+      }
+    }
+    setStatusIsValid(true);
+  }
+  // Now get rid of the dead
+  if (killDeads) {
+    for (vector<unsigned int>::const_iterator iter = deads.begin();
+         iter != deads.end(); ++iter) {
+      Stack &s = spaces_[*iter].first;
+      ghosts.push_back(Ghost(idx2coord(*iter), s));
+      Change change(Change::Killed, *iter);
+      change.pieces.assign(s.begin(), s.end());
+      journal_.push_back(change);
+      s.clear();
+    }
+  } else if (!deads.empty()) {
+    // Dead stacks remain, which splitStatus() does not expect
+    setStatusIsValid(false);
+  }
+}
+void Board::computeStatus() {
   // We now need to update the status of the cases
-  for_each(spaces_.begin(), spaces_.end(), resetStatus);
-  stack<Coord> toVisit;
-  // Start from the reds...
+  for (unsigned int i = 0; i < spaces_.size(); ++i) {
+    setStatus(i, -1);
+  }
+  //  Each component refers to the first of its reds, so that all its spaces
+  // have the same status
   for (map<const Piece *, Coord>::const_iterator iter = redSpaces_.begin();
        iter != redSpaces_.end(); ++iter) {
-    int i = coord2idx(iter->second);
-    spaces_[i].second = i;
-    toVisit.push(iter->second);
+    unsigned int i = coord2idx(iter->second);
+    if (spaces_[i].second == -1) {
+      relabel(i, i, NULL);
+    }
   }
-  /// ...and propagate.
-  while (!toVisit.empty()) {
-    Coord c = toVisit.top();
-    toVisit.pop();
-    int l = spaces_[coord2idx(c)].second;
-    Coord n[6] = {Coord(c.x() - 1, c.y()),     Coord(c.x() + 1, c.y()),
-                  Coord(c.x(), c.y() - 1),     Coord(c.x(), c.y() + 1),
-                  Coord(c.x() - 1, c.y() - 1), Coord(c.x() + 1, c.y() + 1)};
-    for (unsigned int i = 0; i < 6; ++i) {
-      if (!isValid(n[i]))
+}
+/*!
+ * Updates the status of the component of src, which has just been emptied.
+ *
+ * Searches are run in turn from the non empty neighbours of src, one space
+ * at a time, and are merged when they meet. When a single search is still
+ * running, the spaces found by the finished ones are the parts that were
+ * disconnected. The rest of the component, usually the largest part, is
+ * only visited if the red its status refers to was disconnected.
+ *
+ * The spaces that are no longer connected to a red are added to deads.
+ * Returns false if the status has to be fully recomputed instead.
+ */
+bool Board::splitStatus(unsigned int src, vector<unsigned int> &deads) {
+  const int label = spaces_[src].second;
+  setStatus(src, -1);
+  if (label == -1)
+    return false;
+
+  // A search per non empty neighbour. group[] merges the searches that met.
+  vector<unsigned int> *queues = queues_;
+  for (unsigned int i = 0; i < 6; ++i)
+    queues[i].clear();
+  unsigned int heads[6] = {0, 0, 0, 0, 0, 0};
+  int group[6];
+  int nbSearches = 0;
+  if (++generation_ == 0) {
+    fill(visit_.begin(), visit_.end(), 0u);
+    generation_ = 1;
+  }
+  for (unsigned int i = 0; i < 6; ++i) {
+    const int n = neighbours_[6 * src + i];
+    if (n != -1 && spaces_[n].first.hasPieces()) {
+      visit_[n] = generation_;
+      owner_[n] = nbSearches;
+      group[nbSearches] = nbSearches;
+      queues[nbSearches++].push_back(n);
+    }
+  }
+
+  int nbRunning = nbSearches;
+  bool running[6];
+  for (int i = 0; i < nbSearches; ++i)
+    running[i] = true;
+  while (nbRunning > 1) {
+    for (int i = 0; i < nbSearches && nbRunning > 1; ++i) {
+      if (!running[i] || heads[i] == queues[i].size())
         continue;
-      unsigned int p = coord2idx(n[i]);
-      Space &s = spaces_[p];
-      if (s.second == -1 && s.first.hasPieces()) {
-        s.second = l;
-        toVisit.push(n[i]);
+      const unsigned int c = queues[i][heads[i]++];
+      for (unsigned int j = 0; j < 6; ++j) {
+        const int n = neighbours_[6 * c + j];
+        if (n == -1 || !spaces_[n].first.hasPieces())
+          continue;
+        if (visit_[n] != generation_) {
+          visit_[n] = generation_;
+          owner_[n] = i;
+          queues[i].push_back(n);
+        } else if (group[owner_[n]] != group[i]) {
+          // Merge the group of the owner into the group of i
+          const int merged = group[owner_[n]];
+          for (int k = 0; k < nbSearches; ++k)
+            if (group[k] == merged)
+              group[k] = group[i];
+          --nbRunning;
+        }
+      }
+      // Is the group of i finished ?
+      bool finished = true;
+      for (int k = 0; k < nbSearches; ++k)
+        if (group[k] == group[i] && heads[k] != queues[k].size())
+          finished = false;
+      if (finished) {
+        for (int k = 0; k < nbSearches; ++k)
+          if (group[k] == group[i])
+            running[k] = false;
+        --nbRunning;
       }
     }
   }
-  // Now get rid of the dead
-  if (killDeads) {
-    unsigned int i = 0;
-    for (vector<Space>::iterator iter = spaces_.begin(); iter != spaces_.end();
-         ++iter, ++i) {
-      if (iter->second == -1 && iter->first.hasPieces()) {
-        ghosts.push_back(Ghost(idx2coord(i), iter->first));
-        iter->first.clear();
+
+  // Status of each finished group: one of its reds, if any
+  int remaining = -1;
+  for (int i = 0; i < nbSearches; ++i) {
+    if (running[i]) {
+      remaining = group[i];
+      continue;
+    }
+    if (group[i] != i)
+      continue;
+    int status = -1;
+    for (map<const Piece *, Coord>::const_iterator iter = redSpaces_.begin();
+         iter != redSpaces_.end(); ++iter) {
+      const unsigned int r = coord2idx(iter->second);
+      if (visit_[r] == generation_ && group[owner_[r]] == i &&
+          (status == -1 || int(r) < status))
+        status = r;
+    }
+    for (int k = 0; k < nbSearches; ++k) {
+      if (group[k] != i)
+        continue;
+      for (vector<unsigned int>::const_iterator iter = queues[k].begin();
+           iter != queues[k].end(); ++iter) {
+        setStatus(*iter, status);
+        if (status == -1)
+          deads.push_back(*iter);
+      }
+    }
+  }
+  if (remaining == -1)
+    return true;
+
+  //  The rest of the component keeps its status if the red it refers to is
+  // still in it. Otherwise it refers to another of its reds, if any.
+  int status = -1;
+  for (map<const Piece *, Coord>::const_iterator iter = redSpaces_.begin();
+       iter != redSpaces_.end(); ++iter) {
+    const unsigned int r = coord2idx(iter->second);
+    const bool finishedSearch =
+        visit_[r] == generation_ && group[owner_[r]] != remaining;
+    if (spaces_[r].second == label && !finishedSearch &&
+        (status == -1 || int(r) == label ||
+         (status != label && int(r) < status)))
+      status = r;
+  }
+  if (status == label)
+    return true;
+
+  unsigned int start = 0;
+  for (int i = 0; i < nbSearches; ++i)
+    if (group[i] == remaining)
+      start = queues[i].front();
+  relabel(start, status, (status == -1) ? &deads : NULL);
+  return true;
+}
+/*!
+ * Sets the status of the non empty spaces connected to start. They are
+ * added to cells when it is not NULL.
+ */
+void Board::relabel(unsigned int start, int status,
+                    vector<unsigned int> *cells) {
+  if (++generation_ == 0) {
+    fill(visit_.begin(), visit_.end(), 0u);
+    generation_ = 1;
+  }
+  vector<unsigned int> toVisit(1, start);
+  visit_[start] = generation_;
+  while (!toVisit.empty()) {
+    const unsigned int c = toVisit.back();
+    toVisit.pop_back();
+    setStatus(c, status);
+    if (cells)
+      cells->push_back(c);
+    for (unsigned int j = 0; j < 6; ++j) {
+      const int n = neighbours_[6 * c + j];
+      if (n != -1 && visit_[n] != generation_ && spaces_[n].first.hasPieces()) {
+        visit_[n] = generation_;
+        toVisit.push_back(n);
       }
     }
   }
 }
+void Board::setStatus(unsigned int i, int status) {
+  if (spaces_[i].second != status) {
+    journal_.push_back(Change(Change::StatusChanged, i, spaces_[i].second));
+    spaces_[i].second = status;
+  }
+}
+void Board::setStatusIsValid(bool valid) {
+  if (statusIsValid_ != valid) {
+    journal_.push_back(Change(Change::ValidityChanged, 0, statusIsValid_));
+    statusIsValid_ = valid;
+  }
+}
 bool Board::isFree(const Board::ConstStackHandle &h) const {
   Coord c = h.stackCoord();
 
   if (!isValid(c) || !stackAt(c)->hasPieces())
     return false;
 
-  Coord c0 = Coord(c.x() + 1, c.y());
-  Coord c1 = Coord(c.x() - 1, c.y());
-  Coord c2 = Coord(c.x(), c.y() + 1);
-  Coord c3 = Coord(c.x(), c.y() - 1);
-  Coord c4 = Coord(c.x() + 1, c.y() + 1);
-  Coord c5 = Coord(c.x() - 1, c.y() - 1);
-  return ((!isValid(c0) || !stackAt(c0)->hasPieces()) ||
-          (!isValid(c1) || !stackAt(c1)->hasPieces()) ||
-          (!isValid(c2) || !stackAt(c2)->hasPieces()) ||
-          (!isValid(c3) || !stackAt(c3)->hasPieces()) ||
-          (!isValid(c4) || !stackAt(c4)->hasPieces()) ||
-          (!isValid(c5) || !stackAt(c5)->hasPieces()));
+  // Free if one of the 6 neighbours is empty or out of the board
+  const unsigned int i = coord2idx(c);
+  for (unsigned int j = 0; j < 6; ++j) {
+    const int n = neighbours_[6 * i + j];
+    if (n == -1 || !spaces_[n].first.hasPieces())
+      return true;
+  }
+  return false;
 }
 unsigned int Board::heightMax() const {
   return max_element(spaces_.begin(), spaces_.end(), hasLessPieces)
       ->first.height();
 }
-Board::State Board::state() const {
-  State s;
-  s.spaces_ = spaces_;
-  s.redSpaces_ = redSpaces_;
-  s.unplaced_[0] = unplaced_[0];
-  s.unplaced_[1] = unplaced_[1];
-  s.unplaced_[2] = unplaced_[2];
-  return s;
-}
-void Board::restore(State s) {
-  spaces_ = s.spaces_;
-  redSpaces_ = s.redSpaces_;
-  unplaced_[0] = s.unplaced_[0];
-  unplaced_[1] = s.unplaced_[1];
-  unplaced_[2] = s.unplaced_[2];
+Board::Mark Board::mark() const { return journal_.size(); }
+/*!
+ * Undoes the changes, in reverse order, until the journal is back to m.
+ */
+void Board::rollback(Mark m) {
+  while (journal_.size() > m) {
+    const Change &change = journal_.back();
+    Stack &s = spaces_[change.index].first;
+    switch (change.type) {
+    case Change::Placed: {
+      const Piece *p = s.back();
+      s.pop_back();
+      unplaced_[change.value].push(p);
+      if (p->isRed()) {
+        redSpaces_.erase(p);
+      }
+    } break;
+    case Change::Moved: {
+      Stack &d = spaces_[change.value].first;
+      const Stack::iterator first = d.end() - change.height;
+      for (Stack::const_iterator iter = first; iter != d.end(); ++iter) {
+        if ((*iter)->isRed()) {
+          redSpaces_[*iter] = idx2coord(change.index);
+        }
+      }
+      s.insert(s.end(), first, d.end());
+      d.erase(first, d.end());
+    } break;
+    case Change::Killed:
+      s.insert(s.end(), change.pieces.begin(), change.pieces.end());
+      break;
+    case Change::StatusChanged:
+      spaces_[change.index].second = change.value;
+      break;
+    case Change::ValidityChanged:
+      statusIsValid_ = change.value != 0;
+      break;
+    }
+    journal_.pop_back();
+  }
 }
 //************************************************************
 // Implementation of Board::Coord
@@ -395,3 +627,8 @@ Board::ConstStackIterator::ConstStackIterator(Coord c, const Space *s,
 //************************************************************
 Board::Ghost::Ghost(Board::Coord c, const Stack &s)
     : coord(c), stack(s.begin(), s.end()) {}
+//************************************************************
+// Implementation of Board::Change
+//************************************************************
+Board::Change::Change(Type t, unsigned int i, int v)
+    : type(t), index(i), value(v), height(0) {}
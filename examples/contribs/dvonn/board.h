@@ -80,6 +80,12 @@ public:
   typedef std::deque<Ghost> Ghosts;
   Ghosts move(Coord src, Coord dst, bool killDeads);
 
+  // Undo: every place() and move() is recorded, rollback() undoes all the
+  // changes done since mark() was called.
+  typedef unsigned int Mark;
+  Mark mark() const;
+  void rollback(Mark m);
+
   std::string prettyPrinted(const char *prefix = "") const;
 
 private:
@@ -94,19 +100,28 @@ private:
   std::deque<Piece> pieces_;
   std::stack<const Piece *> unplaced_[3];
   std::map<const Piece *, Coord> redSpaces_;
-
-  void updateStatus(Ghosts &ghosts, bool killDeads);
-
-public:
-  class State {
-  private:
-    friend class Board;
-    std::vector<Space> spaces_;
-    std::stack<const Piece *> unplaced_[3];
-    std::map<const Piece *, Coord> redSpaces_;
-  };
-  State state() const;
-  void restore(State);
+  // Indices of the 6 neighbours of each space, -1 when outside the board
+  std::vector<int> neighbours_;
+
+  void updateStatus(Ghosts &ghosts, bool killDeads, unsigned int src);
+  void computeStatus();
+  bool splitStatus(unsigned int src, std::vector<unsigned int> &deads);
+  void relabel(unsigned int start, int status,
+               std::vector<unsigned int> *cells);
+  void setStatus(unsigned int i, int status);
+  void setStatusIsValid(bool valid);
+
+  //  The status of the spaces is updated incrementally after each move, only
+  // in the component of the emptied space, as long as statusIsValid_.
+  bool statusIsValid_;
+  // Scratch data of splitStatus()
+  std::vector<unsigned int> visit_;
+  std::vector<int> owner_;
+  std::vector<unsigned int> queues_[6];
+  unsigned int generation_;
+
+  class Change;
+  std::vector<Change> journal_;
 };
 //++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
 // Interface of Board::Coord
@@ -185,6 +200,24 @@ protected:
   friend class Board;
   Ghost(Coord c, const Stack &s);
 };
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Interface of Board::Change
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// An entry of the undo journal.
+class Board::Change {
+public:
+  typedef enum { Placed, Moved, Killed, StatusChanged, ValidityChanged } Type;
+  Change(Type t, unsigned int i, int v = 0);
+  Type type;
+  // The space (source of a Moved)
+  unsigned int index;
+  // The color of a Placed, the destination of a Moved, the previous status
+  // or validity of a StatusChanged or ValidityChanged
+  int value;
+  // The moved height, or the killed pieces
+  unsigned int height;
+  std::vector<const Piece *> pieces;
+};
 }; // namespace dvonn
 extern std::ostream &operator<<(std::ostream &, const dvonn::Piece &);
 extern std::ostream &operator<<(std::ostream &, const dvonn::Stack &);
@@ -27,10 +27,12 @@ void Game::reinit() {
   score_[WhitePlayer] = -1;
   score_[BlackPlayer] = -1;
   time_ = 0;
-  historyStates_.clear();
+  historyMarks_.clear();
+  historyActions_.clear();
   historyPlayers_.clear();
   historyPhases_.clear();
-  historyStates_.push_back(board_.state());
+  historyMarks_.push_back(board_.mark());
+  historyActions_.push_back(Action());
   historyPlayers_.push_back(theOnePlaying());
   historyPhases_.push_back(phase());
 }
@@ -69,7 +71,9 @@ bool Game::doPlacement(Placement p) {
         phase_ = MovePhase;
       }
       switchPlayers(player_);
-      updateHistory();
+      Action action;
+      action.placements.push_back(p);
+      updateHistory(action);
       return true;
     }
   }
@@ -85,7 +89,12 @@ bool Game::doMove(const Move m) {
       return false;
     ghosts_[m] = board_.move(m.src, m.dst, true);
     switchPlayers(player_);
-    updateHistory();
+    {
+      Action action;
+      action.isMove = true;
+      action.move = m;
+      updateHistory(action);
+    }
     break;
   case GameOverPhase:
     (void)board_.move(m.src, m.dst, false);
@@ -121,12 +130,11 @@ void Game::switchPlayers(Player p) {
     player_ = n;
     return;
   }
-  Move m;
-  if (getRandomMove(n, m)) {
+  if (hasMove(n)) {
     player_ = n;
     return;
   }
-  if (getRandomMove(p, m)) {
+  if (hasMove(p)) {
     player_ = p;
     return;
   }
@@ -153,16 +161,18 @@ void Game::randomlyFinishPlacement() {
 
   random_shuffle(s.begin(), s.end());
   deque<Color>::const_iterator pter = s.begin();
+  Action action;
   for (Board::ConstStackIterator iter = board_.stacks_begin(),
                                  istop = board_.stacks_end();
        iter != istop; ++iter) {
     if (!(*iter).hasPieces()) {
+      action.placements.push_back(Placement(*pter, iter.stackCoord()));
       board_.place(board_.getUnplacedPiece(*pter++), iter.stackCoord());
     }
   }
   phase_ = MovePhase;
   player_ = WhitePlayer;
-  updateHistory();
+  updateHistory(action);
 }
 bool Game::getRandomMove(Player p, Game::Move &m) const {
   deque<Move> moves;
@@ -187,6 +197,20 @@ bool Game::getRandomMove(Player p, Game::Move &m) const {
   }
   return false;
 }
+/*!
+ * Same as getRandomMove() != false, but stops at the first possible move.
+ */
+bool Game::hasMove(Player p) const {
+  for (Board::ConstStackIterator iter = board_.stacks_begin(),
+                                 istop = board_.stacks_end();
+       iter != istop; ++iter) {
+    if (iter->hasPieces() && iter->onTop()->color() == colorOf(p) &&
+        board_.isFree(iter) && !possibleDestinations(iter).empty()) {
+      return true;
+    }
+  }
+  return false;
+}
 QString Game::fileName() const { return fileName_; }
 bool Game::load(const QString &fileName) {
   fileName_ = fileName;
@@ -217,15 +241,17 @@ bool Game::saveAs(const QString &fileName) {
   fileName_ = fileName;
   return save();
 }
-void Game::updateHistory() {
+void Game::updateHistory(const Action &action) {
   ++time_;
-  if (time_ >= historyStates_.size()) // cannot be more than size() actually
+  if (time_ >= historyMarks_.size()) // cannot be more than size() actually
   {
-    historyStates_.push_back(board_.state());
+    historyMarks_.push_back(board_.mark());
+    historyActions_.push_back(action);
     historyPlayers_.push_back(theOnePlaying());
     historyPhases_.push_back(phase());
   } else {
-    historyStates_[time_] = board_.state();
+    historyMarks_[time_] = board_.mark();
+    historyActions_[time_] = action;
     historyPlayers_[time_] = theOnePlaying();
     historyPhases_[time_] = phase();
   }
@@ -233,20 +259,34 @@ void Game::updateHistory() {
 }
 bool Game::canUndo() const { return time_ > 0; }
 bool Game::canRedo() const { return time_ < knownTime_; }
+/*!
+ * The Board changes made since the previous time are rolled back.
+ */
 void Game::undo() {
   if (canUndo()) {
     if (knownTime_ == 0)
       knownTime_ = time_;
     --time_;
-    board_.restore(historyStates_[time_]);
+    board_.rollback(historyMarks_[time_]);
     player_ = historyPlayers_[time_];
     phase_ = historyPhases_[time_];
   }
 }
+/*!
+ * The undone placements or move are played again.
+ */
 void Game::redo() {
   if (canRedo()) {
     ++time_;
-    board_.restore(historyStates_[time_]);
+    const Action &action = historyActions_[time_];
+    for (vector<Placement>::const_iterator iter = action.placements.begin();
+         iter != action.placements.end(); ++iter) {
+      board_.place(board_.getUnplacedPiece(iter->color), iter->dst);
+    }
+    if (action.isMove) {
+      const Move &m = action.move;
+      ghosts_[m] = board_.move(m.src, m.dst, true);
+    }
     player_ = historyPlayers_[time_];
     phase_ = historyPhases_[time_];
   }
@@ -256,6 +296,10 @@ void Game::redo() {
 //************************************************************
 Game::Placement::Placement(Color c, Board::Coord d) : color(c), dst(d) {}
 //************************************************************
+// Implementation of Game::Action
+//************************************************************
+Game::Action::Action() : isMove(false) {}
+//************************************************************
 // Implementation of Game::Move
 //************************************************************
 Game::Move::Move(Board::Coord s, Board::Coord d) : src(s), dst(d) {}
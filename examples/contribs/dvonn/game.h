@@ -62,8 +62,11 @@ public:
   bool canRedo() const;
 
 private:
+  class Action;
+
   void switchPlayers(Player p);
-  void updateHistory();
+  bool hasMove(Player p) const;
+  void updateHistory(const Action &action);
 
   QString fileName_;
   Board board_;
@@ -73,7 +76,10 @@ private:
   int score_[2];
   unsigned int time_;
   unsigned int knownTime_;
-  std::deque<Board::State> historyStates_;
+  // Board::mark() at each time, rolled back to by undo()
+  std::deque<Board::Mark> historyMarks_;
+  // What led to each time, replayed by redo()
+  std::deque<Action> historyActions_;
   std::deque<Player> historyPlayers_;
   std::deque<Phase> historyPhases_;
 };
@@ -96,6 +102,16 @@ public:
   Board::Coord dst;
   bool operator<(const Move other) const;
 };
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Interface of Game::Action
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+class Game::Action {
+public:
+  Action();
+  std::vector<Placement> placements;
+  bool isMove;
+  Move move;
+};
 } // namespace dvonn
 extern std::ostream &operator<<(std::ostream &, const dvonn::Game::Placement);
 extern std::ostream &operator<<(std::ostream &, const dvonn::Game::Move);
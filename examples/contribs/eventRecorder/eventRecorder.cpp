@@ -1,6 +1,12 @@
 #include "eventRecorder.h"
 #include "replayInterface.h"
 #include "viewer.h"
+#include "QGLViewer/frameSink.h"
+#include <QDataStream>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <algorithm>
 #include <qcombobox.h>
 #include <qfiledialog.h>
 #include <qlabel.h>
@@ -18,7 +24,8 @@ using namespace qglviewer;
   All \p qglviewer events will then be filtered by the created EventRecorder.
   See \c QObject::installEventFilter() for details. */
 EventRecorder::EventRecorder(Viewer *const qglviewer)
-    : qglviewer_(qglviewer), eventRecords_(25000) {
+    : qglviewer_(qglviewer), eventRecords_(25000), isBenchmarking_(false),
+      benchmarkDuration_(0), frameSink_(NULL) {
   if (!qglviewer) {
     qWarning("NULL QGLViewer in EventRecorder constructor");
     return;
@@ -53,10 +60,12 @@ EventRecorder::~EventRecorder() {
   if (replayInterface_)
     delete replayInterface_;
 
+  closeFrameSink();
+
   for (QValueVector<Event>::iterator it = eventRecords_.begin(),
                                      end = eventRecords_.end();
        it != end; ++it)
-    delete (*it).event.keyEvent; // or any other pointer
+    deleteEvent(*it);
 }
 
 EventRecorder::FrameState::FrameState(Frame *const fr) : frame(fr) {
@@ -176,9 +185,26 @@ bool EventRecorder::eventFilter(QObject *, QEvent *e) {
   return false;
 }
 
-/*! Saves current recorded events in a file in XML format. If no \p filename is
-  provided (default), opens a file dialog to ask for a name. See also
-  loadEventRecord(). */
+// Binary event records start with this magic number ("QEVR") and a format
+// version. See EventRecorder::saveBinaryEventRecord().
+static const quint32 binaryEventRecordMagic = 0x51455652;
+static const quint16 binaryEventRecordVersion = 1;
+
+static bool isBinaryEventRecordFileName(const QString &name) {
+  return QFileInfo(name).suffix().toLower() == "evr";
+}
+
+static void setBinaryEventRecordFormat(QDataStream &stream) {
+  stream.setVersion(QDataStream::Qt_5_4);
+  stream.setFloatingPointPrecision(QDataStream::DoublePrecision);
+}
+
+/*! Saves current recorded events in a file. If no \p filename is provided
+  (default), opens a file dialog to ask for a name. See also loadEventRecord().
+
+  When \p filename has an \c .evr extension, a compact binary format is used.
+  It is much faster to load than the default XML format, which is preferable
+  for long scenarios used with benchmarkReplay(). */
 void EventRecorder::saveEventRecord(const QString &filename) const {
   QString name;
   bool ok = false;
@@ -200,6 +226,13 @@ void EventRecorder::saveEventRecord(const QString &filename) const {
   else
     name = filename;
 
+  if (isBinaryEventRecordFileName(name)) {
+    if (!saveBinaryEventRecord(name))
+      QMessageBox::warning(qglviewer(), "Save to file error",
+                           "Unable to save to file " + name);
+    return;
+  }
+
   // Create the DOM document
   QDomDocument doc("EVENTRECORDER");
 
@@ -314,13 +347,17 @@ void EventRecorder::saveEventRecord(const QString &filename) const {
   scene. Trying to replay() an event list recorded in an other context is most
   likely to produce unexpected results. Only the initial camera and
   manipulatedFrame (if any) states are loaded back and can be restored (see
-  cameraIsRestored() and manipulatedFrameIsRestored()). */
-void EventRecorder::loadEventRecord(const QString &filename) {
+  cameraIsRestored() and manipulatedFrameIsRestored()).
+
+  Both the XML and the binary formats (see saveEventRecord()) are read, the
+  format is detected from the file content. Returns \c false if the file could
+  not be read. */
+bool EventRecorder::loadEventRecord(const QString &filename) {
   QString name;
   if (filename.isEmpty()) {
     name = *((QFileDialog::getOpenFileNames()).begin());
     if (name.isEmpty()) // means cancel
-      return;
+      return false;
   } else
     name = filename;
 
@@ -330,6 +367,18 @@ void EventRecorder::loadEventRecord(const QString &filename) {
   // Write the DOM tree to file
   QFile f(name);
   if (f.open(IO_ReadOnly) == true) {
+    const QByteArray magic = f.peek(sizeof(binaryEventRecordMagic));
+    QDataStream magicStream(magic);
+    quint32 value = 0;
+    magicStream >> value;
+    if (value == binaryEventRecordMagic) {
+      if (loadBinaryEventRecord(f))
+        return true;
+      QMessageBox::warning(qglviewer(), "Open file error",
+                           "Invalid event record file " + name);
+      return false;
+    }
+
     doc.setContent(&f);
     f.close();
     // Parse the DOM tree
@@ -452,6 +501,7 @@ void EventRecorder::loadEventRecord(const QString &filename) {
       }
       child = child.nextSibling().toElement();
     }
+    return true;
   } else
 #if QT_VERSION < 0x030200
     QMessageBox::warning(qglviewer(), "Open file error",
@@ -461,6 +511,230 @@ void EventRecorder::loadEventRecord(const QString &filename) {
                          "Unable to open file " + name + ":\n" +
                              f.errorString());
 #endif
+  return false;
+}
+
+// Binary version of saveEventRecord(). Events are stored as a type, a time and
+// a fixed size payload, in the order they were recorded.
+bool EventRecorder::saveBinaryEventRecord(const QString &filename) const {
+  QFile f(filename);
+  if (!f.open(QIODevice::WriteOnly))
+    return false;
+
+  QDataStream stream(&f);
+  setBinaryEventRecordFormat(stream);
+  stream << binaryEventRecordMagic << binaryEventRecordVersion;
+
+  stream << qint32(eventIndex_) << qint32(recordDuration_);
+  stream << cameraIsRestored() << manipulatedFrameIsRestored()
+         << savesSnapshots() << saveAtGivenFrameRate() << replaySpeed();
+  stream << qint32(viewerWidth_) << qint32(viewerHeight_);
+  initialCameraFrame_.writeToStream(stream);
+  initialManipulatedFrame_.writeToStream(stream);
+
+  for (int i = 0; i < eventIndex_; ++i) {
+    const Event &e = eventRecords_[i];
+    stream << quint16(e.type) << qint32(e.time);
+
+    switch (e.type) {
+    case QEvent::KeyPress:
+    case QEvent::KeyRelease:
+      stream << qint32(e.event.keyEvent->key())
+             << qint32(e.event.keyEvent->ascii())
+             << qint32(e.event.keyEvent->state());
+      break;
+    case QEvent::MouseButtonPress:
+    case QEvent::MouseButtonRelease:
+    case QEvent::MouseButtonDblClick:
+    case QEvent::MouseMove:
+      stream << qint32(e.event.mouseEvent->x())
+             << qint32(e.event.mouseEvent->y())
+             << qint32(e.event.mouseEvent->button())
+             << qint32(e.event.mouseEvent->state());
+      break;
+    case QEvent::Wheel:
+      stream << qint32(e.event.wheelEvent->x())
+             << qint32(e.event.wheelEvent->y())
+             << qint32(e.event.wheelEvent->delta())
+             << qint32(e.event.wheelEvent->state());
+      break;
+    case QEvent::Timer:
+      break;
+    case QEvent::MaxUser: // Actually means Frame state
+    {
+      // 0: unknown, 1: camera, 2: manipulatedFrame
+      quint8 frameId = 0;
+      if (e.event.frameState->frame == qglviewer()->camera()->frame())
+        frameId = 1;
+      else if ((e.event.frameState->frame == qglviewer()->manipulatedFrame()) &&
+               (qglviewer()->manipulatedFrame()))
+        frameId = 2;
+      stream << frameId;
+      e.event.frameState->state.writeToStream(stream);
+      break;
+    }
+    case QEvent::User:
+      stream << qint32((long)(e.event.frameState));
+      break;
+    default:
+      qWarning("Unknown event type %d", int(e.type));
+      break;
+    }
+  }
+
+  return stream.status() == QDataStream::Ok;
+}
+
+// Binary version of loadEventRecord(). The file header has been checked.
+bool EventRecorder::loadBinaryEventRecord(QFile &file) {
+  QDataStream stream(&file);
+  setBinaryEventRecordFormat(stream);
+
+  quint32 magic;
+  quint16 version;
+  stream >> magic >> version;
+  if (version > binaryEventRecordVersion)
+    qWarning("Event record created with a newer binary format (%d) may not "
+             "be correctly read.",
+             int(version));
+
+  qint32 nbEvents, duration, width, height;
+  bool restoreCamera, restoreManipulatedFrame, snapshots, givenFrameRate;
+  float speed;
+  stream >> nbEvents >> duration;
+  stream >> restoreCamera >> restoreManipulatedFrame >> snapshots >>
+      givenFrameRate >> speed;
+  stream >> width >> height;
+  if ((stream.status() != QDataStream::Ok) || (nbEvents < 0) ||
+      (nbEvents > eventRecords_.size()))
+    return false;
+
+  Frame initialCameraFrame, initialManipulatedFrame;
+  initialCameraFrame.readFromStream(stream);
+  initialManipulatedFrame.readFromStream(stream);
+
+  // Parsed apart, so that the current record is unchanged if the file is
+  // invalid
+  QValueVector<Event> events;
+  events.reserve(nbEvents);
+  bool ok = true;
+  for (int i = 0; ok && (i < nbEvents); ++i) {
+    quint16 type;
+    qint32 time;
+    stream >> type >> time;
+    Event e;
+    e.type = QEvent::Type(type);
+    e.time = time;
+
+    switch (e.type) {
+    case QEvent::KeyPress:
+    case QEvent::KeyRelease: {
+      qint32 key, ascii, state;
+      stream >> key >> ascii >> state;
+      e.event.keyEvent = new QKeyEvent(e.type, key, ascii, state);
+      break;
+    }
+    case QEvent::MouseButtonPress:
+    case QEvent::MouseButtonRelease:
+    case QEvent::MouseButtonDblClick:
+    case QEvent::MouseMove: {
+      qint32 x, y, button, state;
+      stream >> x >> y >> button >> state;
+      e.event.mouseEvent = new QMouseEvent(e.type, QPoint(x, y), button, state);
+      break;
+    }
+    case QEvent::Wheel: {
+      qint32 x, y, delta, state;
+      stream >> x >> y >> delta >> state;
+      e.event.wheelEvent = new QWheelEvent(QPoint(x, y), delta, state);
+      break;
+    }
+    case QEvent::Timer:
+      e.event.keyEvent = NULL; // or any other pointer
+      break;
+    case QEvent::MaxUser: // Actually means Frame state
+    {
+      quint8 frameId;
+      stream >> frameId;
+      Frame *frame = NULL;
+      if (frameId == 1)
+        frame = qglviewer()->camera()->frame();
+      else if (frameId == 2)
+        frame = qglviewer()->manipulatedFrame();
+      if (!frame) {
+        qWarning("Unable to affect Frame state event record");
+        ok = false;
+        break;
+      }
+      e.event.frameState = new EventRecorder::FrameState(frame);
+      e.event.frameState->state.readFromStream(stream);
+      break;
+    }
+    case QEvent::User: {
+      qint32 id;
+      stream >> id;
+      e.event.frameState = (FrameState *)(long)(id);
+      break;
+    }
+    default:
+      qWarning("Unknown event type %d", int(e.type));
+      ok = false;
+      break;
+    }
+
+    if (ok)
+      events.push_back(e);
+  }
+
+  if (!ok || (stream.status() != QDataStream::Ok)) {
+    for (int i = 0; i < events.size(); ++i)
+      deleteEvent(events[i]);
+    return false;
+  }
+
+  // Replaces the current record
+  for (int i = 0; i < nbEvents; ++i) {
+    deleteEvent(eventRecords_[i]);
+    eventRecords_[i] = events[i];
+  }
+  eventIndex_ = nbEvents;
+  recordDuration_ = duration;
+
+  setCameraIsRestored(restoreCamera);
+  setManipulatedFrameIsRestored(restoreManipulatedFrame);
+  setSavesSnapshots(snapshots);
+  setSaveAtGivenFrameRate(givenFrameRate);
+  setReplaySpeed(speed);
+  viewerWidth_ = width;
+  viewerHeight_ = height;
+  initialCameraFrame_ = initialCameraFrame;
+  initialManipulatedFrame_ = initialManipulatedFrame;
+  return true;
+}
+
+// Deletes the event allocated by an Event, according to its type. The unused
+// slots of eventRecords_ are value-initialized: their type is QEvent::None.
+void EventRecorder::deleteEvent(const Event &e) {
+  switch (e.type) {
+  case QEvent::KeyPress:
+  case QEvent::KeyRelease:
+    delete e.event.keyEvent;
+    break;
+  case QEvent::MouseButtonPress:
+  case QEvent::MouseButtonRelease:
+  case QEvent::MouseButtonDblClick:
+  case QEvent::MouseMove:
+    delete e.event.mouseEvent;
+    break;
+  case QEvent::Wheel:
+    delete e.event.wheelEvent;
+    break;
+  case QEvent::MaxUser: // Actually means Frame state
+    delete e.event.frameState;
+    break;
+  default: // Timer has no event, User stores an id
+    break;
+  }
 }
 
 /*! Use this method to make the EventRecorder record Frame related events that
@@ -628,6 +902,32 @@ void EventRecorder::openReplayInterfaceWindow() {
   }
 }
 
+// Restores the camera and manipulatedFrame states, resizes the viewer and
+// calls resetBeforeReplay(), so that a replay starts from the recorded state.
+void EventRecorder::restoreInitialState() {
+  bool updateGLNeeded = false;
+  if (cameraIsRestored()) {
+    qglviewer()->camera()->frame()->setPosition(initialCameraFrame_.position());
+    qglviewer()->camera()->frame()->setOrientation(
+        initialCameraFrame_.orientation());
+    updateGLNeeded = true;
+  }
+
+  if ((manipulatedFrameIsRestored()) && (qglviewer()->manipulatedFrame())) {
+    qglviewer()->manipulatedFrame()->setPosition(
+        initialManipulatedFrame_.position());
+    qglviewer()->manipulatedFrame()->setOrientation(
+        initialManipulatedFrame_.orientation());
+    updateGLNeeded = true;
+  }
+
+  if (updateGLNeeded)
+    qglviewer()->updateGL();
+
+  qglviewer()->resize(viewerWidth_, viewerHeight_);
+  qglviewer()->resetBeforeReplay();
+}
+
 /*! Replays the events that were recorded from the qglviewer() between the
   previous calls to startRecording() and stopRecording() (or from a scenario
   re-loaded from a file using loadEventRecord()).
@@ -651,6 +951,9 @@ void EventRecorder::openReplayInterfaceWindow() {
   tune image quality and size (this can be done through the replay interface,
   see openReplayInterfaceWindow()). When saveAtGivenFrameRate() is \c false, a
   snapshot is only generated after each redraw of the qglviewer().
+  When the QGLViewer::snapshotFileName() ends with \c .avi or \c .y4m, the
+  snapshots are directly written in a single video file instead (see the
+  class documentation).
 
   \arg If savesSnapshots() is \c false, the recorded events are simply played
   back, at the same speed than during the recording (at a precision of a few
@@ -660,32 +963,13 @@ void EventRecorder::replay() {
   if (isRecording())
     return;
 
-  bool updateGLNeeded = false;
-  if (cameraIsRestored()) {
-    qglviewer()->camera()->frame()->setPosition(initialCameraFrame_.position());
-    qglviewer()->camera()->frame()->setOrientation(
-        initialCameraFrame_.orientation());
-    updateGLNeeded = true;
-  }
-
-  if ((manipulatedFrameIsRestored()) && (qglviewer()->manipulatedFrame())) {
-    qglviewer()->manipulatedFrame()->setPosition(
-        initialManipulatedFrame_.position());
-    qglviewer()->manipulatedFrame()->setOrientation(
-        initialManipulatedFrame_.orientation());
-    updateGLNeeded = true;
-  }
-
-  if (updateGLNeeded)
-    qglviewer()->updateGL();
-
-  qglviewer()->resize(viewerWidth_, viewerHeight_);
-  qglviewer()->resetBeforeReplay();
+  restoreInitialState();
 
   nextReplayEvent_ = 0;
   nextEventIsSaveSnapshot_ = false;
 
   if (savesSnapshots()) {
+    openFrameSink();
     if (saveAtGivenFrameRate()) {
       nextEventIsSaveSnapshot_ = true;
       QTimer::singleShot(0, this, SLOT(triggerNextEvent()));
@@ -702,6 +986,47 @@ void EventRecorder::replay() {
   time_.start();
 }
 
+// Replaces the numbered snapshot files by a single video file, depending on
+// the snapshot file name extension.
+void EventRecorder::openFrameSink() {
+  closeFrameSink();
+
+  const QString suffix =
+      QFileInfo(qglviewer()->snapshotFileName()).suffix().toLower();
+  if (suffix == "y4m")
+    frameSink_ = new Y4MFrameSink();
+  else if (suffix == "avi") {
+    MJPEGFrameSink *sink = new MJPEGFrameSink();
+    sink->setQuality(qglviewer()->snapshotQuality());
+    frameSink_ = sink;
+  } else
+    return;
+
+  if (frameSink_->open(qglviewer()->snapshotFileName(), qglviewer()->width(),
+                       qglviewer()->height(), snapshotFrameRate()))
+    qglviewer()->setFrameSink(frameSink_);
+  else {
+    QMessageBox::warning(qglviewer(), "Replay problem",
+                         "Unable to create video file\n" +
+                             qglviewer()->snapshotFileName());
+    delete frameSink_;
+    frameSink_ = NULL;
+  }
+}
+
+void EventRecorder::closeFrameSink() {
+  if (!frameSink_)
+    return;
+
+  if (qglviewer()->frameSink() == frameSink_)
+    qglviewer()->setFrameSink(NULL);
+  if (!frameSink_->close())
+    qWarning("Error while writing video file %s",
+             qglviewer()->snapshotFileName().toLocal8Bit().constData());
+  delete frameSink_;
+  frameSink_ = NULL;
+}
+
 void EventRecorder::saveNumberedSnapshot() const {
   qglviewer()->saveSnapshot(true, true);
 }
@@ -730,6 +1055,7 @@ void EventRecorder::triggerNextEvent() {
     if (!saveAtGivenFrameRate())
       disconnect(qglviewer(), SIGNAL(drawFinished()), this,
                  SLOT(saveNumberedSnapshot()));
+    closeFrameSink();
 
     QMessageBox::information(qglviewer(), "Replay complete",
                              "Replay complete\n");
@@ -794,3 +1120,145 @@ void EventRecorder::replayNextEvent() {
     nextReplayEvent_++;
   }
 }
+
+/*! Replays the recorded events as fast as possible and saves their timings in
+  \p reportFileName. Returns \c false if the report could not be saved.
+
+  The initial state is restored as in replay(). Each event is then sent to the
+  qglviewer() without waiting, and a frame is rendered right after it, so that
+  the rendered sequence only depends on the recorded scenario. Snapshots are
+  never saved and replaySpeed() is ignored.
+
+  For each event, the report gives (in microseconds) the time spent in the
+  qglviewer() event handler (\c input), in its \c draw() and \c postDraw()
+  methods (see frameDrawn()) and the total \c frame time, which includes a \c
+  glFinish(). Note that mouse moves are only applied when the next frame is
+  drawn (see QGLViewer::mouseMoveEvent()), they are hence part of the \c frame
+  time. A \c .json report also contains a summary of the frame time
+  distribution. Any other extension creates a CSV file, with one line per
+  event.
+
+  When the qglviewer() is hidden, frames are rendered off screen using
+  QGLViewer::renderFrame(), which also reads the pixels back. */
+bool EventRecorder::benchmarkReplay(const QString &reportFileName) {
+  if (isRecording() || isBenchmarking())
+    return false;
+
+  restoreInitialState();
+
+  eventTimings_.clear();
+  eventTimings_.reserve(eventIndex_);
+  isBenchmarking_ = true;
+  nextEventIsSaveSnapshot_ = false;
+
+  QElapsedTimer benchmarkTimer, timer;
+  benchmarkTimer.start();
+  for (nextReplayEvent_ = 0; nextReplayEvent_ < eventIndex_;) {
+    EventTiming timing;
+    timing.event = nextReplayEvent_;
+    timing.draw = timing.postDraw = -1;
+    eventTimings_.append(timing);
+
+    timer.start();
+    replayNextEvent(); // increments nextReplayEvent_
+    eventTimings_.last().input = timer.nsecsElapsed();
+
+    timer.start();
+    if (qglviewer()->isVisible()) {
+      qglviewer()->repaint();
+      qglviewer()->makeCurrent();
+      glFinish();
+    } else
+      qglviewer()->renderFrame();
+    eventTimings_.last().frame = timer.nsecsElapsed();
+  }
+  benchmarkDuration_ = benchmarkTimer.nsecsElapsed();
+  isBenchmarking_ = false;
+
+  return saveBenchmarkReport(reportFileName);
+}
+
+/*! Reports the time spent (in nanoseconds) in the qglviewer() \c draw() and \c
+  postDraw() methods for the last frame. Called by the Viewer at the end of its
+  \c postDraw(). Ignored unless isBenchmarking(). */
+void EventRecorder::frameDrawn(qint64 drawTime, qint64 postDrawTime) {
+  if (isBenchmarking() && !eventTimings_.isEmpty()) {
+    eventTimings_.last().draw = drawTime;
+    eventTimings_.last().postDraw = postDrawTime;
+  }
+}
+
+static double microseconds(qint64 nanoseconds) {
+  return (nanoseconds < 0) ? -1.0 : nanoseconds / 1000.0;
+}
+
+// Value below which the given ratio of the sorted values fall.
+static double percentile(const QVector<qint64> &sorted, double ratio) {
+  if (sorted.isEmpty())
+    return 0.0;
+  const int index = qMin(int(ratio * sorted.size()), sorted.size() - 1);
+  return microseconds(sorted[index]);
+}
+
+bool EventRecorder::saveBenchmarkReport(const QString &filename) const {
+  QFile f(filename);
+  if (!f.open(QIODevice::WriteOnly | QIODevice::Text)) {
+    qWarning("Unable to save benchmark report in %s",
+             filename.toLocal8Bit().constData());
+    return false;
+  }
+
+  if (QFileInfo(filename).suffix().toLower() != "json") {
+    QTextStream out(&f);
+    out << "event,type,time,input,draw,postDraw,frame\n";
+    Q_FOREACH (const EventTiming &timing, eventTimings_)
+      out << timing.event << ',' << int(eventRecords_[timing.event].type)
+          << ',' << eventRecords_[timing.event].time << ','
+          << microseconds(timing.input) << ',' << microseconds(timing.draw)
+          << ',' << microseconds(timing.postDraw) << ','
+          << microseconds(timing.frame) << '\n';
+    return out.status() == QTextStream::Ok;
+  }
+
+  QJsonArray events;
+  QVector<qint64> frameTimes;
+  frameTimes.reserve(eventTimings_.size());
+  Q_FOREACH (const EventTiming &timing, eventTimings_) {
+    QJsonObject event;
+    event["event"] = timing.event;
+    event["type"] = int(eventRecords_[timing.event].type);
+    event["time"] = eventRecords_[timing.event].time;
+    event["input"] = microseconds(timing.input);
+    event["draw"] = microseconds(timing.draw);
+    event["postDraw"] = microseconds(timing.postDraw);
+    event["frame"] = microseconds(timing.frame);
+    events.append(event);
+    frameTimes.append(timing.frame);
+  }
+  std::sort(frameTimes.begin(), frameTimes.end());
+
+  qint64 totalFrameTime = 0;
+  Q_FOREACH (qint64 time, frameTimes)
+    totalFrameTime += time;
+
+  QJsonObject frame;
+  frame["mean"] = frameTimes.isEmpty()
+                      ? 0.0
+                      : microseconds(totalFrameTime / frameTimes.size());
+  frame["median"] = percentile(frameTimes, 0.5);
+  frame["p90"] = percentile(frameTimes, 0.9);
+  frame["p99"] = percentile(frameTimes, 0.99);
+  frame["max"] = frameTimes.isEmpty() ? 0.0 : microseconds(frameTimes.last());
+
+  QJsonObject report;
+  report["nbEvents"] = eventIndex_;
+  report["recordDuration"] = recordDuration_; // milliseconds
+  report["replayDuration"] = microseconds(benchmarkDuration_);
+  report["width"] = qglviewer()->width();
+  report["height"] = qglviewer()->height();
+  report["frame"] = frame;
+  report["events"] = events;
+
+  const QByteArray data = QJsonDocument(report).toJson();
+  return f.write(data) == data.size();
+}
@@ -3,11 +3,17 @@
 
 #include "QGLViewer/frame.h"
 
+#include <QElapsedTimer>
+#include <QVector>
 #include <qdatetime.h>
 #include <qevent.h>
 
 class Viewer;
 class ReplayInterface;
+class QFile;
+namespace qglviewer {
+class FrameSink;
+}
 
 /*! \brief A QGLViewer event recorder, that allows for scenario recording and
  replay.
@@ -48,11 +54,37 @@ class ReplayInterface;
  snapshotFrameRate(), saveAtGivenFrameRate(), replaySpeed() for details on the
  replay() parameters.
 
+ <h3>Benchmark</h3>
+
+ A recorded scenario can be used as a performance test. Save it with
+ saveEventRecord() (a \c .evr extension selects a compact binary format, faster
+ to load than XML), then call benchmarkReplay(). Events are fed to the
+ qglviewer() as fast as possible, and a frame is rendered after each of them.
+ The time spent handling each event, in \c draw() and in \c postDraw() is
+ written in a JSON or CSV report, so that the frame time distributions of two
+ builds can be compared on the exact same interaction.
+
+ The example can be run from the command line (for instance on a continuous
+ integration server):
+ \code
+ > eventRecorder -benchmark scenario.evr report.json
+ \endcode
+
  <h3>Movie creation</h3>
 
- The generated numbered image sequence can be converted into a movie by most non
- linear editing software. Here is a way to easily do this using the \c transcode
- publically available software (see <a
+ When the snapshot file name has a \c .avi or \c .y4m extension, the replay()
+ is directly saved in a single video file, using a qglviewer::MJPEGFrameSink
+ (Motion-JPEG AVI, see QGLViewer::snapshotQuality()) or a
+ qglviewer::Y4MFrameSink (uncompressed YUV4MPEG2) respectively. Frames are
+ encoded in background threads and no intermediate image is written. A \c .y4m
+ file can then be compressed with any encoder, for instance:
+ \code
+ > ffmpeg -i movie.y4m -c:v libx264 movie.mp4
+ \endcode
+
+ Otherwise, the generated numbered image sequence can be converted into a movie
+ by most non linear editing software. Here is a way to easily do this using the
+ \c transcode publically available software (see <a
  href="http://zebra.fh-weingarten.de/~transcode/index.html">transcode home
  page</a>).
 
@@ -87,7 +119,18 @@ public Q_SLOTS:
   void replay();
   void openReplayInterfaceWindow();
   void saveEventRecord(const QString &filename = "") const;
-  void loadEventRecord(const QString &filename = "");
+  bool loadEventRecord(const QString &filename = "");
+  //@}
+
+  /*! @name Benchmark */
+  //@{
+public:
+  /*! Returns \c true during benchmarkReplay(). */
+  bool isBenchmarking() const { return isBenchmarking_; };
+  void frameDrawn(qint64 drawTime, qint64 postDrawTime);
+
+public Q_SLOTS:
+  bool benchmarkReplay(const QString &reportFileName);
   //@}
 
   /*! @name Replay parameters */
@@ -225,6 +268,12 @@ private:
   Viewer *const qglviewer() const { return qglviewer_; };
   int predefinedFormat();
   void replayNextEvent();
+  void restoreInitialState();
+  bool saveBinaryEventRecord(const QString &filename) const;
+  bool loadBinaryEventRecord(QFile &file);
+  bool saveBenchmarkReport(const QString &filename) const;
+  void openFrameSink();
+  void closeFrameSink();
 
   class FrameState {
   public:
@@ -247,6 +296,7 @@ private:
     QEvent::Type type;
     int time;
   };
+  static void deleteEvent(const Event &e);
 
   struct PredefinedSettings {
     PredefinedSettings(){};
@@ -286,6 +336,16 @@ private:
   int recordDuration_;
   float replaySpeed_;
   bool saveAtGivenFrameRate_;
+  qglviewer::FrameSink *frameSink_; // when replaying to a video file
+
+  // B e n c h m a r k
+  struct EventTiming {
+    int event;
+    qint64 input, draw, postDraw, frame; // nanoseconds, -1 if not drawn
+  };
+  QVector<EventTiming> eventTimings_;
+  bool isBenchmarking_;
+  qint64 benchmarkDuration_;
 
   // R e p l a y   i n t e r f a c e
   ReplayInterface *replayInterface_;
@@ -6,6 +6,12 @@ int main(int argc, char **argv) {
 
   Viewer viewer;
 
+  // eventRecorder -benchmark scenario.evr report.json
+  const QStringList arguments = application.arguments();
+  const int benchmark = arguments.indexOf("-benchmark");
+  if ((benchmark >= 0) && (benchmark + 2 < arguments.size()))
+    viewer.setBenchmark(arguments[benchmark + 1], arguments[benchmark + 2]);
+
 #if QT_VERSION < 0x040000
   application.setMainWidget(&viewer);
 #else
@@ -1,12 +1,15 @@
 #include "viewer.h"
 #include "eventRecorder.h"
 #include <math.h>
+#include <qapplication.h>
+#include <qtimer.h>
 
 using namespace std;
 using namespace qglviewer;
 
 // Draws a spiral
 void Viewer::draw() {
+  drawTimer_.start();
   const float nbSteps = 200.0;
 
   glBegin(GL_QUAD_STRIP);
@@ -26,6 +29,7 @@ void Viewer::draw() {
     glVertex3f(r2 * c, alt + 0.05, r2 * s);
   }
   glEnd();
+  drawTime_ = drawTimer_.nsecsElapsed();
 }
 
 void Viewer::init() {
@@ -37,7 +41,17 @@ void Viewer::init() {
   setKeyDescription(Qt::Key_R, "Starts/stops recording scenario.");
   setKeyDescription(Qt::SHIFT + Qt::Key_R, "Replay recorded scenario.");
 
-  help();
+  if (!benchmarkEventRecord_.isEmpty())
+    // Once the window is displayed
+    QTimer::singleShot(0, this, SLOT(runBenchmark()));
+  else
+    help();
+}
+
+void Viewer::runBenchmark() {
+  const bool ok = eventRecorder_->loadEventRecord(benchmarkEventRecord_) &&
+                  eventRecorder_->benchmarkReplay(benchmarkReport_);
+  qApp->exit(ok ? 0 : 1);
 }
 
 void Viewer::keyPressEvent(QKeyEvent *e) {
@@ -79,6 +93,7 @@ void Viewer::setManipulatedFrame(ManipulatedFrame *fr) {
 }
 
 void Viewer::postDraw() {
+  drawTimer_.start();
   QGLViewer::postDraw();
   // Red dot when EventRecorder is active
   if (eventRecorder_->isRecording()) {
@@ -95,6 +110,7 @@ void Viewer::postDraw() {
     // restore foregroundColor
     qglColor(foregroundColor());
   }
+  eventRecorder_->frameDrawn(drawTime_, drawTimer_.nsecsElapsed());
 }
 
 QString Viewer::helpString() const {
@@ -107,5 +123,8 @@ QString Viewer::helpString() const {
   text += "replay and save the scenario. You can also save snapshots during "
           "replay, ";
   text += "which can be used to create a movie out of your application.";
+  text += "<br><br>Saved scenarios can be used as benchmarks: run ";
+  text += "<code>eventRecorder -benchmark scenario.evr report.json</code> to ";
+  text += "replay one as fast as possible and save the frame timings.";
   return text;
 }
@@ -1,3 +1,4 @@
+#include <QElapsedTimer>
 #include <QGLViewer/qglviewer.h>
 
 class EventRecorder;
@@ -16,6 +17,15 @@ public:
   then be replayed using 'Shift+R'. */
   EventRecorder *eventRecorder() const { return eventRecorder_; };
 
+  /*! Makes the viewer replay \p eventRecordFileName as soon as it is
+  initialized, save the timings in \p reportFileName and quit the application.
+  See qglviewer::EventRecorder::benchmarkReplay(). */
+  void setBenchmark(const QString &eventRecordFileName,
+                    const QString &reportFileName) {
+    benchmarkEventRecord_ = eventRecordFileName;
+    benchmarkReport_ = reportFileName;
+  };
+
 public:
 Q_SIGNALS:
   /*! Signal emitted by the default QGLViewer::resetBeforeReplay() function.
@@ -46,6 +56,9 @@ protected Q_SLOTS:
 
   void setManipulatedFrame(qglviewer::ManipulatedFrame *fr);
 
+private Q_SLOTS:
+  void runBenchmark();
+
 protected:
   virtual void draw();
   virtual void postDraw();
@@ -55,4 +68,10 @@ protected:
 
 private:
   EventRecorder *eventRecorder_;
+
+  // Timings of draw() and postDraw(), see EventRecorder::frameDrawn()
+  QElapsedTimer drawTimer_;
+  qint64 drawTime_;
+
+  QString benchmarkEventRecord_, benchmarkReport_;
 };
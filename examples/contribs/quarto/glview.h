@@ -39,6 +39,9 @@ class GLViewPieces : public GLView {
 public:
   GLViewPieces(QWidget *parent) : GLView(parent) {}
 
+  // Selection par le joueur artificiel
+  void selectPiece(int piece) { applySelection(piece); }
+
 protected:
   virtual void draw();
   virtual void init();
@@ -60,6 +63,10 @@ public:
 
   void reset() { jeu.init(); }
 
+  // Placement par le joueur artificiel
+  void placePiece(int cell) { applySelection(cell); }
+  const Position &getPosition() const { return jeu.getPosition(); }
+
 protected:
   virtual void draw();
   virtual void init();
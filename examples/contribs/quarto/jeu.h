@@ -2,6 +2,7 @@
 #define JEU_H
 
 #include "piece.h"
+#include "solveur.h"
 
 struct cell {
   bool empty;
@@ -11,6 +12,7 @@ struct cell {
 class Jeu {
 protected:
   struct cell tab[16];
+  Position position;
 
 public:
   Jeu() {}
@@ -21,11 +23,12 @@ public:
       tab[i].empty = true;
       tab[i].piece = NULL;
     }
+    position.init();
   }
   bool needDrawing(int);
   void placePiece(int, Piece *);
-  bool caracCommune(Piece *pieces[4]);
   bool analyze();
+  const Position &getPosition() const { return position; }
 };
 
 #endif // JEU_H
@@ -43,6 +43,8 @@ public:
   bool getCouleur() { return couleur; }
   bool getForme() { return forme; }
   bool getTrou() { return trou; }
+  // Les 4 caracteristiques, voir Position
+  int getId() { return id; }
 };
 
 /*
@@ -1,6 +1,7 @@
 #include "quarto.h"
 
 #include <qapplication.h>
+#include <qcheckbox.h>
 #include <qdialog.h>
 #include <qframe.h>
 #include <qgroupbox.h>
@@ -8,6 +9,7 @@
 #include <qlayout.h>
 #include <qmessagebox.h>
 #include <qpushbutton.h>
+#include <qtimer.h>
 #include <qtooltip.h>
 #include <qvariant.h>
 #include <qwidget.h>
@@ -72,8 +74,8 @@ Quarto::Quarto(QWidget *parent) : QMainWindow(parent) {
   // Indication du tour des joueurs
   HLayout2 = new QHBoxLayout(NULL);
 
-  GameGroupBox->setMaximumSize(600, 100);
-  privateLayoutWidget->setGeometry(QRect(10, 15, 280, 80));
+  GameGroupBox->setMaximumSize(600, 130);
+  privateLayoutWidget->setGeometry(QRect(10, 15, 280, 110));
 
   // titre
   TourDeJeuLabel = new QLabel(privateLayoutWidget);
@@ -125,6 +127,10 @@ Quarto::Quarto(QWidget *parent) : QMainWindow(parent) {
   QuitButton->setText(trUtf8("Quit"));
   HLayout3->addWidget(QuitButton);
   VLayout2->addLayout(HLayout3);
+  // Joueur artificiel
+  OrdinateurCheckBox = new QCheckBox(privateLayoutWidget);
+  OrdinateurCheckBox->setText(trUtf8("Computer plays Player 2"));
+  VLayout2->addWidget(OrdinateurCheckBox);
 
   // Ajout au tableau de fenetres
   MainHLayout->addLayout(VLayout1);
@@ -141,6 +147,8 @@ Quarto::Quarto(QWidget *parent) : QMainWindow(parent) {
   connect(vuePlateau, SIGNAL(piecePlacee()), this, SLOT(piecePlacee()));
   connect(vuePieces, SIGNAL(changeJoueur()), this, SLOT(changeTour()));
   connect(vuePlateau, SIGNAL(endGame()), this, SLOT(finDeJeu()));
+  connect(OrdinateurCheckBox, SIGNAL(toggled(bool)), this,
+          SLOT(joueOrdinateur()));
   // On initialise l'interface
   init(true);
 }
@@ -182,9 +190,27 @@ void Quarto::changeTour() {
       NomLabel->setText(trUtf8("Player 1"));
     joueur = !joueur;
     pieceplacee = false;
+    // Laisse l'interface se redessiner avant que l'ordinateur ne joue
+    if (!joueur)
+      QTimer::singleShot(0, this, SLOT(joueOrdinateur()));
   }
 }
 
+// L'ordinateur joue le Player 2 : il place la piece choisie pour lui, puis
+// choisit celle de son adversaire
+void Quarto::joueOrdinateur() {
+  if (!OrdinateurCheckBox->isChecked() || joueur || pieceplacee)
+    return;
+
+  const Solveur::Coup coup = solveur.bestMove(
+      vuePlateau->getPosition(), setofpiece->getPiece()->getId());
+  vuePlateau->placePiece(coup.cell);
+  // Partie gagnee (et peut-etre recommencee par finDeJeu()), ou plateau plein
+  if (coup.piece == -1 || joueur)
+    return;
+  vuePieces->selectPiece(coup.piece);
+}
+
 void Quarto::finDeJeu() {
   if (QMessageBox::information(this, "Game over",
                                "Game is over, " + NomLabel->text() + " won.",
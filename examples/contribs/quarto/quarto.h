@@ -3,6 +3,7 @@
 
 #include "glview.h"
 #include "piece.h"
+#include "solveur.h"
 #include <iostream>
 #include <qmainwindow.h>
 #include <qvariant.h>
@@ -15,6 +16,7 @@ class QFrame;
 class QGroupBox;
 class QLabel;
 class QPushButton;
+class QCheckBox;
 class QWidget;
 
 class Quarto : public QMainWindow {
@@ -35,6 +37,7 @@ public:
   QGroupBox *GameGroupBox;
   QLabel *TourDeJeuLabel, *NomLabel;
   QPushButton *ResetButton, *QuitButton;
+  QCheckBox *OrdinateurCheckBox;
   QPopupMenu *GagnantPopUp;
 
 public Q_SLOTS:
@@ -43,6 +46,7 @@ public Q_SLOTS:
   virtual void changeTour();
   virtual void piecePlacee();
   virtual void finDeJeu();
+  virtual void joueOrdinateur();
 
 Q_SIGNALS:
   void updategl();
@@ -57,6 +61,7 @@ protected:
   GLViewJeu *vuePlateau;
   GLViewPieces *vuePieces;
   SetOfPiece *setofpiece;
+  Solveur solveur;
   virtual void init(bool);
 };
 
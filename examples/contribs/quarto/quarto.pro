@@ -2,13 +2,19 @@
 
 # See the <code>rules.txt</code> file for explanations.
 
+# Player 2 can be played by the computer, which solves the game exactly in the
+# last moves.
+
 # This program was originally coded by Matthieu Richard.
 
 TEMPLATE = app
 TARGET   = quarto
 
-HEADERS	+= glview.h jeu.h piece.h quarto.h
-SOURCES	+= glview.cpp jeu.cpp piece.cpp quarto.cpp main.cpp
+HEADERS	+= glview.h jeu.h piece.h quarto.h solveur.h
+SOURCES	+= glview.cpp jeu.cpp piece.cpp quarto.cpp solveur.cpp main.cpp
+
+# The computer player explores the first moves in parallel
+QT *= concurrent
 
 DISTFILES += bois.jpg rules.txt
 
@@ -0,0 +1,450 @@
+#include "solveur.h"
+
+#include <QVector>
+#include <QtAlgorithms>
+#include <QtConcurrent>
+
+#include <algorithm>
+#include <stdlib.h>
+
+//********************************************************************//
+//                    Tables                                          //
+//********************************************************************//
+
+// Les 10 alignements : lignes, colonnes et diagonales
+static const quint16 alignements[10] = {
+    0x000F, 0x00F0, 0x0F00, 0xF000, 0x1111,
+    0x2222, 0x4444, 0x8888, 0x8421, 0x1248};
+
+// Repete un masque de cases dans les 4 caracteristiques
+static inline quint64 lanes(quint16 cases) {
+  return cases * Q_UINT64_C(0x0001000100010001);
+}
+
+// Vrai ssi l'une des 4 caracteristiques de v est nulle
+static inline bool hasZeroLane(quint64 v) {
+  return ((v - Q_UINT64_C(0x0001000100010001)) & ~v &
+          Q_UINT64_C(0x8000800080008000)) != 0;
+}
+
+// Les caracteristiques de piece, placee sur la case 0
+static inline quint64 spread(int piece) {
+  return (piece & 1) | (quint64((piece >> 1) & 1) << 16) |
+         (quint64((piece >> 2) & 1) << 32) | (quint64((piece >> 3) & 1) << 48);
+}
+
+// Vrai ssi les 4 pieces de l'alignement complet ont une caracteristique commune
+static inline bool caracCommune(quint64 attributs, quint16 alignement) {
+  const quint64 x = attributs & lanes(alignement);
+  return hasZeroLane(x) || hasZeroLane(x ^ lanes(alignement));
+}
+
+//********************************************************************//
+//                    Position                                        //
+//********************************************************************//
+
+int Position::nbEmpty() const { return 16 - qPopulationCount(occupees); }
+
+int Position::pieceAt(int cell) const {
+  if (isEmpty(cell))
+    return -1;
+  int piece = 0;
+  for (int c = 0; c < 4; ++c)
+    piece |= int((attributs >> (16 * c + cell)) & 1) << c;
+  return piece;
+}
+
+void Position::placePiece(int cell, int piece) {
+  occupees |= 1 << cell;
+  disponibles &= ~(1 << piece);
+  attributs |= spread(piece) << cell;
+}
+
+void Position::removePiece(int cell) {
+  if (isEmpty(cell))
+    return;
+  disponibles |= 1 << pieceAt(cell);
+  occupees &= ~(1 << cell);
+  attributs &= ~lanes(1 << cell);
+}
+
+bool Position::analyze() const {
+  for (int i = 0; i < 10; ++i)
+    if ((occupees & alignements[i]) == alignements[i] &&
+        caracCommune(attributs, alignements[i]))
+      return true;
+  return false;
+}
+
+bool Position::wins(int cell, int piece) const {
+  const quint16 o = occupees | (1 << cell);
+  const quint64 a = attributs | (spread(piece) << cell);
+  for (int i = 0; i < 10; ++i)
+    if ((alignements[i] & (1 << cell)) &&
+        (o & alignements[i]) == alignements[i] &&
+        caracCommune(a, alignements[i]))
+      return true;
+  return false;
+}
+
+quint16 Position::dangerousPieces() const {
+  // Les pieces dont la caracteristique c vaut v : bit piece de parCarac[c][v]
+  static const quint16 parCarac[4][2] = {
+      {0x5555, 0xAAAA}, {0x3333, 0xCCCC}, {0x0F0F, 0xF0F0}, {0x00FF, 0xFF00}};
+
+  quint16 dangereuses = 0;
+  for (int i = 0; i < 10; ++i) {
+    const quint16 pleines = occupees & alignements[i];
+    if (qPopulationCount(pleines) != 3)
+      continue;
+    // Les caracteristiques communes aux 3 pieces de l'alignement
+    for (int c = 0; c < 4; ++c) {
+      const quint16 carac = quint16(attributs >> (16 * c)) & pleines;
+      if (carac == pleines)
+        dangereuses |= parCarac[c][1];
+      else if (carac == 0)
+        dangereuses |= parCarac[c][0];
+    }
+  }
+  return dangereuses;
+}
+
+//********************************************************************//
+//                    Solveur                                         //
+//********************************************************************//
+
+// Type des valeurs stockees dans la table de transposition
+enum { Exacte = 1, Minorant = 2, Majorant = 3 };
+
+//  En dessous de ce nombre de cases vides, la forme canonique coute plus cher
+// que la recherche qu'elle permet d'eviter.
+static const int casesVidesMinTable = 5;
+
+Solveur::Solveur(int tailleTableLog2)
+    : table_(1 << tailleTableLog2), masque_((1 << tailleTableLog2) - 1),
+      arret_(0), nbNodes_(0) {
+  //  Les symetries du plateau qui conservent les alignements : permutations
+  // des lignes et des colonnes, eventuellement transposees, retenues si
+  // elles envoient chaque alignement sur un alignement.
+  int perms[24][4];
+  int nbPerms = 0;
+  for (int p = 0; p < 256; ++p) {
+    const int s[4] = {p & 3, (p >> 2) & 3, (p >> 4) & 3, (p >> 6) & 3};
+    if ((1 << s[0] | 1 << s[1] | 1 << s[2] | 1 << s[3]) == 15) {
+      for (int i = 0; i < 4; ++i)
+        perms[nbPerms][i] = s[i];
+      ++nbPerms;
+    }
+  }
+
+  int nbSymetries = 0;
+  for (int t = 0; t < 2; ++t)
+    for (int l = 0; l < 24; ++l)
+      for (int c = 0; c < 24; ++c) {
+        int image[16];
+        for (int cell = 0; cell < 16; ++cell) {
+          const int i = perms[l][cell / 4], j = perms[c][cell % 4];
+          image[cell] = t ? 4 * j + i : 4 * i + j;
+        }
+
+        bool conserve = true;
+        for (int a = 0; a < 10 && conserve; ++a) {
+          quint16 m = 0;
+          for (int cell = 0; cell < 16; ++cell)
+            if (alignements[a] & (1 << cell))
+              m |= 1 << image[cell];
+          conserve = false;
+          for (int b = 0; b < 10; ++b)
+            conserve |= (m == alignements[b]);
+        }
+        if (!conserve)
+          continue;
+
+        Q_ASSERT(nbSymetries < 32);
+        for (int octet = 0; octet < 2; ++octet)
+          for (int v = 0; v < 256; ++v) {
+            quint16 m = 0;
+            for (int bit = 0; bit < 8; ++bit)
+              if (v & (1 << bit))
+                m |= 1 << image[8 * octet + bit];
+            symetries_[nbSymetries][octet][v] = m;
+          }
+        ++nbSymetries;
+      }
+  Q_ASSERT(nbSymetries == 32);
+}
+
+void Solveur::clear() {
+  for (int i = 0; i < table_.size(); ++i) {
+    table_[i].verification.storeRelease(0);
+    table_[i].donnee.storeRelease(0);
+  }
+}
+
+/*
+ * La cle de la forme canonique de la position, qui est la meme pour toutes
+ * les positions symetriques. occupees recoit les cases occupees de cette
+ * forme. Renvoie faux si la position est trop petite pour etre stockee.
+ */
+bool Solveur::canonicalKey(const Position &position, int piece, quint64 &key,
+                           quint16 &occupees) const {
+  if (position.nbEmpty() < casesVidesMinTable)
+    return false;
+
+  //  Inverse les caracteristiques de toutes les pieces pour que la piece a
+  // placer soit la piece 0
+  quint64 inverse = 0;
+  for (int c = 0; c < 4; ++c)
+    if (piece & (1 << c))
+      inverse |= quint64(0xFFFF) << (16 * c);
+  const quint64 attributs =
+      position.attributs ^ (inverse & lanes(position.occupees));
+
+  bool premiere = true;
+  for (int s = 0; s < 32; ++s) {
+    const quint16(*sym)[256] = symetries_[s];
+    const quint16 o = sym[0][position.occupees & 0xFF] |
+                      sym[1][position.occupees >> 8];
+    if (!premiere && o > occupees)
+      continue;
+
+    //  La piece 0 reste la piece 0 si les caracteristiques sont permutees :
+    // elles sont triees.
+    quint16 c[4];
+    for (int i = 0; i < 4; ++i) {
+      const quint16 m = quint16(attributs >> (16 * i));
+      c[i] = sym[0][m & 0xFF] | sym[1][m >> 8];
+    }
+    std::sort(c, c + 4);
+    const quint64 k = quint64(c[0]) | (quint64(c[1]) << 16) |
+                      (quint64(c[2]) << 32) | (quint64(c[3]) << 48);
+
+    if (premiere || o < occupees || k < key) {
+      occupees = o;
+      key = k;
+      premiere = false;
+    }
+  }
+  return true;
+}
+
+static inline quint64 indexOf(quint64 key, quint16 occupees) {
+  quint64 h = key ^ (quint64(occupees) * Q_UINT64_C(0x9E3779B97F4A7C15));
+  h = (h ^ (h >> 31)) * Q_UINT64_C(0xBF58476D1CE4E5B9);
+  return h ^ (h >> 29);
+}
+
+// Vrai si la table donne la valeur, sinon l'intervalle [alpha, beta] est reduit
+bool Solveur::probe(quint64 key, quint16 occupees, int &alpha, int &beta,
+                    int &valeur) const {
+  const Entree &e = table_[indexOf(key, occupees) & masque_];
+  const quint64 donnee = e.donnee.loadAcquire();
+  if ((e.verification.loadAcquire() ^ donnee) != key ||
+      quint16(donnee) != occupees)
+    return false;
+
+  valeur = int((donnee >> 16) & 3) - 1;
+  switch ((donnee >> 18) & 3) {
+  case Exacte:
+    return true;
+  case Minorant:
+    alpha = qMax(alpha, valeur);
+    break;
+  case Majorant:
+    beta = qMin(beta, valeur);
+    break;
+  default:
+    return false;
+  }
+  return alpha >= beta;
+}
+
+void Solveur::store(quint64 key, quint16 occupees, int valeur, int alpha,
+                    int beta) {
+  const int type =
+      (valeur <= alpha) ? Majorant : ((valeur >= beta) ? Minorant : Exacte);
+  const quint64 donnee =
+      occupees | (quint64(valeur + 1) << 16) | (quint64(type) << 18);
+  Entree &e = table_[indexOf(key, occupees) & masque_];
+  e.verification.storeRelease(key ^ donnee);
+  e.donnee.storeRelease(donnee);
+}
+
+/*
+ * La valeur de la position pour le joueur qui doit placer piece : 1 s'il
+ * gagne, 0 si la partie est nulle, -1 s'il perd, bornee par [alpha, beta].
+ *
+ * piece ne doit pas permettre de gagner immediatement : les pieces qui le
+ * permettent ne sont jamais donnees (voir Position::dangerousPieces()).
+ */
+int Solveur::negamax(const Position &position, int piece, int alpha, int beta,
+                     quint64 &nodes) {
+  ++nodes;
+  if (arret_.loadAcquire())
+    return 0;
+
+  const quint16 vides = ~position.occupees;
+  // Derniere piece, et pas d'alignement
+  if (position.disponibles == (1 << piece))
+    return 0;
+
+  quint64 key = 0;
+  quint16 occupees = 0;
+  const bool table = canonicalKey(position, piece, key, occupees);
+  const int alphaInitial = alpha;
+  int valeur;
+  if (table && probe(key, occupees, alpha, beta, valeur))
+    return valeur;
+
+  int meilleure = -1;
+  for (int cell = 0; cell < 16 && meilleure < beta; ++cell) {
+    if (!(vides & (1 << cell)))
+      continue;
+    Position suivante = position;
+    suivante.placePiece(cell, piece);
+    //  Les pieces qui laisseraient l'adversaire gagner ne sont pas donnees, le
+    // coup est perdant s'il n'y en a pas d'autre.
+    const quint16 donnables =
+        suivante.disponibles & ~suivante.dangerousPieces();
+    for (int p = 0; p < 16; ++p) {
+      if (!(donnables & (1 << p)))
+        continue;
+      const int v =
+          -negamax(suivante, p, -beta, -qMax(alpha, meilleure), nodes);
+      if (v > meilleure) {
+        meilleure = v;
+        if (meilleure >= beta)
+          break;
+      }
+    }
+  }
+
+  // Une recherche interrompue ne donne pas de valeur exacte
+  if (table && !arret_.loadAcquire())
+    store(key, occupees, meilleure, alphaInitial, beta);
+  return meilleure;
+}
+
+// Un coup de la racine, explore par un thread
+struct RootMove {
+  Solveur *solveur;
+  Position position; // apres le coup
+  int cell, piece;
+  int valeur;
+  bool gagnant;
+  quint64 nodes;
+
+  void evaluate() {
+    valeur = -solveur->negamax(position, piece, -1, 1, nodes);
+    //  Le premier coup gagnant arrete les autres recherches : sa valeur est
+    // exacte puisqu'il a ete explore entierement avant l'arret.
+    gagnant = (valeur == 1) && solveur->arret_.testAndSetOrdered(0, 1);
+  }
+};
+
+Solveur::Coup Solveur::solve(const Position &position, int piece,
+                             bool parallel) {
+  Coup coup = {-1, -1, -1, true};
+  nbNodes_ = 1;
+
+  for (int cell = 0; cell < 16; ++cell)
+    if (position.isEmpty(cell) && position.wins(cell, piece)) {
+      coup.cell = cell;
+      coup.valeur = 1;
+      return coup;
+    }
+
+  //  Un coup par case et par piece donnee, sauf les symetriques d'un coup
+  // deja retenu et les pieces qui font perdre immediatement
+  QVector<RootMove> moves;
+  QVector<QPair<quint64, quint16> > keys;
+  for (int cell = 0; cell < 16; ++cell) {
+    if (!position.isEmpty(cell))
+      continue;
+    Position suivante = position;
+    suivante.placePiece(cell, piece);
+    if (coup.cell == -1)
+      coup.cell = cell;
+    if (suivante.disponibles == 0) {
+      coup.valeur = 0;
+      return coup;
+    }
+
+    const quint16 dangereuses = suivante.dangerousPieces();
+    for (int p = 0; p < 16; ++p) {
+      if (!suivante.isAvailable(p))
+        continue;
+      if (coup.piece == -1) {
+        coup.cell = cell;
+        coup.piece = p;
+      }
+      if (dangereuses & (1 << p))
+        continue;
+
+      quint64 key;
+      quint16 occupees;
+      if (canonicalKey(suivante, p, key, occupees)) {
+        if (keys.contains(qMakePair(key, occupees)))
+          continue;
+        keys.append(qMakePair(key, occupees));
+      }
+      RootMove move = {this, suivante, cell, p, -1, false, 0};
+      moves.append(move);
+    }
+  }
+
+  arret_.storeRelease(0);
+  if (parallel)
+    QtConcurrent::blockingMap(moves, &RootMove::evaluate);
+  else
+    for (int i = 0; i < moves.size() && !arret_.loadAcquire(); ++i)
+      moves[i].evaluate();
+
+  //  Si une recherche a ete arretee, seul le coup gagnant a une valeur
+  // exacte. Sinon le premier des meilleurs coups est retenu.
+  const bool arrete = arret_.loadAcquire();
+  for (int i = 0; i < moves.size(); ++i) {
+    nbNodes_ += moves[i].nodes;
+    if (moves[i].gagnant ||
+        (!arrete && (i == 0 || moves[i].valeur > coup.valeur))) {
+      coup.cell = moves[i].cell;
+      coup.piece = moves[i].piece;
+      coup.valeur = moves[i].valeur;
+    }
+  }
+  arret_.storeRelease(0);
+  return coup;
+}
+
+Solveur::Coup Solveur::bestMove(const Position &position, int piece,
+                                int maxEmptyCells) {
+  if (position.nbEmpty() <= maxEmptyCells)
+    return solve(position, piece);
+
+  // Trop tot pour resoudre : un coup au hasard, qui ne perd pas tout de suite
+  Coup coup = {-1, -1, 0, false};
+  int nbSurs = 0;
+  for (int cell = 0; cell < 16; ++cell) {
+    if (!position.isEmpty(cell))
+      continue;
+    if (position.wins(cell, piece)) {
+      Coup gagnant = {cell, -1, 1, true};
+      return gagnant;
+    }
+    Position suivante = position;
+    suivante.placePiece(cell, piece);
+    const quint16 donnables =
+        suivante.disponibles & ~suivante.dangerousPieces();
+    for (int p = 0; p < 16; ++p) {
+      if (coup.cell == -1 && suivante.isAvailable(p)) {
+        coup.cell = cell;
+        coup.piece = p;
+      }
+      if ((donnables & (1 << p)) && rand() % ++nbSurs == 0) {
+        coup.cell = cell;
+        coup.piece = p;
+      }
+    }
+  }
+  return coup;
+}
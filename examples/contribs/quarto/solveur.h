@@ -0,0 +1,105 @@
+#ifndef SOLVEUR_H
+#define SOLVEUR_H
+
+#include <QAtomicInteger>
+#include <QVector>
+
+/*
+ * Position de Quarto codee en bitboards.
+ *
+ * Une piece est un entier de 0 a 15 dont les 4 bits sont ses caracteristiques
+ * (couleur, taille, forme, trou, voir SetOfPiece), une case un entier de 0 a
+ * 15 (ligne * 4 + colonne). Le bit (16 * c + case) de attributs vaut la
+ * caracteristique c de la piece placee sur la case.
+ */
+class Position {
+public:
+  Position() { init(); }
+
+  void init() {
+    occupees = 0;
+    disponibles = 0xFFFF;
+    attributs = 0;
+  }
+  bool isEmpty(int cell) const { return !(occupees & (1 << cell)); }
+  bool isAvailable(int piece) const { return disponibles & (1 << piece); }
+  int nbEmpty() const;
+  int pieceAt(int cell) const;
+
+  void placePiece(int cell, int piece);
+  void removePiece(int cell);
+
+  // Vrai ssi un alignement a ete effectue
+  bool analyze() const;
+  // Vrai ssi placer piece sur la case cell effectue un alignement
+  bool wins(int cell, int piece) const;
+  //  Les pieces qui, donnees a l'adversaire, lui permettent de gagner
+  // immediatement (bit piece du resultat)
+  quint16 dangerousPieces() const;
+
+  quint16 occupees;
+  quint16 disponibles;
+  quint64 attributs;
+};
+
+/*
+ * Joueur artificiel : negamax exact, avec une table de transposition
+ * partagee sans verrou entre les threads qui explorent les coups a la racine.
+ *
+ * Les positions sont stockees sous forme canonique : les caracteristiques
+ * sont inversees de facon a ce que la piece a placer soit la piece 0, et la
+ * plus petite des 32 images du plateau par les symetries qui conservent les
+ * alignements est retenue.
+ */
+class Solveur {
+public:
+  struct Coup {
+    int cell;
+    int piece; // donnee a l'adversaire, -1 si la partie est finie
+    int valeur; // 1 gagne, 0 nul, -1 perd, pour celui qui place
+    bool exact; // valeur n'est qu'une estimation sinon
+  };
+
+  //  La table de transposition a 2^tailleTableLog2 entrees de 16 octets (64
+  // Mo par defaut).
+  explicit Solveur(int tailleTableLog2 = 22);
+
+  //  Le coup optimal pour le joueur qui doit placer piece. La recherche est
+  // repartie sur QThreadPool::globalInstance() si parallel.
+  Coup solve(const Position &position, int piece, bool parallel = true);
+  //  Resout la position quand il reste au plus maxEmptyCells cases vides, sans
+  // quoi un coup qui ne perd pas immediatement est choisi au hasard.
+  Coup bestMove(const Position &position, int piece, int maxEmptyCells = 10);
+
+  // Nombre de positions explorees par le dernier solve()
+  quint64 nbNodes() const { return nbNodes_; }
+  void clear();
+
+private:
+  friend struct RootMove;
+
+  int negamax(const Position &position, int piece, int alpha, int beta,
+              quint64 &nodes);
+  bool canonicalKey(const Position &position, int piece, quint64 &key,
+                    quint16 &occupees) const;
+  bool probe(quint64 key, quint16 occupees, int &alpha, int &beta,
+             int &valeur) const;
+  void store(quint64 key, quint16 occupees, int valeur, int alpha, int beta);
+
+  //  Entree de la table : verification = cle ^ donnee, de facon a detecter
+  // les entrees dont les deux mots ont ete ecrits par des threads differents.
+  struct Entree {
+    QAtomicInteger<quint64> verification;
+    QAtomicInteger<quint64> donnee;
+  };
+  QVector<Entree> table_;
+  quint64 masque_;
+
+  // Permutation des cases par les symetries, octet par octet
+  quint16 symetries_[32][2][256];
+
+  QAtomicInt arret_;
+  quint64 nbNodes_;
+};
+
+#endif // SOLVEUR_H
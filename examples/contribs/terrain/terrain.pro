@@ -6,6 +6,12 @@
 # Acknowledgments to Stefan Roettger for his article <i>Real-Time Generation of Continuous Levels of
 # Detail for Height Fields</i>.
 
+# The water is a double-buffered stencil, updated in parallel bands of rows, and is drawn from
+# a vertex buffer. Its resolution is given to <code>WATER::Init()</code>.
+
+# The trees are sorted in a grid of quadtree nodes, culled with the terrain's view test, and drawn
+# with one instanced draw call per distance band. Press <b>N</b> to change their number.
+
 TEMPLATE = app
 TARGET   = terrain
 
@@ -14,6 +20,8 @@ SOURCES  = quadtree.cpp terrain.cpp viewer.cpp water.cpp sky.cpp tree.cpp main.c
 
 LIBS += -lGLU
 
+QT *= concurrent
+
 DISTFILES *= height128.raw Data/*.jpg Data/*.png
 
 include( ../../examples.pri )
@@ -1,6 +1,10 @@
 // TP OpenGL: Joerg Liebelt, Serigne Sow
 #include "tree.h"
 
+#include <QOpenGLContext>
+#include <float.h>
+#include <string.h>
+
 using namespace qglviewer;
 
 bool TREE::LoadTexture(const QString &filename) {
@@ -26,71 +30,338 @@ bool TREE::LoadTexture(const QString &filename) {
   return true;
 }
 
-void TREE::initTrees(QUADTREE ter, int num, float waterLevel) {
-  int i;
-  myTerrain = ter;
+void TREE::initTrees(TERRAIN &terrain, int num, float waterLevel) {
+  int i, x, z;
+  sizeHeightMap = terrain.sizeHeightMap;
   numTrees = num;
-  treeInfo = new Vec[numTrees];
+  cellSize = qMin(TREE_CELL_SIZE, sizeHeightMap);
+  cellsPerSide = sizeHeightMap / cellSize;
+
+  cells.resize(cellsPerSide * cellsPerSide);
+  for (i = 0; i < cells.size(); i++) {
+    cells[i].first = cells[i].count = 0;
+    cells[i].minY = FLT_MAX;
+    cells[i].maxY = -FLT_MAX;
+    cells[i].maxSize = 0.0f;
+  }
+
+  // placer les arbres hors de l'eau, en notant leur cellule
+  QVector<TREE_INSTANCE> trees(numTrees);
+  QVector<int> cellOf(numTrees);
   qsrand(QTime::currentTime().elapsed());
   for (i = 0; i < numTrees; i++) {
     do {
-      treeInfo[i].setValue(rand() % myTerrain.sizeHeightMap,
-                           rand() % myTerrain.sizeHeightMap,
-                           rand() % myTerrain.sizeHeightMap * treeSizeFactor /
-                               myTerrain.sizeHeightMap);
-    } while (myTerrain.GetScaledHeightAtPoint(
-                 (int)treeInfo[i].x, (int)treeInfo[i].y) <= waterLevel);
+      x = rand() % sizeHeightMap;
+      z = rand() % sizeHeightMap;
+    } while (terrain.GetScaledHeightAtPoint(x, z) <= waterLevel);
+
+    // on place l'arbre a une hauteur reduit de 1%, car les surface n'ont
+    // souvent pas l'hauteur exact et
+    // .. les arbres ont tendance a "voler" dans l'air...
+    TREE_INSTANCE &tree = trees[i];
+    tree.x = (float)x / sizeHeightMap;
+    tree.y = terrain.GetScaledHeightAtPoint(x, z) / sizeHeightMap * 0.99f;
+    tree.z = (float)z / sizeHeightMap;
+    tree.size = rand() % sizeHeightMap * treeSizeFactor / sizeHeightMap;
+
+    TREE_CELL &cell =
+        cells[cellOf[i] = (z / cellSize) * cellsPerSide + x / cellSize];
+    cell.count++;
+    cell.minY = qMin(cell.minY, tree.y);
+    cell.maxY = qMax(cell.maxY, tree.y + tree.size);
+    cell.maxSize = qMax(cell.maxSize, tree.size);
+  }
+
+  // trier les arbres par cellule (tri par denombrement)
+  minY = FLT_MAX;
+  maxY = -FLT_MAX;
+  maxSize = 0.0f;
+  int first = 0;
+  for (i = 0; i < cells.size(); i++) {
+    cells[i].first = first;
+    first += cells[i].count;
+    if (cells[i].count > 0) {
+      minY = qMin(minY, cells[i].minY);
+      maxY = qMax(maxY, cells[i].maxY);
+      maxSize = qMax(maxSize, cells[i].maxSize);
+    }
+  }
+
+  QVector<int> next(cells.size());
+  for (i = 0; i < cells.size(); i++)
+    next[i] = cells[i].first;
+  instances.resize(numTrees);
+  for (i = 0; i < numTrees; i++)
+    instances[next[cellOf[i]]++] = trees[i];
+
+  visible.reserve(numTrees);
+}
+
+// parcours du quadtree a partir du noeud de coin (x,z) et de cote edgeLength,
+// jusqu'au niveau des cellules. Meme test de visibilite que
+// QUADTREE::RefineNode(), sur la boite englobante des arbres
+void TREE::CullNode(QUADTREE &terrain, const Vec &cameraPosition, int x,
+                    int z, int edgeLength) {
+  const TREE_CELL *cell = NULL;
+  float bottom = minY, top = maxY, margin = maxSize;
+  if (edgeLength == cellSize) {
+    cell = cells.constData() + (z / cellSize) * cellsPerSide + x / cellSize;
+    if (cell->count == 0)
+      return;
+    bottom = cell->minY;
+    top = cell->maxY;
+    margin = cell->maxSize;
+  }
+
+  // les arbres debordent de leur noeud d'au plus leur taille
+  const float half = edgeLength / 2.0f / sizeHeightMap;
+  const Vec center((x + edgeLength / 2.0f) / sizeHeightMap,
+                   (bottom + top) / 2.0f,
+                   (z + edgeLength / 2.0f) / sizeHeightMap);
+  if (!terrain.CubeViewTest(center.x, center.y, center.z,
+                            qMax(half + margin, (top - bottom) / 2.0f)))
+    return;
+
+  if (cell) {
+    if ((center - cameraPosition).norm() < TREE_NEAR_DISTANCE)
+      nearCells.append(cell - cells.constData());
+    else
+      farCells.append(cell - cells.constData());
+    return;
+  }
+
+  const int childEdgeLength = edgeLength / 2;
+  CullNode(terrain, cameraPosition, x, z, childEdgeLength);
+  CullNode(terrain, cameraPosition, x + childEdgeLength, z, childEdgeLength);
+  CullNode(terrain, cameraPosition, x, z + childEdgeLength, childEdgeLength);
+  CullNode(terrain, cameraPosition, x + childEdgeLength, z + childEdgeLength,
+           childEdgeLength);
+}
+
+// modele d'un arbre de taille 1, le pied en (0,0,0): deux quads croises, en
+// triangles (x,y,z,u,v). Le premier quad est dessine seul pour les arbres
+// eloignes
+static const GLfloat treeMesh[] = {
+    1.0f, 1.0f, 0.0f, 1.0f, 1.0f,
+    1.0f, 0.0f, 0.0f, 1.0f, 0.0f,
+    0.0f, 0.0f, 0.0f, 0.0f, 0.0f,
+    1.0f, 1.0f, 0.0f, 1.0f, 1.0f,
+    0.0f, 0.0f, 0.0f, 0.0f, 0.0f,
+    0.0f, 1.0f, 0.0f, 0.0f, 1.0f,
+
+    0.5f, 1.0f, -0.5f, 1.0f, 1.0f,
+    0.5f, 0.0f, -0.5f, 1.0f, 0.0f,
+    0.5f, 0.0f, 0.5f, 0.0f, 0.0f,
+    0.5f, 1.0f, -0.5f, 1.0f, 1.0f,
+    0.5f, 0.0f, 0.5f, 0.0f, 0.0f,
+    0.5f, 1.0f, 0.5f, 0.0f, 1.0f};
+static const int nearVertices = 12;
+static const int farVertices = 6;
+
+// instance: (x,y,z) position du pied, w taille. axisX et axisZ orientent le
+// modele
+static const char *const treeVertexShader =
+    "#version 120\n"
+    "attribute vec3 vertex;\n"
+    "attribute vec2 texCoord;\n"
+    "attribute vec4 instance;\n"
+    "uniform vec3 axisX;\n"
+    "uniform vec3 axisZ;\n"
+    "varying vec2 uv;\n"
+    "void main() {\n"
+    "  vec3 p = vertex.x * axisX + vec3(0.0, vertex.y, 0.0) + vertex.z * "
+    "axisZ;\n"
+    "  gl_Position = gl_ModelViewProjectionMatrix *\n"
+    "                vec4(instance.xyz + instance.w * p, 1.0);\n"
+    "  uv = texCoord;\n"
+    "}\n";
+
+// remplace le test alpha: on enleve les pixels "transparents" de la texture
+static const char *const treeFragmentShader =
+    "#version 120\n"
+    "uniform sampler2D image;\n"
+    "varying vec2 uv;\n"
+    "void main() {\n"
+    "  vec4 color = texture2D(image, uv);\n"
+    "  if (color.a <= 0.5)\n"
+    "    discard;\n"
+    "  gl_FragColor = color;\n"
+    "}\n";
+
+void TREE::InitGL() {
+  glInitialized = true;
+
+  QOpenGLContext *context = QOpenGLContext::currentContext();
+  if (context->format().version() >= qMakePair(3, 3)) {
+    vertexAttribDivisor = reinterpret_cast<VertexAttribDivisorFunction>(
+        context->getProcAddress("glVertexAttribDivisor"));
+    drawArraysInstanced = reinterpret_cast<DrawArraysInstancedFunction>(
+        context->getProcAddress("glDrawArraysInstanced"));
+  } else if (context->hasExtension("GL_ARB_instanced_arrays")) {
+    vertexAttribDivisor = reinterpret_cast<VertexAttribDivisorFunction>(
+        context->getProcAddress("glVertexAttribDivisorARB"));
+    drawArraysInstanced = reinterpret_cast<DrawArraysInstancedFunction>(
+        context->getProcAddress("glDrawArraysInstancedARB"));
+  }
+
+  if (vertexAttribDivisor && drawArraysInstanced &&
+      program.addShaderFromSourceCode(QOpenGLShader::Vertex,
+                                      treeVertexShader) &&
+      program.addShaderFromSourceCode(QOpenGLShader::Fragment,
+                                      treeFragmentShader)) {
+    program.bindAttributeLocation("vertex", 0);
+    program.bindAttributeLocation("texCoord", 1);
+    program.bindAttributeLocation("instance", 2);
+    instancing = program.link();
+  }
+
+  if (!instancing) {
+    printf(" tree instancing not available, using vertex arrays\n");
+    return;
   }
+
+  meshBuffer.create();
+  meshBuffer.bind();
+  meshBuffer.allocate(treeMesh, sizeof(treeMesh));
+  meshBuffer.release();
+
+  instanceBuffer.create();
+  instanceBuffer.setUsagePattern(QOpenGLBuffer::StreamDraw);
 }
 
-void TREE::Render() {
-  float dim;
+void TREE::Render(QUADTREE &terrain, const Camera *camera) {
   int i;
+  if (instances.isEmpty())
+    return;
+  if (!glInitialized)
+    InitGL();
+
+  // les cellules visibles, par bande de distance
+  nearCells.resize(0);
+  farCells.resize(0);
+  CullNode(terrain, camera->position(), 0, 0, cellSize * cellsPerSide);
+
+  // regrouper leurs arbres, bande proche en premier
+  visible.resize(0);
+  for (i = 0; i < nearCells.size(); i++) {
+    const TREE_CELL &cell = cells[nearCells[i]];
+    visible.resize(visible.size() + cell.count);
+    memcpy(visible.end() - cell.count, instances.constData() + cell.first,
+           cell.count * sizeof(TREE_INSTANCE));
+  }
+  numNear = visible.size();
+  for (i = 0; i < farCells.size(); i++) {
+    const TREE_CELL &cell = cells[farCells[i]];
+    visible.resize(visible.size() + cell.count);
+    memcpy(visible.end() - cell.count, instances.constData() + cell.first,
+           cell.count * sizeof(TREE_INSTANCE));
+  }
+  if (visible.isEmpty())
+    return;
+
+  // les quads des arbres eloignes sont verticaux, face a la camera
+  Vec right = camera->rightVector();
+  right.y = 0.0;
+  if (right.squaredNorm() < 1E-6)
+    right = Vec(1.0, 0.0, 0.0);
+  else
+    right.normalize();
+
   glDisable(GL_LIGHTING);
+  glEnable(GL_TEXTURE_2D);
+  glBindTexture(GL_TEXTURE_2D, texID);
+
+  if (instancing)
+    RenderInstanced(right);
+  else
+    RenderArrays(right);
+}
+
+// un appel de dessin instancie par bande de distance
+void TREE::RenderInstanced(const Vec &right) {
+  const int stride = 5 * sizeof(GLfloat);
+  program.bind();
+  program.setUniformValue("image", 0);
+
+  meshBuffer.bind();
+  program.enableAttributeArray(0);
+  program.setAttributeBuffer(0, GL_FLOAT, 0, 3, stride);
+  program.enableAttributeArray(1);
+  program.setAttributeBuffer(1, GL_FLOAT, 3 * sizeof(GLfloat), 2, stride);
+
+  instanceBuffer.bind();
+  instanceBuffer.allocate(visible.constData(),
+                          visible.size() * sizeof(TREE_INSTANCE));
+  program.enableAttributeArray(2);
+  vertexAttribDivisor(2, 1);
+
+  if (numNear > 0) {
+    program.setUniformValue("axisX", 1.0f, 0.0f, 0.0f);
+    program.setUniformValue("axisZ", 0.0f, 0.0f, 1.0f);
+    program.setAttributeBuffer(2, GL_FLOAT, 0, 4);
+    drawArraysInstanced(GL_TRIANGLES, 0, nearVertices, numNear);
+  }
+
+  if (visible.size() > numNear) {
+    program.setUniformValue("axisX", float(right.x), float(right.y),
+                            float(right.z));
+    program.setUniformValue("axisZ", 0.0f, 0.0f, 0.0f);
+    program.setAttributeBuffer(2, GL_FLOAT, numNear * sizeof(TREE_INSTANCE), 4);
+    drawArraysInstanced(GL_TRIANGLES, 0, farVertices, visible.size() - numNear);
+  }
+
+  vertexAttribDivisor(2, 0);
+  program.disableAttributeArray(2);
+  program.disableAttributeArray(1);
+  program.disableAttributeArray(0);
+  instanceBuffer.release();
+  program.release();
+}
+
+// ecrit les sommets de l'arbre tree dans vertex, renvoie la fin
+static GLfloat *ExpandTree(GLfloat *vertex, const TREE_INSTANCE &tree,
+                           int numVertices, const Vec &axisX,
+                           const Vec &axisZ) {
+  for (int i = 0; i < numVertices; i++) {
+    const GLfloat *model = treeMesh + 5 * i;
+    const Vec p = model[0] * axisX + Vec(0.0, model[1], 0.0) + model[2] * axisZ;
+    *vertex++ = tree.x + tree.size * p.x;
+    *vertex++ = tree.y + tree.size * p.y;
+    *vertex++ = tree.z + tree.size * p.z;
+    *vertex++ = model[3];
+    *vertex++ = model[4];
+  }
+  return vertex;
+}
+
+// sans instanciation: les arbres visibles dans un seul vertex array
+void TREE::RenderArrays(const Vec &right) {
+  int i;
+  const int numVertices =
+      numNear * nearVertices + (visible.size() - numNear) * farVertices;
+  vertexArray.resize(5 * numVertices);
+
+  GLfloat *vertex = vertexArray.data();
+  for (i = 0; i < numNear; i++)
+    vertex = ExpandTree(vertex, visible[i], nearVertices, Vec(1.0, 0.0, 0.0),
+                        Vec(0.0, 0.0, 1.0));
+  for (; i < visible.size(); i++)
+    vertex = ExpandTree(vertex, visible[i], farVertices, right, Vec());
 
   glAlphaFunc(GL_GREATER, 0.5); // on enleve automatiquement les pixels de la
                                 // texture marques "transparent"
   glEnable(GL_ALPHA_TEST);
 
-  glEnable(GL_TEXTURE_2D);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glVertexPointer(3, GL_FLOAT, 5 * sizeof(GLfloat), vertexArray.constData());
+  glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+  glTexCoordPointer(2, GL_FLOAT, 5 * sizeof(GLfloat),
+                    vertexArray.constData() + 3);
 
-  for (i = 0; i < numTrees; i++) {
-    // on place l'arbre a une hauteur reduit de 5%, car les surface n'ont
-    // souvent pas l'hauteur exact et
-    // .. les arbres ont tendance a "voler" dans l'air...
-    glPushMatrix();
-
-    glTranslatef(treeInfo[i].x / myTerrain.sizeHeightMap,
-                 myTerrain.GetScaledHeightAtPoint((int)treeInfo[i].x,
-                                                  (int)treeInfo[i].y) /
-                     myTerrain.sizeHeightMap * 0.99,
-                 treeInfo[i].y / myTerrain.sizeHeightMap);
-    dim = treeInfo[i].z;
-    glBindTexture(GL_TEXTURE_2D, texID);
-    glBegin(GL_TRIANGLE_FAN);
-    glTexCoord2f(1.0f, 1.0f);
-    glVertex3f(dim, dim, 0);
-    glTexCoord2f(1.0f, 0.0f);
-    glVertex3f(dim, 0, 0);
-    glTexCoord2f(0.0f, 0.0f);
-    glVertex3f(0, 0, 0);
-    glTexCoord2f(0.0f, 1.0f);
-    glVertex3f(0, dim, 0);
-    glEnd();
-    glBindTexture(GL_TEXTURE_2D, texID);
-    glBegin(GL_TRIANGLE_FAN);
-    glTexCoord2f(1.0f, 1.0f);
-    glVertex3f(dim / 2, dim, -dim / 2);
-    glTexCoord2f(1.0f, 0.0f);
-    glVertex3f(dim / 2, 0, -dim / 2);
-    glTexCoord2f(0.0f, 0.0f);
-    glVertex3f(dim / 2, 0, dim / 2);
-    glTexCoord2f(0.0f, 1.0f);
-    glVertex3f(dim / 2, dim, dim / 2);
-    glEnd();
-
-    glPopMatrix();
-  }
+  glDrawArrays(GL_TRIANGLES, 0, numVertices);
+
+  glDisableClientState(GL_VERTEX_ARRAY);
+  glDisableClientState(GL_TEXTURE_COORD_ARRAY);
 
   glDisable(GL_ALPHA_TEST);
 }
@@ -4,6 +4,30 @@
 #define __TREEBOX_H__
 
 #include "quadtree.h"
+#include <QOpenGLBuffer>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+#include <QVector>
+
+// cote (en points de la carte d'hauteur) d'une cellule de la grille des
+// arbres: une cellule correspond a un noeud du quadtree du terrain
+#define TREE_CELL_SIZE 8
+
+// en deca de cette distance a la camera, un arbre est dessine avec deux quads
+// croises, au-dela avec un seul quad tourne vers la camera
+#define TREE_NEAR_DISTANCE 0.3f
+
+// un arbre: position du pied dans le repere du monde, et taille
+struct TREE_INSTANCE {
+  float x, y, z, size;
+};
+
+// une cellule de la grille, ses arbres sont contigus dans TREE::instances
+struct TREE_CELL {
+  int first, count;
+  float minY, maxY; // hauteurs extremes des arbres, sommets compris
+  float maxSize;
+};
 
 class TREE {
 private:
@@ -12,24 +36,62 @@ private:
   bool iwanttrees;
   float treeSizeFactor;
   int numTrees;
-  qglviewer::Vec *treeInfo;
-  // ici, je casse la beaute de mon architecture car avec la ligne suivante,
-  //...TREE depend de QUADTREE et n'est plus independant de la maniere dont le
-  //terrain a ete cree. dommage..
-  QUADTREE myTerrain; // pour recuperer l'hauteur du terrain
+
+  // les arbres, tries par cellule d'une grille de cellsPerSide^2 cellules.
+  // Les hauteurs sont lues une fois pour toutes dans la carte d'hauteur: on ne
+  // garde pas de copie du terrain
+  QVector<TREE_INSTANCE> instances;
+  QVector<TREE_CELL> cells;
+  int sizeHeightMap;
+  int cellSize, cellsPerSide;
+  float minY, maxY, maxSize; // pour l'ensemble des arbres
+
+  // cellules visibles dans l'image en cours, par bande de distance
+  QVector<int> nearCells, farCells;
+  // arbres visibles, ceux de la bande proche en premier
+  QVector<TREE_INSTANCE> visible;
+  int numNear;
+
+  // dessin instancie, OpenGL 3.3 ou GL_ARB_instanced_arrays
+  typedef void(QOPENGLF_APIENTRYP VertexAttribDivisorFunction)(GLuint,
+                                                               GLuint);
+  typedef void(QOPENGLF_APIENTRYP DrawArraysInstancedFunction)(GLenum, GLint,
+                                                               GLsizei,
+                                                               GLsizei);
+  VertexAttribDivisorFunction vertexAttribDivisor;
+  DrawArraysInstancedFunction drawArraysInstanced;
+  bool glInitialized, instancing;
+  QOpenGLShaderProgram program;
+  QOpenGLBuffer meshBuffer, instanceBuffer;
+  // sans instanciation: les sommets des arbres visibles (x,y,z,u,v)
+  QVector<GLfloat> vertexArray;
+
+  void InitGL();
+  void CullNode(QUADTREE &terrain, const qglviewer::Vec &cameraPosition,
+                int x, int z, int edgeLength);
+  void RenderInstanced(const qglviewer::Vec &right);
+  void RenderArrays(const qglviewer::Vec &right);
 
 public:
   TREE() {
     iwanttrees = false;
     treeSizeFactor = 0.05f;
     numTrees = 20;
+    sizeHeightMap = 0;
+    cellSize = cellsPerSide = 0;
+    numNear = 0;
+    vertexAttribDivisor = NULL;
+    drawArraysInstanced = NULL;
+    glInitialized = instancing = false;
   }
 
   bool LoadTexture(const QString &filename);
 
-  void initTrees(QUADTREE ter, int num, float waterLevel);
+  void initTrees(TERRAIN &terrain, int num, float waterLevel);
 
-  void Render();
+  //  Dessine les arbres des noeuds du quadtree visibles par la camera.
+  // terrain.ComputeView() doit avoir ete appele pour l'image en cours.
+  void Render(QUADTREE &terrain, const qglviewer::Camera *camera);
 
   void switchTree() { iwanttrees = !iwanttrees; }
 
@@ -26,7 +26,7 @@ int currentHeightmap = 0;
 const int scaleFactor = 1;
 const int mapSize = 128;
 const float waterLevel = 0.15f;
-const int numTrees = 100;
+int numTrees = 100; // touche N: 100, 1000, 10000, 100000
 
 void Viewer::draw() {
   myQuadtree.ComputeView();
@@ -38,7 +38,7 @@ void Viewer::draw() {
   myQuadtree.Render();
 
   if (myTree.wantTree())
-    myTree.Render();
+    myTree.Render(myQuadtree, camera());
 
   if (mySky.wantSky()) {
     // le ciel
@@ -191,7 +191,7 @@ bool Viewer::DrawShutdown() {
   return res;
 }
 
-// overload c,s,w,r,t
+// overload c,s,w,r,t,n
 void Viewer::keyPressEvent(QKeyEvent *e) {
 #if QT_VERSION < 0x040000
   if (e->state() == Qt::NoButton)
@@ -248,6 +248,11 @@ void Viewer::keyPressEvent(QKeyEvent *e) {
       myTree.switchTree();
       update();
       break;
+    case Qt::Key_N: // changer le nombre d'arbres
+      numTrees = (numTrees >= 100000) ? 100 : 10 * numTrees;
+      myTree.initTrees(myQuadtree, numTrees, waterLevel * mapSize);
+      update();
+      break;
     case Qt::Key_L: // switch direction de lumiere (45 degrees steps)
       myQuadtree.StepLightingDirection();
       myQuadtree.CalculateLighting();
@@ -322,6 +327,8 @@ QString Viewer::helpString() const {
   text += "Press <b>M</b> to toggle wireframe mesh display.<br><br>";
   text += "Press <b>S</b> to toggle sky display.<br>";
   text += "Press <b>T</b> to toggle tree display.<br>";
+  text += "Press <b>N</b> to cycle the number of trees from 100 to "
+          "100000.<br>";
   text += "Press <b>W</b> to toggle water display.<br><br>";
   text += "Press <b>C</b> to create a new fractal terrain.<br>";
   text += "Press <b>H</b> to load a terrain from a heightmap-file "
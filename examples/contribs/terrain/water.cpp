@@ -1,44 +1,74 @@
 // TP OpenGL: Joerg Liebelt, Serigne Sow
 
-// Required to have glLockArraysEXT
-#define GL_GLEXT_PROTOTYPES
-
 #include "water.h"
+#include <QThread>
+#include <QtConcurrentMap>
 #include <qimage.h>
 
-// initialiser le "filet" des vertex d'eau
-void WATER::Init(float myWorldSize, float scaleHeight) {
-  Vec dx, dy;
-  int j, k, x, z, *indexPtr;
+#if defined(__x86_64__) || defined(_M_X64)
+#include <xmmintrin.h>
+
+//  En avant des vagues, les hauteurs et vitesses sont si petites que ce sont
+// des flottants denormalises, dont chaque operation est tres lente. On les
+// arrondit a zero (modes FTZ et DAZ de SSE) pendant le calcul d'une bande.
+class FlushDenormals {
+public:
+  FlushDenormals() : csr(_mm_getcsr()) { _mm_setcsr(csr | 0x8040); }
+  ~FlushDenormals() { _mm_setcsr(csr); }
+
+private:
+  unsigned int csr;
+};
+#else
+class FlushDenormals {};
+#endif
+
+WATER::WATER()
+    : resolution(0), current(0), delta(0.0f),
+      vertexBuffer(QOpenGLBuffer::VertexBuffer),
+      indexBuffer(QOpenGLBuffer::IndexBuffer), indicesChanged(false),
+      worldSize(0.0f), numIndices(0), numVertices(0), refmapID(0) {
+  SetColor(QColor("white"));
+  iwantwater = false;
+}
+
+// initialiser le "filet" des vertex d'eau, myResolution vertex par cote
+void WATER::Init(float myWorldSize, float scaleHeight, int myResolution) {
+  int j, k, x, z;
 
   worldSize = myWorldSize;
-  numIndices = SQR((WATER_RESOLUTION - 1)) * 6;
-  numVertices = SQR(WATER_RESOLUTION);
-
-  // calculer la position du premier vertex
-  dx[0] = worldSize / (WATER_RESOLUTION - 1);
-  dx[1] = 0.0f;
-  dx[2] = 0.0f / (WATER_RESOLUTION - 1);
-  dy[0] = 0.0f / (WATER_RESOLUTION - 1);
-  dy[1] = 0.0f;
-  dy[2] = worldSize / (WATER_RESOLUTION - 1);
-
-  for (j = 0; j < WATER_RESOLUTION; j++) {
-    for (k = 0; k < WATER_RESOLUTION; k++) {
-      // positionner chaque vertex
-      vertArray[(j * WATER_RESOLUTION) + k].setValue(
-          0.0f + dx[0] * k + dy[0] * j, //-1.0f
-          (0.0f + dx[1] * k + dy[1] * j) * scaleHeight,
-          0.0f + dx[2] * k + dy[2] * j); //-1.0f
+  resolution = qMax(myResolution, 2);
+  numIndices = (resolution - 1) * (resolution - 1) * 6;
+  numVertices = resolution * resolution;
+
+  current = 0;
+  heightArray[0].fill(0.0f, numVertices);
+  heightArray[1].fill(0.0f, numVertices);
+  velArray.fill(0.0f, numVertices);
+
+  // positionner chaque vertex, normales verticales
+  const float step = worldSize / (resolution - 1);
+  vertexArray.resize(6 * numVertices);
+  float *vertex = vertexArray.data();
+  for (j = 0; j < resolution; j++) {
+    for (k = 0; k < resolution; k++) {
+      vertex[0] = step * k;
+      vertex[1] = 0.0f;
+      vertex[2] = step * j;
+      vertex[3] = 0.0f;
+      vertex[4] = 1.0f;
+      vertex[5] = 0.0f;
+      vertex += 6;
     }
   }
 
   // calculer les indices des polygons
   x = 0;
-  z = WATER_RESOLUTION;
-  indexPtr = polyIndexArray;
-  for (j = 0; j < WATER_RESOLUTION - 1; j++) {
-    for (k = 0; k < WATER_RESOLUTION - 1; k++) {
+  z = resolution;
+  polyIndexArray.resize(numIndices);
+  GLuint *indexPtr = polyIndexArray.data();
+  for (j = 0; j < resolution - 1; j++) {
+    for (k = 0; k < resolution - 1; k++) {
       indexPtr[0] = x;
       indexPtr[1] = x + 1;
       indexPtr[2] = z;
@@ -53,83 +83,130 @@ void WATER::Init(float myWorldSize, float scaleHeight) {
     x++;
     z++;
   }
+  indicesChanged = true;
+
+  //  decouper le filet en bandes de lignes, une par thread. Les petits filets
+  // sont calcules directement, le cout des threads serait plus eleve.
+  bands.clear();
+  const int nbBands =
+      (numVertices >= 128 * 128) ? qMax(QThread::idealThreadCount(), 1) : 1;
+  for (j = 0; j < nbBands; j++) {
+    WATER_BAND band;
+    band.water = this;
+    band.firstRow = (resolution * j) / nbBands;
+    band.lastRow = (resolution * (j + 1)) / nbBands;
+    bands.append(band);
+  }
 
   // lancer une vague a partir d'une position aleatoire dans l'eau par
   // changement de valeur d'hauteur
-  vertArray[rand() % (SQR(WATER_RESOLUTION))][1] =
+  heightArray[current][rand() % numVertices] =
       1.0f * scaleHeight * 1.5; // quelques vagues...
 }
 
+void WATER_BAND::UpdateHeights() {
+  FlushDenormals flush;
+  water->UpdateHeights(firstRow, lastRow);
+}
+
+void WATER_BAND::UpdateNormals() {
+  FlushDenormals flush;
+  water->UpdateNormals(firstRow, lastRow);
+}
+
 // mise a jour des vertex, pas de temps = delta
-void WATER::Update(float delta) {
-  float d, tempF, vert;
-  int x, z;
+void WATER::Update(float myDelta) {
+  delta = myDelta;
+
+  if (bands.size() > 1)
+    QtConcurrent::blockingMap(bands, &WATER_BAND::UpdateHeights);
+  else
+    bands[0].UpdateHeights();
+
+  // les nouvelles hauteurs deviennent les hauteurs courantes
+  current = 1 - current;
+}
 
-  // calculer les forces qui influencent l'eau a chaque position
-  for (z = 1; z < WATER_RESOLUTION - 1; z++) {
-    for (x = 1; x < WATER_RESOLUTION - 1; x++) {
-      // on a les forces suivantes autour d'une position de l'eau
-      //
-      //    X | X | X
-      //   -----------
-      //    X | 0 | X
-      //   -----------
-      //    X | X | X
-      //
-      tempF = forceArray[(z * WATER_RESOLUTION) + x];
-      vert = vertArray[(z * WATER_RESOLUTION) + x][1];
-
-      // difference d'hauteur = force (simplification d'une vague...)
-
-      // bas
-      d = vert - vertArray[((z - 1) * WATER_RESOLUTION) + x][1];
-      forceArray[((z - 1) * WATER_RESOLUTION) + x] += d;
-      tempF -= d;
-
-      // gauche
-      d = vert - vertArray[(z * WATER_RESOLUTION) + (x - 1)][1];
-      forceArray[(z * WATER_RESOLUTION) + (x - 1)] += d;
-      tempF -= d;
-
-      // haut
-      d = (vert - vertArray[((z + 1) * WATER_RESOLUTION) + x][1]);
-      forceArray[((z + 1) * WATER_RESOLUTION) + x] += d;
-      tempF -= d;
-
-      // droite
-      d = (vert - vertArray[(z * WATER_RESOLUTION) + (x + 1)][1]);
-      forceArray[(z * WATER_RESOLUTION) + (x + 1)] += d;
-      tempF -= d;
-
-      // haut droite
-      d = (vert - vertArray[((z + 1) * WATER_RESOLUTION) + (x + 1)][1]) * 5;
-      forceArray[((z + 1) * WATER_RESOLUTION) + (x + 1)] += d;
-      tempF -= d;
-
-      // bas gauche
-      d = (vert - vertArray[((z - 1) * WATER_RESOLUTION) + (x - 1)][1]) * 5;
-      forceArray[((z - 1) * WATER_RESOLUTION) + (x - 1)] += d;
-      tempF -= d;
-
-      // bas droite
-      d = (vert - vertArray[((z - 1) * WATER_RESOLUTION) + (x + 1)][1]) * 5;
-      forceArray[((z - 1) * WATER_RESOLUTION) + (x + 1)] += d;
-      tempF -= d;
-
-      // haut gauche
-      d = (vert - vertArray[((z + 1) * WATER_RESOLUTION) + (x - 1)][1]) * 5;
-      forceArray[((z + 1) * WATER_RESOLUTION) + (x - 1)] += d;
-      tempF -= d;
-
-      forceArray[(z * WATER_RESOLUTION) + x] = tempF;
+// force qui influence l'eau a la position (x,z), cas general (bords du filet)
+float WATER::ForceAt(int z, int x) const {
+  const float *height = heightArray[current].constData();
+  const float vert = height[(z * resolution) + x];
+  const int last = resolution - 2;
+  const bool inside = (z >= 1 && z <= last && x >= 1 && x <= last);
+
+  //  Chaque vertex interieur est tire par ses huit voisins, et tire ses
+  // voisins en retour: la difference d'hauteur est comptee une fois pour
+  // chaque extremite interieure.
+  float force = 0.0f;
+  for (int dz = -1; dz <= 1; dz++) {
+    for (int dx = -1; dx <= 1; dx++) {
+      const int nz = z + dz;
+      const int nx = x + dx;
+      if ((dz == 0 && dx == 0) || nz < 0 || nz >= resolution || nx < 0 ||
+          nx >= resolution)
+        continue;
+
+      const int count =
+          int(inside) + int(nz >= 1 && nz <= last && nx >= 1 && nx <= last);
+      const float weight = (dz != 0 && dx != 0) ? 5.0f : 1.0f;
+      force += count * weight * (height[(nz * resolution) + nx] - vert);
     }
   }
+  return force;
+}
+
+// calculer les nouvelles hauteurs des lignes [firstRow, lastRow[
+void WATER::UpdateHeights(int firstRow, int lastRow) {
+  const float *height = heightArray[current].constData();
+  float *next = heightArray[1 - current].data();
+  float *vel = velArray.data();
+  int x, z;
 
-  // calculer les vitesses (en fct. de la force et du temps qui s'est ecoule
-  for (x = 0; x < numVertices; x++) {
-    velArray[x] += (forceArray[x] * delta);
-    vertArray[x][1] += velArray[x];
-    forceArray[x] = 0.0f;
+  for (z = firstRow; z < lastRow; z++) {
+    const int row = z * resolution;
+
+    //  cellules ou tous les voisins sont interieurs: colonnes [first, last[,
+    // hors des deux premieres et deux dernieres lignes
+    int first = 2, last = resolution - 2;
+    if (z < 2 || z > resolution - 3)
+      first = last = resolution;
+
+    // bords du filet: certains voisins manquent ou ne sont pas interieurs
+    for (x = 0; x < resolution; x++) {
+      if (x == first)
+        x = last;
+      if (x == resolution)
+        break;
+      vel[row + x] += ForceAt(z, x) * delta;
+      next[row + x] = height[row + x] + vel[row + x];
+    }
+
+    //  on a les forces suivantes autour d'une position de l'eau
+    //
+    //    5 | 1 | 5
+    //   -----------
+    //    1 | 0 | 1
+    //   -----------
+    //    5 | 1 | 5
+    //
+    //  Chaque difference d'hauteur compte deux fois (le vertex et son voisin
+    // sont interieurs). Boucle sans branchement, vectorisable par le
+    // compilateur.
+    if (first == last)
+      continue;
+
+    const float *up = height + row - resolution;
+    const float *mid = height + row;
+    const float *down = height + row + resolution;
+    for (x = first; x < last; x++) {
+      const float vert = mid[x];
+      const float side = up[x] + down[x] + mid[x - 1] + mid[x + 1];
+      const float diagonal = up[x - 1] + up[x + 1] + down[x - 1] + down[x + 1];
+      const float force =
+          2.0f * ((side - 4.0f * vert) + 5.0f * (diagonal - 4.0f * vert));
+      vel[row + x] += force * delta;
+      next[row + x] = vert + vel[row + x];
+    }
   }
 }
 
@@ -137,113 +214,88 @@ void WATER::Update(float delta) {
 // .. etant la somme des normales des vertex autour; principe "l'hauteur se
 // translate en direction" (ca pousse..)
 void WATER::CalcNormals() {
-  float tmpf;
+  if (bands.size() > 1)
+    QtConcurrent::blockingMap(bands, &WATER_BAND::UpdateNormals);
+  else
+    bands[0].UpdateNormals();
+}
+
+// normale du vertex (i,j), cas general (bords du filet)
+void WATER::NormalAt(int i, int j, float *normal) const {
+  const float *height = heightArray[current].constData();
+  const int left = (j != 0) ? j - 1 : j; // cas de bord
+  const int right = (j != resolution - 1) ? j + 1 : j; // cas de bord
+  const float vert = height[(i * resolution) + j];
+  float nx = 0.0f, nz = 0.0f;
+
+  // 4 "particules d'eau" au-dessus
+  if (i != 0) {
+    const float *up = height + (i - 1) * resolution;
+    nx -= up[left] + 2.0f * up[j] + up[right];
+    nz += up[right] - up[left];
+  } else // cas de bord
+    nx -= vert * 4.0f;
+
+  // autres deux cas
+  nz += 2.0f * (height[(i * resolution) + right] -
+                height[(i * resolution) + left]);
+
+  // 4 "particules d'eau" au-dessous
+  if (i != resolution - 1) {
+    const float *down = height + (i + 1) * resolution;
+    nx += down[left] + 2.0f * down[j] + down[right];
+    nz += down[right] - down[left];
+  } else // cas de bord
+    nx += vert * 4.0f;
+
+  // normaliser, creer la normale a partir des sommes d'influences autour
+  const float tmpf = 1.0f / sqrtf(nx * nx + nz * nz + 1.0f);
+  normal[0] = nx * tmpf;
+  normal[1] = tmpf;
+  normal[2] = nz * tmpf;
+}
+
+// hauteurs et normales des lignes [firstRow, lastRow[ du vertex buffer
+void WATER::UpdateNormals(int firstRow, int lastRow) {
+  const float *height = heightArray[current].constData();
+  float *vertex = vertexArray.data();
   int i, j;
 
-  for (i = 0; i < WATER_RESOLUTION; i++) {
-    for (j = 0; j < WATER_RESOLUTION; j++) {
-      // initialiser
-      normalArray[(i * WATER_RESOLUTION) + j][0] = 0.0f;
-      normalArray[(i * WATER_RESOLUTION) + j][1] = 1.0f;
-      normalArray[(i * WATER_RESOLUTION) + j][2] = 0.0f;
-
-      // 4 "particules d'eau" au-dessus
-      if (i != 0) {
-        if (j != 0) {
-          normalArray[(i * WATER_RESOLUTION) + j][0] +=
-              -vertArray[((i - 1) * WATER_RESOLUTION) + j - 1][1];
-          normalArray[(i * WATER_RESOLUTION) + j][2] +=
-              -vertArray[((i - 1) * WATER_RESOLUTION) + j - 1][1];
-        } else // cas de bord
-        {
-          normalArray[(i * WATER_RESOLUTION) + j][0] +=
-              -vertArray[((i - 1) * WATER_RESOLUTION) + j][1];
-          normalArray[(i * WATER_RESOLUTION) + j][2] +=
-              -vertArray[((i - 1) * WATER_RESOLUTION) + j][1];
-        }
-
-        normalArray[(i * WATER_RESOLUTION) + j][0] +=
-            -vertArray[((i - 1) * WATER_RESOLUTION) + j][1] * 2.0f;
-
-        if (j != (WATER_RESOLUTION - 1)) {
-          normalArray[(i * WATER_RESOLUTION) + j][0] +=
-              -vertArray[((i - 1) * WATER_RESOLUTION) + j + 1][1];
-          normalArray[(i * WATER_RESOLUTION) + j][2] +=
-              vertArray[((i - 1) * WATER_RESOLUTION) + j + 1][1];
-        } else // cas de bord
-        {
-          normalArray[(i * WATER_RESOLUTION) + j][0] +=
-              -vertArray[((i - 1) * WATER_RESOLUTION) + j][1];
-          normalArray[(i * WATER_RESOLUTION) + j][2] +=
-              vertArray[((i - 1) * WATER_RESOLUTION) + j][1];
-        }
-      } else // cas de bord
-      {
-        normalArray[(i * WATER_RESOLUTION) + j][0] +=
-            -vertArray[(i * WATER_RESOLUTION) + j][1] * 4.0f;
-        normalArray[(i * WATER_RESOLUTION) + j][2] += 0;
-      }
+  for (i = firstRow; i < lastRow; i++) {
+    const int row = i * resolution;
+    float *v = vertex + 6 * row;
 
-      // autres deux cas
-      if (j != 0)
-        normalArray[(i * WATER_RESOLUTION) + j][2] +=
-            -vertArray[(i * WATER_RESOLUTION) + j - 1][1] * 2.0f;
-      else
-        normalArray[(i * WATER_RESOLUTION) + j][2] +=
-            -vertArray[(i * WATER_RESOLUTION) + j][1] * 2.0f;
-
-      if (j != (WATER_RESOLUTION - 1))
-        normalArray[(i * WATER_RESOLUTION) + j][2] +=
-            vertArray[(i * WATER_RESOLUTION) + j + 1][1] * 2.0f;
-      else
-        normalArray[(i * WATER_RESOLUTION) + j][2] +=
-            vertArray[(i * WATER_RESOLUTION) + j][1] * 2.0f;
-
-      // 4 "particules d'eau" au-dessous
-      if (i != (WATER_RESOLUTION - 1)) {
-        if (j != 0) {
-          normalArray[(i * WATER_RESOLUTION) + j][0] +=
-              vertArray[((i + 1) * WATER_RESOLUTION) + j - 1][1];
-          normalArray[(i * WATER_RESOLUTION) + j][2] +=
-              -vertArray[((i + 1) * WATER_RESOLUTION) + j - 1][1];
-        } else {
-          normalArray[(i * WATER_RESOLUTION) + j][0] +=
-              vertArray[((i + 1) * WATER_RESOLUTION) + j][1];
-          normalArray[(i * WATER_RESOLUTION) + j][2] +=
-              -vertArray[((i + 1) * WATER_RESOLUTION) + j][1];
-        }
-
-        normalArray[(i * WATER_RESOLUTION) + j][0] +=
-            vertArray[((i + 1) * WATER_RESOLUTION) + j][1] * 2.0f;
-
-        if (j != WATER_RESOLUTION - 1) {
-          normalArray[(i * WATER_RESOLUTION) + j][0] +=
-              vertArray[((i + 1) * WATER_RESOLUTION) + j + 1][1];
-          normalArray[(i * WATER_RESOLUTION) + j][2] +=
-              vertArray[((i + 1) * WATER_RESOLUTION) + j + 1][1];
-        } else {
-          normalArray[(i * WATER_RESOLUTION) + j][0] +=
-              vertArray[((i + 1) * WATER_RESOLUTION) + j][1];
-          normalArray[(i * WATER_RESOLUTION) + j][2] +=
-              vertArray[((i + 1) * WATER_RESOLUTION) + j][1];
-        }
-      } else // CAS DE BORD
-      {
-        normalArray[(i * WATER_RESOLUTION) + j][0] +=
-            vertArray[(i * WATER_RESOLUTION) + j][1] * 4.0f;
-        normalArray[(i * WATER_RESOLUTION) + j][2] += 0;
+    if (i == 0 || i == resolution - 1) {
+      for (j = 0; j < resolution; j++) {
+        v[6 * j + 1] = height[row + j];
+        NormalAt(i, j, v + 6 * j + 3);
       }
+      continue;
+    }
 
-      // normaliser, creer la normale a partir des sommes d'influences autour
-      tmpf = 1.0f / (float)sqrt(normalArray[(i * WATER_RESOLUTION) + j][0] *
-                                    normalArray[(i * WATER_RESOLUTION) + j][0] +
-                                normalArray[(i * WATER_RESOLUTION) + j][2] *
-                                    normalArray[(i * WATER_RESOLUTION) + j][2] +
-                                1.0f);
-      normalArray[(i * WATER_RESOLUTION) + j][0] *= tmpf;
-      normalArray[(i * WATER_RESOLUTION) + j][1] *= tmpf;
-      normalArray[(i * WATER_RESOLUTION) + j][2] *= tmpf;
+    NormalAt(i, 0, v + 3);
+    v[1] = height[row];
+
+    // cas interieur, sans bords
+    const float *up = height + row - resolution;
+    const float *mid = height + row;
+    const float *down = height + row + resolution;
+    for (j = 1; j < resolution - 1; j++) {
+      const float nx = (down[j - 1] + 2.0f * down[j] + down[j + 1]) -
+                       (up[j - 1] + 2.0f * up[j] + up[j + 1]);
+      const float nz = (up[j + 1] - up[j - 1]) +
+                       2.0f * (mid[j + 1] - mid[j - 1]) +
+                       (down[j + 1] - down[j - 1]);
+      const float tmpf = 1.0f / sqrtf(nx * nx + nz * nz + 1.0f);
+      v[6 * j + 1] = mid[j];
+      v[6 * j + 3] = nx * tmpf;
+      v[6 * j + 4] = tmpf;
+      v[6 * j + 5] = nz * tmpf;
     }
+
+    j = resolution - 1;
+    v[6 * j + 1] = height[row + j];
+    NormalAt(i, j, v + 6 * j + 3);
   }
 }
 
@@ -268,34 +320,50 @@ void WATER::Render() {
   glColor4f(color.red() / 255.0, color.green() / 255.0, color.blue() / 255.0,
             qAlpha(color.rgb()) / 255.0);
 
-  // utiliser opengl vertex buffer pointer: actualisation des positions en temps
-  // reel (pseudo-tr)
+  //  buffers crees une fois pour toutes (le contexte OpenGL doit etre
+  // courant): les indices ne changent qu'avec Init(), les positions et
+  // normales sont remplacees a chaque image
+  if (!vertexBuffer.isCreated()) {
+    vertexBuffer.create();
+    vertexBuffer.setUsagePattern(QOpenGLBuffer::StreamDraw);
+  }
+  if (!indexBuffer.isCreated())
+    indexBuffer.create();
+
+  vertexBuffer.bind();
+  vertexBuffer.allocate(vertexArray.constData(),
+                        vertexArray.size() * sizeof(float));
+
+  indexBuffer.bind();
+  if (indicesChanged) {
+    indexBuffer.allocate(polyIndexArray.constData(),
+                         polyIndexArray.size() * sizeof(GLuint));
+    indicesChanged = false;
+  }
+
+  // positions et normales entrelacees dans le vertex buffer
   glEnableClientState(GL_VERTEX_ARRAY);
-  glVertexPointer(3, GL_FLOAT, sizeof(Vec), &vertArray);
+  glVertexPointer(3, GL_FLOAT, 6 * sizeof(float), (const GLvoid *)0);
 
-  // utiliser opengl normal buffer pointer: actualisation de la lumiere en temps
-  // reel (pseudo-tr)
   glEnableClientState(GL_NORMAL_ARRAY);
-  glNormalPointer(GL_FLOAT, sizeof(Vec), &normalArray);
+  glNormalPointer(GL_FLOAT, 6 * sizeof(float),
+                  (const GLvoid *)(3 * sizeof(float)));
 
   // activer generation autmatique de coord. de textures
   glEnable(GL_TEXTURE_GEN_S);
   glEnable(GL_TEXTURE_GEN_T);
   glEnable(GL_TEXTURE_GEN_R);
 
-  // ici, transmission des vertex listes vers la memoire; on passe la liste des
-  // vertex sur laquelle on a cree  un pointeur avec glVertexPointer; acces
-  // exlusif pendant l'operation  glLockArraysEXT( 0, numVertices );
-
   // dessiner l'eau
-  glDrawElements(GL_TRIANGLES, numIndices, GL_UNSIGNED_INT, polyIndexArray);
-
-  // glUnlockArraysEXT( );
+  glDrawElements(GL_TRIANGLES, numIndices, GL_UNSIGNED_INT, (const GLvoid *)0);
 
   // desactiver vertex arrays
   glDisableClientState(GL_VERTEX_ARRAY);
   glDisableClientState(GL_NORMAL_ARRAY);
 
+  indexBuffer.release();
+  vertexBuffer.release();
+
   glDisable(GL_TEXTURE_2D);
   glDisable(GL_BLEND);
 
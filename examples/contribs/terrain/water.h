@@ -4,23 +4,47 @@
 #define __WATER_H__
 
 #include <QGLViewer/qglviewer.h>
+#include <QOpenGLBuffer>
+#include <QVector>
 #include <math.h>
 #include <qcolor.h>
 
+// resolution par defaut, voir WATER::Init()
 #define WATER_RESOLUTION 60
-#define SQR(number) (number * number)
 
-using namespace qglviewer; // classe VEC
+using namespace qglviewer;
+
+class WATER;
+
+// Une bande de lignes du filet, traitee par un thread
+struct WATER_BAND {
+  WATER *water;
+  int firstRow, lastRow; // [firstRow, lastRow[
+
+  void UpdateHeights();
+  void UpdateNormals();
+};
 
 class WATER {
 private:
-  Vec vertArray[SQR(WATER_RESOLUTION)];   // champ de vertex
-  Vec normalArray[SQR(WATER_RESOLUTION)]; // champ des normales de vertex
-  float forceArray[SQR(
-      WATER_RESOLUTION)]; // champ des forces influencant un vertex d'eau
-  float velArray[SQR(WATER_RESOLUTION)]; // champ de vitesses des vagues
-  int polyIndexArray[SQR((WATER_RESOLUTION - 1)) *
-                     6]; // champ des indices des polygones (pour updates..)
+  int resolution; // nombre de vertex par cote
+
+  //  champs des hauteurs: on lit heightArray[current] et on ecrit dans
+  // l'autre, ce qui permet de calculer chaque vertex independamment
+  QVector<float> heightArray[2];
+  int current;
+  QVector<float> velArray; // champ de vitesses des vagues
+
+  //  positions et normales entrelacees (x,y,z,nx,ny,nz), telles qu'envoyees
+  // dans le vertex buffer
+  QVector<float> vertexArray;
+  QVector<GLuint> polyIndexArray; // champ des indices des polygones
+
+  QVector<WATER_BAND> bands;
+  float delta; // pas de temps de l'Update() en cours
+
+  QOpenGLBuffer vertexBuffer, indexBuffer;
+  bool indicesChanged;
 
   float worldSize;
 
@@ -33,13 +57,18 @@ private:
 
   unsigned int refmapID;
 
+  void UpdateHeights(int firstRow, int lastRow);
+  void UpdateNormals(int firstRow, int lastRow);
+  float ForceAt(int z, int x) const;
+  void NormalAt(int i, int j, float *normal) const;
+
+  friend struct WATER_BAND;
+
 public:
-  WATER() {
-    SetColor(QColor("white"));
-    iwantwater = false;
-  }
+  WATER();
 
-  void Init(float myWorldSize, float scaleHeight);
+  void Init(float myWorldSize, float scaleHeight,
+            int myResolution = WATER_RESOLUTION);
 
   void Update(float delta);
   void CalcNormals();
@@ -49,6 +78,8 @@ public:
 
   bool wantWater() { return iwantwater; }
 
+  int Resolution() const { return resolution; }
+
   void LoadReflectionMap(const QString &filename);
 
   void SetColor(const QColor &col) { color = col; }
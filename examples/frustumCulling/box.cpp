@@ -1,5 +1,4 @@
 #include "box.h"
-#include "cullingCamera.h"
 
 using namespace std;
 using namespace qglviewer;
@@ -49,16 +48,47 @@ void Box::buildBoxHierarchy(int l) {
   }
 }
 
-void Box::drawIfAllChildrenAreVisible(const CullingCamera *camera) const {
-  static bool *entirely = new bool;
-
-  if (camera->aaBoxIsVisible(p1, p2, entirely)) {
-    if (*entirely)
-      draw();
-    else if (child[0])
+// planeMask holds the frustum planes that intersect the parent box. The other
+// planes are not tested again.
+void Box::drawIfAllChildrenAreVisible(const Camera *camera,
+                                      int planeMask) const {
+  switch (camera->aaBoxVisibility(p1, p2, &planeMask)) {
+  case Camera::OUTSIDE:
+    break;
+  case Camera::INSIDE:
+    draw();
+    break;
+  case Camera::INTERSECTING:
+    if (child[0])
       for (int i = 0; i < 8; ++i)
-        child[i]->drawIfAllChildrenAreVisible(camera);
+        child[i]->drawIfAllChildrenAreVisible(camera, planeMask);
     else
       draw();
+    break;
+  }
+}
+
+void Box::getBoxes(QVector<Vec> &corners1, QVector<Vec> &corners2) const {
+  corners1.append(p1);
+  corners2.append(p2);
+  if (child[0])
+    for (int i = 0; i < 8; ++i)
+      child[i]->getBoxes(corners1, corners2);
+}
+
+int Box::numberOfVisibleLeaves(const Camera *camera, int planeMask) const {
+  switch (camera->aaBoxVisibility(p1, p2, &planeMask)) {
+  case Camera::OUTSIDE:
+    return 0;
+  case Camera::INSIDE:
+    return 1 << (3 * level);
+  case Camera::INTERSECTING:
+  default:
+    if (!child[0])
+      return 1;
+    int nb = 0;
+    for (int i = 0; i < 8; ++i)
+      nb += child[i]->numberOfVisibleLeaves(camera, planeMask);
+    return nb;
   }
 }
@@ -1,6 +1,6 @@
 #include <QGLViewer/camera.h>
 
-class CullingCamera;
+#include <QVector>
 
 // An Axis Aligned Bounding Box octree hierarchy element.
 class Box {
@@ -8,9 +8,17 @@ public:
   Box(const qglviewer::Vec &P1, const qglviewer::Vec &P2) : p1(P1), p2(P2){};
 
   void draw() const;
-  void drawIfAllChildrenAreVisible(const CullingCamera *camera) const;
+  void drawIfAllChildrenAreVisible(
+      const qglviewer::Camera *camera,
+      int planeMask = qglviewer::Camera::AllFrustumPlanes) const;
   void buildBoxHierarchy(int l);
 
+  // Used by the culling benchmark
+  void getBoxes(QVector<qglviewer::Vec> &corners1,
+                QVector<qglviewer::Vec> &corners2) const;
+  int numberOfVisibleLeaves(const qglviewer::Camera *camera,
+                            int planeMask) const;
+
   // Lazy static member, so that it is shared by viewers
   static Box *Root;
 
@@ -1,16 +1,19 @@
 #include <QGLViewer/qglviewer.h>
 
-class CullingCamera;
-
 class Viewer : public QGLViewer {
 public:
-  void setCullingCamera(const CullingCamera *const cc) { cullingCamera = cc; }
+  void setCullingCamera(const qglviewer::Camera *const cc) {
+    cullingCamera = cc;
+  }
 
 protected:
   virtual void draw();
   virtual void init();
+  virtual void keyPressEvent(QKeyEvent *e);
   virtual QString helpString() const;
 
 private:
-  const CullingCamera *cullingCamera;
+  void benchmark();
+
+  const qglviewer::Camera *cullingCamera;
 };
@@ -1,16 +1,16 @@
-# Frustum culling using <code>getFrustumPlanesCoefficients</code>.
+# Frustum culling using <code>Camera::aaBoxVisibility</code>.
 
-# A hierarchical octree structure is clipped against a camera's frustum clipping planes, obtained
-# using <code>getFrustumPlanesCoefficients</code>. A second viewer displays an external view of the
-# scene that exhibits the clipping (using <code>drawCamera()</code> to display the frustum).
+# A hierarchical octree structure is clipped against a camera's frustum clipping planes, using
+# <code>Camera::aaBoxVisibility</code>. Frustum planes that do not intersect a box are not tested
+# again for its children. A second viewer displays an external view of the scene that exhibits
+# the clipping (using <code>drawCamera()</code> to display the frustum).
 
-# This frustum culling implementation is quite naive. Many optimisation techniques are available in
-# the litterature.
+# Press '<b>B</b>' to compare the timings of the different culling methods on the octree boxes.
 
 TEMPLATE = app
 TARGET   = frustumCulling
 
-HEADERS  = frustumCulling.h cullingCamera.h box.h
-SOURCES  = frustumCulling.cpp cullingCamera.cpp box.cpp main.cpp
+HEADERS  = frustumCulling.h box.h
+SOURCES  = frustumCulling.cpp box.cpp main.cpp
 
 include( ../examples.pri )
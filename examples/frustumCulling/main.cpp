@@ -1,5 +1,4 @@
 #include "box.h"
-#include "cullingCamera.h"
 #include "frustumCulling.h"
 
 #include <QApplication>
@@ -18,15 +17,9 @@ int main(int argc, char **argv) {
   // Instantiate the two viewers.
   Viewer viewer, observer;
 
-  // Give v a cullingCamera;
-  Camera *c = viewer.camera();
-  CullingCamera *cc = new CullingCamera();
-  viewer.setCamera(cc);
-  delete c;
-
-  // Both viewers share the culling camera
-  viewer.setCullingCamera(cc);
-  observer.setCullingCamera(cc);
+  // Both viewers cull the scene with the first viewer's camera
+  viewer.setCullingCamera(viewer.camera());
+  observer.setCullingCamera(viewer.camera());
 
   // Place observer
   observer.setSceneRadius(10.0);
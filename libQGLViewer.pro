@@ -1,6 +1,6 @@
 CONFIG       += ordered
 TEMPLATE      = subdirs
-SUBDIRS       = QGLViewer examples designerPlugin
+SUBDIRS       = QGLViewer examples designerPlugin benchmarks
 
 QT_VERSION=$$[QT_VERSION]
 